@@ -6,14 +6,53 @@ foreach(var IKAC SRC OUTPUT EXPECTED)
     endif()
 endforeach()
 
-execute_process(
-    COMMAND "${IKAC}" -E "${SRC}"
-    OUTPUT_FILE "${OUTPUT}"
-    RESULT_VARIABLE rc
-)
-if(rc)
-    message(FATAL_ERROR "Pre-processing failed (${SRC})")
+if(DEFINED PCH)
+    # Precompile the header next to a copy of the test files, then compile
+    # and run the test with it
+    get_filename_component(SRC_DIR "${SRC}" DIRECTORY)
+    get_filename_component(SRC_NAME "${SRC}" NAME)
+    set(WORK_DIR "${BIN}.dir")
+    file(REMOVE_RECURSE "${WORK_DIR}")
+    file(GLOB SRC_FILES "${SRC_DIR}/*.ika")
+    file(COPY ${SRC_FILES} DESTINATION "${WORK_DIR}")
+
+    execute_process(
+        COMMAND "${IKAC}" -emit-pch "${PCH}"
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE rc
+    )
+    if(rc)
+        message(FATAL_ERROR "Precompiling ${PCH} failed (${SRC})")
+    endif()
+
+    execute_process(
+        COMMAND "${IKAC}" -o "${BIN}" "${SRC_NAME}"
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE rc
+    )
+    if(rc)
+        message(FATAL_ERROR "Compilation failed (${SRC})")
+    endif()
+
+    execute_process(
+        COMMAND "${BIN}"
+        OUTPUT_FILE "${OUTPUT}"
+        RESULT_VARIABLE rc
+    )
+    if(rc)
+        message(FATAL_ERROR "Program exited with code ${rc} (${SRC})")
+    endif()
+else()
+    execute_process(
+        COMMAND "${IKAC}" -E "${SRC}"
+        OUTPUT_FILE "${OUTPUT}"
+        RESULT_VARIABLE rc
+    )
+    if(rc)
+        message(FATAL_ERROR "Pre-processing failed (${SRC})")
+    endif()
 endif()
+
 execute_process(
     COMMAND "${CMAKE_COMMAND}" -E compare_files --ignore-eol "${OUTPUT}" "${EXPECTED}"
     RESULT_VARIABLE diff_rc
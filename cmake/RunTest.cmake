@@ -6,21 +6,38 @@ foreach(var IKAC SRC BIN OUTPUT EXPECTED)
     endif()
 endforeach()
 
-execute_process(
-    COMMAND "${IKAC}" -o "${BIN}" "${SRC}"
-    RESULT_VARIABLE rc
-)
-if(rc)
-    message(FATAL_ERROR "Compilation failed (${SRC})")
+set(IKAC_FLAGS)
+if(DEFINED TARGET)
+    list(APPEND IKAC_FLAGS -target ${TARGET})
 endif()
 
-execute_process(
-    COMMAND "${BIN}"
-    OUTPUT_FILE "${OUTPUT}"
-    RESULT_VARIABLE rc
-)
-if(rc)
-    message(FATAL_ERROR "Program exited with code ${rc} (${SRC})")
+if(DEFINED RUN)
+    # Run in memory with -run or -interp
+    execute_process(
+        COMMAND "${IKAC}" ${IKAC_FLAGS} ${RUN} "${SRC}"
+        OUTPUT_FILE "${OUTPUT}"
+        RESULT_VARIABLE rc
+    )
+    if(rc)
+        message(FATAL_ERROR "Program exited with code ${rc} (${SRC})")
+    endif()
+else()
+    execute_process(
+        COMMAND "${IKAC}" ${IKAC_FLAGS} -o "${BIN}" "${SRC}"
+        RESULT_VARIABLE rc
+    )
+    if(rc)
+        message(FATAL_ERROR "Compilation failed (${SRC})")
+    endif()
+
+    execute_process(
+        COMMAND "${BIN}"
+        OUTPUT_FILE "${OUTPUT}"
+        RESULT_VARIABLE rc
+    )
+    if(rc)
+        message(FATAL_ERROR "Program exited with code ${rc} (${SRC})")
+    endif()
 endif()
 
 execute_process(
@@ -14,7 +14,8 @@ syntax keyword ikaKeyword else if return while break continue asm
 syntax keyword ikaDecl var const fn extern pub packed enum struct true false null
 syntax keyword ikaBuiltinOp sizeof as
 syntax keyword ikaLiteral true false null
-syntax keyword ikaType void bool u8 u16 u32 i8 i16 i32
+syntax keyword ikaType void bool u8 u16 u32 u64 i8 i16 i32 i64 f32 f64
+syntax match ikaAttribute /@\h\w*/
 
 " Comment
 syntax match ikaComment "//.*$"
@@ -27,10 +28,11 @@ syntax region ikaChar start=/'/ skip=/\\./ end=/'/ contains=ikaEscape
 syntax match ikaEscape /\\[nrt\\'\"0]/
 syntax match ikaEscape /\\x\x\{2}/
 
-" Numbers: binary, hex, decimal
+" Numbers: binary, hex, decimal, floating-point
 syntax match ikaNumber /\<0[bB][01]\+\>/
 syntax match ikaNumber /\<0[xX][0-9a-fA-F]\+\>/
 syntax match ikaNumber /\<[0-9]\+\>/
+syntax match ikaFloat /\<[0-9]\+\(\.[0-9]\+\([eE][+-]\=[0-9]\+\)\=\|[eE][+-]\=[0-9]\+\)\>/
 
 " Highlight groups
 highlight link ikaKeyword Keyword
@@ -38,6 +40,7 @@ highlight link ikaDecl Statement
 highlight link ikaBuiltinOp Function
 highlight link ikaLiteral Boolean
 highlight link ikaType Type
+highlight link ikaAttribute PreProc
 highlight link ikaPreproc PreProc
 highlight link ikaErrorDirective PreProc
 highlight link ikaWarningDirective PreProc
@@ -48,3 +51,4 @@ highlight link ikaString String
 highlight link ikaChar Character
 highlight link ikaEscape SpecialChar
 highlight link ikaNumber Number
+highlight link ikaFloat Float
@@ -0,0 +1,136 @@
+#include "abi.h"
+
+static void merge_class(ArgClass* dst, ArgClass src) {
+    if (*dst == ARG_CLASS_NONE || *dst == src) {
+        *dst = src;
+    } else {
+        // INTEGER wins over SSE
+        *dst = ARG_CLASS_INTEGER;
+    }
+}
+
+// Returns 0 if the value has to be passed in memory
+static int classify_type(const Type* type, int offset,
+                         ArgClass classes[SYSV_MAX_EIGHTBYTES]) {
+    if (type->alignment > 0 && offset % type->alignment != 0) {
+        // unaligned fields of packed structs
+        return 0;
+    }
+
+    switch (type->type) {
+        case METADATA_PRIMITIVE:
+            merge_class(&classes[offset / 8],
+                        is_float(type) ? ARG_CLASS_SSE : ARG_CLASS_INTEGER);
+            return 1;
+
+        case METADATA_POINTER:
+        case METADATA_FUNC:
+            merge_class(&classes[offset / 8], ARG_CLASS_INTEGER);
+            return 1;
+
+        case METADATA_ARRAY:
+            if (type->array_size == 0) {
+                merge_class(&classes[offset / 8], ARG_CLASS_INTEGER);
+                return 1;
+            }
+
+            for (int i = 0; i < type->array_size; i++) {
+                if (!classify_type(type->inner_type,
+                                   offset + i * type->inner_type->size,
+                                   classes)) {
+                    return 0;
+                }
+            }
+            return 1;
+
+        case METADATA_TYPE: {
+            SymbolTableEntry* curr = type->type_ste->name_space->ste;
+            while (curr) {
+                if (curr->type == SYM_FIELD) {
+                    FieldSymbolTableEntry* field =
+                        (FieldSymbolTableEntry*)curr;
+                    if (!classify_type(field->data_type,
+                                       offset + field->offset, classes)) {
+                        return 0;
+                    }
+                }
+                curr = curr->next;
+            }
+            return 1;
+        }
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+int sysv_classify(const Type* type, ArgClass classes[SYSV_MAX_EIGHTBYTES]) {
+    for (int i = 0; i < SYSV_MAX_EIGHTBYTES; i++) {
+        classes[i] = ARG_CLASS_NONE;
+    }
+
+    if (type->size == 0 || type->size > SYSV_MAX_EIGHTBYTES * 8) {
+        return 0;
+    }
+
+    if (!classify_type(type, 0, classes)) {
+        return 0;
+    }
+
+    int count = (type->size + 7) / 8;
+    for (int i = 0; i < count; i++) {
+        if (classes[i] == ARG_CLASS_NONE) {
+            // eightbyte of padding
+            classes[i] = ARG_CLASS_SSE;
+        }
+    }
+    return count;
+}
+
+int sysv_ret_in_memory(const Type* type) {
+    if (is_void(type)) {
+        return 0;
+    }
+
+    ArgClass classes[SYSV_MAX_EIGHTBYTES];
+    return sysv_classify(type, classes) == 0;
+}
+
+void sysv_init_args(SysVArgState* state, const Type* return_type) {
+    state->gpr_count = sysv_ret_in_memory(return_type) ? 1 : 0;
+    state->sse_count = 0;
+    state->stack_size = 0;
+}
+
+void sysv_assign_arg(SysVArgState* state, const Type* type, SysVArgLoc* loc) {
+    int count = sysv_classify(type, loc->classes);
+
+    int gpr_needed = 0;
+    int sse_needed = 0;
+    for (int i = 0; i < count; i++) {
+        if (loc->classes[i] == ARG_CLASS_INTEGER) {
+            gpr_needed++;
+        } else {
+            sse_needed++;
+        }
+    }
+
+    if (count > 0 && state->gpr_count + gpr_needed <= SYSV_GPR_ARG_COUNT &&
+        state->sse_count + sse_needed <= SYSV_SSE_ARG_COUNT) {
+        loc->eightbyte_count = count;
+        for (int i = 0; i < count; i++) {
+            if (loc->classes[i] == ARG_CLASS_INTEGER) {
+                loc->regs[i] = state->gpr_count++;
+            } else {
+                loc->regs[i] = state->sse_count++;
+            }
+        }
+        loc->stack_offset = 0;
+        return;
+    }
+
+    // Arguments on the stack take 8-byte slots
+    loc->eightbyte_count = 0;
+    loc->stack_offset = state->stack_size;
+    state->stack_size += (type->size + 7) / 8 * 8;
+}
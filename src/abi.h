@@ -0,0 +1,45 @@
+#ifndef ABI_H
+#define ABI_H
+
+#include "symbol_table.h"
+#include "type.h"
+
+// Argument passing of the x86-64 System V ABI
+
+#define SYSV_GPR_ARG_COUNT 6
+#define SYSV_SSE_ARG_COUNT 8
+#define SYSV_MAX_EIGHTBYTES 2
+
+typedef enum ArgClass {
+    ARG_CLASS_NONE,  // padding only
+    ARG_CLASS_INTEGER,
+    ARG_CLASS_SSE,
+    ARG_CLASS_MEMORY,
+} ArgClass;
+
+typedef struct SysVArgLoc {
+    int eightbyte_count;  // 0 if passed on the stack
+    ArgClass classes[SYSV_MAX_EIGHTBYTES];
+    int regs[SYSV_MAX_EIGHTBYTES];  // register index in its class
+    int stack_offset;               // offset in the stack argument area
+} SysVArgLoc;
+
+typedef struct SysVArgState {
+    int gpr_count;
+    int sse_count;
+    int stack_size;
+} SysVArgState;
+
+// Classify a value passed in registers. Returns the number of eightbytes, or
+// 0 if the value is passed in memory.
+int sysv_classify(const Type* type, ArgClass classes[SYSV_MAX_EIGHTBYTES]);
+
+// Returns 1 if the value is returned through a hidden pointer in RDI
+int sysv_ret_in_memory(const Type* type);
+
+void sysv_init_args(SysVArgState* state, const Type* return_type);
+
+// Assign the next argument to registers or to the stack
+void sysv_assign_arg(SysVArgState* state, const Type* type, SysVArgLoc* loc);
+
+#endif
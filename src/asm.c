@@ -0,0 +1,2472 @@
+#include "asm.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define MAX_OPERANDS 3
+#define MAX_ALIGNMENT_LOG2 12
+
+typedef enum RegKind {
+    REG_NONE,
+    REG_GPR8,
+    REG_GPR16,
+    REG_GPR32,
+    REG_GPR64,
+    REG_XMM,
+    REG_RIP,
+} RegKind;
+
+typedef struct Reg {
+    RegKind kind;
+    int num;
+    int rex;  // 1: requires REX (%sil, %r8b), -1: cannot use REX (%ah)
+} Reg;
+
+typedef struct AsmExpr {
+    int sym;  // -1 if absolute
+    long long val;
+} AsmExpr;
+
+typedef enum OperandKind {
+    OPERAND_REG,
+    OPERAND_IMM,
+    OPERAND_MEM,
+} OperandKind;
+
+typedef struct AsmOperand {
+    OperandKind kind;
+    int indirect;  // '*' of jmp and call
+    Reg reg;
+    AsmExpr expr;  // immediate or displacement
+    Reg base;
+    Reg index;
+    int scale;
+} AsmOperand;
+
+typedef enum InsnClass {
+    INSN_ALU,
+    INSN_MOV,
+    INSN_MOVABS,
+    INSN_TEST,
+    INSN_LEA,
+    INSN_PUSH,
+    INSN_POP,
+    INSN_UNARY,
+    INSN_INCDEC,
+    INSN_IMUL,
+    INSN_SHIFT,
+    INSN_SHIFT_DOUBLE,
+    INSN_SETCC,
+    INSN_CMOVCC,
+    INSN_JCC,
+    INSN_JMP,
+    INSN_CALL,
+    INSN_RET,
+    INSN_FIXED,
+    INSN_MOVX,
+    INSN_SSE,
+    INSN_SSE_MOV,
+    INSN_CVTSI2F,
+    INSN_CVTF2SI,
+    INSN_MOVD,
+    INSN_X87,
+} InsnClass;
+
+typedef struct InsnDesc {
+    const char* name;
+    InsnClass cls;
+    int suffix;  // accepts a b/w/l/q size suffix
+    int ext;     // ModRM extension or destination size
+    int opcode;
+    int prefix;  // mandatory prefix
+    int size;    // source size of INSN_MOVX
+} InsnDesc;
+
+#define REX_W 0x48
+#define ONLY_64 64
+
+static const InsnDesc insn_table[] = {
+    {"add", INSN_ALU, 1, 0, 0, 0, 0},
+    {"or", INSN_ALU, 1, 1, 0, 0, 0},
+    {"adc", INSN_ALU, 1, 2, 0, 0, 0},
+    {"sbb", INSN_ALU, 1, 3, 0, 0, 0},
+    {"and", INSN_ALU, 1, 4, 0, 0, 0},
+    {"sub", INSN_ALU, 1, 5, 0, 0, 0},
+    {"xor", INSN_ALU, 1, 6, 0, 0, 0},
+    {"cmp", INSN_ALU, 1, 7, 0, 0, 0},
+    {"mov", INSN_MOV, 1, 0, 0, 0, 0},
+    {"movabs", INSN_MOVABS, 1, 0, 0, 0, 0},
+    {"test", INSN_TEST, 1, 0, 0, 0, 0},
+    {"lea", INSN_LEA, 1, 0, 0, 0, 0},
+    {"push", INSN_PUSH, 1, 0, 0, 0, 0},
+    {"pop", INSN_POP, 1, 0, 0, 0, 0},
+    {"not", INSN_UNARY, 1, 2, 0, 0, 0},
+    {"neg", INSN_UNARY, 1, 3, 0, 0, 0},
+    {"mul", INSN_UNARY, 1, 4, 0, 0, 0},
+    {"div", INSN_UNARY, 1, 6, 0, 0, 0},
+    {"idiv", INSN_UNARY, 1, 7, 0, 0, 0},
+    {"inc", INSN_INCDEC, 1, 0, 0, 0, 0},
+    {"dec", INSN_INCDEC, 1, 1, 0, 0, 0},
+    {"imul", INSN_IMUL, 1, 0, 0, 0, 0},
+    {"rol", INSN_SHIFT, 1, 0, 0, 0, 0},
+    {"ror", INSN_SHIFT, 1, 1, 0, 0, 0},
+    {"shl", INSN_SHIFT, 1, 4, 0, 0, 0},
+    {"sal", INSN_SHIFT, 1, 4, 0, 0, 0},
+    {"shr", INSN_SHIFT, 1, 5, 0, 0, 0},
+    {"sar", INSN_SHIFT, 1, 7, 0, 0, 0},
+    {"shld", INSN_SHIFT_DOUBLE, 1, 0, 0x0FA4, 0, 0},
+    {"shrd", INSN_SHIFT_DOUBLE, 1, 0, 0x0FAC, 0, 0},
+    {"jmp", INSN_JMP, 1, 0, 0, 0, 0},
+    {"call", INSN_CALL, 1, 0, 0, 0, 0},
+    {"ret", INSN_RET, 1, 0, 0, 0, 0},
+    {"leave", INSN_FIXED, 1, 0, 0xC9, 0, 0},
+    {"cltd", INSN_FIXED, 0, 0, 0x99, 0, 0},
+    {"cdq", INSN_FIXED, 0, 0, 0x99, 0, 0},
+    {"cqto", INSN_FIXED, 0, ONLY_64, 0x99, REX_W, 0},
+    {"cqo", INSN_FIXED, 0, ONLY_64, 0x99, REX_W, 0},
+    {"cwtl", INSN_FIXED, 0, 0, 0x98, 0, 0},
+    {"cltq", INSN_FIXED, 0, ONLY_64, 0x98, REX_W, 0},
+    {"cdqe", INSN_FIXED, 0, ONLY_64, 0x98, REX_W, 0},
+    {"cld", INSN_FIXED, 0, 0, 0xFC, 0, 0},
+    {"std", INSN_FIXED, 0, 0, 0xFD, 0, 0},
+    {"nop", INSN_FIXED, 0, 0, 0x90, 0, 0},
+    {"hlt", INSN_FIXED, 0, 0, 0xF4, 0, 0},
+    {"int3", INSN_FIXED, 0, 0, 0xCC, 0, 0},
+    {"ud2", INSN_FIXED, 0, 0, 0x0F0B, 0, 0},
+    {"movsb", INSN_FIXED, 0, 0, 0xA4, 0, 0},
+    {"movsw", INSN_FIXED, 0, 0, 0xA5, 0x66, 0},
+    {"movsl", INSN_FIXED, 0, 0, 0xA5, 0, 0},
+    {"movsq", INSN_FIXED, 0, ONLY_64, 0xA5, REX_W, 0},
+    {"stosb", INSN_FIXED, 0, 0, 0xAA, 0, 0},
+    {"stosw", INSN_FIXED, 0, 0, 0xAB, 0x66, 0},
+    {"stosl", INSN_FIXED, 0, 0, 0xAB, 0, 0},
+    {"stosq", INSN_FIXED, 0, ONLY_64, 0xAB, REX_W, 0},
+    {"movzbw", INSN_MOVX, 0, 2, 0x0FB6, 0, 1},
+    {"movzbl", INSN_MOVX, 0, 4, 0x0FB6, 0, 1},
+    {"movzbq", INSN_MOVX, 0, 8, 0x0FB6, 0, 1},
+    {"movzwl", INSN_MOVX, 0, 4, 0x0FB7, 0, 2},
+    {"movzwq", INSN_MOVX, 0, 8, 0x0FB7, 0, 2},
+    {"movsbw", INSN_MOVX, 0, 2, 0x0FBE, 0, 1},
+    {"movsbl", INSN_MOVX, 0, 4, 0x0FBE, 0, 1},
+    {"movsbq", INSN_MOVX, 0, 8, 0x0FBE, 0, 1},
+    {"movswl", INSN_MOVX, 0, 4, 0x0FBF, 0, 2},
+    {"movswq", INSN_MOVX, 0, 8, 0x0FBF, 0, 2},
+    {"movslq", INSN_MOVX, 0, 8, 0x63, 0, 4},
+    {"addss", INSN_SSE, 0, 0, 0x0F58, 0xF3, 0},
+    {"addsd", INSN_SSE, 0, 0, 0x0F58, 0xF2, 0},
+    {"subss", INSN_SSE, 0, 0, 0x0F5C, 0xF3, 0},
+    {"subsd", INSN_SSE, 0, 0, 0x0F5C, 0xF2, 0},
+    {"mulss", INSN_SSE, 0, 0, 0x0F59, 0xF3, 0},
+    {"mulsd", INSN_SSE, 0, 0, 0x0F59, 0xF2, 0},
+    {"divss", INSN_SSE, 0, 0, 0x0F5E, 0xF3, 0},
+    {"divsd", INSN_SSE, 0, 0, 0x0F5E, 0xF2, 0},
+    {"sqrtss", INSN_SSE, 0, 0, 0x0F51, 0xF3, 0},
+    {"sqrtsd", INSN_SSE, 0, 0, 0x0F51, 0xF2, 0},
+    {"minss", INSN_SSE, 0, 0, 0x0F5D, 0xF3, 0},
+    {"minsd", INSN_SSE, 0, 0, 0x0F5D, 0xF2, 0},
+    {"maxss", INSN_SSE, 0, 0, 0x0F5F, 0xF3, 0},
+    {"maxsd", INSN_SSE, 0, 0, 0x0F5F, 0xF2, 0},
+    {"andps", INSN_SSE, 0, 0, 0x0F54, 0, 0},
+    {"andpd", INSN_SSE, 0, 0, 0x0F54, 0x66, 0},
+    {"orps", INSN_SSE, 0, 0, 0x0F56, 0, 0},
+    {"orpd", INSN_SSE, 0, 0, 0x0F56, 0x66, 0},
+    {"xorps", INSN_SSE, 0, 0, 0x0F57, 0, 0},
+    {"xorpd", INSN_SSE, 0, 0, 0x0F57, 0x66, 0},
+    {"ucomiss", INSN_SSE, 0, 0, 0x0F2E, 0, 0},
+    {"ucomisd", INSN_SSE, 0, 0, 0x0F2E, 0x66, 0},
+    {"comiss", INSN_SSE, 0, 0, 0x0F2F, 0, 0},
+    {"comisd", INSN_SSE, 0, 0, 0x0F2F, 0x66, 0},
+    {"cvtss2sd", INSN_SSE, 0, 0, 0x0F5A, 0xF3, 0},
+    {"cvtsd2ss", INSN_SSE, 0, 0, 0x0F5A, 0xF2, 0},
+    {"movss", INSN_SSE_MOV, 0, 0, 0x0F10, 0xF3, 0},
+    {"movsd", INSN_SSE_MOV, 0, 0, 0x0F10, 0xF2, 0},
+    {"movups", INSN_SSE_MOV, 0, 0, 0x0F10, 0, 0},
+    {"movupd", INSN_SSE_MOV, 0, 0, 0x0F10, 0x66, 0},
+    {"movaps", INSN_SSE_MOV, 0, 0, 0x0F28, 0, 0},
+    {"movapd", INSN_SSE_MOV, 0, 0, 0x0F28, 0x66, 0},
+    {"cvtsi2ss", INSN_CVTSI2F, 1, 0, 0x0F2A, 0xF3, 0},
+    {"cvtsi2sd", INSN_CVTSI2F, 1, 0, 0x0F2A, 0xF2, 0},
+    {"cvttss2si", INSN_CVTF2SI, 1, 0, 0x0F2C, 0xF3, 0},
+    {"cvttsd2si", INSN_CVTF2SI, 1, 0, 0x0F2C, 0xF2, 0},
+    {"cvtss2si", INSN_CVTF2SI, 1, 0, 0x0F2D, 0xF3, 0},
+    {"cvtsd2si", INSN_CVTF2SI, 1, 0, 0x0F2D, 0xF2, 0},
+    {"movd", INSN_MOVD, 0, 4, 0, 0, 0},
+    {"flds", INSN_X87, 0, 0, 0xD9, 0, 0},
+    {"fldl", INSN_X87, 0, 0, 0xDD, 0, 0},
+    {"filds", INSN_X87, 0, 0, 0xDF, 0, 0},
+    {"fildl", INSN_X87, 0, 0, 0xDB, 0, 0},
+    {"fildq", INSN_X87, 0, 5, 0xDF, 0, 0},
+    {"fildll", INSN_X87, 0, 5, 0xDF, 0, 0},
+    {"fadds", INSN_X87, 0, 0, 0xD8, 0, 0},
+    {"faddl", INSN_X87, 0, 0, 0xDC, 0, 0},
+    {"fmuls", INSN_X87, 0, 1, 0xD8, 0, 0},
+    {"fmull", INSN_X87, 0, 1, 0xDC, 0, 0},
+    {"fsubs", INSN_X87, 0, 4, 0xD8, 0, 0},
+    {"fsubl", INSN_X87, 0, 4, 0xDC, 0, 0},
+    {"fdivs", INSN_X87, 0, 6, 0xD8, 0, 0},
+    {"fdivl", INSN_X87, 0, 6, 0xDC, 0, 0},
+    {"fsts", INSN_X87, 0, 2, 0xD9, 0, 0},
+    {"fstl", INSN_X87, 0, 2, 0xDD, 0, 0},
+    {"fstps", INSN_X87, 0, 3, 0xD9, 0, 0},
+    {"fstpl", INSN_X87, 0, 3, 0xDD, 0, 0},
+    {"fistpl", INSN_X87, 0, 3, 0xDB, 0, 0},
+    {"fistpq", INSN_X87, 0, 7, 0xDF, 0, 0},
+    {"fistpll", INSN_X87, 0, 7, 0xDF, 0, 0},
+    {"fldcw", INSN_X87, 0, 5, 0xD9, 0, 0},
+    {"fnstcw", INSN_X87, 0, 7, 0xD9, 0, 0},
+    {"fstcw", INSN_X87, 0, 7, 0xD9, 0x9B, 0},
+};
+
+static const InsnDesc jcc_desc = {"j", INSN_JCC, 0, 0, 0, 0, 0};
+static const InsnDesc setcc_desc = {"set", INSN_SETCC, 0, 0, 0, 0, 0};
+static const InsnDesc cmovcc_desc = {"cmov", INSN_CMOVCC, 1, 0, 0, 0, 0};
+
+static const struct {
+    const char* name;
+    int cc;
+} cc_table[] = {
+    {"o", 0},   {"no", 1},  {"b", 2},   {"c", 2},    {"nae", 2}, {"ae", 3},
+    {"nb", 3},  {"nc", 3},  {"e", 4},   {"z", 4},    {"ne", 5},  {"nz", 5},
+    {"be", 6},  {"na", 6},  {"a", 7},   {"nbe", 7},  {"s", 8},   {"ns", 9},
+    {"p", 10},  {"pe", 10}, {"np", 11}, {"po", 11},  {"l", 12},  {"nge", 12},
+    {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14},  {"g", 15},  {"nle", 15},
+};
+
+// Open addressing table over insn_table, built on first use
+#define INSN_HASH_SIZE 512
+static short insn_hash[INSN_HASH_SIZE];
+static int insn_hash_ready;
+
+static unsigned int hash_str(Str s) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < s.len; i++) {
+        h = (h ^ (unsigned char)s.ptr[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void init_insn_hash(void) {
+    for (int i = 0; i < (int)ARRAY_SIZE(insn_table); i++) {
+        unsigned int h = hash_str(str(insn_table[i].name)) % INSN_HASH_SIZE;
+        while (insn_hash[h]) {
+            h = (h + 1) % INSN_HASH_SIZE;
+        }
+        insn_hash[h] = i + 1;
+    }
+    insn_hash_ready = 1;
+}
+
+static const InsnDesc* find_insn_name(Str name) {
+    unsigned int h = hash_str(name) % INSN_HASH_SIZE;
+    while (insn_hash[h]) {
+        const InsnDesc* desc = &insn_table[insn_hash[h] - 1];
+        if (str_eql(name, str(desc->name))) {
+            return desc;
+        }
+        h = (h + 1) % INSN_HASH_SIZE;
+    }
+    return NULL;
+}
+
+static int find_cc(Str name) {
+    for (int i = 0; i < (int)ARRAY_SIZE(cc_table); i++) {
+        if (str_eql(name, str(cc_table[i].name))) {
+            return cc_table[i].cc;
+        }
+    }
+    return -1;
+}
+
+static int suffix_size(char c) {
+    switch (c) {
+        case 'b':
+            return 1;
+        case 'w':
+            return 2;
+        case 'l':
+            return 4;
+        case 'q':
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+static int starts_with(Str s, const char* prefix) {
+    int len = strlen(prefix);
+    return s.len > len && memcmp(s.ptr, prefix, len) == 0;
+}
+
+static Str str_slice(Str s, int start, int end) {
+    return (Str){s.ptr + start, end - start};
+}
+
+// Returns NULL if the mnemonic is unknown
+static const InsnDesc* find_insn(Str name, int* size, int* cc) {
+    *size = 0;
+    *cc = 0;
+
+    const InsnDesc* desc = find_insn_name(name);
+    if (desc) {
+        return desc;
+    }
+
+    if (starts_with(name, "j")) {
+        *cc = find_cc(str_slice(name, 1, name.len));
+        if (*cc >= 0) {
+            return &jcc_desc;
+        }
+    } else if (starts_with(name, "set")) {
+        *cc = find_cc(str_slice(name, 3, name.len));
+        if (*cc >= 0) {
+            return &setcc_desc;
+        }
+    } else if (starts_with(name, "cmov")) {
+        *cc = find_cc(str_slice(name, 4, name.len));
+        if (*cc >= 0) {
+            return &cmovcc_desc;
+        }
+        *cc = find_cc(str_slice(name, 4, name.len - 1));
+        *size = suffix_size(name.ptr[name.len - 1]);
+        if (*cc >= 0 && *size != 0) {
+            return &cmovcc_desc;
+        }
+        return NULL;
+    }
+
+    if (name.len < 2) {
+        return NULL;
+    }
+
+    *size = suffix_size(name.ptr[name.len - 1]);
+    if (*size == 0) {
+        return NULL;
+    }
+
+    desc = find_insn_name(str_slice(name, 0, name.len - 1));
+    if (desc && desc->suffix) {
+        return desc;
+    }
+    return NULL;
+}
+
+typedef enum StmtKind {
+    STMT_LABEL,
+    STMT_INSN,
+    STMT_SECTION,
+    STMT_DATA,
+    STMT_STRING,
+    STMT_ZERO,
+    STMT_ALIGN,
+} StmtKind;
+
+typedef struct AsmStmt {
+    StmtKind kind;
+    int line;
+    int section;  // STMT_SECTION
+    int symbol;   // STMT_LABEL
+    const InsnDesc* insn;
+    int size;  // operand size, data size or alignment
+    int cc;
+    int rep;
+    int is_long;  // jump relaxed to rel32
+    int operand_count;
+    AsmOperand operands[MAX_OPERANDS];
+    AsmExpr expr;  // STMT_DATA
+    Str str;       // STMT_STRING, with escapes
+    long long count;
+} AsmStmt;
+
+typedef struct Fixup {
+    int section;
+    int offset;
+    int symbol;
+    AsmRelocType type;
+    long long addend;
+} Fixup;
+
+// rel8 of a short jump
+typedef struct JumpFixup {
+    int section;
+    int offset;
+    int symbol;
+    long long addend;
+    int stmt;
+} JumpFixup;
+
+typedef struct Assembler {
+    AsmObject* obj;
+    int bits;
+    int line;
+    int section;
+
+    char* err;
+    int err_size;
+    int failed;
+
+    UtlVector(AsmStmt) stmts;
+    UtlVector(Fixup) fixups;
+    UtlVector(JumpFixup) jumps;
+
+    // Symbol name to index + 1
+    int* sym_map;
+    int sym_map_cap;
+} Assembler;
+
+static int asm_error(Assembler* as, const char* fmt, ...) {
+    if (!as->failed) {
+        int n = 0;
+        if (as->line > 0) {
+            n = snprintf(as->err, as->err_size, "line %d: ", as->line);
+        }
+        if (n >= 0 && n < as->err_size) {
+            va_list ap;
+            va_start(ap, fmt);
+            vsnprintf(as->err + n, as->err_size - n, fmt, ap);
+            va_end(ap);
+        }
+    }
+    as->failed = 1;
+    return 0;
+}
+
+int asm_is_temp_symbol(const AsmSymbol* sym) {
+    return !sym->is_section && sym->name.len >= 2 && sym->name.ptr[0] == '.' &&
+           sym->name.ptr[1] == 'L';
+}
+
+static void grow_sym_map(Assembler* as) {
+    int cap = as->sym_map_cap ? as->sym_map_cap * 2 : 256;
+    int* map = never_fail_allocator.alloc(&never_fail_allocator,
+                                          cap * sizeof(int));
+    memset(map, 0, cap * sizeof(int));
+
+    for (int i = 0; i < as->sym_map_cap; i++) {
+        int index = as->sym_map[i];
+        if (index == 0) {
+            continue;
+        }
+        Str name = as->obj->symbols.data[index - 1].name;
+        unsigned int h = hash_str(name) & (cap - 1);
+        while (map[h]) {
+            h = (h + 1) & (cap - 1);
+        }
+        map[h] = index;
+    }
+
+    never_fail_allocator.free(&never_fail_allocator, as->sym_map);
+    as->sym_map = map;
+    as->sym_map_cap = cap;
+}
+
+// Find or create a symbol
+static int get_symbol(Assembler* as, Str name) {
+    if ((int)as->obj->symbols.size * 2 >= as->sym_map_cap) {
+        grow_sym_map(as);
+    }
+
+    unsigned int h = hash_str(name) & (as->sym_map_cap - 1);
+    while (as->sym_map[h]) {
+        int index = as->sym_map[h] - 1;
+        if (str_eql(as->obj->symbols.data[index].name, name)) {
+            return index;
+        }
+        h = (h + 1) & (as->sym_map_cap - 1);
+    }
+
+    AsmSymbol sym = {
+        .name = name,
+        .section = -1,
+    };
+    utlvector_push(&as->obj->symbols, sym);
+    as->sym_map[h] = as->obj->symbols.size;
+    return as->obj->symbols.size - 1;
+}
+
+static int get_section(Assembler* as, Str name, int flags) {
+    for (int i = 0; i < (int)as->obj->sections.size; i++) {
+        if (str_eql(as->obj->sections.data[i].name, name)) {
+            return i;
+        }
+    }
+
+    AsmSymbol sym = {
+        .name = name,
+        .section = as->obj->sections.size,
+        .is_section = 1,
+    };
+    utlvector_push(&as->obj->symbols, sym);
+
+    AsmSection section = {
+        .name = name,
+        .flags = flags,
+        .alignment = 1,
+        .symbol = as->obj->symbols.size - 1,
+        .data = utlvector_init(&never_fail_allocator),
+        .relocs = utlvector_init(&never_fail_allocator),
+    };
+    utlvector_push(&as->obj->sections, section);
+    return as->obj->sections.size - 1;
+}
+
+static int default_section_flags(Str name) {
+    if (str_eql(name, str(".text")) || starts_with(name, ".text.")) {
+        return ASM_SECTION_ALLOC | ASM_SECTION_EXEC;
+    }
+    if (str_eql(name, str(".data")) || starts_with(name, ".data.")) {
+        return ASM_SECTION_ALLOC | ASM_SECTION_WRITE;
+    }
+    if (str_eql(name, str(".rodata")) || starts_with(name, ".rodata.")) {
+        return ASM_SECTION_ALLOC;
+    }
+    return 0;
+}
+
+// Parsing
+
+static inline int is_sym_start(char c) {
+    return isalpha((unsigned char)c) || c == '_' || c == '.';
+}
+
+static inline int is_sym_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static const char* skip_space(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+static Str parse_name(const char** pp, const char* end) {
+    const char* p = *pp;
+    const char* start = p;
+    if (p < end && is_sym_start(*p)) {
+        p++;
+        while (p < end && is_sym_char(*p)) {
+            p++;
+        }
+    }
+    *pp = p;
+    return (Str){start, (int)(p - start)};
+}
+
+static int parse_number(Assembler* as, const char** pp, const char* end,
+                        long long* val) {
+    const char* p = *pp;
+    unsigned long long n = 0;
+
+    if (p < end && *p == '\'') {
+        // character constant
+        if (p + 1 >= end) {
+            return asm_error(as, "bad character constant");
+        }
+        *val = (unsigned char)p[1];
+        *pp = (p + 2 < end && p[2] == '\'') ? p + 3 : p + 2;
+        return 1;
+    }
+
+    int base = 10;
+    if (p + 1 < end && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    } else if (p + 1 < end && p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) {
+        base = 2;
+        p += 2;
+    } else if (p[0] == '0') {
+        base = 8;
+    }
+
+    const char* start = p;
+    while (p < end) {
+        int digit;
+        if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+        } else if (*p >= 'a' && *p <= 'f') {
+            digit = *p - 'a' + 10;
+        } else if (*p >= 'A' && *p <= 'F') {
+            digit = *p - 'A' + 10;
+        } else {
+            break;
+        }
+        if (digit >= base) {
+            return asm_error(as, "invalid digit in number");
+        }
+        n = n * base + digit;
+        p++;
+    }
+
+    if (p == start && base != 8) {
+        return asm_error(as, "expected number");
+    }
+
+    *val = (long long)n;
+    *pp = p;
+    return 1;
+}
+
+static int parse_expr(Assembler* as, const char** pp, const char* end,
+                      AsmExpr* expr) {
+    const char* p = *pp;
+    expr->sym = -1;
+    expr->val = 0;
+
+    int sign = 1;
+    while (1) {
+        p = skip_space(p, end);
+        if (p < end && (*p == '-' || *p == '+')) {
+            if (*p == '-') {
+                sign = -sign;
+            }
+            p++;
+            continue;
+        }
+
+        if (p < end && (isdigit((unsigned char)*p) || *p == '\'')) {
+            long long val;
+            if (!parse_number(as, &p, end, &val)) {
+                return 0;
+            }
+            expr->val += sign * val;
+        } else if (p < end && is_sym_start(*p)) {
+            Str name = parse_name(&p, end);
+            if (sign < 0 || expr->sym >= 0) {
+                return asm_error(as, "unsupported expression");
+            }
+            expr->sym = get_symbol(as, name);
+        } else {
+            return asm_error(as, "expected expression");
+        }
+
+        p = skip_space(p, end);
+        if (p < end && (*p == '+' || *p == '-')) {
+            sign = (*p == '-') ? -1 : 1;
+            p++;
+            continue;
+        }
+        break;
+    }
+
+    *pp = p;
+    return 1;
+}
+
+static const char* gpr_names[] = {"ax", "cx", "dx", "bx",
+                                  "sp", "bp", "si", "di"};
+
+static int find_gpr(const char* s) {
+    for (int i = 0; i < 8; i++) {
+        if (s[0] == gpr_names[i][0] && s[1] == gpr_names[i][1]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int decode_reg(Str name, Reg* reg) {
+    reg->rex = 0;
+    const char* s = name.ptr;
+    int n;
+
+    if (name.len == 2) {
+        if ((n = find_gpr(s)) >= 0) {
+            reg->kind = REG_GPR16;
+            reg->num = n;
+            return 1;
+        }
+        static const char low[] = "acdb";
+        for (int i = 0; i < 4; i++) {
+            if (s[0] == low[i] && (s[1] == 'l' || s[1] == 'h')) {
+                reg->kind = REG_GPR8;
+                reg->num = (s[1] == 'l') ? i : i + 4;
+                reg->rex = (s[1] == 'l') ? 0 : -1;
+                return 1;
+            }
+        }
+    }
+
+    if (name.len == 3) {
+        if (str_eql(name, str("rip"))) {
+            reg->kind = REG_RIP;
+            reg->num = 0;
+            return 1;
+        }
+        if ((s[0] == 'e' || s[0] == 'r') && (n = find_gpr(s + 1)) >= 0) {
+            reg->kind = (s[0] == 'e') ? REG_GPR32 : REG_GPR64;
+            reg->num = n;
+            return 1;
+        }
+        if (s[2] == 'l' && (n = find_gpr(s)) >= 4) {
+            // %spl, %bpl, %sil, %dil
+            reg->kind = REG_GPR8;
+            reg->num = n;
+            reg->rex = 1;
+            return 1;
+        }
+    }
+
+    if (name.len >= 4 && memcmp(s, "xmm", 3) == 0) {
+        n = 0;
+        for (int i = 3; i < name.len; i++) {
+            if (!isdigit((unsigned char)s[i])) {
+                return 0;
+            }
+            n = n * 10 + s[i] - '0';
+        }
+        if (n > 15) {
+            return 0;
+        }
+        reg->kind = REG_XMM;
+        reg->num = n;
+        return 1;
+    }
+
+    if (name.len >= 2 && s[0] == 'r' && isdigit((unsigned char)s[1])) {
+        int i = 1;
+        n = 0;
+        while (i < name.len && isdigit((unsigned char)s[i])) {
+            n = n * 10 + s[i] - '0';
+            i++;
+        }
+        if (n < 8 || n > 15 || i < name.len - 1) {
+            return 0;
+        }
+        reg->num = n;
+        char suffix = (i < name.len) ? s[i] : 0;
+        switch (suffix) {
+            case 0:
+                reg->kind = REG_GPR64;
+                return 1;
+            case 'd':
+                reg->kind = REG_GPR32;
+                return 1;
+            case 'w':
+                reg->kind = REG_GPR16;
+                return 1;
+            case 'b':
+            case 'l':
+                reg->kind = REG_GPR8;
+                reg->rex = 1;
+                return 1;
+            default:
+                return 0;
+        }
+    }
+
+    return 0;
+}
+
+static int parse_reg(Assembler* as, const char** pp, const char* end,
+                     Reg* reg) {
+    const char* p = *pp;
+    if (p >= end || *p != '%') {
+        return asm_error(as, "expected register");
+    }
+    p++;
+
+    const char* start = p;
+    while (p < end && isalnum((unsigned char)*p)) {
+        p++;
+    }
+
+    Str name = {start, (int)(p - start)};
+    if (!decode_reg(name, reg)) {
+        return asm_error(as, "unknown register %%%.*s", name.len, name.ptr);
+    }
+
+    if (as->bits != 64 && (reg->kind == REG_GPR64 || reg->kind == REG_RIP ||
+                           reg->num >= 8 || reg->rex == 1)) {
+        return asm_error(as, "register %%%.*s requires 64-bit mode", name.len,
+                         name.ptr);
+    }
+
+    *pp = p;
+    return 1;
+}
+
+static int is_addr_reg(Assembler* as, Reg reg) {
+    return reg.kind == (as->bits == 64 ? REG_GPR64 : REG_GPR32);
+}
+
+static int parse_operand(Assembler* as, const char** pp, const char* end,
+                         AsmOperand* op) {
+    const char* p = skip_space(*pp, end);
+    memset(op, 0, sizeof(*op));
+    op->expr.sym = -1;
+
+    if (p < end && *p == '*') {
+        op->indirect = 1;
+        p = skip_space(p + 1, end);
+    }
+
+    if (p < end && *p == '$') {
+        op->kind = OPERAND_IMM;
+        p++;
+        if (!parse_expr(as, &p, end, &op->expr)) {
+            return 0;
+        }
+    } else if (p < end && *p == '%') {
+        op->kind = OPERAND_REG;
+        if (!parse_reg(as, &p, end, &op->reg)) {
+            return 0;
+        }
+        p = skip_space(p, end);
+        if (p < end && *p == ':') {
+            return asm_error(as, "segment override is not supported");
+        }
+    } else {
+        op->kind = OPERAND_MEM;
+        if (p < end && *p != '(') {
+            if (!parse_expr(as, &p, end, &op->expr)) {
+                return 0;
+            }
+        }
+
+        if (p < end && *p == '(') {
+            p = skip_space(p + 1, end);
+            if (p < end && *p == '%') {
+                if (!parse_reg(as, &p, end, &op->base)) {
+                    return 0;
+                }
+                if (op->base.kind != REG_RIP && !is_addr_reg(as, op->base)) {
+                    return asm_error(as, "invalid base register");
+                }
+                p = skip_space(p, end);
+            }
+
+            if (p < end && *p == ',') {
+                p = skip_space(p + 1, end);
+                if (p < end && *p == '%') {
+                    if (!parse_reg(as, &p, end, &op->index)) {
+                        return 0;
+                    }
+                    if (!is_addr_reg(as, op->index) || op->index.num == 4) {
+                        return asm_error(as, "invalid index register");
+                    }
+                    p = skip_space(p, end);
+                }
+
+                op->scale = 1;
+                if (p < end && *p == ',') {
+                    p = skip_space(p + 1, end);
+                    long long scale;
+                    if (!parse_number(as, &p, end, &scale)) {
+                        return 0;
+                    }
+                    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+                        return asm_error(as, "invalid scale factor");
+                    }
+                    op->scale = scale;
+                    p = skip_space(p, end);
+                }
+            }
+
+            if (p >= end || *p != ')') {
+                return asm_error(as, "expected ')'");
+            }
+            p++;
+
+            if (op->base.kind == REG_RIP && op->index.kind != REG_NONE) {
+                return asm_error(as, "invalid use of %%rip");
+            }
+        }
+    }
+
+    *pp = skip_space(p, end);
+    return 1;
+}
+
+static AsmStmt* add_stmt(Assembler* as, StmtKind kind) {
+    AsmStmt stmt = {
+        .kind = kind,
+        .line = as->line,
+    };
+    utlvector_push(&as->stmts, stmt);
+    return &as->stmts.data[as->stmts.size - 1];
+}
+
+static int parse_insn(Assembler* as, Str name, const char* p,
+                      const char* end) {
+    int rep = 0;
+    if (str_eql(name, str("rep")) || str_eql(name, str("repe")) ||
+        str_eql(name, str("repz"))) {
+        rep = 0xF3;
+    } else if (str_eql(name, str("repne")) || str_eql(name, str("repnz"))) {
+        rep = 0xF2;
+    }
+
+    if (rep) {
+        p = skip_space(p, end);
+        name = parse_name(&p, end);
+        if (name.len == 0) {
+            return asm_error(as, "expected instruction after prefix");
+        }
+    }
+
+    int size, cc;
+    const InsnDesc* desc = find_insn(name, &size, &cc);
+    if (!desc) {
+        return asm_error(as, "unsupported instruction '%.*s'", name.len,
+                         name.ptr);
+    }
+
+    AsmOperand operands[MAX_OPERANDS];
+    int count = 0;
+    p = skip_space(p, end);
+    while (p < end) {
+        if (count == MAX_OPERANDS) {
+            return asm_error(as, "too many operands");
+        }
+        if (!parse_operand(as, &p, end, &operands[count++])) {
+            return 0;
+        }
+        if (p < end) {
+            if (*p != ',') {
+                return asm_error(as, "junk after operand");
+            }
+            p++;
+        }
+    }
+
+    AsmStmt* stmt = add_stmt(as, STMT_INSN);
+    stmt->insn = desc;
+    stmt->size = size;
+    stmt->cc = cc;
+    stmt->rep = rep;
+    stmt->operand_count = count;
+    memcpy(stmt->operands, operands, count * sizeof(AsmOperand));
+    return 1;
+}
+
+static int parse_string(Assembler* as, const char** pp, const char* end,
+                        Str* s) {
+    const char* p = skip_space(*pp, end);
+    if (p >= end || *p != '"') {
+        return asm_error(as, "expected string");
+    }
+    p++;
+
+    const char* start = p;
+    while (p < end && *p != '"') {
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+        }
+        p++;
+    }
+    if (p >= end) {
+        return asm_error(as, "unterminated string");
+    }
+
+    *s = (Str){start, (int)(p - start)};
+    *pp = skip_space(p + 1, end);
+    return 1;
+}
+
+static int parse_align(Assembler* as, const char* p, const char* end,
+                       int is_log2) {
+    long long align, max_skip = 0;
+    AsmExpr fill;
+
+    p = skip_space(p, end);
+    if (!parse_number(as, &p, end, &align)) {
+        return 0;
+    }
+    p = skip_space(p, end);
+
+    if (p < end && *p == ',') {
+        p = skip_space(p + 1, end);
+        if (p < end && *p != ',') {
+            if (!parse_expr(as, &p, end, &fill)) {
+                return 0;
+            }
+            if (fill.sym >= 0 || fill.val != 0) {
+                return asm_error(as, "unsupported alignment fill");
+            }
+        }
+        if (p < end && *p == ',') {
+            p = skip_space(p + 1, end);
+            if (!parse_number(as, &p, end, &max_skip)) {
+                return 0;
+            }
+        }
+    }
+
+    if (is_log2) {
+        if (align > MAX_ALIGNMENT_LOG2) {
+            return asm_error(as, "alignment too large");
+        }
+        align = 1LL << align;
+    } else if (align <= 0 || (align & (align - 1)) != 0 ||
+               align > (1 << MAX_ALIGNMENT_LOG2)) {
+        return asm_error(as, "invalid alignment");
+    }
+
+    AsmStmt* stmt = add_stmt(as, STMT_ALIGN);
+    stmt->size = align;
+    stmt->count = max_skip;
+    return 1;
+}
+
+static int parse_directive(Assembler* as, Str name, const char* p,
+                           const char* end) {
+    p = skip_space(p, end);
+
+    if (str_eql(name, str(".text")) || str_eql(name, str(".data"))) {
+        AsmStmt* stmt = add_stmt(as, STMT_SECTION);
+        stmt->section = get_section(as, name, default_section_flags(name));
+        as->section = stmt->section;
+        return 1;
+    }
+
+    if (str_eql(name, str(".section"))) {
+        const char* start = p;
+        while (p < end && *p != ',' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        Str section_name = {start, (int)(p - start)};
+        if (section_name.len == 0) {
+            return asm_error(as, "expected section name");
+        }
+
+        int flags = default_section_flags(section_name);
+        p = skip_space(p, end);
+        if (p < end && *p == ',') {
+            p++;
+            Str flag_str;
+            if (!parse_string(as, &p, end, &flag_str)) {
+                return 0;
+            }
+            flags = 0;
+            for (int i = 0; i < flag_str.len; i++) {
+                switch (flag_str.ptr[i]) {
+                    case 'a':
+                        flags |= ASM_SECTION_ALLOC;
+                        break;
+                    case 'w':
+                        flags |= ASM_SECTION_WRITE;
+                        break;
+                    case 'x':
+                        flags |= ASM_SECTION_EXEC;
+                        break;
+                    default:
+                        return asm_error(as, "unsupported section flag '%c'",
+                                         flag_str.ptr[i]);
+                }
+            }
+
+            if (p < end && *p == ',') {
+                p = skip_space(p + 1, end);
+                if (p < end && *p == '@') {
+                    p++;
+                }
+                Str type = parse_name(&p, end);
+                if (!str_eql(type, str("progbits"))) {
+                    return asm_error(as, "unsupported section type");
+                }
+            }
+        }
+
+        if (skip_space(p, end) != end) {
+            return asm_error(as, "junk after section directive");
+        }
+
+        AsmStmt* stmt = add_stmt(as, STMT_SECTION);
+        stmt->section = get_section(as, section_name, flags);
+        as->section = stmt->section;
+        return 1;
+    }
+
+    if (str_eql(name, str(".globl")) || str_eql(name, str(".global"))) {
+        while (p < end) {
+            Str sym_name = parse_name(&p, end);
+            if (sym_name.len == 0) {
+                return asm_error(as, "expected symbol name");
+            }
+            int index = get_symbol(as, sym_name);
+            as->obj->symbols.data[index].is_global = 1;
+            p = skip_space(p, end);
+            if (p < end && *p == ',') {
+                p = skip_space(p + 1, end);
+            }
+        }
+        return 1;
+    }
+
+    if (str_eql(name, str(".string")) || str_eql(name, str(".asciz")) ||
+        str_eql(name, str(".ascii"))) {
+        int nul = !str_eql(name, str(".ascii"));
+        while (p < end) {
+            Str s;
+            if (!parse_string(as, &p, end, &s)) {
+                return 0;
+            }
+            AsmStmt* stmt = add_stmt(as, STMT_STRING);
+            stmt->str = s;
+            stmt->size = nul;
+            if (p < end && *p == ',') {
+                p++;
+            }
+        }
+        return 1;
+    }
+
+    int data_size = 0;
+    if (str_eql(name, str(".byte"))) {
+        data_size = 1;
+    } else if (str_eql(name, str(".short")) || str_eql(name, str(".word")) ||
+               str_eql(name, str(".value"))) {
+        data_size = 2;
+    } else if (str_eql(name, str(".long")) || str_eql(name, str(".int"))) {
+        data_size = 4;
+    } else if (str_eql(name, str(".quad"))) {
+        data_size = 8;
+    }
+
+    if (data_size) {
+        while (p < end) {
+            AsmExpr expr;
+            if (!parse_expr(as, &p, end, &expr)) {
+                return 0;
+            }
+            if (expr.sym >= 0 && data_size < 4) {
+                return asm_error(as, "relocation too small");
+            }
+            AsmStmt* stmt = add_stmt(as, STMT_DATA);
+            stmt->size = data_size;
+            stmt->expr = expr;
+            if (p < end && *p == ',') {
+                p++;
+            }
+        }
+        return 1;
+    }
+
+    if (str_eql(name, str(".zero")) || str_eql(name, str(".skip"))) {
+        long long count;
+        if (!parse_number(as, &p, end, &count)) {
+            return 0;
+        }
+        if (count < 0) {
+            return asm_error(as, "negative size");
+        }
+        AsmStmt* stmt = add_stmt(as, STMT_ZERO);
+        stmt->count = count;
+        return 1;
+    }
+
+    if (str_eql(name, str(".p2align"))) {
+        return parse_align(as, p, end, 1);
+    }
+
+    if (str_eql(name, str(".align")) || str_eql(name, str(".balign"))) {
+        return parse_align(as, p, end, 0);
+    }
+
+    if (str_eql(name, str(".type")) || str_eql(name, str(".size")) ||
+        str_eql(name, str(".file")) || str_eql(name, str(".ident"))) {
+        // symbol information is not needed by the linker
+        return 1;
+    }
+
+    return asm_error(as, "unsupported directive '%.*s'", name.len, name.ptr);
+}
+
+// Parse one statement in [p, end)
+static int parse_stmt(Assembler* as, const char* p, const char* end) {
+    while (1) {
+        p = skip_space(p, end);
+        if (p >= end) {
+            return 1;
+        }
+
+        Str name = parse_name(&p, end);
+        if (name.len == 0) {
+            return asm_error(as, "unexpected character '%c'", *p);
+        }
+
+        const char* q = skip_space(p, end);
+        if (q < end && *q == ':') {
+            int index = get_symbol(as, name);
+            AsmSymbol* sym = &as->obj->symbols.data[index];
+            if (sym->section >= 0) {
+                return asm_error(as, "symbol '%.*s' is already defined",
+                                 name.len, name.ptr);
+            }
+            sym->section = as->section;
+
+            AsmStmt* stmt = add_stmt(as, STMT_LABEL);
+            stmt->symbol = index;
+            p = q + 1;
+            continue;
+        }
+
+        if (name.ptr[0] == '.') {
+            return parse_directive(as, name, p, end);
+        }
+        return parse_insn(as, name, p, end);
+    }
+}
+
+static int parse(Assembler* as, const char* src) {
+    const char* p = src;
+    as->line = 1;
+
+    while (*p) {
+        // Find the end of the statement, skipping over strings
+        const char* start = p;
+        int in_str = 0;
+        while (*p && *p != '\n') {
+            if (in_str) {
+                if (*p == '\\' && p[1] != '\0') {
+                    p++;
+                } else if (*p == '"') {
+                    in_str = 0;
+                }
+            } else if (*p == '"') {
+                in_str = 1;
+            } else if (*p == '#' || *p == ';') {
+                break;
+            }
+            p++;
+        }
+
+        if (!parse_stmt(as, start, p)) {
+            return 0;
+        }
+
+        if (*p == ';') {
+            p++;
+            continue;
+        }
+
+        while (*p && *p != '\n') {
+            p++;
+        }
+        if (*p == '\n') {
+            p++;
+            as->line++;
+        }
+    }
+    return 1;
+}
+
+// Encoding
+
+static inline AsmSection* cur_section(Assembler* as) {
+    return &as->obj->sections.data[as->section];
+}
+
+static inline int cur_offset(Assembler* as) {
+    return cur_section(as)->data.size;
+}
+
+static inline void emit_byte(Assembler* as, int b) {
+    unsigned char c = b;
+    utlvector_push(&cur_section(as)->data, c);
+}
+
+static void emit_value(Assembler* as, unsigned long long val, int size) {
+    for (int i = 0; i < size; i++) {
+        emit_byte(as, (val >> (i * 8)) & 0xFF);
+    }
+}
+
+static void add_fixup(Assembler* as, int symbol, AsmRelocType type,
+                      long long addend) {
+    Fixup fixup = {
+        .section = as->section,
+        .offset = cur_offset(as),
+        .symbol = symbol,
+        .type = type,
+        .addend = addend,
+    };
+    utlvector_push(&as->fixups, fixup);
+}
+
+static inline int fits_int8(long long val) { return val >= -128 && val <= 127; }
+
+static inline int fits_int32(long long val) {
+    return val >= INT32_MIN && val <= INT32_MAX;
+}
+
+// Emit an immediate of the given size. 8-byte operations take a sign-extended
+// 32-bit immediate unless size is 8.
+static int emit_imm(Assembler* as, AsmExpr expr, int size, int op_size) {
+    if (expr.sym >= 0) {
+        if (size == 8) {
+            add_fixup(as, expr.sym, ASM_RELOC_ABS64, expr.val);
+        } else if (size == 4) {
+            add_fixup(as, expr.sym,
+                      (as->bits == 64 && op_size == 8) ? ASM_RELOC_ABS32S
+                                                       : ASM_RELOC_ABS32,
+                      expr.val);
+        } else {
+            return asm_error(as, "relocation too small");
+        }
+        emit_value(as, 0, size);
+        return 1;
+    }
+
+    long long val = expr.val;
+    int ok;
+    switch (size) {
+        case 1:
+            ok = val >= -128 && val <= 255;
+            break;
+        case 2:
+            ok = val >= -32768 && val <= 65535;
+            break;
+        case 4:
+            ok = (op_size == 8) ? fits_int32(val)
+                                : (val >= INT32_MIN && val <= UINT32_MAX);
+            break;
+        default:
+            ok = 1;
+            break;
+    }
+    if (!ok) {
+        return asm_error(as, "immediate out of range");
+    }
+
+    emit_value(as, val, size);
+    return 1;
+}
+
+static inline int imm_size(int op_size) { return op_size == 2 ? 2 : 4; }
+
+static int merge_rex(Assembler* as, int a, int b) {
+    if ((a == 1 && b == -1) || (a == -1 && b == 1)) {
+        return asm_error(as, "cannot use high byte register with REX prefix");
+    }
+    return a ? a : b;
+}
+
+static int emit_prefixes(Assembler* as, int prefix, int size, int rex,
+                         int rex_hint) {
+    if (size == 2) {
+        emit_byte(as, 0x66);
+    }
+    if (prefix) {
+        emit_byte(as, prefix);
+    }
+    if (rex || rex_hint == 1) {
+        if (as->bits != 64) {
+            return asm_error(as, "instruction requires 64-bit mode");
+        }
+        if (rex_hint == -1) {
+            return asm_error(as,
+                             "cannot use high byte register with REX prefix");
+        }
+        emit_byte(as, 0x40 | rex);
+    }
+    return 1;
+}
+
+static void emit_opcode(Assembler* as, int opcode) {
+    if (opcode > 0xFFFF) {
+        emit_byte(as, (opcode >> 16) & 0xFF);
+    }
+    if (opcode > 0xFF) {
+        emit_byte(as, (opcode >> 8) & 0xFF);
+    }
+    emit_byte(as, opcode & 0xFF);
+}
+
+static void emit_disp32(Assembler* as, AsmExpr disp) {
+    if (disp.sym >= 0) {
+        add_fixup(as, disp.sym,
+                  as->bits == 64 ? ASM_RELOC_ABS32S : ASM_RELOC_ABS32,
+                  disp.val);
+        emit_value(as, 0, 4);
+    } else {
+        emit_value(as, disp.val, 4);
+    }
+}
+
+// trailing is the number of immediate bytes after the displacement
+static void emit_modrm(Assembler* as, int reg, const AsmOperand* rm,
+                       int trailing) {
+    reg = (reg & 7) << 3;
+
+    if (rm->kind == OPERAND_REG) {
+        emit_byte(as, 0xC0 | reg | (rm->reg.num & 7));
+        return;
+    }
+
+    AsmExpr disp = rm->expr;
+
+    if (rm->base.kind == REG_RIP) {
+        emit_byte(as, reg | 5);
+        if (disp.sym >= 0) {
+            add_fixup(as, disp.sym, ASM_RELOC_PC32, disp.val - 4 - trailing);
+            emit_value(as, 0, 4);
+        } else {
+            emit_value(as, disp.val, 4);
+        }
+        return;
+    }
+
+    int has_base = rm->base.kind != REG_NONE;
+    int has_index = rm->index.kind != REG_NONE;
+
+    if (!has_base && !has_index) {
+        if (as->bits == 64) {
+            emit_byte(as, reg | 4);
+            emit_byte(as, 0x25);
+        } else {
+            emit_byte(as, reg | 5);
+        }
+        emit_disp32(as, disp);
+        return;
+    }
+
+    int mod;
+    if (!has_base) {
+        mod = 0;
+    } else if (disp.sym < 0 && disp.val == 0 && (rm->base.num & 7) != 5) {
+        mod = 0;
+    } else if (disp.sym < 0 && fits_int8(disp.val)) {
+        mod = 1;
+    } else {
+        mod = 2;
+    }
+
+    int need_sib = has_index || !has_base || (rm->base.num & 7) == 4;
+    if (need_sib) {
+        static const int scale_bits[] = {0, 0, 1, 0, 2, 0, 0, 0, 3};
+        emit_byte(as, (mod << 6) | reg | 4);
+        emit_byte(as, (scale_bits[has_index ? rm->scale : 1] << 6) |
+                          ((has_index ? rm->index.num & 7 : 4) << 3) |
+                          (has_base ? rm->base.num & 7 : 5));
+    } else {
+        emit_byte(as, (mod << 6) | reg | (rm->base.num & 7));
+    }
+
+    if (mod == 1) {
+        emit_byte(as, disp.val & 0xFF);
+    } else if (mod == 2 || !has_base) {
+        emit_disp32(as, disp);
+    }
+}
+
+// Emit an instruction with a ModRM operand. reg is a register number or an
+// opcode extension.
+static int emit_insn_rm(Assembler* as, int prefix, int size, int opcode,
+                        int reg, int rex_hint, const AsmOperand* rm,
+                        int trailing) {
+    int rex = 0;
+    if (size == 8) {
+        rex |= 8;
+    }
+    if (reg & 8) {
+        rex |= 4;
+    }
+
+    if (rm->kind == OPERAND_REG) {
+        if (rm->reg.num & 8) {
+            rex |= 1;
+        }
+        if (rm->reg.kind == REG_GPR8) {
+            rex_hint = merge_rex(as, rex_hint, rm->reg.rex);
+        }
+    } else if (rm->kind == OPERAND_MEM) {
+        if (rm->index.kind != REG_NONE && (rm->index.num & 8)) {
+            rex |= 2;
+        }
+        if (rm->base.kind != REG_NONE && rm->base.kind != REG_RIP &&
+            (rm->base.num & 8)) {
+            rex |= 1;
+        }
+    } else {
+        return asm_error(as, "invalid operand");
+    }
+
+    if (as->failed || !emit_prefixes(as, prefix, size, rex, rex_hint)) {
+        return 0;
+    }
+
+    emit_opcode(as, opcode);
+    emit_modrm(as, reg, rm, trailing);
+    return 1;
+}
+
+// Emit an instruction with the register in the low bits of the opcode
+static int emit_insn_reg(Assembler* as, int size, int opcode, Reg reg) {
+    if (!emit_prefixes(as, 0, size, (size == 8 ? 8 : 0) | (reg.num >> 3),
+                       reg.kind == REG_GPR8 ? reg.rex : 0)) {
+        return 0;
+    }
+    emit_byte(as, opcode + (reg.num & 7));
+    return 1;
+}
+
+// Short form of an immediate operation on %al, %ax, %eax or %rax
+static int emit_accumulator_imm(Assembler* as, int size, int opcode,
+                                AsmExpr imm) {
+    if (!emit_prefixes(as, 0, size, size == 8 ? 8 : 0, 0)) {
+        return 0;
+    }
+    emit_byte(as, opcode);
+    return emit_imm(as, imm, size == 1 ? 1 : imm_size(size), size);
+}
+
+static inline int is_gpr(const AsmOperand* op) {
+    return op->kind == OPERAND_REG && op->reg.kind >= REG_GPR8 &&
+           op->reg.kind <= REG_GPR64;
+}
+
+static inline int is_xmm(const AsmOperand* op) {
+    return op->kind == OPERAND_REG && op->reg.kind == REG_XMM;
+}
+
+static int gpr_size(const AsmOperand* op) {
+    if (!is_gpr(op)) {
+        return 0;
+    }
+    switch (op->reg.kind) {
+        case REG_GPR8:
+            return 1;
+        case REG_GPR16:
+            return 2;
+        case REG_GPR32:
+            return 4;
+        case REG_GPR64:
+            return 8;
+        default:
+            UNREACHABLE();
+    }
+}
+
+// Operand size from the suffix or the last register operand
+static int infer_size(Assembler* as, const AsmStmt* stmt) {
+    if (stmt->size) {
+        return stmt->size;
+    }
+    for (int i = stmt->operand_count - 1; i >= 0; i--) {
+        int size = gpr_size(&stmt->operands[i]);
+        if (size) {
+            return size;
+        }
+    }
+    return asm_error(as, "cannot infer operand size");
+}
+
+static inline int is_accumulator(const AsmOperand* op) {
+    return is_gpr(op) && op->reg.num == 0;
+}
+
+static inline int reg_rex(const AsmOperand* op) {
+    return op->reg.kind == REG_GPR8 ? op->reg.rex : 0;
+}
+
+static int check_operands(Assembler* as, const AsmStmt* stmt, int min,
+                          int max) {
+    if (stmt->operand_count < min || stmt->operand_count > max) {
+        return asm_error(as, "wrong number of operands");
+    }
+    return 1;
+}
+
+static int encode_alu(Assembler* as, const AsmStmt* stmt) {
+    if (!check_operands(as, stmt, 2, 2)) {
+        return 0;
+    }
+
+    const AsmOperand* src = &stmt->operands[0];
+    const AsmOperand* dst = &stmt->operands[1];
+    int ext = stmt->insn->ext;
+    int size = infer_size(as, stmt);
+    if (!size) {
+        return 0;
+    }
+
+    if (src->kind == OPERAND_IMM && is_accumulator(dst) &&
+        (size == 1 || src->expr.sym >= 0 || !fits_int8(src->expr.val))) {
+        return emit_accumulator_imm(as, size, ext * 8 + (size == 1 ? 4 : 5),
+                                    src->expr);
+    }
+
+    if (src->kind == OPERAND_IMM && dst->kind != OPERAND_IMM) {
+        if (size == 1) {
+            return emit_insn_rm(as, 0, size, 0x80, ext, 0, dst, 1) &&
+                   emit_imm(as, src->expr, 1, size);
+        }
+        if (src->expr.sym < 0 && fits_int8(src->expr.val)) {
+            return emit_insn_rm(as, 0, size, 0x83, ext, 0, dst, 1) &&
+                   emit_imm(as, src->expr, 1, size);
+        }
+        return emit_insn_rm(as, 0, size, 0x81, ext, 0, dst, imm_size(size)) &&
+               emit_imm(as, src->expr, imm_size(size), size);
+    }
+
+    int opcode = ext * 8 + (size == 1 ? 0 : 1);
+    if (src->kind == OPERAND_REG && dst->kind != OPERAND_IMM) {
+        return emit_insn_rm(as, 0, size, opcode, src->reg.num, reg_rex(src),
+                            dst, 0);
+    }
+    if (dst->kind == OPERAND_REG && src->kind == OPERAND_MEM) {
+        return emit_insn_rm(as, 0, size, opcode + 2, dst->reg.num,
+                            reg_rex(dst), src, 0);
+    }
+    return asm_error(as, "invalid operands");
+}
+
+static int encode_movd(Assembler* as, const AsmStmt* stmt, int size) {
+    if (!check_operands(as, stmt, 2, 2)) {
+        return 0;
+    }
+
+    const AsmOperand* src = &stmt->operands[0];
+    const AsmOperand* dst = &stmt->operands[1];
+    int w = (size == 8) ? 8 : 4;
+
+    if (is_xmm(dst)) {
+        if (size == 8 && (is_xmm(src) || src->kind == OPERAND_MEM)) {
+            return emit_insn_rm(as, 0xF3, 4, 0x0F7E, dst->reg.num, 0, src, 0);
+        }
+        if (is_xmm(src) || src->kind == OPERAND_IMM) {
+            return asm_error(as, "invalid operands");
+        }
+        return emit_insn_rm(as, 0x66, w, 0x0F6E, dst->reg.num, 0, src, 0);
+    }
+
+    if (is_xmm(src)) {
+        if (dst->kind == OPERAND_IMM) {
+            return asm_error(as, "invalid operands");
+        }
+        if (size == 8 && dst->kind == OPERAND_MEM) {
+            return emit_insn_rm(as, 0x66, 4, 0x0FD6, src->reg.num, 0, dst, 0);
+        }
+        return emit_insn_rm(as, 0x66, w, 0x0F7E, src->reg.num, 0, dst, 0);
+    }
+
+    return asm_error(as, "invalid operands");
+}
+
+static int encode_mov(Assembler* as, const AsmStmt* stmt) {
+    if (!check_operands(as, stmt, 2, 2)) {
+        return 0;
+    }
+
+    const AsmOperand* src = &stmt->operands[0];
+    const AsmOperand* dst = &stmt->operands[1];
+
+    if (is_xmm(src) || is_xmm(dst)) {
+        return encode_movd(as, stmt, stmt->size ? stmt->size : 8);
+    }
+
+    int size = infer_size(as, stmt);
+    if (!size) {
+        return 0;
+    }
+
+    if (src->kind == OPERAND_IMM && dst->kind == OPERAND_REG) {
+        if (size == 8) {
+            if (src->expr.sym < 0 && !fits_int32(src->expr.val)) {
+                return emit_insn_reg(as, 8, 0xB8, dst->reg) &&
+                       emit_imm(as, src->expr, 8, 8);
+            }
+            return emit_insn_rm(as, 0, 8, 0xC7, 0, 0, dst, 4) &&
+                   emit_imm(as, src->expr, 4, 8);
+        }
+        return emit_insn_reg(as, size, size == 1 ? 0xB0 : 0xB8, dst->reg) &&
+               emit_imm(as, src->expr, size == 1 ? 1 : imm_size(size), size);
+    }
+
+    if (src->kind == OPERAND_IMM && dst->kind == OPERAND_MEM) {
+        int n = (size == 1) ? 1 : imm_size(size);
+        return emit_insn_rm(as, 0, size, size == 1 ? 0xC6 : 0xC7, 0, 0, dst,
+                            n) &&
+               emit_imm(as, src->expr, n, size);
+    }
+
+    if (src->kind == OPERAND_REG && dst->kind != OPERAND_IMM) {
+        return emit_insn_rm(as, 0, size, size == 1 ? 0x88 : 0x89,
+                            src->reg.num, reg_rex(src), dst, 0);
+    }
+
+    if (dst->kind == OPERAND_REG && src->kind == OPERAND_MEM) {
+        return emit_insn_rm(as, 0, size, size == 1 ? 0x8A : 0x8B,
+                            dst->reg.num, reg_rex(dst), src, 0);
+    }
+
+    return asm_error(as, "invalid operands");
+}
+
+static int encode_movabs(Assembler* as, const AsmStmt* stmt) {
+    if (!check_operands(as, stmt, 2, 2)) {
+        return 0;
+    }
+
+    const AsmOperand* src = &stmt->operands[0];
+    const AsmOperand* dst = &stmt->operands[1];
+    if (src->kind != OPERAND_IMM || gpr_size(dst) != 8) {
+        return asm_error(as, "unsupported operands of movabs");
+    }
+
+    return emit_insn_reg(as, 8, 0xB8, dst->reg) &&
+           emit_imm(as, src->expr, 8, 8);
+}
+
+static int encode_test(Assembler* as, const AsmStmt* stmt) {
+    if (!check_operands(as, stmt, 2, 2)) {
+        return 0;
+    }
+
+    const AsmOperand* src = &stmt->operands[0];
+    const AsmOperand* dst = &stmt->operands[1];
+    int size = infer_size(as, stmt);
+    if (!size) {
+        return 0;
+    }
+
+    if (src->kind == OPERAND_IMM && is_accumulator(dst)) {
+        return emit_accumulator_imm(as, size, size == 1 ? 0xA8 : 0xA9,
+                                    src->expr);
+    }
+
+    if (src->kind == OPERAND_IMM && dst->kind != OPERAND_IMM) {
+        int n = (size == 1) ? 1 : imm_size(size);
+        return emit_insn_rm(as, 0, size, size == 1 ? 0xF6 : 0xF7, 0, 0, dst,
+                            n) &&
+               emit_imm(as, src->expr, n, size);
+    }
+
+    if (dst->kind == OPERAND_MEM) {
+        const AsmOperand* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (dst->kind == OPERAND_REG && src->kind != OPERAND_IMM) {
+        return emit_insn_rm(as, 0, size, size == 1 ? 0x84 : 0x85,
+                            dst->reg.num, reg_rex(dst), src, 0);
+    }
+
+    return asm_error(as, "invalid operands");
+}
+
+static int encode_lea(Assembler* as, const AsmStmt* stmt) {
+    if (!check_operands(as, stmt, 2, 2)) {
+        return 0;
+    }
+
+    const AsmOperand* src = &stmt->operands[0];
+    const AsmOperand* dst = &stmt->operands[1];
+    if (src->kind != OPERAND_MEM || !is_gpr(dst) || gpr_size(dst) == 1) {
+        return asm_error(as, "invalid operands");
+    }
+
+    return emit_insn_rm(as, 0, gpr_size(dst), 0x8D, dst->reg.num, 0, src, 0);
+}
+
+static int encode_push_pop(Assembler* as, const AsmStmt* stmt, int is_push) {
+    if (!check_operands(as, stmt, 1, 1)) {
+        return 0;
+    }
+
+    const AsmOperand* op = &stmt->operands[0];
+    int stack_size = as->bits / 8;
+    if ((stmt->size && stmt->size != stack_size) ||
+        (is_gpr(op) && gpr_size(op) != stack_size)) {
+        return asm_error(as, "invalid operand size");
+    }
+
+    // push and pop default to the stack width, so no REX.W
+    switch (op->kind) {
+        case OPERAND_REG:
+            if (!is_gpr(op)) {
+                return asm_error(as, "invalid operands");
+            }
+            return emit_insn_reg(as, 4, is_push ? 0x50 : 0x58, op->reg);
+
+        case OPERAND_IMM:
+            if (!is_push) {
+                return asm_error(as, "invalid operands");
+            }
+            if (op->expr.sym < 0 && fits_int8(op->expr.val)) {
+                emit_byte(as, 0x6A);
+                return emit_imm(as, op->expr, 1, stack_size);
+            }
+            emit_byte(as, 0x68);
+            return emit_imm(as, op->expr, 4, stack_size);
+
+        case OPERAND_MEM:
+            if (!stmt->size) {
+                return asm_error(as, "cannot infer operand size");
+            }
+            return emit_insn_rm(as, 0, 4, is_push ? 0xFF : 0x8F,
+                                is_push ? 6 : 0, 0, op, 0);
+    }
+
+    UNREACHABLE();
+}
+
+static int encode_unary(Assembler* as, const AsmStmt* stmt, int opcode) {
+    if (!check_operands(as, stmt, 1, 1)) {
+        return 0;
+    }
+
+    int size = infer_size(as, stmt);
+    if (!size) {
+        return 0;
+    }
+
+    return emit_insn_rm(as, 0, size, size == 1 ? opcode - 1 : opcode,
+                        stmt->insn->ext, 0, &stmt->operands[0], 0);
+}
+
+static int encode_imul(Assembler* as, const AsmStmt* stmt) {
+    if (!check_operands(as, stmt, 1, 3)) {
+        return 0;
+    }
+
+    int size = infer_size(as, stmt);
+    if (!size) {
+        return 0;
+    }
+
+    const AsmOperand* ops = stmt->operands;
+    if (stmt->operand_count == 1) {
+        return emit_insn_rm(as, 0, size, size == 1 ? 0xF6 : 0xF7, 5, 0, &ops[0],
+                            0);
+    }
+
+    if (size == 1) {
+        return asm_error(as, "invalid operand size");
+    }
+
+    const AsmOperand* dst = &ops[stmt->operand_count - 1];
+    if (dst->kind != OPERAND_REG) {
+        return asm_error(as, "invalid operands");
+    }
+
+    if (ops[0].kind == OPERAND_IMM) {
+        const AsmOperand* src = (stmt->operand_count == 3) ? &ops[1] : dst;
+        if (ops[0].expr.sym < 0 && fits_int8(ops[0].expr.val)) {
+            return emit_insn_rm(as, 0, size, 0x6B, dst->reg.num, 0, src, 1) &&
+                   emit_imm(as, ops[0].expr, 1, size);
+        }
+        return emit_insn_rm(as, 0, size, 0x69, dst->reg.num, 0, src,
+                            imm_size(size)) &&
+               emit_imm(as, ops[0].expr, imm_size(size), size);
+    }
+
+    if (stmt->operand_count != 2) {
+        return asm_error(as, "invalid operands");
+    }
+    return emit_insn_rm(as, 0, size, 0x0FAF, dst->reg.num, 0, &ops[0], 0);
+}
+
+static inline int is_cl(const AsmOperand* op) {
+    return op->kind == OPERAND_REG && op->reg.kind == REG_GPR8 &&
+           op->reg.num == 1;
+}
+
+static int encode_shift(Assembler* as, const AsmStmt* stmt) {
+    if (!check_operands(as, stmt, 1, 2)) {
+        return 0;
+    }
+
+    const AsmOperand* dst = &stmt->operands[stmt->operand_count - 1];
+    int size = stmt->size ? stmt->size : gpr_size(dst);
+    if (!size) {
+        return asm_error(as, "cannot infer operand size");
+    }
+
+    int ext = stmt->insn->ext;
+    int byte = (size == 1);
+
+    if (stmt->operand_count == 1) {
+        return emit_insn_rm(as, 0, size, byte ? 0xD0 : 0xD1, ext, 0, dst, 0);
+    }
+
+    const AsmOperand* count = &stmt->operands[0];
+    if (is_cl(count)) {
+        return emit_insn_rm(as, 0, size, byte ? 0xD2 : 0xD3, ext, 0, dst, 0);
+    }
+
+    if (count->kind != OPERAND_IMM) {
+        return asm_error(as, "invalid shift count");
+    }
+
+    if (count->expr.sym < 0 && count->expr.val == 1) {
+        return emit_insn_rm(as, 0, size, byte ? 0xD0 : 0xD1, ext, 0, dst, 0);
+    }
+    return emit_insn_rm(as, 0, size, byte ? 0xC0 : 0xC1, ext, 0, dst, 1) &&
+           emit_imm(as, count->expr, 1, size);
+}
+
+static int encode_shift_double(Assembler* as, const AsmStmt* stmt) {
+    if (!check_operands(as, stmt, 3, 3)) {
+        return 0;
+    }
+
+    const AsmOperand* count = &stmt->operands[0];
+    const AsmOperand* src = &stmt->operands[1];
+    const AsmOperand* dst = &stmt->operands[2];
+    int size = infer_size(as, stmt);
+    if (!size) {
+        return 0;
+    }
+
+    if (!is_gpr(src) || size == 1) {
+        return asm_error(as, "invalid operands");
+    }
+
+    if (is_cl(count)) {
+        return emit_insn_rm(as, 0, size, stmt->insn->opcode + 1, src->reg.num,
+                            0, dst, 0);
+    }
+    if (count->kind != OPERAND_IMM) {
+        return asm_error(as, "invalid shift count");
+    }
+    return emit_insn_rm(as, 0, size, stmt->insn->opcode, src->reg.num, 0, dst,
+                        1) &&
+           emit_imm(as, count->expr, 1, size);
+}
+
+// Direct jump target
+static int get_target(Assembler* as, const AsmStmt* stmt, AsmExpr* target) {
+    if (!check_operands(as, stmt, 1, 1)) {
+        return 0;
+    }
+
+    const AsmOperand* op = &stmt->operands[0];
+    if (op->kind != OPERAND_MEM || op->indirect ||
+        op->base.kind != REG_NONE || op->index.kind != REG_NONE ||
+        op->expr.sym < 0) {
+        return asm_error(as, "invalid jump target");
+    }
+
+    *target = op->expr;
+    return 1;
+}
+
+static int encode_jump(Assembler* as, const AsmStmt* stmt, int short_opcode,
+                       int long_opcode) {
+    AsmExpr target = {-1, 0};
+    if (!get_target(as, stmt, &target)) {
+        return 0;
+    }
+
+    if (stmt->is_long) {
+        emit_opcode(as, long_opcode);
+        add_fixup(as, target.sym, ASM_RELOC_PC32, target.val - 4);
+        emit_value(as, 0, 4);
+        return 1;
+    }
+
+    emit_byte(as, short_opcode);
+    JumpFixup jump = {
+        .section = as->section,
+        .offset = cur_offset(as),
+        .symbol = target.sym,
+        .addend = target.val,
+        .stmt = stmt - as->stmts.data,
+    };
+    utlvector_push(&as->jumps, jump);
+    emit_byte(as, 0);
+    return 1;
+}
+
+static int encode_indirect(Assembler* as, const AsmStmt* stmt, int ext) {
+    const AsmOperand* op = &stmt->operands[0];
+    if (op->kind == OPERAND_IMM ||
+        (is_gpr(op) && gpr_size(op) != as->bits / 8)) {
+        return asm_error(as, "invalid operands");
+    }
+    return emit_insn_rm(as, 0, 4, 0xFF, ext, 0, op, 0);
+}
+
+static int encode_insn(Assembler* as, const AsmStmt* stmt) {
+    const InsnDesc* insn = stmt->insn;
+    const AsmOperand* ops = stmt->operands;
+
+    if (stmt->rep) {
+        emit_byte(as, stmt->rep);
+    }
+
+    switch (insn->cls) {
+        case INSN_ALU:
+            return encode_alu(as, stmt);
+
+        case INSN_MOV:
+            return encode_mov(as, stmt);
+
+        case INSN_MOVABS:
+            return encode_movabs(as, stmt);
+
+        case INSN_TEST:
+            return encode_test(as, stmt);
+
+        case INSN_LEA:
+            return encode_lea(as, stmt);
+
+        case INSN_PUSH:
+            return encode_push_pop(as, stmt, 1);
+
+        case INSN_POP:
+            return encode_push_pop(as, stmt, 0);
+
+        case INSN_UNARY:
+            return encode_unary(as, stmt, 0xF7);
+
+        case INSN_INCDEC:
+            return encode_unary(as, stmt, 0xFF);
+
+        case INSN_IMUL:
+            return encode_imul(as, stmt);
+
+        case INSN_SHIFT:
+            return encode_shift(as, stmt);
+
+        case INSN_SHIFT_DOUBLE:
+            return encode_shift_double(as, stmt);
+
+        case INSN_SETCC:
+            if (!check_operands(as, stmt, 1, 1)) {
+                return 0;
+            }
+            if (ops[0].kind == OPERAND_REG && gpr_size(&ops[0]) != 1) {
+                return asm_error(as, "invalid operands");
+            }
+            return emit_insn_rm(as, 0, 1, 0x0F90 + stmt->cc, 0, 0, &ops[0], 0);
+
+        case INSN_CMOVCC: {
+            if (!check_operands(as, stmt, 2, 2)) {
+                return 0;
+            }
+            int size = infer_size(as, stmt);
+            if (!size) {
+                return 0;
+            }
+            if (ops[1].kind != OPERAND_REG || size == 1) {
+                return asm_error(as, "invalid operands");
+            }
+            return emit_insn_rm(as, 0, size, 0x0F40 + stmt->cc,
+                                ops[1].reg.num, 0, &ops[0], 0);
+        }
+
+        case INSN_JCC:
+            return encode_jump(as, stmt, 0x70 + stmt->cc, 0x0F80 + stmt->cc);
+
+        case INSN_JMP:
+            if (stmt->operand_count == 1 && ops[0].indirect) {
+                return encode_indirect(as, stmt, 4);
+            }
+            return encode_jump(as, stmt, 0xEB, 0xE9);
+
+        case INSN_CALL: {
+            if (stmt->operand_count == 1 && ops[0].indirect) {
+                return encode_indirect(as, stmt, 2);
+            }
+            AsmExpr target = {-1, 0};
+            if (!get_target(as, stmt, &target)) {
+                return 0;
+            }
+            emit_byte(as, 0xE8);
+            add_fixup(as, target.sym,
+                      as->bits == 64 ? ASM_RELOC_PLT32 : ASM_RELOC_PC32,
+                      target.val - 4);
+            emit_value(as, 0, 4);
+            return 1;
+        }
+
+        case INSN_RET:
+            if (!check_operands(as, stmt, 0, 1)) {
+                return 0;
+            }
+            if (stmt->operand_count == 0) {
+                emit_byte(as, 0xC3);
+                return 1;
+            }
+            if (ops[0].kind != OPERAND_IMM) {
+                return asm_error(as, "invalid operands");
+            }
+            emit_byte(as, 0xC2);
+            return emit_imm(as, ops[0].expr, 2, 2);
+
+        case INSN_FIXED:
+            if (!check_operands(as, stmt, 0, 0)) {
+                return 0;
+            }
+            if (insn->ext == ONLY_64 && as->bits != 64) {
+                return asm_error(as, "instruction requires 64-bit mode");
+            }
+            if (insn->prefix) {
+                emit_byte(as, insn->prefix);
+            }
+            emit_opcode(as, insn->opcode);
+            return 1;
+
+        case INSN_MOVX:
+            if (!check_operands(as, stmt, 2, 2)) {
+                return 0;
+            }
+            if (gpr_size(&ops[1]) != insn->ext ||
+                ops[0].kind == OPERAND_IMM ||
+                (ops[0].kind == OPERAND_REG &&
+                 gpr_size(&ops[0]) != insn->size)) {
+                return asm_error(as, "invalid operands");
+            }
+            return emit_insn_rm(as, 0, insn->ext, insn->opcode, ops[1].reg.num,
+                                0, &ops[0], 0);
+
+        case INSN_SSE:
+            if (!check_operands(as, stmt, 2, 2)) {
+                return 0;
+            }
+            if (!is_xmm(&ops[1]) || !(is_xmm(&ops[0]) ||
+                                      ops[0].kind == OPERAND_MEM)) {
+                return asm_error(as, "invalid operands");
+            }
+            return emit_insn_rm(as, insn->prefix, 4, insn->opcode,
+                                ops[1].reg.num, 0, &ops[0], 0);
+
+        case INSN_SSE_MOV:
+            if (!check_operands(as, stmt, 2, 2)) {
+                return 0;
+            }
+            if (is_xmm(&ops[1]) &&
+                (is_xmm(&ops[0]) || ops[0].kind == OPERAND_MEM)) {
+                return emit_insn_rm(as, insn->prefix, 4, insn->opcode,
+                                    ops[1].reg.num, 0, &ops[0], 0);
+            }
+            if (is_xmm(&ops[0]) && ops[1].kind == OPERAND_MEM) {
+                return emit_insn_rm(as, insn->prefix, 4, insn->opcode + 1,
+                                    ops[0].reg.num, 0, &ops[1], 0);
+            }
+            return asm_error(as, "invalid operands");
+
+        case INSN_CVTSI2F: {
+            if (!check_operands(as, stmt, 2, 2)) {
+                return 0;
+            }
+            int size = stmt->size ? stmt->size : gpr_size(&ops[0]);
+            if (!size) {
+                size = 4;
+            }
+            if (!is_xmm(&ops[1]) || ops[0].kind == OPERAND_IMM ||
+                is_xmm(&ops[0]) || size < 4) {
+                return asm_error(as, "invalid operands");
+            }
+            return emit_insn_rm(as, insn->prefix, size, insn->opcode,
+                                ops[1].reg.num, 0, &ops[0], 0);
+        }
+
+        case INSN_CVTF2SI: {
+            if (!check_operands(as, stmt, 2, 2)) {
+                return 0;
+            }
+            int size = gpr_size(&ops[1]);
+            if (size < 4 ||
+                !(is_xmm(&ops[0]) || ops[0].kind == OPERAND_MEM)) {
+                return asm_error(as, "invalid operands");
+            }
+            return emit_insn_rm(as, insn->prefix, size, insn->opcode,
+                                ops[1].reg.num, 0, &ops[0], 0);
+        }
+
+        case INSN_MOVD:
+            return encode_movd(as, stmt, insn->ext);
+
+        case INSN_X87:
+            if (!check_operands(as, stmt, 1, 1)) {
+                return 0;
+            }
+            if (ops[0].kind != OPERAND_MEM) {
+                return asm_error(as, "invalid operands");
+            }
+            return emit_insn_rm(as, insn->prefix, 4, insn->opcode, insn->ext,
+                                0, &ops[0], 0);
+    }
+
+    UNREACHABLE();
+}
+
+// Recommended multi-byte NOPs
+static const unsigned char nops[][9] = {
+    {0x90},
+    {0x66, 0x90},
+    {0x0F, 0x1F, 0x00},
+    {0x0F, 0x1F, 0x40, 0x00},
+    {0x0F, 0x1F, 0x44, 0x00, 0x00},
+    {0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+    {0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+    {0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+static void emit_align(Assembler* as, const AsmStmt* stmt) {
+    AsmSection* section = cur_section(as);
+    if (stmt->size > section->alignment) {
+        section->alignment = stmt->size;
+    }
+
+    int pad = (stmt->size - cur_offset(as) % stmt->size) % stmt->size;
+    if (pad == 0 || (stmt->count > 0 && pad > stmt->count)) {
+        return;
+    }
+
+    if (section->flags & ASM_SECTION_EXEC) {
+        while (pad > 0) {
+            int n = MIN(pad, (int)ARRAY_SIZE(nops));
+            utlvector_pushall(&section->data, nops[n - 1], n);
+            pad -= n;
+        }
+    } else {
+        emit_value(as, 0, pad);
+    }
+}
+
+static void emit_string(Assembler* as, const AsmStmt* stmt) {
+    Str s = stmt->str;
+    for (int i = 0; i < s.len; i++) {
+        char c = s.ptr[i];
+        if (c != '\\' || i + 1 >= s.len) {
+            emit_byte(as, c);
+            continue;
+        }
+
+        c = s.ptr[++i];
+        if (c >= '0' && c <= '7') {
+            int val = 0;
+            for (int n = 0; n < 3 && i < s.len && s.ptr[i] >= '0' &&
+                            s.ptr[i] <= '7';
+                 n++, i++) {
+                val = val * 8 + s.ptr[i] - '0';
+            }
+            i--;
+            emit_byte(as, val);
+            continue;
+        }
+
+        if (c == 'x') {
+            int val = 0;
+            while (i + 1 < s.len && isxdigit((unsigned char)s.ptr[i + 1])) {
+                c = s.ptr[++i];
+                val = val * 16 +
+                      (isdigit((unsigned char)c) ? c - '0'
+                                                 : tolower((unsigned char)c) -
+                                                       'a' + 10);
+            }
+            emit_byte(as, val);
+            continue;
+        }
+
+        switch (c) {
+            case 'n':
+                emit_byte(as, '\n');
+                break;
+            case 't':
+                emit_byte(as, '\t');
+                break;
+            case 'r':
+                emit_byte(as, '\r');
+                break;
+            case 'b':
+                emit_byte(as, '\b');
+                break;
+            case 'f':
+                emit_byte(as, '\f');
+                break;
+            default:
+                emit_byte(as, c);
+                break;
+        }
+    }
+
+    if (stmt->size) {
+        emit_byte(as, 0);
+    }
+}
+
+static int emit_data(Assembler* as, const AsmStmt* stmt) {
+    AsmExpr expr = stmt->expr;
+    if (expr.sym < 0) {
+        emit_value(as, expr.val, stmt->size);
+        return 1;
+    }
+
+    if (stmt->size == 8) {
+        if (as->bits != 64) {
+            return asm_error(as, "relocation too large");
+        }
+        add_fixup(as, expr.sym, ASM_RELOC_ABS64, expr.val);
+    } else {
+        add_fixup(as, expr.sym, ASM_RELOC_ABS32, expr.val);
+    }
+    emit_value(as, 0, stmt->size);
+    return 1;
+}
+
+static int run_pass(Assembler* as) {
+    for (size_t i = 0; i < as->obj->sections.size; i++) {
+        utlvector_clear(&as->obj->sections.data[i].data);
+    }
+    utlvector_clear(&as->fixups);
+    utlvector_clear(&as->jumps);
+    as->section = 0;
+
+    for (size_t i = 0; i < as->stmts.size; i++) {
+        const AsmStmt* stmt = &as->stmts.data[i];
+        as->line = stmt->line;
+
+        switch (stmt->kind) {
+            case STMT_LABEL:
+                as->obj->symbols.data[stmt->symbol].offset = cur_offset(as);
+                break;
+
+            case STMT_INSN:
+                encode_insn(as, stmt);
+                break;
+
+            case STMT_SECTION:
+                as->section = stmt->section;
+                break;
+
+            case STMT_DATA:
+                emit_data(as, stmt);
+                break;
+
+            case STMT_STRING:
+                emit_string(as, stmt);
+                break;
+
+            case STMT_ZERO:
+                emit_value(as, 0, stmt->count);
+                break;
+
+            case STMT_ALIGN:
+                emit_align(as, stmt);
+                break;
+        }
+
+        if (as->failed) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Relax short jumps that do not reach. Returns 1 if anything changed.
+static int relax_jumps(Assembler* as) {
+    int changed = 0;
+    for (size_t i = 0; i < as->jumps.size; i++) {
+        JumpFixup* jump = &as->jumps.data[i];
+        const AsmSymbol* sym = &as->obj->symbols.data[jump->symbol];
+
+        long long disp = sym->offset + jump->addend - (jump->offset + 1);
+        if (sym->section != jump->section || !fits_int8(disp)) {
+            as->stmts.data[jump->stmt].is_long = 1;
+            changed = 1;
+            continue;
+        }
+
+        as->obj->sections.data[jump->section].data.data[jump->offset] =
+            disp & 0xFF;
+    }
+    return changed;
+}
+
+static int resolve_fixups(Assembler* as) {
+    for (size_t i = 0; i < as->fixups.size; i++) {
+        const Fixup* fixup = &as->fixups.data[i];
+        AsmSection* section = &as->obj->sections.data[fixup->section];
+        const AsmSymbol* sym = &as->obj->symbols.data[fixup->symbol];
+        int pc_rel = fixup->type == ASM_RELOC_PC32 ||
+                     fixup->type == ASM_RELOC_PLT32;
+
+        if (pc_rel && sym->section == fixup->section) {
+            long long val = sym->offset + fixup->addend - fixup->offset;
+            for (int j = 0; j < 4; j++) {
+                section->data.data[fixup->offset + j] = (val >> (j * 8)) & 0xFF;
+            }
+            continue;
+        }
+
+        if (sym->section < 0 && asm_is_temp_symbol(sym)) {
+            as->line = 0;
+            return asm_error(as, "undefined symbol '%.*s'", sym->name.len,
+                             sym->name.ptr);
+        }
+
+        AsmReloc reloc = {
+            .offset = fixup->offset,
+            .symbol = fixup->symbol,
+            .type = fixup->type,
+            .addend = fixup->addend,
+        };
+
+        if (sym->section >= 0 && !sym->is_global) {
+            // Local symbols are referenced through their section
+            reloc.symbol = as->obj->sections.data[sym->section].symbol;
+            reloc.addend += sym->offset;
+            if (reloc.type == ASM_RELOC_PLT32) {
+                reloc.type = ASM_RELOC_PC32;
+            }
+        }
+
+        utlvector_push(&section->relocs, reloc);
+    }
+    return 1;
+}
+
+int asm_assemble(AsmObject* obj, int bits, const char* src, char* err,
+                 int err_size) {
+    if (!insn_hash_ready) {
+        init_insn_hash();
+    }
+
+    memset(obj, 0, sizeof(*obj));
+    obj->bits = bits;
+    obj->sections.allocator = &never_fail_allocator;
+    obj->symbols.allocator = &never_fail_allocator;
+
+    Assembler as = {
+        .obj = obj,
+        .bits = bits,
+        .err = err,
+        .err_size = err_size,
+        .stmts = utlvector_init(&never_fail_allocator),
+        .fixups = utlvector_init(&never_fail_allocator),
+        .jumps = utlvector_init(&never_fail_allocator),
+    };
+
+    get_section(&as, str(".text"), default_section_flags(str(".text")));
+
+    if (parse(&as, src)) {
+        while (run_pass(&as) && relax_jumps(&as)) {
+        }
+        if (!as.failed) {
+            resolve_fixups(&as);
+        }
+    }
+
+    utlvector_deinit(&as.stmts);
+    utlvector_deinit(&as.fixups);
+    utlvector_deinit(&as.jumps);
+    never_fail_allocator.free(&never_fail_allocator, as.sym_map);
+
+    if (as.failed) {
+        asm_free(obj);
+        return 1;
+    }
+    return 0;
+}
+
+void asm_free(AsmObject* obj) {
+    for (size_t i = 0; i < obj->sections.size; i++) {
+        utlvector_deinit(&obj->sections.data[i].data);
+        utlvector_deinit(&obj->sections.data[i].relocs);
+    }
+    utlvector_deinit(&obj->sections);
+    utlvector_deinit(&obj->symbols);
+}
@@ -0,0 +1,68 @@
+#ifndef ASM_H
+#define ASM_H
+
+#include <stdio.h>
+
+#include "str.h"
+#include "utl/utlvector.h"
+
+// In-process assembler for the AT&T syntax emitted by codegen
+
+typedef enum AsmRelocType {
+    ASM_RELOC_ABS32,
+    ASM_RELOC_ABS32S,  // sign-extended 32-bit address (x86-64 only)
+    ASM_RELOC_ABS64,
+    ASM_RELOC_PC32,
+    ASM_RELOC_PLT32,  // call target
+} AsmRelocType;
+
+typedef struct AsmReloc {
+    int offset;
+    int symbol;  // index in AsmObject.symbols
+    AsmRelocType type;
+    long long addend;
+} AsmReloc;
+
+enum {
+    ASM_SECTION_ALLOC = 1 << 0,
+    ASM_SECTION_WRITE = 1 << 1,
+    ASM_SECTION_EXEC = 1 << 2,
+};
+
+typedef struct AsmSection {
+    Str name;
+    int flags;
+    int alignment;
+    int symbol;  // section symbol
+    UtlVector(unsigned char) data;
+    UtlVector(AsmReloc) relocs;
+} AsmSection;
+
+typedef struct AsmSymbol {
+    Str name;
+    int section;  // -1 if undefined
+    int offset;
+    int is_global;
+    int is_section;
+} AsmSymbol;
+
+typedef struct AsmObject {
+    int bits;  // 32 or 64
+    UtlVector(AsmSection) sections;
+    UtlVector(AsmSymbol) symbols;
+} AsmObject;
+
+// Assemble the source into obj. Returns 0 on success; otherwise writes the
+// error message into err. Names in obj point into src.
+int asm_assemble(AsmObject* obj, int bits, const char* src, char* err,
+                 int err_size);
+
+void asm_free(AsmObject* obj);
+
+// Returns 1 for local labels (.L*) that are not written into object files
+int asm_is_temp_symbol(const AsmSymbol* sym);
+
+// Write obj as an ELF relocatable object
+int elf_write(const AsmObject* obj, FILE* fp);
+
+#endif
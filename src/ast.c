@@ -0,0 +1,203 @@
+#include "ast.h"
+
+void ast_init(AST* ast, UtlAllocator* allocator) {
+    *ast = (AST){
+        .node_types = utlvector_init(allocator),
+        .pos = utlvector_init(allocator),
+        .data = utlvector_init(allocator),
+        .extra = utlvector_init(allocator),
+    };
+
+    ast_add_node(ast, NODE_STMTS, (SourcePos){0}, (ASTNodeData){0});
+}
+
+// Copy the vector to a buffer of the exact size in the arena
+static void move_to_arena(UtlVector_void* v, size_t element_size,
+                          UtlArenaAllocator* arena) {
+    void* data = NULL;
+    if (v->size > 0) {
+        data = utlarena_alloc(arena, v->size * element_size);
+        memcpy(data, v->data, v->size * element_size);
+    }
+    v->allocator->free(v->allocator, v->data);
+
+    v->data = data;
+    v->capacity = v->size;
+    v->allocator = utlarena_allocator(arena);
+}
+
+void ast_finish(AST* ast, UtlArenaAllocator* arena) {
+    move_to_arena((UtlVector_void*)&ast->node_types,
+                  sizeof(*ast->node_types.data), arena);
+    move_to_arena((UtlVector_void*)&ast->pos, sizeof(*ast->pos.data), arena);
+    move_to_arena((UtlVector_void*)&ast->data, sizeof(*ast->data.data), arena);
+    move_to_arena((UtlVector_void*)&ast->extra, sizeof(*ast->extra.data),
+                  arena);
+
+    size_t count = ast->node_types.size;
+    ast->types = utlarena_alloc(arena, count * sizeof(const Type*));
+    memset(ast->types, 0, count * sizeof(const Type*));
+    ast->flags = utlarena_alloc(arena, count);
+    memset(ast->flags, 0, count);
+}
+
+NodeIndex ast_add_node(AST* ast, ASTNodeType type, SourcePos pos,
+                       ASTNodeData data) {
+    utlvector_push(&ast->node_types, type);
+    utlvector_push(&ast->pos, pos);
+    utlvector_push(&ast->data, data);
+    return ast->node_types.size - 1;
+}
+
+uint32_t ast_add_extra(AST* ast, const uint32_t* words, int count) {
+    uint32_t start = ast->extra.size;
+    if (count > 0) {
+        utlvector_pushall(&ast->extra, words, count);
+    }
+    return start;
+}
+
+static inline ASTNodeData list_data(AST* ast, uint32_t aux, NodeIndex lhs,
+                                    ASTNodeList list) {
+    return (ASTNodeData){
+        .aux = aux,
+        .lhs = lhs,
+        .rhs = ast_add_extra(ast, list.nodes, list.count),
+    };
+}
+
+NodeIndex ast_new_stmts(AST* ast, SourcePos pos, StatementListNode stmts) {
+    ASTNodeData data = {
+        .aux = stmts.stmts.count,
+        .lhs = ast_add_extra(ast, stmts.stmts.nodes, stmts.stmts.count),
+    };
+    return ast_add_node(ast, NODE_STMTS, pos, data);
+}
+
+NodeIndex ast_new_intlit(AST* ast, SourcePos pos, IntLitNode lit) {
+    NodeIndex node = ast_add_node(ast, NODE_INTLIT, pos, (ASTNodeData){0});
+    ast_set_intlit(ast, node, lit);
+    return node;
+}
+
+NodeIndex ast_new_floatlit(AST* ast, SourcePos pos, FloatLitNode lit) {
+    NodeIndex node = ast_add_node(ast, NODE_FLOATLIT, pos, (ASTNodeData){0});
+    ast_set_floatlit(ast, node, lit);
+    return node;
+}
+
+NodeIndex ast_new_strlit(AST* ast, SourcePos pos, StrLitNode lit) {
+    ASTNodeData data;
+    pack_str(&data, lit.val);
+    return ast_add_node(ast, NODE_STRLIT, pos, data);
+}
+
+NodeIndex ast_new_binop(AST* ast, SourcePos pos, BinaryOpNode binop) {
+    ASTNodeData data = {binop.op, binop.left, binop.right};
+    return ast_add_node(ast, NODE_BINARYOP, pos, data);
+}
+
+NodeIndex ast_new_unaryop(AST* ast, SourcePos pos, UnaryOpNode unaryop) {
+    ASTNodeData data = {unaryop.op, unaryop.node, 0};
+    return ast_add_node(ast, NODE_UNARYOP, pos, data);
+}
+
+NodeIndex ast_new_var(AST* ast, SourcePos pos, VarNode var) {
+    ASTNodeData data = {0};
+    pack_ptr(&data, var.ste);
+    return ast_add_node(ast, NODE_VAR, pos, data);
+}
+
+NodeIndex ast_new_call(AST* ast, SourcePos pos, CallNode call) {
+    ASTNodeData data = list_data(ast, call.args.count, call.node, call.args);
+    return ast_add_node(ast, NODE_CALL, pos, data);
+}
+
+NodeIndex ast_new_print(AST* ast, SourcePos pos, PrintNode print_node) {
+    ASTNodeData data = list_data(ast, print_node.args.count, print_node.fmt,
+                                 print_node.args);
+    return ast_add_node(ast, NODE_PRINT, pos, data);
+}
+
+NodeIndex ast_new_ret(AST* ast, SourcePos pos, ReturnNode ret) {
+    ASTNodeData data = {0, ret.expr, 0};
+    return ast_add_node(ast, NODE_RET, pos, data);
+}
+
+NodeIndex ast_new_assign(AST* ast, SourcePos pos, AssignNode assign) {
+    ASTNodeData data = {assign.from_decl, assign.left, assign.right};
+    return ast_add_node(ast, NODE_ASSIGN, pos, data);
+}
+
+NodeIndex ast_new_if(AST* ast, SourcePos pos, IfStatementNode if_node) {
+    ASTNodeData data = {if_node.else_block, if_node.expr, if_node.then_block};
+    return ast_add_node(ast, NODE_IF, pos, data);
+}
+
+NodeIndex ast_new_while(AST* ast, SourcePos pos, WhileNode while_node) {
+    ASTNodeData data = {while_node.inc, while_node.expr, while_node.block};
+    return ast_add_node(ast, NODE_WHILE, pos, data);
+}
+
+NodeIndex ast_new_goto(AST* ast, SourcePos pos, GotoNode goto_node) {
+    ASTNodeData data = {goto_node.op, 0, 0};
+    return ast_add_node(ast, NODE_GOTO, pos, data);
+}
+
+NodeIndex ast_new_type_node(AST* ast, SourcePos pos, TypeNode type_node) {
+    ASTNodeData data = {0};
+    pack_ptr(&data, type_node.data_type);
+    return ast_add_node(ast, NODE_TYPE, pos, data);
+}
+
+NodeIndex ast_new_indexof(AST* ast, SourcePos pos, IndexOfNode idxof) {
+    ASTNodeData data = {0, idxof.left, idxof.right};
+    return ast_add_node(ast, NODE_INDEXOF, pos, data);
+}
+
+NodeIndex ast_new_field(AST* ast, SourcePos pos, FieldNode field) {
+    ASTNodeData ident;
+    pack_str(&ident, field.ident);
+    uint32_t words[] = {ident.aux, ident.lhs, ident.rhs};
+
+    ASTNodeData data = {
+        .lhs = field.node,
+        .rhs = ast_add_extra(ast, words, ARRAY_SIZE(words)),
+    };
+    return ast_add_node(ast, NODE_FIELD, pos, data);
+}
+
+NodeIndex ast_new_cast(AST* ast, SourcePos pos, CastNode cast) {
+    ASTNodeData data = {.aux = cast.expr};
+    pack_ptr(&data, cast.data_type);
+    return ast_add_node(ast, NODE_CAST, pos, data);
+}
+
+NodeIndex ast_new_asm(AST* ast, SourcePos pos, AsmNode asm_node) {
+    ASTNodeData data;
+    pack_str(&data, asm_node.asm_str);
+    return ast_add_node(ast, NODE_ASM, pos, data);
+}
+
+NodeIndex ast_new_hint(AST* ast, SourcePos pos, BranchHintNode hint) {
+    ASTNodeData data = {hint.likely, hint.expr, 0};
+    return ast_add_node(ast, NODE_HINT, pos, data);
+}
+
+NodeIndex ast_new_error(AST* ast, SourcePos pos, ErrorNode err) {
+    ASTNodeData data = {0};
+    pack_ptr(&data, err.val);
+    return ast_add_node(ast, NODE_ERR, pos, data);
+}
+
+void ast_set_intlit(AST* ast, NodeIndex node, IntLitNode lit) {
+    ASTNodeData* data = &ast->data.data[node];
+    data->aux = lit.data_type;
+    pack_u64(data, lit.val);
+}
+
+void ast_set_floatlit(AST* ast, NodeIndex node, FloatLitNode lit) {
+    ASTNodeData* data = &ast->data.data[node];
+    data->aux = lit.data_type;
+    pack_double(data, lit.val);
+}
@@ -1,16 +1,21 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stdint.h>
+#include <string.h>
+
 #include "error.h"
 #include "lexer.h"
 #include "source.h"
 #include "symbol_table.h"
 #include "type.h"
+#include "utl/utlvector.h"
 
 typedef enum ASTNodeType {
     NODE_ERR = -1,
     NODE_STMTS,
     NODE_INTLIT,
+    NODE_FLOATLIT,
     NODE_STRLIT,
     NODE_BINARYOP,
     NODE_UNARYOP,
@@ -27,201 +32,404 @@ typedef enum ASTNodeType {
     NODE_FIELD,
     NODE_CAST,
     NODE_ASM,
+    NODE_HINT,
 } ASTNodeType;
 
-typedef struct ASTNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
-} ASTNode;
+/*
+ * The nodes are stored in parallel arrays indexed by NodeIndex. Each node has
+ * a type, a position and three 32-bit words. Child nodes are indices, 64-bit
+ * values and pointers take two words, and lists are ranges of the extra array.
+ *
+ *  node        aux         lhs         rhs
+ *  STMTS       count       extra index
+ *  INTLIT      data_type   val
+ *  FLOATLIT    data_type   val
+ *  STRLIT      len         ptr
+ *  BINARYOP    op          left        right
+ *  UNARYOP     op          node
+ *  VAR                     ste
+ *  CALL        arg count   node        extra index
+ *  PRINT       arg count   fmt         extra index
+ *  RET                     expr
+ *  ASSIGN      from_decl   left        right
+ *  IF          else_block  expr        then_block
+ *  WHILE       inc         expr        block
+ *  GOTO        op
+ *  TYPE                    data_type
+ *  INDEXOF                 left        right
+ *  FIELD                   node        extra index of ident
+ *  CAST        expr        data_type
+ *  ASM         len         ptr
+ *  HINT        likely      expr
+ *  ERR                     val
+ */
+
+typedef struct ASTNodeData {
+    uint32_t aux;
+    NodeIndex lhs;
+    NodeIndex rhs;
+} ASTNodeData;
+
+#define TYPE_INFO_LVALUE 1
+#define TYPE_INFO_ADDRESS 2
+
+typedef struct AST {
+    // Filled in by the parser, node 0 is a placeholder
+    UtlVector(int8_t) node_types;
+    UtlVector(SourcePos) pos;
+    UtlVector(ASTNodeData) data;
+    UtlVector(NodeIndex) extra;
+
+    // Filled in by sema
+    const Type** types;
+    uint8_t* flags;  // TYPE_INFO_*
+} AST;
+
+void ast_init(AST* ast, UtlAllocator* allocator);
+
+// Move the nodes to the arena and allocate the type info once the tree is
+// complete. No nodes can be added after this.
+void ast_finish(AST* ast, UtlArenaAllocator* arena);
+
+NodeIndex ast_add_node(AST* ast, ASTNodeType type, SourcePos pos,
+                       ASTNodeData data);
+
+// Returns the index of the first word in extra
+uint32_t ast_add_extra(AST* ast, const uint32_t* words, int count);
+
+static inline ASTNodeType ast_node_type(const AST* ast, NodeIndex node) {
+    return ast->node_types.data[node];
+}
 
-typedef struct TypedASTNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
-} TypedASTNode;
+static inline SourcePos ast_pos(const AST* ast, NodeIndex node) {
+    return ast->pos.data[node];
+}
 
-typedef struct IntLitNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline int is_typed_node(ASTNodeType type) {
+    switch (type) {
+        case NODE_INTLIT:
+        case NODE_FLOATLIT:
+        case NODE_STRLIT:
+        case NODE_BINARYOP:
+        case NODE_UNARYOP:
+        case NODE_VAR:
+        case NODE_CALL:
+        case NODE_ASSIGN:
+        case NODE_INDEXOF:
+        case NODE_FIELD:
+        case NODE_CAST:
+        case NODE_HINT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static inline TypeInfo ast_type_info(const AST* ast, NodeIndex node) {
+    assert(is_typed_node(ast_node_type(ast, node)));
+    uint8_t flags = ast->flags[node];
+    return (TypeInfo){
+        .is_lvalue = (flags & TYPE_INFO_LVALUE) != 0,
+        .is_address = (flags & TYPE_INFO_ADDRESS) != 0,
+        .type = ast->types[node],
+    };
+}
+
+static inline void ast_set_type_info(AST* ast, NodeIndex node,
+                                     TypeInfo info) {
+    assert(is_typed_node(ast_node_type(ast, node)));
+    ast->flags[node] = (info.is_lvalue ? TYPE_INFO_LVALUE : 0) |
+                       (info.is_address ? TYPE_INFO_ADDRESS : 0);
+    ast->types[node] = info.type;
+}
+
+/*
+ * Packing values into the node words
+ */
+
+static inline void pack_u64(ASTNodeData* data, uint64_t val) {
+    data->lhs = (uint32_t)val;
+    data->rhs = (uint32_t)(val >> 32);
+}
+
+static inline uint64_t unpack_u64(ASTNodeData data) {
+    return data.lhs | ((uint64_t)data.rhs << 32);
+}
+
+static inline void pack_ptr(ASTNodeData* data, const void* ptr) {
+    pack_u64(data, (uintptr_t)ptr);
+}
+
+static inline void* unpack_ptr(ASTNodeData data) {
+    return (void*)(uintptr_t)unpack_u64(data);
+}
+
+static inline void pack_double(ASTNodeData* data, double val) {
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    pack_u64(data, bits);
+}
+
+static inline double unpack_double(ASTNodeData data) {
+    uint64_t bits = unpack_u64(data);
+    double val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+static inline void pack_str(ASTNodeData* data, Str s) {
+    data->aux = s.len;
+    pack_ptr(data, s.ptr);
+}
 
-    int val;
+static inline Str unpack_str(ASTNodeData data) {
+    return (Str){unpack_ptr(data), data.aux};
+}
+
+/*
+ * Decoded nodes, returned by value
+ */
+
+// Range of node indices in the extra array
+typedef struct ASTNodeList {
+    const NodeIndex* nodes;
+    int count;
+} ASTNodeList;
+
+static inline ASTNodeList ast_list(const AST* ast, uint32_t start,
+                                   int count) {
+    return (ASTNodeList){count > 0 ? &ast->extra.data[start] : NULL, count};
+}
+
+typedef struct IntLitNode {
+    long long val;
     PrimitiveType data_type;
 } IntLitNode;
 
-typedef struct StrLitNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline IntLitNode ast_intlit(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (IntLitNode){(long long)unpack_u64(data), data.aux};
+}
+
+typedef struct FloatLitNode {
+    double val;
+    PrimitiveType data_type;
+} FloatLitNode;
 
+static inline FloatLitNode ast_floatlit(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (FloatLitNode){unpack_double(data), data.aux};
+}
+
+typedef struct StrLitNode {
     Str val;
 } StrLitNode;
 
-typedef struct BinaryOpNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline StrLitNode ast_strlit(const AST* ast, NodeIndex node) {
+    return (StrLitNode){unpack_str(ast->data.data[node])};
+}
 
+typedef struct BinaryOpNode {
     TkType op;
-    ASTNode* left;
-    ASTNode* right;
+    NodeIndex left;
+    NodeIndex right;
 } BinaryOpNode;
 
-typedef struct UnaryOpNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline BinaryOpNode ast_binop(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (BinaryOpNode){data.aux, data.lhs, data.rhs};
+}
 
+typedef struct UnaryOpNode {
     TkType op;
-    ASTNode* node;
+    NodeIndex node;
 } UnaryOpNode;
 
-typedef struct VarNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline UnaryOpNode ast_unaryop(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (UnaryOpNode){data.aux, data.lhs};
+}
 
+typedef struct VarNode {
     SymbolTableEntry* ste;
 } VarNode;
 
-typedef struct AssignNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline VarNode ast_var(const AST* ast, NodeIndex node) {
+    return (VarNode){unpack_ptr(ast->data.data[node])};
+}
 
-    ASTNode* left;
-    ASTNode* right;
+typedef struct AssignNode {
+    NodeIndex left;
+    NodeIndex right;
     int from_decl;
 } AssignNode;
 
-typedef struct IfStatementNode {
-    ASTNodeType type;
-    SourcePos pos;
+static inline AssignNode ast_assign(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (AssignNode){data.lhs, data.rhs, data.aux};
+}
 
-    ASTNode* expr;
-    ASTNode* then_block;
-    ASTNode* else_block;
+typedef struct IfStatementNode {
+    NodeIndex expr;
+    NodeIndex then_block;
+    NodeIndex else_block;
 } IfStatementNode;
 
-typedef struct WhileNode {
-    ASTNodeType type;
-    SourcePos pos;
+static inline IfStatementNode ast_if(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (IfStatementNode){data.lhs, data.rhs, data.aux};
+}
 
-    ASTNode* expr;
-    ASTNode* inc;
-    ASTNode* block;
+typedef struct WhileNode {
+    NodeIndex expr;
+    NodeIndex inc;
+    NodeIndex block;
 } WhileNode;
 
-typedef struct GotoNode {
-    ASTNodeType type;
-    SourcePos pos;
+static inline WhileNode ast_while(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (WhileNode){data.lhs, data.aux, data.rhs};
+}
 
+typedef struct GotoNode {
     TkType op;
 } GotoNode;
 
-typedef struct ErrorNode {
-    ASTNodeType type;
-    SourcePos pos;
+static inline GotoNode ast_goto(const AST* ast, NodeIndex node) {
+    return (GotoNode){ast->data.data[node].aux};
+}
 
+typedef struct ErrorNode {
     Error* val;
 } ErrorNode;
 
-typedef struct ASTNodeList ASTNodeList;
-struct ASTNodeList {
-    ASTNode* node;
-    ASTNodeList* next;
-};
+static inline ErrorNode ast_error(const AST* ast, NodeIndex node) {
+    return (ErrorNode){unpack_ptr(ast->data.data[node])};
+}
 
 typedef struct StatementListNode {
-    ASTNodeType type;
-    SourcePos pos;
-
-    ASTNodeList* stmts;
-    ASTNodeList* _tail;
+    ASTNodeList stmts;
 } StatementListNode;
 
-typedef struct CallNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline StatementListNode ast_stmts(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (StatementListNode){ast_list(ast, data.lhs, data.aux)};
+}
 
-    ASTNode* node;
-    ASTNodeList* args;
+typedef struct CallNode {
+    NodeIndex node;
+    ASTNodeList args;  // in reverse order, like ArgList
 } CallNode;
 
-typedef struct PrintNode {
-    ASTNodeType type;
-    SourcePos pos;
+static inline CallNode ast_call(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (CallNode){data.lhs, ast_list(ast, data.rhs, data.aux)};
+}
 
-    Str fmt;
-    ASTNodeList* args;
+typedef struct PrintNode {
+    NodeIndex fmt;     // string literal
+    ASTNodeList args;  // in reverse order
 } PrintNode;
 
-typedef struct ReturnNode {
-    ASTNodeType type;
-    SourcePos pos;
+static inline PrintNode ast_print(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (PrintNode){data.lhs, ast_list(ast, data.rhs, data.aux)};
+}
 
-    ASTNode* expr;
+typedef struct ReturnNode {
+    NodeIndex expr;
 } ReturnNode;
 
-typedef struct IndexOfNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline ReturnNode ast_ret(const AST* ast, NodeIndex node) {
+    return (ReturnNode){ast->data.data[node].lhs};
+}
 
-    ASTNode* left;
-    ASTNode* right;
+typedef struct IndexOfNode {
+    NodeIndex left;
+    NodeIndex right;
 } IndexOfNode;
 
-typedef struct FieldNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline IndexOfNode ast_indexof(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (IndexOfNode){data.lhs, data.rhs};
+}
 
-    ASTNode* node;
+typedef struct FieldNode {
+    NodeIndex node;
     Str ident;
 } FieldNode;
 
-typedef struct TypeNode {
-    ASTNodeType type;
-    SourcePos pos;
+static inline FieldNode ast_field(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    const NodeIndex* ident = &ast->extra.data[data.rhs];
+    ASTNodeData ident_data = {ident[0], ident[1], ident[2]};
+    return (FieldNode){data.lhs, unpack_str(ident_data)};
+}
 
+typedef struct TypeNode {
     const Type* data_type;
 } TypeNode;
 
-typedef struct CastNode {
-    ASTNodeType type;
-    SourcePos pos;
-    TypeInfo type_info;
+static inline TypeNode ast_type_node(const AST* ast, NodeIndex node) {
+    return (TypeNode){unpack_ptr(ast->data.data[node])};
+}
 
+typedef struct CastNode {
     const Type* data_type;
-    ASTNode* expr;
+    NodeIndex expr;
 } CastNode;
 
-typedef struct AsmNode {
-    ASTNodeType type;
-    SourcePos pos;
+static inline CastNode ast_cast(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (CastNode){unpack_ptr(data), data.aux};
+}
 
+typedef struct AsmNode {
     Str asm_str;
 } AsmNode;
 
-static inline TypedASTNode* as_typed_ast(ASTNode* node) {
-    switch (node->type) {
-        case NODE_INTLIT:
-        case NODE_STRLIT:
-        case NODE_BINARYOP:
-        case NODE_UNARYOP:
-        case NODE_VAR:
-        case NODE_CALL:
-        case NODE_ASSIGN:
-        case NODE_INDEXOF:
-        case NODE_FIELD:
-        case NODE_CAST:
-            return (TypedASTNode*)node;
-        default:
-            UNREACHABLE();
-    }
+static inline AsmNode ast_asm(const AST* ast, NodeIndex node) {
+    return (AsmNode){unpack_str(ast->data.data[node])};
 }
 
+typedef struct BranchHintNode {
+    NodeIndex expr;
+    int likely;
+} BranchHintNode;
+
+static inline BranchHintNode ast_hint(const AST* ast, NodeIndex node) {
+    ASTNodeData data = ast->data.data[node];
+    return (BranchHintNode){data.lhs, data.aux};
+}
+
+/*
+ * Building nodes, used by the parser
+ */
+
+NodeIndex ast_new_stmts(AST* ast, SourcePos pos, StatementListNode stmts);
+NodeIndex ast_new_intlit(AST* ast, SourcePos pos, IntLitNode lit);
+NodeIndex ast_new_floatlit(AST* ast, SourcePos pos, FloatLitNode lit);
+NodeIndex ast_new_strlit(AST* ast, SourcePos pos, StrLitNode lit);
+NodeIndex ast_new_binop(AST* ast, SourcePos pos, BinaryOpNode binop);
+NodeIndex ast_new_unaryop(AST* ast, SourcePos pos, UnaryOpNode unaryop);
+NodeIndex ast_new_var(AST* ast, SourcePos pos, VarNode var);
+NodeIndex ast_new_call(AST* ast, SourcePos pos, CallNode call);
+NodeIndex ast_new_print(AST* ast, SourcePos pos, PrintNode print_node);
+NodeIndex ast_new_ret(AST* ast, SourcePos pos, ReturnNode ret);
+NodeIndex ast_new_assign(AST* ast, SourcePos pos, AssignNode assign);
+NodeIndex ast_new_if(AST* ast, SourcePos pos, IfStatementNode if_node);
+NodeIndex ast_new_while(AST* ast, SourcePos pos, WhileNode while_node);
+NodeIndex ast_new_goto(AST* ast, SourcePos pos, GotoNode goto_node);
+NodeIndex ast_new_type_node(AST* ast, SourcePos pos, TypeNode type_node);
+NodeIndex ast_new_indexof(AST* ast, SourcePos pos, IndexOfNode idxof);
+NodeIndex ast_new_field(AST* ast, SourcePos pos, FieldNode field);
+NodeIndex ast_new_cast(AST* ast, SourcePos pos, CastNode cast);
+NodeIndex ast_new_asm(AST* ast, SourcePos pos, AsmNode asm_node);
+NodeIndex ast_new_hint(AST* ast, SourcePos pos, BranchHintNode hint);
+NodeIndex ast_new_error(AST* ast, SourcePos pos, ErrorNode err);
+
+// Literals are folded in place by the parser and converted by sema
+void ast_set_intlit(AST* ast, NodeIndex node, IntLitNode lit);
+void ast_set_floatlit(AST* ast, NodeIndex node, FloatLitNode lit);
+
 #endif
@@ -0,0 +1,1388 @@
+#include "bytecode.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "abi.h"
+#include "codegen.h"
+#include "utils.h"
+
+// Location in memory, base register + offset
+typedef struct BcAddr {
+    int base;
+    int offset;
+} BcAddr;
+
+typedef struct BcState {
+    BcProgram* prog;
+    UtlArenaAllocator* arena;
+    const AST* ast;
+    Error* err;
+
+    FuncSymbolTableEntry** func_stes;  // same order as prog->funcs
+    int func_count;
+
+    BcFunc* func;
+    UtlVector(int) labels;  // instruction index of each label
+    int reg_count;          // registers in use
+    const Type* return_type;
+
+    int break_label;
+    int continue_label;
+} BcState;
+
+static void error(BcState* state, SourcePos pos, const char* fmt, ...) {
+    if (state->err != NULL) {
+        return;
+    }
+
+    Error* result = utlarena_alloc(state->arena, sizeof(Error));
+    result->pos = pos;
+
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(result->msg, ERROR_MAX_LENGTH, fmt, ap);
+    va_end(ap);
+
+    state->err = result;
+}
+
+// 64-bit integers and pointers
+static inline int is_wide(const Type* type) {
+    return type->size == 8 && !is_float(type) && !is_large_type(type);
+}
+
+static inline int fits_imm(long long val) {
+    return val >= INT32_MIN && val <= INT32_MAX;
+}
+
+static int emit(BcState* state, BcOp op, int a, int b, int c, long long imm) {
+    assert(fits_imm(imm));
+    BcInsn insn = {
+        .op = op,
+        .a = a,
+        .b = b,
+        .c = c,
+        .imm = (int32_t)imm,
+    };
+    utlvector_push(&state->func->code, insn);
+    return state->func->code.size - 1;
+}
+
+static int new_reg(BcState* state) {
+    int reg = state->reg_count++;
+    if (state->reg_count > state->func->reg_count) {
+        state->func->reg_count = state->reg_count;
+    }
+    return reg;
+}
+
+static int new_label(BcState* state) {
+    int label = -1;
+    utlvector_push(&state->labels, label);
+    return state->labels.size - 1;
+}
+
+static void bind_label(BcState* state, int label) {
+    state->labels.data[label] = state->func->code.size;
+}
+
+static int add_const(BcState* state, uint64_t val) {
+    utlvector_push(&state->prog->consts, val);
+    return state->prog->consts.size - 1;
+}
+
+// Returns the constant holding the address of the symbol
+static int add_symbol_ref(BcState* state, Str name, int func) {
+    BcProgram* prog = state->prog;
+    for (size_t i = 0; i < prog->refs.size; i++) {
+        const BcSymbolRef* ref = &prog->refs.data[i];
+        if (ref->func == func && (func >= 0 || str_eql(ref->name, name))) {
+            return ref->const_index;
+        }
+    }
+
+    BcSymbolRef ref = {
+        .name = name,
+        .func = func,
+        .const_index = add_const(state, 0),
+    };
+    utlvector_push(&prog->refs, ref);
+    return ref.const_index;
+}
+
+static const char* add_string(BcState* state, Str s) {
+    char* result = utlarena_alloc(state->arena, s.len + 1);
+    memcpy(result, s.ptr, s.len);
+    result[s.len] = '\0';
+    return result;
+}
+
+static int get_func_index(BcState* state, const SymbolTableEntry* ste) {
+    for (int i = 0; i < state->func_count; i++) {
+        if ((const SymbolTableEntry*)state->func_stes[i] == ste) {
+            return i;
+        }
+    }
+    UNREACHABLE();
+}
+
+// Frame space for temporary structs, returns the offset below the frame
+// pointer
+static int alloc_frame_temp(BcState* state, const Type* type) {
+    int alignment = type->alignment > 0 ? type->alignment : 1;
+    int offset = state->func->frame_size + type->size;
+    offset += (alignment - offset % alignment) % alignment;
+    state->func->frame_size = offset;
+    return offset;
+}
+
+static void emit_load_imm(BcState* state, int dst, long long val) {
+    if (fits_imm(val)) {
+        emit(state, BC_LOADI, dst, 0, 0, val);
+    } else {
+        emit(state, BC_LOADK, dst, 0, 0, add_const(state, val));
+    }
+}
+
+static void materialize(BcState* state, BcAddr addr, int dst) {
+    if (addr.base != dst || addr.offset != 0) {
+        emit(state, BC_LEA, dst, addr.base, 0, addr.offset);
+    }
+}
+
+// Load the value if it's not a large type, else load the address
+static void emit_load(BcState* state, int dst, BcAddr addr, const Type* type) {
+    if (is_large_type(type)) {
+        materialize(state, addr, dst);
+        return;
+    }
+
+    BcOp op;
+    switch (type->size) {
+        case 8:
+            op = BC_LD64;
+            break;
+        case 4:
+            op = BC_LD32;
+            break;
+        case 2:
+            op = type->primitive_type == TYPE_I16 ? BC_LD16S : BC_LD16U;
+            break;
+        case 1:
+            op = type->primitive_type == TYPE_I8 ? BC_LD8S : BC_LD8U;
+            break;
+        default:
+            UNREACHABLE();
+    }
+    emit(state, op, dst, addr.base, 0, addr.offset);
+}
+
+static void emit_store(BcState* state, BcAddr addr, int src,
+                       const Type* type) {
+    if (is_large_type(type)) {
+        int dest = addr.base;
+        if (addr.offset != 0) {
+            dest = new_reg(state);
+            materialize(state, addr, dest);
+        }
+        emit(state, BC_COPY, dest, src, 0, type->size);
+        return;
+    }
+
+    BcOp op;
+    switch (type->size) {
+        case 8:
+            op = BC_ST64;
+            break;
+        case 4:
+            op = BC_ST32;
+            break;
+        case 2:
+            op = BC_ST16;
+            break;
+        case 1:
+            op = BC_ST8;
+            break;
+        default:
+            UNREACHABLE();
+    }
+    emit(state, op, addr.base, src, 0, addr.offset);
+}
+
+static void emit_int_to_float(BcState* state, int reg, const Type* from,
+                              const Type* to) {
+    int f64 = to->primitive_type == TYPE_F64;
+    BcOp op;
+    switch (from->primitive_type) {
+        case TYPE_U64:
+            op = f64 ? BC_U64TOF64 : BC_U64TOF32;
+            break;
+        case TYPE_U32:
+            op = f64 ? BC_U32TOF64 : BC_U32TOF32;
+            break;
+        case TYPE_I64:
+            op = f64 ? BC_I64TOF64 : BC_I64TOF32;
+            break;
+        default:
+            op = f64 ? BC_I32TOF64 : BC_I32TOF32;
+    }
+    emit(state, op, reg, reg, 0, 0);
+}
+
+static void emit_float_to_int(BcState* state, int reg, const Type* from,
+                              const Type* to) {
+    int f64 = from->primitive_type == TYPE_F64;
+    BcOp op;
+    switch (to->primitive_type) {
+        case TYPE_U64:
+            op = f64 ? BC_F64TOU64 : BC_F32TOU64;
+            break;
+        case TYPE_U32:
+        case TYPE_I64:
+            op = f64 ? BC_F64TOI64 : BC_F32TOI64;
+            break;
+        default:
+            op = f64 ? BC_F64TOI32 : BC_F32TOI32;
+    }
+    emit(state, op, reg, reg, 0, 0);
+}
+
+// Convert the value between arithmetic types and pointers, same as the
+// x86-64 backend
+static void emit_convert(BcState* state, int reg, const Type* from,
+                         const Type* to) {
+    if (is_float(to)) {
+        if (is_int(from)) {
+            emit_int_to_float(state, reg, from, to);
+        } else if (from->primitive_type != to->primitive_type) {
+            emit(state,
+                 to->primitive_type == TYPE_F64 ? BC_F32TOF64 : BC_F64TOF32,
+                 reg, reg, 0, 0);
+        }
+        return;
+    }
+
+    if (is_float(from)) {
+        emit_float_to_int(state, reg, from, to);
+        return;
+    }
+
+    if (!is_wide(to) || is_wide(from) || is_large_type(from)) {
+        return;
+    }
+
+    if (is_int(from) && is_signed(from->primitive_type)) {
+        emit(state, BC_SEXT32, reg, reg, 0, 0);
+    } else {
+        emit(state, BC_ZEXT32, reg, reg, 0, 0);
+    }
+}
+
+static void compile_stmt(BcState* state, NodeIndex node);
+static void compile_expr(BcState* state, NodeIndex node, int dst);
+static void compile_value(BcState* state, NodeIndex node, int dst);
+static BcAddr compile_addr(BcState* state, NodeIndex node, int dst);
+
+static inline const Type* type_of(BcState* state, NodeIndex node) {
+    return ast_type_info(state->ast, node).type;
+}
+
+static void emit_jump_if(BcState* state, int reg, const Type* type,
+                         int jump_if, int label) {
+    BcOp op;
+    if (is_wide(type)) {
+        op = jump_if ? BC_JNZ64 : BC_JZ64;
+    } else {
+        op = jump_if ? BC_JNZ32 : BC_JZ32;
+    }
+    emit(state, op, reg, 0, 0, label);
+}
+
+static void compile_cond(BcState* state, NodeIndex expr, int jump_if,
+                         int label) {
+    int reg = new_reg(state);
+    compile_value(state, expr, reg);
+    emit_jump_if(state, reg, type_of(state, expr), jump_if, label);
+    state->reg_count = reg;
+}
+
+static void compile_intlit(BcState* state, NodeIndex node, int dst) {
+    IntLitNode lit = ast_intlit(state->ast, node);
+    long long val = lit.val;
+    if (lit.data_type != TYPE_I64 && lit.data_type != TYPE_U64) {
+        val = (int)(unsigned int)val;
+    }
+    emit_load_imm(state, dst, val);
+}
+
+static void compile_floatlit(BcState* state, NodeIndex node, int dst) {
+    FloatLitNode lit = ast_floatlit(state->ast, node);
+    unsigned long long bits = get_float_bits(lit.val, lit.data_type);
+    if (lit.data_type == TYPE_F32) {
+        // only the low 32 bits are used
+        emit(state, BC_LOADI, dst, 0, 0, (int)(unsigned int)bits);
+    } else {
+        emit_load_imm(state, dst, (long long)bits);
+    }
+}
+
+static void compile_strlit(BcState* state, NodeIndex node, int dst) {
+    StrLitNode lit = ast_strlit(state->ast, node);
+    const char* s = add_string(state, lit.val);
+    emit(state, BC_LOADK, dst, 0, 0, add_const(state, (uintptr_t)s));
+}
+
+static void compile_logical_binop(BcState* state, NodeIndex node, int dst) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    int label = new_label(state);
+
+    compile_value(state, binop.left, dst);
+    emit_jump_if(state, dst, type_of(state, binop.left), binop.op == TK_LOR,
+                 label);
+    compile_value(state, binop.right, dst);
+
+    bind_label(state, label);
+}
+
+static void compile_binop_float(BcState* state, NodeIndex node, int dst) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    const Type* l_type = type_of(state, binop.left);
+    const Type* r_type = type_of(state, binop.right);
+    const Type* type = get_primitive_type(
+        implicit_type_convert(l_type->primitive_type, r_type->primitive_type));
+    int f64 = type->primitive_type == TYPE_F64;
+
+    compile_value(state, binop.left, dst);
+    emit_convert(state, dst, l_type, type);
+
+    int right = new_reg(state);
+    compile_value(state, binop.right, right);
+    emit_convert(state, right, r_type, type);
+
+    int l = dst;
+    int r = right;
+    BcOp op;
+    switch (binop.op) {
+        case TK_ADD:
+            op = f64 ? BC_ADDF64 : BC_ADDF32;
+            break;
+        case TK_SUB:
+            op = f64 ? BC_SUBF64 : BC_SUBF32;
+            break;
+        case TK_MUL:
+            op = f64 ? BC_MULF64 : BC_MULF32;
+            break;
+        case TK_DIV:
+            op = f64 ? BC_DIVF64 : BC_DIVF32;
+            break;
+        case TK_EQ:
+            op = f64 ? BC_EQF64 : BC_EQF32;
+            break;
+        case TK_NE:
+            op = f64 ? BC_NEF64 : BC_NEF32;
+            break;
+        case TK_LT:
+            op = f64 ? BC_LTF64 : BC_LTF32;
+            break;
+        case TK_LE:
+            op = f64 ? BC_LEF64 : BC_LEF32;
+            break;
+        case TK_GT:
+            op = f64 ? BC_LTF64 : BC_LTF32;
+            l = right;
+            r = dst;
+            break;
+        case TK_GE:
+            op = f64 ? BC_LEF64 : BC_LEF32;
+            l = right;
+            r = dst;
+            break;
+        default:
+            UNREACHABLE();
+    }
+    emit(state, op, dst, l, r, 0);
+
+    state->reg_count = right;
+}
+
+// Type the operands are converted to before the operation
+static const Type* get_binop_type(BcState* state, BinaryOpNode binop) {
+    const Type* l_type = type_of(state, binop.left);
+    const Type* r_type = type_of(state, binop.right);
+
+    if (is_bool(l_type)) {
+        return l_type;
+    }
+
+    if (binop.op == TK_ADD || binop.op == TK_SUB) {
+        if (is_array_ptr(l_type)) {
+            return l_type;
+        }
+        if (is_array_ptr(r_type)) {
+            return r_type;
+        }
+    }
+
+    int pri_ltype = is_ptr_like(l_type) ? TYPE_U64 : l_type->primitive_type;
+    int pri_rtype = is_ptr_like(r_type) ? TYPE_U64 : r_type->primitive_type;
+    return get_primitive_type(implicit_type_convert(pri_ltype, pri_rtype));
+}
+
+// The index of pointer arithmetic is extended to 64 bits
+static void emit_convert_operand(BcState* state, int reg, const Type* from,
+                                 const Type* to) {
+    if (is_array_ptr(to) && !is_array_ptr(from)) {
+        to = get_primitive_type(is_signed(from->primitive_type) ? TYPE_I64
+                                                                : TYPE_U64);
+    }
+    emit_convert(state, reg, from, to);
+}
+
+// Value of an integer literal after converting to type, returns 0 if the
+// node is not a literal
+static int get_const_operand(BcState* state, NodeIndex node, const Type* type,
+                             long long* val) {
+    if (ast_node_type(state->ast, node) != NODE_INTLIT) {
+        return 0;
+    }
+
+    IntLitNode lit = ast_intlit(state->ast, node);
+    *val = lit.val;
+    if (lit.data_type != TYPE_I64 && lit.data_type != TYPE_U64) {
+        if (is_signed(lit.data_type) || !is_wide(type)) {
+            *val = (int)(unsigned int)*val;
+        } else {
+            *val = (unsigned int)*val;
+        }
+    }
+    return 1;
+}
+
+static int get_elem_size(const Type* type) {
+    if (is_void(type->inner_type)) {
+        return 1;
+    }
+    assert(!type->inner_type->incomplete);
+    return type->inner_type->size;
+}
+
+static void compile_binop(BcState* state, NodeIndex node, int dst) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    if (binop.op == TK_COMMA) {
+        compile_stmt(state, binop.left);
+        compile_expr(state, binop.right, dst);
+        return;
+    }
+
+    if (binop.op == TK_LOR || binop.op == TK_LAND) {
+        compile_logical_binop(state, node, dst);
+        return;
+    }
+
+    const Type* l_type = type_of(state, binop.left);
+    const Type* r_type = type_of(state, binop.right);
+    if (is_float(l_type) || is_float(r_type)) {
+        compile_binop_float(state, node, dst);
+        return;
+    }
+
+    const Type* type = get_binop_type(state, binop);
+    int wide = is_wide(type);
+
+    compile_value(state, binop.left, dst);
+    emit_convert_operand(state, dst, l_type, type);
+
+    int l_ptr = is_array_ptr(l_type);
+    int r_ptr = is_array_ptr(r_type);
+    int is_add = binop.op == TK_ADD || binop.op == TK_SUB;
+
+    // Constant offsets
+    long long val;
+    if (is_add && !r_ptr && get_const_operand(state, binop.right, type, &val)) {
+        if (l_ptr) {
+            val *= get_elem_size(l_type);
+        }
+        if (binop.op == TK_SUB) {
+            val = -val;
+        }
+        if (fits_imm(val)) {
+            emit(state, wide ? BC_LEA : BC_ADDI32, dst, dst, 0, val);
+            return;
+        }
+    }
+
+    int right = new_reg(state);
+    compile_value(state, binop.right, right);
+    emit_convert_operand(state, right, r_type, type);
+
+    int signed_op = !is_bool(type) && !is_ptr_like(type) &&
+                    is_signed(type->primitive_type);
+    int l = dst;
+    int r = right;
+    BcOp op;
+    switch (binop.op) {
+        case TK_ADD:
+        case TK_SUB:
+            if (l_ptr || r_ptr) {
+                int size = get_elem_size(l_ptr ? l_type : r_type);
+                if (size != 1) {
+                    int index = l_ptr ? right : dst;
+                    emit(state, BC_MULI64, index, index, 0, size);
+                }
+                wide = 1;
+            }
+            if (binop.op == TK_ADD) {
+                op = wide ? BC_ADD64 : BC_ADD32;
+            } else {
+                op = wide ? BC_SUB64 : BC_SUB32;
+            }
+            break;
+
+        case TK_EQ:
+            op = wide ? BC_EQ64 : BC_EQ32;
+            break;
+        case TK_NE:
+            op = wide ? BC_NE64 : BC_NE32;
+            break;
+        case TK_LT:
+        case TK_GT:
+            if (signed_op) {
+                op = wide ? BC_LTS64 : BC_LTS32;
+            } else {
+                op = wide ? BC_LTU64 : BC_LTU32;
+            }
+            if (binop.op == TK_GT) {
+                l = right;
+                r = dst;
+            }
+            break;
+        case TK_LE:
+        case TK_GE:
+            if (signed_op) {
+                op = wide ? BC_LES64 : BC_LES32;
+            } else {
+                op = wide ? BC_LEU64 : BC_LEU32;
+            }
+            if (binop.op == TK_GE) {
+                l = right;
+                r = dst;
+            }
+            break;
+
+        case TK_MUL:
+            op = wide ? BC_MUL64 : BC_MUL32;
+            break;
+        case TK_DIV:
+            if (signed_op) {
+                op = wide ? BC_DIVS64 : BC_DIVS32;
+            } else {
+                op = wide ? BC_DIVU64 : BC_DIVU32;
+            }
+            break;
+        case TK_MOD:
+            if (signed_op) {
+                op = wide ? BC_MODS64 : BC_MODS32;
+            } else {
+                op = wide ? BC_MODU64 : BC_MODU32;
+            }
+            break;
+        case TK_SHL:
+            op = wide ? BC_SHL64 : BC_SHL32;
+            break;
+        case TK_SHR:
+            if (signed_op) {
+                op = wide ? BC_SHRS64 : BC_SHRS32;
+            } else {
+                op = wide ? BC_SHRU64 : BC_SHRU32;
+            }
+            break;
+        case TK_AND:
+            op = wide ? BC_AND64 : BC_AND32;
+            break;
+        case TK_XOR:
+            op = wide ? BC_XOR64 : BC_XOR32;
+            break;
+        case TK_OR:
+            op = wide ? BC_OR64 : BC_OR32;
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+    emit(state, op, dst, l, r, 0);
+
+    state->reg_count = right;
+}
+
+static void compile_unaryop(BcState* state, NodeIndex node, int dst) {
+    UnaryOpNode unaryop = ast_unaryop(state->ast, node);
+    if (unaryop.op == TK_AND) {
+        materialize(state, compile_addr(state, unaryop.node, dst), dst);
+        return;
+    }
+
+    compile_value(state, unaryop.node, dst);
+
+    const Type* type = type_of(state, unaryop.node);
+    int wide = is_wide(type);
+    switch (unaryop.op) {
+        case TK_ADD:
+        case TK_MUL:
+            break;
+
+        case TK_SUB:
+            if (is_float(type)) {
+                emit(state,
+                     type->primitive_type == TYPE_F64 ? BC_NEGF64 : BC_NEGF32,
+                     dst, dst, 0, 0);
+            } else {
+                emit(state, wide ? BC_NEG64 : BC_NEG32, dst, dst, 0, 0);
+            }
+            break;
+
+        case TK_NOT:
+            emit(state, wide ? BC_NOT64 : BC_NOT32, dst, dst, 0, 0);
+            break;
+
+        case TK_LNOT:
+            emit(state, wide ? BC_LNOT64 : BC_LNOT32, dst, dst, 0, 0);
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+static BcAddr var_addr(BcState* state, VarSymbolTableEntry* var, int dst) {
+    if (var->attr == SYM_ATTR_EXTERN) {
+        emit(state, BC_LOADK, dst, 0, 0,
+             add_symbol_ref(state, var->ident, -1));
+        return (BcAddr){dst, 0};
+    }
+
+    if (var->attr == SYM_ATTR_EXPORT || var->is_global) {
+        uintptr_t addr = (uintptr_t)(state->prog->globals + var->offset);
+        emit(state, BC_LOADK, dst, 0, 0, add_const(state, addr));
+        return (BcAddr){dst, 0};
+    }
+
+    if (var->is_arg) {
+        // Argument passed on the stack
+        return (BcAddr){0, var->offset + var->sym->arg_offset};
+    }
+
+    // Local variable
+    return (BcAddr){0, -var->offset};
+}
+
+static BcAddr compile_assign(BcState* state, NodeIndex node, int dst) {
+    AssignNode assign = ast_assign(state->ast, node);
+    const Type* l_type = type_of(state, assign.left);
+    BcAddr addr = compile_addr(state, assign.left, dst);
+
+    int right = new_reg(state);
+    compile_value(state, assign.right, right);
+    emit_convert(state, right, type_of(state, assign.right), l_type);
+    emit_store(state, addr, right, l_type);
+
+    state->reg_count = right;
+    return addr;
+}
+
+static BcAddr compile_field(BcState* state, NodeIndex node, int dst) {
+    FieldNode field = ast_field(state->ast, node);
+    const Type* l_type = type_of(state, field.node);
+
+    BcAddr addr;
+    if (l_type->type == METADATA_POINTER && l_type->pointer_level == 1) {
+        // member access through pointer
+        compile_value(state, field.node, dst);
+        addr = (BcAddr){dst, 0};
+        l_type = l_type->inner_type;
+    } else {
+        addr = compile_addr(state, field.node, dst);
+    }
+
+    const TypeSymbolTableEntry* type_ste = l_type->type_ste;
+    FieldSymbolTableEntry* ste = (FieldSymbolTableEntry*)symbol_table_find(
+        type_ste->name_space, field.ident, 1);
+    assert(ste != NULL && ste->type == SYM_FIELD);
+
+    addr.offset += ste->offset;
+    return addr;
+}
+
+static BcAddr compile_indexof(BcState* state, NodeIndex node, int dst) {
+    IndexOfNode idxof = ast_indexof(state->ast, node);
+    const Type* l_type = type_of(state, idxof.left);
+    const Type* r_type = type_of(state, idxof.right);
+    int elem_size = l_type->inner_type->size;
+
+    BcAddr addr;
+    if (l_type->array_size == 0) {
+        compile_value(state, idxof.left, dst);
+        addr = (BcAddr){dst, 0};
+    } else {
+        addr = compile_addr(state, idxof.left, dst);
+    }
+
+    const Type* index_type = get_primitive_type(
+        is_signed(r_type->primitive_type) ? TYPE_I64 : TYPE_U64);
+
+    long long val;
+    if (get_const_operand(state, idxof.right, index_type, &val) &&
+        fits_imm(addr.offset + val * elem_size)) {
+        addr.offset += val * elem_size;
+        return addr;
+    }
+
+    materialize(state, addr, dst);
+
+    int index = new_reg(state);
+    compile_value(state, idxof.right, index);
+    emit_convert(state, index, r_type, index_type);
+    if (elem_size != 1) {
+        emit(state, BC_MULI64, index, index, 0, elem_size);
+    }
+    emit(state, BC_ADD64, dst, dst, index, 0);
+
+    state->reg_count = index;
+    return (BcAddr){dst, 0};
+}
+
+// Address of a node with type_info.is_address
+static BcAddr compile_addr(BcState* state, NodeIndex node, int dst) {
+    switch (ast_node_type(state->ast, node)) {
+        case NODE_VAR: {
+            VarNode var = ast_var(state->ast, node);
+            if (var.ste->type == SYM_VAR) {
+                return var_addr(state, (VarSymbolTableEntry*)var.ste, dst);
+            }
+        } break;
+
+        case NODE_FIELD:
+            return compile_field(state, node, dst);
+
+        case NODE_INDEXOF:
+            return compile_indexof(state, node, dst);
+
+        case NODE_ASSIGN:
+            return compile_assign(state, node, dst);
+
+        case NODE_UNARYOP: {
+            UnaryOpNode unaryop = ast_unaryop(state->ast, node);
+            if (unaryop.op == TK_MUL) {
+                compile_value(state, unaryop.node, dst);
+                return (BcAddr){dst, 0};
+            }
+        } break;
+
+        case NODE_BINARYOP: {
+            BinaryOpNode binop = ast_binop(state->ast, node);
+            if (binop.op == TK_COMMA) {
+                compile_stmt(state, binop.left);
+                return compile_addr(state, binop.right, dst);
+            }
+        } break;
+
+        case NODE_HINT:
+            return compile_addr(state, ast_hint(state->ast, node).expr, dst);
+
+        default:
+            break;
+    }
+
+    compile_expr(state, node, dst);
+    return (BcAddr){dst, 0};
+}
+
+// Compute the value of the node, structs are kept by address
+static void compile_value(BcState* state, NodeIndex node, int dst) {
+    TypeInfo info = ast_type_info(state->ast, node);
+    if (info.is_address) {
+        BcAddr addr = compile_addr(state, node, dst);
+        emit_load(state, dst, addr, info.type);
+    } else {
+        compile_expr(state, node, dst);
+    }
+}
+
+// Check if the native call fits in the argument area of the interpreter
+static int add_call_sig(BcState* state, SourcePos pos, const Type** arg_types,
+                        int arg_count, const Type* return_type) {
+    SysVArgState arg_state;
+    sysv_init_args(&arg_state, return_type);
+    for (int i = 0; i < arg_count; i++) {
+        SysVArgLoc loc;
+        sysv_assign_arg(&arg_state, arg_types[i], &loc);
+    }
+    if (arg_state.stack_size > BC_MAX_NATIVE_STACK_ARGS * 8) {
+        error(state, pos, "too many arguments for a native call");
+    }
+
+    BcCallSig sig = {
+        .arg_count = arg_count,
+        .arg_types = arg_types,
+        .return_type = return_type,
+    };
+    utlvector_push(&state->prog->sigs, sig);
+    return state->prog->sigs.size - 1;
+}
+
+// Small integers are extended by the caller
+static void emit_extend_return(BcState* state, int reg,
+                               const Type* return_type) {
+    if (return_type->type != METADATA_PRIMITIVE) {
+        return;
+    }
+
+    switch (return_type->primitive_type) {
+        case TYPE_BOOL:
+        case TYPE_U8:
+            emit(state, BC_ZEXT8, reg, reg, 0, 0);
+            break;
+        case TYPE_I8:
+            emit(state, BC_SEXT8, reg, reg, 0, 0);
+            break;
+        case TYPE_U16:
+            emit(state, BC_ZEXT16, reg, reg, 0, 0);
+            break;
+        case TYPE_I16:
+            emit(state, BC_SEXT16, reg, reg, 0, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+static void compile_call(BcState* state, NodeIndex node, int dst) {
+    CallNode call = ast_call(state->ast, node);
+    const Type* func_type = type_of(state, call.node);
+    assert(func_type->type == METADATA_FUNC);
+    const FuncMetadata* func_data = &func_type->func_data;
+    const Type* return_type = func_data->return_type;
+
+    int arg_count = call.args.count;
+    NodeIndex* arg_nodes =
+        utlarena_alloc(state->arena, sizeof(NodeIndex) * (arg_count + 1));
+    const Type** arg_types =
+        utlarena_alloc(state->arena, sizeof(Type*) * (arg_count + 1));
+
+    // Both lists are in reverse order
+    for (int i = 0; i < arg_count; i++) {
+        arg_nodes[i] = call.args.nodes[arg_count - 1 - i];
+        arg_types[i] = type_of(state, arg_nodes[i]);
+        if (is_float(arg_types[i])) {
+            // default argument promotion
+            arg_types[i] = get_primitive_type(TYPE_F64);
+        }
+    }
+
+    int param_count = 0;
+    ArgList* param = func_data->args;
+    while (param) {
+        param_count++;
+        param = param->next;
+    }
+
+    int i = param_count - 1;
+    param = func_data->args;
+    while (param) {
+        arg_types[i--] = param->type;
+        param = param->next;
+    }
+
+    // Direct calls use the symbol
+    const FuncSymbolTableEntry* ste = NULL;
+    if (ast_node_type(state->ast, call.node) == NODE_VAR) {
+        ste = (FuncSymbolTableEntry*)ast_var(state->ast, call.node).ste;
+        if (ste->type != SYM_FUNC) {
+            ste = NULL;
+        }
+    }
+    int is_internal = ste && ste->node;
+
+    if (is_large_type(return_type)) {
+        // The callee copies the value to the temporary space
+        int offset = alloc_frame_temp(state, return_type);
+        emit(state, BC_LEA, dst, 0, 0, -offset);
+    }
+
+    int base = state->reg_count;
+    if (!is_internal) {
+        new_reg(state);  // function address
+    }
+    int first_arg = state->reg_count;
+    for (i = 0; i < arg_count; i++) {
+        new_reg(state);
+    }
+
+    for (i = 0; i < arg_count; i++) {
+        compile_value(state, arg_nodes[i], first_arg + i);
+        emit_convert(state, first_arg + i, type_of(state, arg_nodes[i]),
+                     arg_types[i]);
+    }
+
+    if (is_internal) {
+        emit(state, BC_CALL, dst, first_arg, arg_count,
+             get_func_index(state, (const SymbolTableEntry*)ste));
+    } else {
+        BcOp op;
+        if (ste) {
+            emit(state, BC_LOADK, base, 0, 0,
+                 add_symbol_ref(state, ste->ident, -1));
+            op = BC_CALLX;
+        } else {
+            compile_value(state, call.node, base);
+            op = BC_CALLI;
+        }
+        int sig = add_call_sig(state, ast_pos(state->ast, node), arg_types,
+                               arg_count, return_type);
+        emit(state, op, dst, base, arg_count, sig);
+    }
+
+    emit_extend_return(state, dst, return_type);
+
+    state->reg_count = base;
+}
+
+static void compile_print(BcState* state, NodeIndex node) {
+    PrintNode print_node = ast_print(state->ast, node);
+    int arg_count = print_node.args.count + 1;
+
+    const Type** arg_types =
+        utlarena_alloc(state->arena, sizeof(Type*) * arg_count);
+    arg_types[0] = get_string_type();
+
+    int base = new_reg(state);
+    for (int i = 0; i < arg_count; i++) {
+        new_reg(state);
+    }
+
+    const char* fmt =
+        add_string(state, ast_strlit(state->ast, print_node.fmt).val);
+    emit(state, BC_LOADK, base + 1, 0, 0, add_const(state, (uintptr_t)fmt));
+
+    for (int i = arg_count - 1; i > 0; i--) {
+        NodeIndex arg = print_node.args.nodes[arg_count - 1 - i];
+        const Type* type = type_of(state, arg);
+        arg_types[i] = type;
+        if (is_float(type)) {
+            // printf takes double
+            arg_types[i] = get_primitive_type(TYPE_F64);
+        }
+
+        compile_value(state, arg, base + 1 + i);
+        emit_convert(state, base + 1 + i, type, arg_types[i]);
+    }
+
+    emit(state, BC_LOADK, base, 0, 0,
+         add_symbol_ref(state, str("printf"), -1));
+    int sig = add_call_sig(state, ast_pos(state->ast, node), arg_types,
+                           arg_count, get_primitive_type(TYPE_I32));
+    emit(state, BC_CALLX, base, base, arg_count, sig);
+
+    state->reg_count = base;
+}
+
+static void compile_ret(BcState* state, NodeIndex node) {
+    ReturnNode ret = ast_ret(state->ast, node);
+    if (!ret.expr) {
+        emit(state, BC_RETV, 0, 0, 0, 0);
+        return;
+    }
+
+    int reg = new_reg(state);
+    compile_value(state, ret.expr, reg);
+    emit_convert(state, reg, type_of(state, ret.expr), state->return_type);
+
+    if (is_large_type(state->return_type)) {
+        emit(state, BC_RETC, reg, 0, 0, state->return_type->size);
+    } else {
+        emit(state, BC_RET, reg, 0, 0, 0);
+    }
+}
+
+static void compile_if(BcState* state, NodeIndex node) {
+    IfStatementNode if_node = ast_if(state->ast, node);
+    int else_label = new_label(state);
+    int end_label = new_label(state);
+
+    compile_cond(state, if_node.expr, 0, else_label);
+    compile_stmt(state, if_node.then_block);
+
+    if (if_node.else_block) {
+        emit(state, BC_JMP, 0, 0, 0, end_label);
+        bind_label(state, else_label);
+        compile_stmt(state, if_node.else_block);
+    } else {
+        bind_label(state, else_label);
+    }
+
+    bind_label(state, end_label);
+}
+
+static void compile_while(BcState* state, NodeIndex node) {
+    WhileNode while_node = ast_while(state->ast, node);
+    int loop_label = new_label(state);
+    int inc_label = new_label(state);
+    int cond_label = new_label(state);
+    int end_label = new_label(state);
+
+    emit(state, BC_JMP, 0, 0, 0, cond_label);
+    bind_label(state, loop_label);
+
+    int prev_break_label = state->break_label;
+    int prev_continue_label = state->continue_label;
+    state->break_label = end_label;
+    state->continue_label = inc_label;
+
+    compile_stmt(state, while_node.block);
+
+    state->break_label = prev_break_label;
+    state->continue_label = prev_continue_label;
+
+    bind_label(state, inc_label);
+    if (while_node.inc) {
+        compile_stmt(state, while_node.inc);
+    }
+
+    bind_label(state, cond_label);
+    compile_cond(state, while_node.expr, 1, loop_label);
+
+    bind_label(state, end_label);
+}
+
+static void compile_expr(BcState* state, NodeIndex node, int dst) {
+    switch (ast_node_type(state->ast, node)) {
+        case NODE_INTLIT:
+            compile_intlit(state, node, dst);
+            break;
+
+        case NODE_FLOATLIT:
+            compile_floatlit(state, node, dst);
+            break;
+
+        case NODE_STRLIT:
+            compile_strlit(state, node, dst);
+            break;
+
+        case NODE_BINARYOP:
+            compile_binop(state, node, dst);
+            break;
+
+        case NODE_UNARYOP:
+            compile_unaryop(state, node, dst);
+            break;
+
+        case NODE_VAR: {
+            VarNode var = ast_var(state->ast, node);
+            if (var.ste->type == SYM_FUNC) {
+                // Function pointer
+                int func = -1;
+                if (((FuncSymbolTableEntry*)var.ste)->node) {
+                    func = get_func_index(state, var.ste);
+                }
+                emit(state, BC_LOADK, dst, 0, 0,
+                     add_symbol_ref(state, var.ste->ident, func));
+            } else {
+                materialize(state, compile_addr(state, node, dst), dst);
+            }
+        } break;
+
+        case NODE_ASSIGN:
+        case NODE_FIELD:
+        case NODE_INDEXOF:
+            materialize(state, compile_addr(state, node, dst), dst);
+            break;
+
+        case NODE_CALL:
+            compile_call(state, node, dst);
+            break;
+
+        case NODE_CAST: {
+            CastNode cast = ast_cast(state->ast, node);
+            compile_value(state, cast.expr, dst);
+            emit_convert(state, dst, type_of(state, cast.expr), cast.data_type);
+        } break;
+
+        case NODE_HINT:
+            compile_expr(state, ast_hint(state->ast, node).expr, dst);
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+static void compile_stmt(BcState* state, NodeIndex node) {
+    int reg_count = state->reg_count;
+
+    switch (ast_node_type(state->ast, node)) {
+        case NODE_STMTS: {
+            ASTNodeList stmts = ast_stmts(state->ast, node).stmts;
+            for (int i = 0; i < stmts.count; i++) {
+                compile_stmt(state, stmts.nodes[i]);
+            }
+        } break;
+
+        case NODE_IF:
+            compile_if(state, node);
+            break;
+
+        case NODE_WHILE:
+            compile_while(state, node);
+            break;
+
+        case NODE_GOTO: {
+            GotoNode goto_node = ast_goto(state->ast, node);
+            int label = goto_node.op == TK_BREAK ? state->break_label
+                                                 : state->continue_label;
+            emit(state, BC_JMP, 0, 0, 0, label);
+        } break;
+
+        case NODE_RET:
+            compile_ret(state, node);
+            break;
+
+        case NODE_PRINT:
+            compile_print(state, node);
+            break;
+
+        case NODE_ASM:
+            error(state, ast_pos(state->ast, node),
+                  "asm statements are not supported by the interpreter");
+            break;
+
+        default:
+            compile_expr(state, node, new_reg(state));
+    }
+
+    state->reg_count = reg_count;
+}
+
+// Store the arguments to the same places as the x86-64 backend
+static void compile_params(BcState* state, const FuncMetadata* func_data,
+                           const SymbolTable* func_sym) {
+    int param_count = 0;
+    ArgList* arg = func_data->args;
+    while (arg) {
+        param_count++;
+        arg = arg->next;
+    }
+
+    const Type** params =
+        utlarena_alloc(state->arena, sizeof(Type*) * (param_count + 1));
+    int i = param_count - 1;
+    arg = func_data->args;
+    while (arg) {
+        params[i--] = arg->type;
+        arg = arg->next;
+    }
+
+    state->func->param_count = param_count;
+    state->func->param_types = params;
+    state->func->has_va_args = func_data->has_va_args;
+
+    SysVArgState arg_state;
+    sysv_init_args(&arg_state, func_data->return_type);
+    int spill_size = arg_state.gpr_count * REGISTER_SIZE;
+
+    state->reg_count = 1 + param_count;
+    state->func->reg_count = state->reg_count;
+
+    for (i = 0; i < param_count; i++) {
+        SysVArgLoc loc;
+        sysv_assign_arg(&arg_state, params[i], &loc);
+
+        BcAddr addr;
+        if (loc.eightbyte_count > 0) {
+            spill_size += loc.eightbyte_count * REGISTER_SIZE;
+            addr = (BcAddr){0, -(func_sym->reg_arg_offset + spill_size)};
+        } else {
+            addr = (BcAddr){0, func_sym->arg_offset + loc.stack_offset};
+        }
+
+        if (is_large_type(params[i])) {
+            emit_store(state, addr, 1 + i, params[i]);
+        } else {
+            emit(state, BC_ST64, addr.base, 1 + i, 0, addr.offset);
+        }
+    }
+}
+
+static void compile_func(BcState* state, BcFunc* func,
+                         const FuncMetadata* func_data, NodeIndex body,
+                         const SymbolTable* func_sym,
+                         const Type* return_type) {
+    state->func = func;
+    state->return_type = return_type;
+    state->break_label = -1;
+    state->continue_label = -1;
+    utlvector_clear(&state->labels);
+
+    func->return_type = return_type;
+    func->frame_size = *func_sym->stack_size;
+    func->arg_size = func_sym->arg_offset + func_sym->arg_size;
+    func->reg_count = 1;
+    state->reg_count = 1;
+
+    if (func_data) {
+        compile_params(state, func_data, func_sym);
+    }
+
+    compile_stmt(state, body);
+    emit(state, BC_RETV, 0, 0, 0, 0);
+
+    for (size_t i = 0; i < func->code.size; i++) {
+        BcInsn* insn = &func->code.data[i];
+        switch (insn->op) {
+            case BC_JMP:
+            case BC_JZ32:
+            case BC_JNZ32:
+            case BC_JZ64:
+            case BC_JNZ64:
+                insn->imm = state->labels.data[insn->imm];
+                break;
+            default:
+                break;
+        }
+    }
+
+    func->frame_size += (16 - func->frame_size % 16) % 16;
+    func->arg_size += (16 - func->arg_size % 16) % 16;
+
+    if (func->reg_count > BC_MAX_REG_COUNT) {
+        error(state, ast_pos(state->ast, body),
+              "function is too large for the interpreter");
+    }
+}
+
+static void write_value(unsigned char* p, unsigned long long val, int size) {
+    for (int i = 0; i < size; i++) {
+        p[i] = (val >> (i * 8)) & 0xFF;
+    }
+}
+
+static void init_global_var(BcState* state, VarSymbolTableEntry* var) {
+    unsigned char* p = state->prog->globals + var->offset;
+    int size = var->data_type->size;
+
+    switch (ast_node_type(state->ast, var->init_val)) {
+        case NODE_FLOATLIT: {
+            FloatLitNode floatlit = ast_floatlit(state->ast, var->init_val);
+            write_value(p, get_float_bits(floatlit.val, floatlit.data_type),
+                        size);
+        } break;
+        case NODE_INTLIT: {
+            IntLitNode intlit = ast_intlit(state->ast, var->init_val);
+            if (is_float(var->data_type)) {
+                double val = intlit.data_type == TYPE_U64
+                                 ? (double)(unsigned long long)intlit.val
+                                 : (double)intlit.val;
+                PrimitiveType type = var->data_type->primitive_type;
+                write_value(p, get_float_bits(val, type), size);
+            } else {
+                write_value(p, intlit.val, size);
+            }
+        } break;
+        case NODE_STRLIT: {
+            StrLitNode strlit = ast_strlit(state->ast, var->init_val);
+            write_value(p, (uintptr_t)add_string(state, strlit.val), size);
+        } break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+Error* bytecode_compile(BcProgram* prog, UtlArenaAllocator* arena,
+                        const AST* ast, NodeIndex node, SymbolTable* sym,
+                        Str entry_sym) {
+    *prog = (BcProgram){
+        .funcs = utlvector_init(&never_fail_allocator),
+        .consts = utlvector_init(&never_fail_allocator),
+        .sigs = utlvector_init(&never_fail_allocator),
+        .refs = utlvector_init(&never_fail_allocator),
+    };
+
+    BcState state = {
+        .prog = prog,
+        .arena = arena,
+        .ast = ast,
+        .labels = utlvector_init(&never_fail_allocator),
+    };
+
+    // Global variables
+    size_t globals_size = sym->offset > 0 ? sym->offset : 1;
+    prog->globals =
+        never_fail_allocator.alloc(&never_fail_allocator, globals_size);
+    memset(prog->globals, 0, globals_size);
+
+    int func_count = 0;
+    SymbolTableEntry* curr = sym->ste;
+    while (curr) {
+        if (curr->type == SYM_VAR) {
+            VarSymbolTableEntry* var = (VarSymbolTableEntry*)curr;
+            if (var->attr != SYM_ATTR_EXTERN && var->init_val) {
+                init_global_var(&state, var);
+            }
+        } else if (curr->type == SYM_FUNC &&
+                   ((FuncSymbolTableEntry*)curr)->node) {
+            func_count++;
+        }
+        curr = curr->next;
+    }
+
+    int has_user_defined_entry = (symbol_table_find(sym, entry_sym, 1) != NULL);
+
+    // Functions are added first so they keep their addresses
+    state.func_stes = utlarena_alloc(
+        arena, sizeof(FuncSymbolTableEntry*) * (func_count + 1));
+    curr = sym->ste;
+    while (curr) {
+        if (curr->type == SYM_FUNC && ((FuncSymbolTableEntry*)curr)->node) {
+            state.func_stes[state.func_count++] = (FuncSymbolTableEntry*)curr;
+        }
+        curr = curr->next;
+    }
+
+    for (int i = 0; i < func_count + !has_user_defined_entry; i++) {
+        BcFunc func = {
+            .name = i < func_count ? state.func_stes[i]->ident : entry_sym,
+            .code = utlvector_init(&never_fail_allocator),
+        };
+        utlvector_push(&prog->funcs, func);
+    }
+
+    for (int i = 0; i < func_count; i++) {
+        FuncSymbolTableEntry* func = state.func_stes[i];
+        compile_func(&state, &prog->funcs.data[i], &func->func_data,
+                     func->node, func->func_sym, func->func_data.return_type);
+        if (str_eql(func->ident, entry_sym)) {
+            prog->entry = i;
+        }
+    }
+
+    // entry function
+    if (!has_user_defined_entry) {
+        compile_func(&state, &prog->funcs.data[func_count], NULL, node, sym,
+                     get_primitive_type(TYPE_U8));
+        prog->entry = func_count;
+    }
+
+    utlvector_deinit(&state.labels);
+    return state.err;
+}
+
+void bytecode_free(BcProgram* prog) {
+    for (size_t i = 0; i < prog->funcs.size; i++) {
+        utlvector_deinit(&prog->funcs.data[i].code);
+    }
+    utlvector_deinit(&prog->funcs);
+    utlvector_deinit(&prog->consts);
+    utlvector_deinit(&prog->sigs);
+    utlvector_deinit(&prog->refs);
+    never_fail_allocator.free(&never_fail_allocator, prog->globals);
+}
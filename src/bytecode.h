@@ -0,0 +1,198 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ast.h"
+#include "utl/utlvector.h"
+
+// Register-based bytecode for the interpreter. It is lowered from the typed
+// AST with the x86-64 target layout, so memory is shared with native code.
+
+typedef union BcValue {
+    int64_t i;
+    uint64_t u;
+    double f64;
+    float f32;
+    void* p;
+} BcValue;
+
+/*
+ * a, b, c are registers and imm is an immediate. R0 holds the frame pointer
+ * and the arguments are passed in R1..Rn. 32-bit operations ignore the upper
+ * bits of the operands and zero-extend the result.
+ */
+#define BC_OPS(X)                                                      \
+    X(MOV)    /* a = b */                                               \
+    X(LOADI)  /* a = imm */                                             \
+    X(LOADK)  /* a = consts[imm] */                                     \
+    X(LEA)    /* a = b + imm */                                         \
+    X(LD8S)   /* a = *(b + imm) */                                      \
+    X(LD8U)                                                            \
+    X(LD16S)                                                           \
+    X(LD16U)                                                           \
+    X(LD32)                                                            \
+    X(LD64)                                                            \
+    X(ST8) /* *(a + imm) = b */                                         \
+    X(ST16)                                                            \
+    X(ST32)                                                            \
+    X(ST64)                                                            \
+    X(COPY) /* copy imm bytes from b to a */                            \
+    X(ADD32)                                                           \
+    X(SUB32)                                                           \
+    X(MUL32)                                                           \
+    X(DIVS32)                                                          \
+    X(DIVU32)                                                          \
+    X(MODS32)                                                          \
+    X(MODU32)                                                          \
+    X(SHL32)                                                           \
+    X(SHRS32)                                                          \
+    X(SHRU32)                                                          \
+    X(AND32)                                                           \
+    X(OR32)                                                            \
+    X(XOR32)                                                           \
+    X(ADDI32) /* a = b + imm */                                         \
+    X(NEG32)                                                           \
+    X(NOT32)                                                           \
+    X(LNOT32)                                                          \
+    X(EQ32)                                                            \
+    X(NE32)                                                            \
+    X(LTS32)                                                           \
+    X(LES32)                                                           \
+    X(LTU32)                                                           \
+    X(LEU32)                                                           \
+    X(ADD64)                                                           \
+    X(SUB64)                                                           \
+    X(MUL64)                                                           \
+    X(DIVS64)                                                          \
+    X(DIVU64)                                                          \
+    X(MODS64)                                                          \
+    X(MODU64)                                                          \
+    X(SHL64)                                                           \
+    X(SHRS64)                                                          \
+    X(SHRU64)                                                          \
+    X(AND64)                                                           \
+    X(OR64)                                                            \
+    X(XOR64)                                                           \
+    X(MULI64) /* a = b * imm */                                         \
+    X(NEG64)                                                           \
+    X(NOT64)                                                           \
+    X(LNOT64)                                                          \
+    X(EQ64)                                                            \
+    X(NE64)                                                            \
+    X(LTS64)                                                           \
+    X(LES64)                                                           \
+    X(LTU64)                                                           \
+    X(LEU64)                                                           \
+    X(ADDF32)                                                          \
+    X(SUBF32)                                                          \
+    X(MULF32)                                                          \
+    X(DIVF32)                                                          \
+    X(NEGF32)                                                          \
+    X(EQF32)                                                           \
+    X(NEF32)                                                           \
+    X(LTF32)                                                           \
+    X(LEF32)                                                           \
+    X(ADDF64)                                                          \
+    X(SUBF64)                                                          \
+    X(MULF64)                                                          \
+    X(DIVF64)                                                          \
+    X(NEGF64)                                                          \
+    X(EQF64)                                                           \
+    X(NEF64)                                                           \
+    X(LTF64)                                                           \
+    X(LEF64)                                                           \
+    X(SEXT8)                                                           \
+    X(ZEXT8)                                                           \
+    X(SEXT16)                                                          \
+    X(ZEXT16)                                                          \
+    X(SEXT32)                                                          \
+    X(ZEXT32)                                                          \
+    X(I32TOF32)                                                        \
+    X(U32TOF32)                                                        \
+    X(I64TOF32)                                                        \
+    X(U64TOF32)                                                        \
+    X(I32TOF64)                                                        \
+    X(U32TOF64)                                                        \
+    X(I64TOF64)                                                        \
+    X(U64TOF64)                                                        \
+    X(F32TOI32)                                                        \
+    X(F32TOI64)                                                        \
+    X(F32TOU64)                                                        \
+    X(F64TOI32)                                                        \
+    X(F64TOI64)                                                        \
+    X(F64TOU64)                                                        \
+    X(F32TOF64)                                                        \
+    X(F64TOF32)                                                        \
+    X(JMP) /* goto imm */                                               \
+    X(JZ32)                                                            \
+    X(JNZ32)                                                           \
+    X(JZ64)                                                            \
+    X(JNZ64)                                                           \
+    X(CALL)  /* a = funcs[imm](b, ..., b + c - 1) */                    \
+    X(CALLI) /* a = b(b + 1, ..., b + c), signature in sigs[imm] */     \
+    X(CALLX) /* same as CALLI, but b is always a native function */     \
+    X(RET)   /* return a */                                             \
+    X(RETC)  /* return a copy of the imm bytes at a */                  \
+    X(RETV)
+
+typedef enum BcOp {
+#define X(name) BC_##name,
+    BC_OPS(X)
+#undef X
+        BC_OP_COUNT,
+} BcOp;
+
+typedef struct BcInsn {
+    uint16_t op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+    int32_t imm;
+} BcInsn;
+
+#define BC_MAX_REG_COUNT 65536
+
+// Stack arguments of native calls, in 8-byte slots
+#define BC_MAX_NATIVE_STACK_ARGS 16
+
+typedef struct BcFunc {
+    Str name;
+    UtlVector(BcInsn) code;
+    int reg_count;
+    int frame_size;  // bytes below the frame pointer
+    int arg_size;    // bytes above the frame pointer, up to the last argument
+    int param_count;
+    const Type** param_types;  // in declaration order
+    const Type* return_type;
+    int has_va_args;
+} BcFunc;
+
+// Argument types of a native call after the conversions
+typedef struct BcCallSig {
+    int arg_count;
+    const Type** arg_types;
+    const Type* return_type;
+} BcCallSig;
+
+// A constant that is filled in with an address when the program is loaded
+typedef struct BcSymbolRef {
+    Str name;   // extern symbol
+    int func;   // index in funcs, or -1 for extern symbols
+    int const_index;
+} BcSymbolRef;
+
+typedef struct BcProgram {
+    UtlVector(BcFunc) funcs;
+    UtlVector(uint64_t) consts;
+    UtlVector(BcCallSig) sigs;
+    UtlVector(BcSymbolRef) refs;
+    unsigned char* globals;
+    int entry;  // index in funcs
+} BcProgram;
+
+Error* bytecode_compile(BcProgram* prog, UtlArenaAllocator* arena,
+                        const AST* ast, NodeIndex node, SymbolTable* sym,
+                        Str entry_sym);
+
+void bytecode_free(BcProgram* prog);
+
+#endif
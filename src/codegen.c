@@ -1,46 +1,29 @@
 #include "codegen.h"
 
 #include <stdlib.h>
-
-#ifndef NDEBUG
-
-#define GEN(out, ...)                                   \
-    do {                                                \
-        fprintf(out, __VA_ARGS__);                      \
-        fprintf(out, " # %s:%d\n", __func__, __LINE__); \
-    } while (0)
-
-#else
-
-#define GEN(out, ...)              \
-    do {                           \
-        fprintf(out, __VA_ARGS__); \
-        fprintf(out, "\n");        \
-    } while (0)
-
-#endif
-
-#define genf(...)                         \
-    do {                                  \
-        if (state->out != NULL) {         \
-            GEN(state->out, __VA_ARGS__); \
-        }                                 \
-    } while (0)
-
-#ifdef _WIN32
-#define OS_SYM_PREFIX "_"
-#else
-#define OS_SYM_PREFIX ""
-#endif
+#include <string.h>
 
 #define NO_MEMCPY
 #define INLINE_COPY_LIMIT 16
 
-static inline int add_label(CodegenState* state) {
-    return state->label_count++;
+// Registers for CALLCONV_REGPARM arguments
+static inline const char* get_reg_arg(int index) {
+    switch (index) {
+        case 0:
+            return "%eax";
+        case 1:
+            return "%edx";
+        case 2:
+            return "%ecx";
+        default:
+            UNREACHABLE();
+    }
 }
 
-static int add_data(CodegenState* state, Str str) {
+// Functions with at most this many AST nodes are inlined without @inline
+#define INLINE_NODE_LIMIT 24
+
+int add_data(CodegenState* state, Str str) {
     for (int i = 0; i < state->data_count; i++) {
         if (str_eql(str, state->data[i])) {
             return i;
@@ -50,27 +33,89 @@ static int add_data(CodegenState* state, Str str) {
     return state->data_count++;
 }
 
-static void emit_node(CodegenState* state, ASTNode* node);
+unsigned long long get_float_bits(double val, PrimitiveType type) {
+    if (type == TYPE_F32) {
+        float f = (float)val;
+        unsigned int bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+
+    unsigned long long bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+
+int add_float_data(CodegenState* state, double val, PrimitiveType type) {
+    FloatData data = {
+        .bits = get_float_bits(val, type),
+        .size = get_primitive_type(type)->size,
+    };
+
+    for (size_t i = 0; i < state->float_data.size; i++) {
+        if (state->float_data.data[i].bits == data.bits &&
+            state->float_data.data[i].size == data.size) {
+            return i;
+        }
+    }
+    utlvector_push(&state->float_data, data);
+    return state->float_data.size - 1;
+}
+
+// Functions expanded inline keep their floating-point return value in XMM0
+// instead of the x87 stack
+static inline int in_inline_func(CodegenState* state) {
+    return state->inline_depth > 1;
+}
+
+static void emit_node(CodegenState* state, NodeIndex node);
 
-static inline void emit_stmts(CodegenState* state, StatementListNode* stmts) {
-    ASTNodeList* iter = stmts->stmts;
-    while (iter) {
-        emit_node(state, iter->node);
-        iter = iter->next;
+static inline void emit_stmts(CodegenState* state, NodeIndex node) {
+    StatementListNode stmts = ast_stmts(state->ast, node);
+    for (int i = 0; i < stmts.stmts.count; i++) {
+        emit_node(state, stmts.stmts.nodes[i]);
     }
 }
 
-static inline void emit_intlit(CodegenState* state, IntLitNode* lit) {
-    genf("    movl $%d, %%eax", lit->val);
+static inline void emit_intlit(CodegenState* state, NodeIndex node) {
+    IntLitNode lit = ast_intlit(state->ast, node);
+    unsigned long long val = lit.val;
+    genf("    movl $%d, %%eax", (int)(unsigned int)val);
+    if (lit.data_type == TYPE_I64 || lit.data_type == TYPE_U64) {
+        genf("    movl $%d, %%edx", (int)(unsigned int)(val >> 32));
+    }
+}
+
+static inline void emit_floatlit(CodegenState* state, NodeIndex node) {
+    FloatLitNode lit = ast_floatlit(state->ast, node);
+    const Type* type = get_primitive_type(lit.data_type);
+    if (get_float_bits(lit.val, lit.data_type) == 0) {
+        genf("    xorps %%xmm0, %%xmm0");
+    } else {
+        genf("    mov%s .LF%d, %%xmm0", float_suffix(type),
+             add_float_data(state, lit.val, lit.data_type));
+    }
 }
 
-static inline void emit_strlit(CodegenState* state, StrLitNode* lit) {
-    genf("    movl $.LC%d, %%eax", add_data(state, lit->val));
+static inline void emit_strlit(CodegenState* state, NodeIndex node) {
+    StrLitNode lit = ast_strlit(state->ast, node);
+    genf("    movl $.LC%d, %%eax", add_data(state, lit.val));
 }
 
 // load the value into register if size is 4 bytes, 2 bytes, or 1 byte,
 // else do nothing.
 static void emit_load_address(CodegenState* state, const Type* type) {
+    if (is_float(type)) {
+        genf("    mov%s (%%eax), %%xmm0", float_suffix(type));
+        return;
+    }
+
+    if (is_int64(type)) {
+        genf("    movl 4(%%eax), %%edx");
+        genf("    movl (%%eax), %%eax");
+        return;
+    }
+
     switch (type->size) {
         case 4:
             genf("    movl (%%eax), %%eax");
@@ -99,27 +144,426 @@ static void emit_load_address(CodegenState* state, const Type* type) {
     }
 }
 
-static void emit_binop(CodegenState* state, BinaryOpNode* binop) {
-    emit_node(state, binop->left);
+static void emit_int_to_float(CodegenState* state, const Type* from,
+                              const Type* to) {
+    const char* suffix = float_suffix(to);
+
+    if (is_int64(from)) {
+        // SSE2 can't convert 64-bit integers in 32-bit mode, use the x87 FPU
+        genf("    pushl %%edx");
+        genf("    pushl %%eax");
+        genf("    fildq (%%esp)");
+        if (from->primitive_type == TYPE_U64) {
+            int label = add_label(state);
+            genf("    testl %%edx, %%edx");
+            genf("    jns .L%d", label);
+            genf("    fadds .LF%d",
+                 add_float_data(state, 18446744073709551616.0, TYPE_F32));
+            genf(".L%d:", label);
+        }
+        genf(to->primitive_type == TYPE_F32 ? "    fstps (%%esp)"
+                                            : "    fstpl (%%esp)");
+        genf("    mov%s (%%esp), %%xmm0", suffix);
+        genf("    addl $8, %%esp");
+    } else if (from->primitive_type == TYPE_U32) {
+        int label = add_label(state);
+        genf("    cvtsi2sd %%eax, %%xmm0");
+        genf("    testl %%eax, %%eax");
+        genf("    jns .L%d", label);
+        genf("    addsd .LF%d, %%xmm0",
+             add_float_data(state, 4294967296.0, TYPE_F64));
+        genf(".L%d:", label);
+        if (to->primitive_type == TYPE_F32) {
+            genf("    cvtsd2ss %%xmm0, %%xmm0");
+        }
+    } else {
+        genf("    cvtsi2%s %%eax, %%xmm0", suffix);
+    }
+}
+
+static void emit_float_to_int(CodegenState* state, const Type* from,
+                              const Type* to) {
+    const char* suffix = float_suffix(from);
+
+    // Unsigned values with the top bit set don't fit in the signed conversion,
+    // they are biased down first and the top bit is put back in ECX.
+    PrimitiveType to_type = to->primitive_type;
+    if (to_type == TYPE_U32 || to_type == TYPE_U64) {
+        double bias =
+            to_type == TYPE_U32 ? 2147483648.0 : 9223372036854775808.0;
+        int bias_data = add_float_data(state, bias, from->primitive_type);
+        int label = add_label(state);
+
+        genf("    xorl %%ecx, %%ecx");
+        genf("    ucomi%s .LF%d, %%xmm0", suffix, bias_data);
+        genf("    jb .L%d", label);
+        genf("    sub%s .LF%d, %%xmm0", suffix, bias_data);
+        genf("    movl $0x80000000, %%ecx");
+        genf(".L%d:", label);
+    }
+
+    if (is_int64(to)) {
+        // SSE2 can't convert 64-bit integers in 32-bit mode, use the x87 FPU
+        // with truncation
+        genf("    subl $12, %%esp");
+        genf("    mov%s %%xmm0, (%%esp)", suffix);
+        genf(from->primitive_type == TYPE_F32 ? "    flds (%%esp)"
+                                              : "    fldl (%%esp)");
+        genf("    fnstcw 8(%%esp)");
+        genf("    movzwl 8(%%esp), %%eax");
+        genf("    orl $0xc00, %%eax");
+        genf("    movw %%ax, 10(%%esp)");
+        genf("    fldcw 10(%%esp)");
+        genf("    fistpq (%%esp)");
+        genf("    fldcw 8(%%esp)");
+        genf("    movl (%%esp), %%eax");
+        genf("    movl 4(%%esp), %%edx");
+        genf("    addl $12, %%esp");
+    } else {
+        genf("    cvtt%s2si %%xmm0, %%eax", suffix);
+    }
+
+    if (to_type == TYPE_U32) {
+        genf("    xorl %%ecx, %%eax");
+    } else if (to_type == TYPE_U64) {
+        genf("    xorl %%ecx, %%edx");
+    }
+}
 
-    if (binop->op == TK_COMMA) {
-        emit_node(state, binop->right);
+// Convert the value between arithmetic types, the value is in EAX, EDX:EAX for
+// 64-bit integers, or XMM0 for floating-point numbers.
+static void emit_convert(CodegenState* state, const Type* from,
+                         const Type* to) {
+    if (is_float(to)) {
+        if (is_int(from)) {
+            emit_int_to_float(state, from, to);
+        } else if (from->primitive_type != to->primitive_type) {
+            if (to->primitive_type == TYPE_F64) {
+                genf("    cvtss2sd %%xmm0, %%xmm0");
+            } else {
+                genf("    cvtsd2ss %%xmm0, %%xmm0");
+            }
+        }
+        return;
+    }
+
+    if (is_float(from)) {
+        emit_float_to_int(state, from, to);
         return;
     }
 
-    const TypedASTNode* l_node = as_typed_ast(binop->left);
-    const Type* l_type = &l_node->type_info.type;
-    const TypedASTNode* r_node = as_typed_ast(binop->right);
-    const Type* r_type = &r_node->type_info.type;
+    if (!is_int64(to) || is_int64(from)) {
+        return;
+    }
 
-    if (l_node->type_info.is_address) {
+    if (is_int(from) && is_signed(from->primitive_type)) {
+        genf("    cdq");
+    } else {
+        genf("    xorl %%edx, %%edx");
+    }
+}
+
+// Push the floating-point value in XMM0
+static inline void emit_push_float(CodegenState* state, const Type* type) {
+    genf("    subl $%d, %%esp", type->size);
+    genf("    mov%s %%xmm0, (%%esp)", float_suffix(type));
+}
+
+static inline int is_float_binop(const AST* ast, BinaryOpNode binop) {
+    const Type* l_type = ast_type_info(ast, binop.left).type;
+    const Type* r_type = ast_type_info(ast, binop.right).type;
+    return is_float(l_type) || is_float(r_type);
+}
+
+static void emit_binop_float(CodegenState* state, NodeIndex node) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    TypeInfo l_info = ast_type_info(state->ast, binop.left);
+    const Type* l_type = l_info.type;
+    TypeInfo r_info = ast_type_info(state->ast, binop.right);
+    const Type* r_type = r_info.type;
+
+    const Type* type = get_primitive_type(
+        implicit_type_convert(l_type->primitive_type, r_type->primitive_type));
+    const char* suffix = float_suffix(type);
+
+    emit_node(state, binop.left);
+    if (l_info.is_address) {
+        emit_load_address(state, l_type);
+    }
+    emit_convert(state, l_type, type);
+    emit_push_float(state, type);
+
+    emit_node(state, binop.right);
+    if (r_info.is_address) {
+        emit_load_address(state, r_type);
+    }
+    emit_convert(state, r_type, type);
+
+    // left = XMM0, right = XMM1
+    genf("    movaps %%xmm0, %%xmm1");
+    genf("    mov%s (%%esp), %%xmm0", suffix);
+    genf("    addl $%d, %%esp", type->size);
+
+    switch (binop.op) {
+        case TK_ADD:
+            genf("    add%s %%xmm1, %%xmm0", suffix);
+            break;
+
+        case TK_SUB:
+            genf("    sub%s %%xmm1, %%xmm0", suffix);
+            break;
+
+        case TK_MUL:
+            genf("    mul%s %%xmm1, %%xmm0", suffix);
+            break;
+
+        case TK_DIV:
+            genf("    div%s %%xmm1, %%xmm0", suffix);
+            break;
+
+        // Unordered compares set ZF, PF and CF
+        case TK_EQ:
+            genf("    ucomi%s %%xmm1, %%xmm0", suffix);
+            genf("    sete %%al");
+            genf("    setnp %%cl");
+            genf("    andb %%cl, %%al");
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        case TK_NE:
+            genf("    ucomi%s %%xmm1, %%xmm0", suffix);
+            genf("    setne %%al");
+            genf("    setp %%cl");
+            genf("    orb %%cl, %%al");
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        case TK_GT:
+        case TK_GE:
+            genf("    ucomi%s %%xmm1, %%xmm0", suffix);
+            genf(binop.op == TK_GT ? "    seta %%al" : "    setae %%al");
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        case TK_LT:
+        case TK_LE:
+            genf("    ucomi%s %%xmm0, %%xmm1", suffix);
+            genf(binop.op == TK_LT ? "    seta %%al" : "    setae %%al");
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+static inline int is_int64_binop(const AST* ast, BinaryOpNode binop) {
+    const Type* l_type = ast_type_info(ast, binop.left).type;
+    const Type* r_type = ast_type_info(ast, binop.right).type;
+    return is_int(l_type) && is_int(r_type) &&
+           (is_int64(l_type) || is_int64(r_type));
+}
+
+static void emit_binop_int64(CodegenState* state, NodeIndex node) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    TypeInfo l_info = ast_type_info(state->ast, binop.left);
+    const Type* l_type = l_info.type;
+    TypeInfo r_info = ast_type_info(state->ast, binop.right);
+    const Type* r_type = r_info.type;
+
+    PrimitiveType result_type =
+        implicit_type_convert(l_type->primitive_type, r_type->primitive_type);
+    const Type* type = get_primitive_type(result_type);
+    int result_signed = is_signed(result_type);
+
+    emit_node(state, binop.left);
+    if (l_info.is_address) {
+        emit_load_address(state, l_type);
+    }
+    emit_convert(state, l_type, type);
+
+    genf("    pushl %%edx");
+    genf("    pushl %%eax");
+
+    emit_node(state, binop.right);
+    if (r_info.is_address) {
+        emit_load_address(state, r_type);
+    }
+    emit_convert(state, r_type, type);
+
+    genf("    pushl %%edx");
+    genf("    pushl %%eax");
+
+    // left = EDX:EAX, right = 4(%esp):(%esp)
+    genf("    movl 8(%%esp), %%eax");
+    genf("    movl 12(%%esp), %%edx");
+
+    switch (binop.op) {
+        case TK_ADD:
+            genf("    addl (%%esp), %%eax");
+            genf("    adcl 4(%%esp), %%edx");
+            break;
+
+        case TK_SUB:
+            genf("    subl (%%esp), %%eax");
+            genf("    sbbl 4(%%esp), %%edx");
+            break;
+
+        case TK_MUL:
+            genf("    movl %%edx, %%ecx");
+            genf("    imull (%%esp), %%ecx");
+            genf("    movl 4(%%esp), %%edx");
+            genf("    imull %%eax, %%edx");
+            genf("    addl %%edx, %%ecx");
+            genf("    mull (%%esp)");
+            genf("    addl %%ecx, %%edx");
+            break;
+
+        case TK_DIV:
+        case TK_MOD: {
+            const char* func;
+            if (binop.op == TK_DIV) {
+                func = result_signed ? "__divdi3" : "__udivdi3";
+            } else {
+                func = result_signed ? "__moddi3" : "__umoddi3";
+            }
+
+            genf("    pushl 4(%%esp)");
+            genf("    pushl 4(%%esp)");
+            genf("    pushl 20(%%esp)");
+            genf("    pushl 20(%%esp)");
+            genf("    call " OS_SYM_PREFIX "%s", func);
+            genf("    addl $16, %%esp");
+        } break;
+
+        case TK_SHL: {
+            int label = add_label(state);
+            genf("    movl (%%esp), %%ecx");
+            genf("    shldl %%cl, %%eax, %%edx");
+            genf("    shll %%cl, %%eax");
+            genf("    testb $32, %%cl");
+            genf("    je .L%d", label);
+            genf("    movl %%eax, %%edx");
+            genf("    xorl %%eax, %%eax");
+            genf(".L%d:", label);
+        } break;
+
+        case TK_SHR: {
+            int label = add_label(state);
+            genf("    movl (%%esp), %%ecx");
+            genf("    shrdl %%cl, %%edx, %%eax");
+            if (result_signed) {
+                genf("    sarl %%cl, %%edx");
+            } else {
+                genf("    shrl %%cl, %%edx");
+            }
+            genf("    testb $32, %%cl");
+            genf("    je .L%d", label);
+            genf("    movl %%edx, %%eax");
+            if (result_signed) {
+                genf("    sarl $31, %%edx");
+            } else {
+                genf("    xorl %%edx, %%edx");
+            }
+            genf(".L%d:", label);
+        } break;
+
+        case TK_AND:
+            genf("    andl (%%esp), %%eax");
+            genf("    andl 4(%%esp), %%edx");
+            break;
+
+        case TK_XOR:
+            genf("    xorl (%%esp), %%eax");
+            genf("    xorl 4(%%esp), %%edx");
+            break;
+
+        case TK_OR:
+            genf("    orl (%%esp), %%eax");
+            genf("    orl 4(%%esp), %%edx");
+            break;
+
+        case TK_EQ:
+        case TK_NE:
+            genf("    xorl (%%esp), %%eax");
+            genf("    xorl 4(%%esp), %%edx");
+            genf("    orl %%edx, %%eax");
+            if (binop.op == TK_EQ) {
+                genf("    sete %%al");
+            } else {
+                genf("    setne %%al");
+            }
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        case TK_LT:
+        case TK_GE:
+            // left - right
+            genf("    cmpl (%%esp), %%eax");
+            genf("    movl %%edx, %%ecx");
+            genf("    sbbl 4(%%esp), %%ecx");
+            if (binop.op == TK_LT) {
+                genf(result_signed ? "    setl %%al" : "    setb %%al");
+            } else {
+                genf(result_signed ? "    setge %%al" : "    setae %%al");
+            }
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        case TK_GT:
+        case TK_LE:
+            // right - left
+            genf("    movl (%%esp), %%ecx");
+            genf("    cmpl %%eax, %%ecx");
+            genf("    movl 4(%%esp), %%ecx");
+            genf("    sbbl %%edx, %%ecx");
+            if (binop.op == TK_GT) {
+                genf(result_signed ? "    setl %%al" : "    setb %%al");
+            } else {
+                genf(result_signed ? "    setge %%al" : "    setae %%al");
+            }
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+
+    genf("    addl $16, %%esp");
+}
+
+static void emit_binop(CodegenState* state, NodeIndex node) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    if (binop.op != TK_COMMA && is_float_binop(state->ast, binop)) {
+        emit_binop_float(state, node);
+        return;
+    }
+
+    if (binop.op != TK_COMMA && is_int64_binop(state->ast, binop)) {
+        emit_binop_int64(state, node);
+        return;
+    }
+
+    emit_node(state, binop.left);
+
+    if (binop.op == TK_COMMA) {
+        emit_node(state, binop.right);
+        return;
+    }
+
+    TypeInfo l_info = ast_type_info(state->ast, binop.left);
+    const Type* l_type = l_info.type;
+    TypeInfo r_info = ast_type_info(state->ast, binop.right);
+    const Type* r_type = r_info.type;
+
+    if (l_info.is_address) {
         emit_load_address(state, l_type);
     }
 
     genf("    pushl %%eax");
 
-    emit_node(state, binop->right);
-    if (r_node->type_info.is_address) {
+    emit_node(state, binop.right);
+    if (r_info.is_address) {
         emit_load_address(state, r_type);
     }
 
@@ -128,8 +572,8 @@ static void emit_binop(CodegenState* state, BinaryOpNode* binop) {
 
     if (is_bool(l_type)) {
         // Boolean operations
-        if (binop->op == TK_EQ || binop->op == TK_NE) {
-            if (binop->op == TK_EQ) {
+        if (binop.op == TK_EQ || binop.op == TK_NE) {
+            if (binop.op == TK_EQ) {
                 genf("    cmpl %%ecx, %%eax");
                 genf("    sete %%al");
                 genf("    movzbl %%al, %%eax");
@@ -140,18 +584,18 @@ static void emit_binop(CodegenState* state, BinaryOpNode* binop) {
             }
         } else {
             int label = add_label(state);
-            if (binop->op == TK_LOR) {
+            if (binop.op == TK_LOR) {
                 genf("    testl %%eax, %%eax");
                 genf("    jnz .L%d", label);
-            } else if (binop->op == TK_LAND) {
+            } else if (binop.op == TK_LAND) {
                 genf("    testl %%eax, %%eax");
                 genf("    jz .L%d", label);
             } else {
                 UNREACHABLE();
             }
 
-            emit_node(state, binop->right);
-            if (r_node->type_info.is_address) {
+            emit_node(state, binop.right);
+            if (r_info.is_address) {
                 emit_load_address(state, r_type);
             }
 
@@ -159,7 +603,7 @@ static void emit_binop(CodegenState* state, BinaryOpNode* binop) {
         }
     } else {
         // At this point, both operands are either pointer or integer.
-        switch (binop->op) {
+        switch (binop.op) {
             case TK_ADD:
             case TK_SUB: {
                 int l_ptr = is_array_ptr(l_type);
@@ -184,13 +628,13 @@ static void emit_binop(CodegenState* state, BinaryOpNode* binop) {
                         }
                     }
 
-                    if (binop->op == TK_ADD) {
+                    if (binop.op == TK_ADD) {
                         genf("    addl %%ecx, %%eax");
                     } else {  // TK_SUB
                         genf("    subl %%ecx, %%eax");
                     }
                 } else if (is_int(l_type) && is_int(r_type)) {  // Integers
-                    if (binop->op == TK_ADD) {
+                    if (binop.op == TK_ADD) {
                         genf("    addl %%ecx, %%eax");
                     } else {  // TK_SUB
                         genf("    subl %%ecx, %%eax");
@@ -215,7 +659,7 @@ static void emit_binop(CodegenState* state, BinaryOpNode* binop) {
                 int result_signed = is_signed(result_type);
 
                 genf("    cmpl %%ecx, %%eax");
-                switch (binop->op) {
+                switch (binop.op) {
                     case TK_EQ:
                         genf("    sete %%al");
                         break;
@@ -261,7 +705,7 @@ static void emit_binop(CodegenState* state, BinaryOpNode* binop) {
                     l_type->primitive_type, r_type->primitive_type);
                 int result_signed = is_signed(result_type);
 
-                switch (binop->op) {
+                switch (binop.op) {
                     case TK_MUL:
                         genf("    imull %%ecx, %%eax");
                         break;
@@ -316,7 +760,7 @@ static void emit_binop(CodegenState* state, BinaryOpNode* binop) {
                         break;
 
                     default:
-                        // fprintf(stderr, "Token type: %d\n", binop->op);
+                        // fprintf(stderr, "Token type: %d\n", binop.op);
                         UNREACHABLE();
                 }
             }
@@ -324,14 +768,15 @@ static void emit_binop(CodegenState* state, BinaryOpNode* binop) {
     }
 }
 
-static void emit_unaryop(CodegenState* state, UnaryOpNode* unaryop) {
-    emit_node(state, unaryop->node);
+static void emit_unaryop(CodegenState* state, NodeIndex node) {
+    UnaryOpNode unaryop = ast_unaryop(state->ast, node);
+    emit_node(state, unaryop.node);
 
-    const TypedASTNode* node = as_typed_ast(unaryop->node);
-    int is_address = node->type_info.is_address;
-    const Type* type = &node->type_info.type;
+    TypeInfo info = ast_type_info(state->ast, unaryop.node);
+    int is_address = info.is_address;
+    const Type* type = info.type;
 
-    switch (unaryop->op) {
+    switch (unaryop.op) {
         case TK_ADD:
             if (is_address) {
                 emit_load_address(state, type);
@@ -342,7 +787,17 @@ static void emit_unaryop(CodegenState* state, UnaryOpNode* unaryop) {
             if (is_address) {
                 emit_load_address(state, type);
             }
+            if (is_float(type)) {
+                genf("    mov%s .LF%d, %%xmm1", float_suffix(type),
+                     add_float_data(state, -0.0, type->primitive_type));
+                genf("    xorps %%xmm1, %%xmm0");
+                break;
+            }
             genf("    negl %%eax");
+            if (is_int64(type)) {
+                genf("    adcl $0, %%edx");
+                genf("    negl %%edx");
+            }
             break;
 
         case TK_NOT:
@@ -350,6 +805,9 @@ static void emit_unaryop(CodegenState* state, UnaryOpNode* unaryop) {
                 emit_load_address(state, type);
             }
             genf("    notl %%eax");
+            if (is_int64(type)) {
+                genf("    notl %%edx");
+            }
             break;
 
         case TK_LNOT:
@@ -395,9 +853,9 @@ static int get_func_args_size(const FuncMetadata* func_data) {
         curr = curr->next;
     }
 
-    if (func_data->return_type->size > REGISTER_SIZE) {
+    if (is_large_type(func_data->return_type)) {
         // We use System V ABI for returning struct (a pointer to the space as
-        // the hidden first arguemnt) This will be wrong for MSVC ABI like
+        // the hidden first argument) This will be wrong for MSVC ABI like
         // stdcall or thiscall
         args_size += PTR_SIZE;
     }
@@ -405,11 +863,12 @@ static int get_func_args_size(const FuncMetadata* func_data) {
     return args_size;
 }
 
-static void emit_var(CodegenState* state, VarNode* var) {
-    switch (var->ste->type) {
+static void emit_var(CodegenState* state, NodeIndex node) {
+    VarNode var = ast_var(state->ast, node);
+    switch (var.ste->type) {
         case SYM_VAR: {
             // Variable
-            VarSymbolTableEntry* var_ste = (VarSymbolTableEntry*)var->ste;
+            VarSymbolTableEntry* var_ste = (VarSymbolTableEntry*)var.ste;
             if (var_ste->attr == SYM_ATTR_EXPORT || var_ste->is_global) {
                 genf("    movl $" OS_SYM_PREFIX "%.*s, %%eax",
                      var_ste->ident.len, var_ste->ident.ptr);
@@ -424,7 +883,7 @@ static void emit_var(CodegenState* state, VarNode* var) {
         } break;
         case SYM_FUNC: {
             // Function pointer
-            FuncSymbolTableEntry* func_ste = (FuncSymbolTableEntry*)var->ste;
+            FuncSymbolTableEntry* func_ste = (FuncSymbolTableEntry*)var.ste;
             const FuncMetadata* func_data = &func_ste->func_data;
             if (func_data->callconv == CALLCONV_STDCALL) {
                 int args_size = get_func_args_size(func_data);
@@ -490,46 +949,250 @@ static void emit_memcpy(CodegenState* state, const char* dest, const char* src,
 #endif
 }
 
-static void emit_assign(CodegenState* state, AssignNode* assign) {
-    emit_node(state, assign->left);
+static void emit_assign(CodegenState* state, NodeIndex node) {
+    AssignNode assign = ast_assign(state->ast, node);
+    emit_node(state, assign.left);
 
-    const TypedASTNode* l_node = as_typed_ast(assign->left);
-    const Type* l_type = &l_node->type_info.type;
+    TypeInfo l_info = ast_type_info(state->ast, assign.left);
+    const Type* l_type = l_info.type;
 
     genf("    pushl %%eax");
 
-    emit_node(state, assign->right);
-    const TypedASTNode* r_node = as_typed_ast(assign->right);
-    if (r_node->type_info.is_address) {
-        emit_load_address(state, &r_node->type_info.type);
+    emit_node(state, assign.right);
+    TypeInfo r_info = ast_type_info(state->ast, assign.right);
+    if (r_info.is_address) {
+        emit_load_address(state, r_info.type);
     }
+    emit_convert(state, r_info.type, l_type);
 
     genf("    popl %%ecx");
 
     // ecx = left addr, eax = right
-    switch (l_type->size) {
-        case 4:
-            genf("    movl %%eax, (%%ecx)");
-            break;
-        case 3:
-            genf("    movw %%ax, (%%ecx)");
-            genf("    movb %%ah, 2(%%ecx)");
-            break;
-        case 2:
-            genf("    movw %%ax, (%%ecx)");
-            break;
-        case 1:
-            genf("    movb %%al, (%%ecx)");
-            break;
-        default: {
-            emit_memcpy(state, "%ecx", "%eax", l_type->size);
-        } break;
+    if (is_float(l_type)) {
+        genf("    mov%s %%xmm0, (%%ecx)", float_suffix(l_type));
+    } else if (is_int64(l_type)) {
+        genf("    movl %%eax, (%%ecx)");
+        genf("    movl %%edx, 4(%%ecx)");
+    } else {
+        switch (l_type->size) {
+            case 4:
+                genf("    movl %%eax, (%%ecx)");
+                break;
+            case 3:
+                genf("    movw %%ax, (%%ecx)");
+                genf("    movb %%ah, 2(%%ecx)");
+                break;
+            case 2:
+                genf("    movw %%ax, (%%ecx)");
+                break;
+            case 1:
+                genf("    movb %%al, (%%ecx)");
+                break;
+            default: {
+                emit_memcpy(state, "%ecx", "%eax", l_type->size);
+            } break;
+        }
     }
 
     genf("    movl %%ecx, %%eax");
 }
 
-static void emit_if(CodegenState* state, IfStatementNode* if_node) {
+static inline int is_null_lit(const AST* ast, NodeIndex node) {
+    return ast_node_type(ast, node) == NODE_INTLIT &&
+           ast_intlit(ast, node).data_type == TYPE_VOID;
+}
+
+// Returns 1 if the condition is likely true, -1 if it's likely false,
+// and 0 if unknown.
+static int predict_cond(const AST* ast, NodeIndex node) {
+    switch (ast_node_type(ast, node)) {
+        case NODE_HINT:
+            return ast_hint(ast, node).likely ? 1 : -1;
+
+        case NODE_UNARYOP: {
+            UnaryOpNode unaryop = ast_unaryop(ast, node);
+            if (unaryop.op == TK_LNOT) {
+                return -predict_cond(ast, unaryop.node);
+            }
+        } break;
+
+        case NODE_BINARYOP: {
+            // Pointers are rarely null
+            BinaryOpNode binop = ast_binop(ast, node);
+            if (binop.op != TK_EQ && binop.op != TK_NE) {
+                break;
+            }
+            if (is_null_lit(ast, binop.left) || is_null_lit(ast, binop.right)) {
+                return binop.op == TK_EQ ? -1 : 1;
+            }
+        } break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+// Returns 1 if the block calls exit, abort, or a @cold function.
+static int is_cold_block(const AST* ast, NodeIndex node) {
+    if (node == 0) {
+        return 0;
+    }
+
+    if (ast_node_type(ast, node) == NODE_STMTS) {
+        ASTNodeList stmts = ast_stmts(ast, node).stmts;
+        for (int i = 0; i < stmts.count; i++) {
+            if (is_cold_block(ast, stmts.nodes[i])) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    if (ast_node_type(ast, node) != NODE_CALL) {
+        return 0;
+    }
+
+    NodeIndex func_node = ast_call(ast, node).node;
+    if (ast_node_type(ast, func_node) != NODE_VAR) {
+        return 0;
+    }
+
+    SymbolTableEntry* ste = ast_var(ast, func_node).ste;
+    if (ste->type != SYM_FUNC) {
+        return 0;
+    }
+
+    FuncSymbolTableEntry* func = (FuncSymbolTableEntry*)ste;
+    return (func->func_data.attrs & FUNC_ATTR_COLD) ||
+           str_eql(func->ident, str("exit")) ||
+           str_eql(func->ident, str("abort"));
+}
+
+// Defer the block to the end of the function. It jumps to end_label when
+// done. Returns the label of the block, or -1 if it must be emitted in place.
+static int add_cold_block(CodegenState* state, NodeIndex node, int end_label) {
+    if (state->cold_block_count >= MAX_COLD_BLOCK_COUNT) {
+        return -1;
+    }
+
+    ColdBlock* block = &state->cold_blocks[state->cold_block_count++];
+    block->node = node;
+    block->label = add_label(state);
+    block->end_label = end_label;
+
+    block->return_label = state->return_label;
+    block->return_type = state->return_type;
+    block->temp_struct_stack_offset = state->temp_struct_stack_offset;
+
+    block->in_loop = state->in_loop;
+    block->break_label = state->break_label;
+    block->continue_label = state->continue_label;
+
+    block->inline_depth = state->inline_depth;
+    memcpy(block->inline_stack, state->inline_stack,
+           sizeof(state->inline_stack));
+
+    return block->label;
+}
+
+static void emit_cold_blocks(CodegenState* state) {
+    // Cold blocks can add more cold blocks
+    for (int i = 0; i < state->cold_block_count; i++) {
+        ColdBlock* block = &state->cold_blocks[i];
+
+        state->return_label = block->return_label;
+        state->return_type = block->return_type;
+        state->temp_struct_stack_offset = block->temp_struct_stack_offset;
+
+        state->in_loop = block->in_loop;
+        state->break_label = block->break_label;
+        state->continue_label = block->continue_label;
+
+        state->inline_depth = block->inline_depth;
+        memcpy(state->inline_stack, block->inline_stack,
+               sizeof(state->inline_stack));
+
+        genf(".L%d:", block->label);
+        emit_node(state, block->node);
+        genf("    jmp .L%d", block->end_label);
+    }
+
+    state->cold_block_count = 0;
+    state->in_loop = 0;
+    state->inline_depth = 0;
+}
+
+static void emit_cond(CodegenState* state, NodeIndex expr) {
+    emit_node(state, expr);
+    TypeInfo expr_info = ast_type_info(state->ast, expr);
+    if (expr_info.is_address) {
+        emit_load_address(state, expr_info.type);
+    }
+
+    genf("    testl %%eax, %%eax");
+}
+
+static void emit_if(CodegenState* state, NodeIndex node) {
+    IfStatementNode if_node = ast_if(state->ast, node);
+    int prediction = predict_cond(state->ast, if_node.expr);
+    if (prediction == 0) {
+        int then_cold = is_cold_block(state->ast, if_node.then_block);
+        int else_cold = is_cold_block(state->ast, if_node.else_block);
+        if (then_cold != else_cold) {
+            prediction = then_cold ? -1 : 1;
+        }
+    }
+
+    int end_label = add_label(state);
+
+    if (prediction < 0) {
+        /*
+         *      <cond>
+         *      JNZ cold_label
+         *      <else_block>
+         *  end_label:
+         *      ...
+         *  cold_label:
+         *      <then_block>
+         *      JMP end_label
+         */
+        int cold_label = add_cold_block(state, if_node.then_block, end_label);
+        if (cold_label >= 0) {
+            emit_cond(state, if_node.expr);
+            genf("    jnz .L%d", cold_label);
+
+            if (if_node.else_block) {
+                emit_node(state, if_node.else_block);
+            }
+
+            genf(".L%d:", end_label);
+            return;
+        }
+    } else if (prediction > 0 && if_node.else_block) {
+        /*
+         *      <cond>
+         *      JZ cold_label
+         *      <then_block>
+         *  end_label:
+         *      ...
+         *  cold_label:
+         *      <else_block>
+         *      JMP end_label
+         */
+        int cold_label = add_cold_block(state, if_node.else_block, end_label);
+        if (cold_label >= 0) {
+            emit_cond(state, if_node.expr);
+            genf("    jz .L%d", cold_label);
+
+            emit_node(state, if_node.then_block);
+
+            genf(".L%d:", end_label);
+            return;
+        }
+    }
+
     /*
      *      <cond>
      *      JZ else_label
@@ -539,57 +1202,46 @@ static void emit_if(CodegenState* state, IfStatementNode* if_node) {
      *      <else_block>
      *  end_label:
      */
-    int end_label = add_label(state);
     int else_label = add_label(state);
 
-    emit_node(state, if_node->expr);
-    const TypedASTNode* expr_node = as_typed_ast(if_node->expr);
-    if (expr_node->type_info.is_address) {
-        emit_load_address(state, &expr_node->type_info.type);
-    }
-
-    genf("    testl %%eax, %%eax");
+    emit_cond(state, if_node.expr);
     genf("    jz .L%d", else_label);
 
-    emit_node(state, if_node->then_block);
+    emit_node(state, if_node.then_block);
 
     genf("    jmp .L%d", end_label);
     genf(".L%d:", else_label);
 
-    if (if_node->else_block) {
-        emit_node(state, if_node->else_block);
+    if (if_node.else_block) {
+        emit_node(state, if_node.else_block);
     }
 
     genf(".L%d:", end_label);
 }
 
-static void emit_while(CodegenState* state, WhileNode* while_node) {
+static void emit_while(CodegenState* state, NodeIndex node) {
+    WhileNode while_node = ast_while(state->ast, node);
     /*
+     *      JMP cond_label
      *  loop_label:
-     *      <cond>
-     *      JZ end_label
      *      <block>
-     *   inc_label:
+     *  inc_label:
      *      <inc>
-     *      JMP loop_label
+     *  cond_label:
+     *      <cond>
+     *      JNZ loop_label
      *  end_lable:
      */
 
     int loop_label = add_label(state);
     int inc_label = add_label(state);
+    int cond_label = add_label(state);
     int end_label = add_label(state);
 
+    genf("    jmp .L%d", cond_label);
+    genf("    .p2align %d,,%d", LOOP_ALIGNMENT_LOG2, LOOP_ALIGNMENT_MAX_SKIP);
     genf(".L%d:", loop_label);
 
-    emit_node(state, while_node->expr);
-    const TypedASTNode* expr_node = as_typed_ast(while_node->expr);
-    if (expr_node->type_info.is_address) {
-        emit_load_address(state, &expr_node->type_info.type);
-    }
-
-    genf("    testl %%eax, %%eax");
-    genf("    jz .L%d", end_label);
-
     int prev_in_loop = state->in_loop;
     int prev_break_label = state->break_label;
     int prev_continue_label = state->continue_label;
@@ -598,23 +1250,27 @@ static void emit_while(CodegenState* state, WhileNode* while_node) {
     state->break_label = end_label;
     state->continue_label = inc_label;
 
-    emit_node(state, while_node->block);
+    emit_node(state, while_node.block);
 
     state->in_loop = prev_in_loop;
     state->break_label = prev_break_label;
     state->continue_label = prev_continue_label;
 
     genf(".L%d:", inc_label);
-    if (while_node->inc) {
-        emit_node(state, while_node->inc);
+    if (while_node.inc) {
+        emit_node(state, while_node.inc);
     }
 
-    genf("    jmp .L%d", loop_label);
+    genf(".L%d:", cond_label);
+    emit_cond(state, while_node.expr);
+    genf("    jnz .L%d", loop_label);
+
     genf(".L%d:", end_label);
 }
 
-static inline void emit_goto(CodegenState* state, GotoNode* node) {
-    switch (node->op) {
+static inline void emit_goto(CodegenState* state, NodeIndex node) {
+    GotoNode goto_node = ast_goto(state->ast, node);
+    switch (goto_node.op) {
         case TK_BREAK:
             genf("    jmp .L%d", state->break_label);
             break;
@@ -626,7 +1282,185 @@ static inline void emit_goto(CodegenState* state, GotoNode* node) {
     }
 }
 
-static void emit_call(CodegenState* state, CallNode* call) {
+// Subtract the node count of the tree from budget.
+// Returns 0 if the tree is over budget or cannot be inlined.
+static int inline_budget(const AST* ast, NodeIndex node, int* budget) {
+    if (node == 0) {
+        return 1;
+    }
+
+    if (--(*budget) < 0) {
+        return 0;
+    }
+
+    switch (ast_node_type(ast, node)) {
+        case NODE_STMTS: {
+            ASTNodeList stmts = ast_stmts(ast, node).stmts;
+            for (int i = 0; i < stmts.count; i++) {
+                if (!inline_budget(ast, stmts.nodes[i], budget)) {
+                    return 0;
+                }
+            }
+            return 1;
+        }
+
+        case NODE_INTLIT:
+        case NODE_FLOATLIT:
+        case NODE_STRLIT:
+        case NODE_VAR:
+        case NODE_GOTO:
+            return 1;
+
+        case NODE_BINARYOP: {
+            BinaryOpNode binop = ast_binop(ast, node);
+            return inline_budget(ast, binop.left, budget) &&
+                   inline_budget(ast, binop.right, budget);
+        }
+
+        case NODE_UNARYOP:
+            return inline_budget(ast, ast_unaryop(ast, node).node, budget);
+
+        case NODE_ASSIGN: {
+            AssignNode assign = ast_assign(ast, node);
+            return inline_budget(ast, assign.left, budget) &&
+                   inline_budget(ast, assign.right, budget);
+        }
+
+        case NODE_IF: {
+            IfStatementNode if_node = ast_if(ast, node);
+            return inline_budget(ast, if_node.expr, budget) &&
+                   inline_budget(ast, if_node.then_block, budget) &&
+                   inline_budget(ast, if_node.else_block, budget);
+        }
+
+        case NODE_WHILE: {
+            WhileNode while_node = ast_while(ast, node);
+            return inline_budget(ast, while_node.expr, budget) &&
+                   inline_budget(ast, while_node.inc, budget) &&
+                   inline_budget(ast, while_node.block, budget);
+        }
+
+        case NODE_CALL: {
+            CallNode call = ast_call(ast, node);
+            if (!inline_budget(ast, call.node, budget)) {
+                return 0;
+            }
+
+            for (int i = 0; i < call.args.count; i++) {
+                if (!inline_budget(ast, call.args.nodes[i], budget)) {
+                    return 0;
+                }
+            }
+            return 1;
+        }
+
+        case NODE_PRINT: {
+            ASTNodeList args = ast_print(ast, node).args;
+            for (int i = 0; i < args.count; i++) {
+                if (!inline_budget(ast, args.nodes[i], budget)) {
+                    return 0;
+                }
+            }
+            return 1;
+        }
+
+        case NODE_RET:
+            return inline_budget(ast, ast_ret(ast, node).expr, budget);
+
+        case NODE_INDEXOF: {
+            IndexOfNode idxof = ast_indexof(ast, node);
+            return inline_budget(ast, idxof.left, budget) &&
+                   inline_budget(ast, idxof.right, budget);
+        }
+
+        case NODE_FIELD:
+            return inline_budget(ast, ast_field(ast, node).node, budget);
+
+        case NODE_CAST:
+            return inline_budget(ast, ast_cast(ast, node).expr, budget);
+
+        case NODE_HINT:
+            return inline_budget(ast, ast_hint(ast, node).expr, budget);
+
+        case NODE_ASM:
+            // labels in inline assembly would be duplicated
+            return 0;
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+// Returns the function to expand inline at this call site, or NULL if the
+// call should be a regular call.
+static FuncSymbolTableEntry* get_inline_func(CodegenState* state,
+                                             NodeIndex node) {
+    CallNode call = ast_call(state->ast, node);
+    if (ast_node_type(state->ast, call.node) != NODE_VAR) {
+        return NULL;
+    }
+
+    SymbolTableEntry* ste = ast_var(state->ast, call.node).ste;
+    if (ste->type != SYM_FUNC) {
+        return NULL;
+    }
+
+    FuncSymbolTableEntry* func = (FuncSymbolTableEntry*)ste;
+    const FuncMetadata* func_data = &func->func_data;
+    if (func->node == 0 || func_data->has_va_args ||
+        func_data->callconv == CALLCONV_THISCALL ||
+        (func_data->attrs & FUNC_ATTR_NOINLINE)) {
+        return NULL;
+    }
+
+    if (state->inline_depth >= MAX_INLINE_DEPTH) {
+        return NULL;
+    }
+
+    // recursive call
+    for (int i = 0; i < state->inline_depth; i++) {
+        if (state->inline_stack[i] == func) {
+            return NULL;
+        }
+    }
+
+    int budget;
+    if (func_data->attrs & FUNC_ATTR_INLINE) {
+        budget = INT32_MAX;
+    } else if (func_data->attrs & FUNC_ATTR_COLD) {
+        return NULL;
+    } else {
+        budget = INLINE_NODE_LIMIT;
+    }
+
+    if (!inline_budget(state->ast, func->node, &budget)) {
+        return NULL;
+    }
+
+    return func;
+}
+
+static void emit_func_body(CodegenState* state, FuncSymbolTableEntry* func);
+
+static void emit_inline_func(CodegenState* state, FuncSymbolTableEntry* func) {
+    int prev_return_label = state->return_label;
+    const Type* prev_return_type = state->return_type;
+    int prev_temp_struct_stack_offset = state->temp_struct_stack_offset;
+
+    state->inline_stack[state->inline_depth++] = func;
+
+    emit_func_body(state, func);
+    genf("    leave");
+
+    state->inline_depth--;
+
+    state->return_label = prev_return_label;
+    state->return_type = prev_return_type;
+    state->temp_struct_stack_offset = prev_temp_struct_stack_offset;
+}
+
+static void emit_call(CodegenState* state, NodeIndex node) {
+    CallNode call = ast_call(state->ast, node);
     /*
      *  local 3         [ebp]-16 <-ESP
      *  local 2         [ebp]-8
@@ -638,25 +1472,52 @@ static void emit_call(CodegenState* state, CallNode* call) {
      *  arg 3           [ebp]+16
      */
 
-    const TypedASTNode* func_node = as_typed_ast(call->node);
-    const Type* func_type = &func_node->type_info.type;
+    TypeInfo func_info = ast_type_info(state->ast, call.node);
+    const Type* func_type = func_info.type;
     assert(func_type->type == METADATA_FUNC);
 
-    ASTNodeList* curr = call->args;
+    // Both lists are in reverse order, skip the variadic arguments first
+    int va_arg_count = call.args.count;
+    ArgList* param = func_type->func_data.args;
+    while (param) {
+        va_arg_count--;
+        param = param->next;
+    }
+
+    param = func_type->func_data.args;
     int args_size = 0;
-    while (curr) {
-        emit_node(state, curr->node);
+    for (int i = 0; i < call.args.count; i++) {
+        emit_node(state, call.args.nodes[i]);
 
-        const TypedASTNode* node = as_typed_ast(curr->node);
-        if (node->type_info.is_address) {
-            emit_load_address(state, &node->type_info.type);
+        TypeInfo info = ast_type_info(state->ast, call.args.nodes[i]);
+        if (info.is_address) {
+            emit_load_address(state, info.type);
         }
 
-        int size = node->type_info.type.size;
+        const Type* arg_type = info.type;
+        if (va_arg_count > 0) {
+            if (arg_type->primitive_type == TYPE_F32 && is_float(arg_type)) {
+                // default argument promotion
+                emit_convert(state, arg_type, get_primitive_type(TYPE_F64));
+                arg_type = get_primitive_type(TYPE_F64);
+            }
+            va_arg_count--;
+        } else {
+            emit_convert(state, arg_type, param->type);
+            arg_type = param->type;
+            param = param->next;
+        }
+
+        int size = arg_type->size;
         // padding
         size += (MAX_ALIGNMENT - (size % MAX_ALIGNMENT)) % MAX_ALIGNMENT;
 
-        if (size <= REGISTER_SIZE) {
+        if (is_float(arg_type)) {
+            emit_push_float(state, arg_type);
+        } else if (is_int64(arg_type)) {
+            genf("    pushl %%edx");
+            genf("    pushl %%eax");
+        } else if (size <= REGISTER_SIZE) {
             genf("    pushl %%eax");
         } else {
             genf("    subl $%d, %%esp", size);
@@ -665,30 +1526,59 @@ static void emit_call(CodegenState* state, CallNode* call) {
         }
 
         args_size += size;
-        curr = curr->next;
+    }
+
+    int reg_arg_count = func_type->func_data.reg_arg_count;
+    for (int i = 0; i < reg_arg_count; i++) {
+        genf("    popl %s", get_reg_arg(i));
+        args_size -= REGISTER_SIZE;
     }
 
     const Type* return_type = func_type->func_data.return_type;
-    if (return_type->size > REGISTER_SIZE) {
-        genf("    leal -%d(%%ebp), %%eax", state->temp_struct_stack_offset);
-        genf("    pushl %%eax");
+    if (is_large_type(return_type)) {
+        if (reg_arg_count > 0) {
+            // %eax is holding an argument
+            genf("    pushl %%ebp");
+            genf("    subl $%d, (%%esp)", state->temp_struct_stack_offset);
+        } else {
+            genf("    leal -%d(%%ebp), %%eax", state->temp_struct_stack_offset);
+            genf("    pushl %%eax");
+        }
         args_size += PTR_SIZE;
     }
 
-    emit_node(state, call->node);
+    FuncSymbolTableEntry* inline_func = get_inline_func(state, node);
+    if (inline_func) {
+        // Expand the callee with its own frame. The slot for the return
+        // address is kept so the arguments are at the same offsets.
+        genf("    pushl $0");
+        emit_inline_func(state, inline_func);
+        genf("    addl $%d, %%esp", args_size + PTR_SIZE);
+    } else if (func_type->func_data.callconv == CALLCONV_REGPARM) {
+        // Only called directly, so the callee is known
+        assert(ast_node_type(state->ast, call.node) == NODE_VAR);
+        const SymbolTableEntry* ste = ast_var(state->ast, call.node).ste;
+        genf("    call " OS_SYM_PREFIX "%.*s", ste->ident.len, ste->ident.ptr);
+
+        if (args_size > 0) {
+            genf("    addl $%d, %%esp", args_size);
+        }
+    } else {
+        emit_node(state, call.node);
 
-    if (func_node->type_info.is_address) {
-        emit_load_address(state, func_type);
-    }
+        if (func_info.is_address) {
+            emit_load_address(state, func_type);
+        }
 
-    if (func_type->func_data.callconv == CALLCONV_THISCALL) {
-        genf("    popl %%ecx");
-    }
+        if (func_type->func_data.callconv == CALLCONV_THISCALL) {
+            genf("    popl %%ecx");
+        }
 
-    genf("    call *%%eax");
+        genf("    call *%%eax");
 
-    if (func_type->func_data.callconv == CALLCONV_CDECL && args_size > 0) {
-        genf("    addl $%d, %%esp", args_size);
+        if (func_type->func_data.callconv == CALLCONV_CDECL && args_size > 0) {
+            genf("    addl $%d, %%esp", args_size);
+        }
     }
 
     // Return value
@@ -700,7 +1590,20 @@ static void emit_call(CodegenState* state, CallNode* call) {
         return;
     }
 
+    if (is_float(return_type)) {
+        if (!inline_func) {
+            // Move the return value from the x87 stack to XMM0
+            int size = return_type->size;
+            genf("    subl $%d, %%esp", size);
+            genf(size == 4 ? "    fstps (%%esp)" : "    fstpl (%%esp)");
+            genf("    mov%s (%%esp), %%xmm0", float_suffix(return_type));
+            genf("    addl $%d, %%esp", size);
+        }
+        return;
+    }
+
     switch (return_type->size) {
+        case 8:
         case 4:
             break;
         case 2:
@@ -722,53 +1625,77 @@ static void emit_call(CodegenState* state, CallNode* call) {
     }
 }
 
-static void emit_print(CodegenState* state, PrintNode* print_node) {
-    int arg_count = 0;
-    ASTNodeList* curr = print_node->args;
-    while (curr) {
-        emit_node(state, curr->node);
+static void emit_print(CodegenState* state, NodeIndex node) {
+    PrintNode print_node = ast_print(state->ast, node);
+    int args_size = 0;
+    for (int i = 0; i < print_node.args.count; i++) {
+        emit_node(state, print_node.args.nodes[i]);
+
+        TypeInfo info = ast_type_info(state->ast, print_node.args.nodes[i]);
+        if (info.is_address) {
+            emit_load_address(state, info.type);
+        }
 
-        TypedASTNode* node = as_typed_ast(curr->node);
-        if (node->type_info.is_address) {
-            emit_load_address(state, &node->type_info.type);
+        const Type* type = info.type;
+        if (is_float(type)) {
+            // printf takes double
+            const Type* double_type = get_primitive_type(TYPE_F64);
+            emit_convert(state, type, double_type);
+            emit_push_float(state, double_type);
+            args_size += double_type->size;
+            continue;
+        }
+
+        if (is_int64(type)) {
+            genf("    pushl %%edx");
+            args_size += REGISTER_SIZE;
         }
 
         genf("    pushl %%eax");
-        arg_count++;
-        curr = curr->next;
+        args_size += REGISTER_SIZE;
     }
 
-    genf("    pushl $.LC%d", add_data(state, print_node->fmt));
+    StrLitNode fmt = ast_strlit(state->ast, print_node.fmt);
+    genf("    pushl $.LC%d", add_data(state, fmt.val));
 
-    arg_count++;
+    args_size += PTR_SIZE;
 
     genf("    call " OS_SYM_PREFIX "printf");
-    genf("    addl $%d, %%esp", arg_count * REGISTER_SIZE);
+    genf("    addl $%d, %%esp", args_size);
 }
 
-static void emit_ret(CodegenState* state, ReturnNode* ret) {
-    if (ret->expr) {
-        emit_node(state, ret->expr);
-        const TypedASTNode* expr_node = as_typed_ast(ret->expr);
-        if (expr_node->type_info.is_address) {
-            emit_load_address(state, &expr_node->type_info.type);
+static void emit_ret(CodegenState* state, NodeIndex node) {
+    ReturnNode ret = ast_ret(state->ast, node);
+    if (ret.expr) {
+        emit_node(state, ret.expr);
+        TypeInfo expr_info = ast_type_info(state->ast, ret.expr);
+        if (expr_info.is_address) {
+            emit_load_address(state, expr_info.type);
         }
 
-        const Type* return_type = &(as_typed_ast(ret->expr)->type_info.type);
-        if (return_type->size > REGISTER_SIZE) {
+        const Type* return_type = ast_type_info(state->ast, ret.expr).type;
+        emit_convert(state, return_type, state->return_type);
+        if (is_large_type(return_type)) {
             genf("    movl 8(%%ebp), %%ecx");
             emit_memcpy(state, "%ecx", "%eax", return_type->size);
             genf("    movl 8(%%ebp), %%eax");
+        } else if (is_float(state->return_type) && !in_inline_func(state)) {
+            // Floating-point values are returned on the x87 stack
+            int size = state->return_type->size;
+            emit_push_float(state, state->return_type);
+            genf(size == 4 ? "    flds (%%esp)" : "    fldl (%%esp)");
+            genf("    addl $%d, %%esp", size);
         }
     }
 
     genf("    jmp .L%d", state->return_label);
 }
 
-static void emit_field(CodegenState* state, FieldNode* field) {
-    emit_node(state, field->node);
+static void emit_field(CodegenState* state, NodeIndex node) {
+    FieldNode field = ast_field(state->ast, node);
+    emit_node(state, field.node);
 
-    const Type* l_type = &(as_typed_ast(field->node)->type_info.type);
+    const Type* l_type = ast_type_info(state->ast, field.node).type;
     if (l_type->type == METADATA_POINTER && l_type->pointer_level == 1) {
         // member access through pointer
         emit_load_address(state, l_type);
@@ -777,28 +1704,29 @@ static void emit_field(CodegenState* state, FieldNode* field) {
 
     const TypeSymbolTableEntry* type_ste = l_type->type_ste;
     FieldSymbolTableEntry* ste = (FieldSymbolTableEntry*)symbol_table_find(
-        type_ste->name_space, field->ident, 1);
+        type_ste->name_space, field.ident, 1);
     assert(ste != NULL && ste->type == SYM_FIELD);
 
     genf("    leal %d(%%eax), %%eax", ste->offset);
 }
 
-static void emit_indexof(CodegenState* state, IndexOfNode* idxof) {
-    emit_node(state, idxof->left);
+static void emit_indexof(CodegenState* state, NodeIndex node) {
+    IndexOfNode idxof = ast_indexof(state->ast, node);
+    emit_node(state, idxof.left);
 
-    const TypedASTNode* l_node = as_typed_ast(idxof->left);
-    const Type* l_type = &l_node->type_info.type;
-    if (l_node->type_info.is_address && l_type->array_size == 0) {
-        emit_load_address(state, &l_node->type_info.type);
+    TypeInfo l_info = ast_type_info(state->ast, idxof.left);
+    const Type* l_type = l_info.type;
+    if (l_info.is_address && l_type->array_size == 0) {
+        emit_load_address(state, l_info.type);
     }
 
     genf("    pushl %%eax");
 
-    emit_node(state, idxof->right);
+    emit_node(state, idxof.right);
 
-    const TypedASTNode* r_node = as_typed_ast(idxof->right);
-    if (r_node->type_info.is_address) {
-        emit_load_address(state, &r_node->type_info.type);
+    TypeInfo r_info = ast_type_info(state->ast, idxof.right);
+    if (r_info.is_address) {
+        emit_load_address(state, r_info.type);
     }
 
     genf("    popl %%ecx");
@@ -809,89 +1737,98 @@ static void emit_indexof(CodegenState* state, IndexOfNode* idxof) {
     genf("    addl %%ecx, %%eax");
 }
 
-static void emit_cast(CodegenState* state, CastNode* cast) {
-    UNUSED(state);
-    emit_node(state, cast->expr);
+static void emit_cast(CodegenState* state, NodeIndex node) {
+    CastNode cast = ast_cast(state->ast, node);
+    emit_node(state, cast.expr);
 
-    const TypedASTNode* expr = as_typed_ast(cast->expr);
-    if (expr->type_info.is_address) {
-        emit_load_address(state, &expr->type_info.type);
+    TypeInfo expr_info = ast_type_info(state->ast, cast.expr);
+    if (expr_info.is_address) {
+        emit_load_address(state, expr_info.type);
     }
+    emit_convert(state, expr_info.type, cast.data_type);
 }
 
-static void emit_asm(CodegenState* state, AsmNode* asm_node) {
-    UNUSED(state);
-    genf("%.*s", asm_node->asm_str.len, asm_node->asm_str.ptr);
+static void emit_asm(CodegenState* state, NodeIndex node) {
+    AsmNode asm_node = ast_asm(state->ast, node);
+    genf("%.*s", asm_node.asm_str.len, asm_node.asm_str.ptr);
 }
 
-static void emit_node(CodegenState* state, ASTNode* node) {
-    switch (node->type) {
+static void emit_node(CodegenState* state, NodeIndex node) {
+    switch (ast_node_type(state->ast, node)) {
         case NODE_STMTS:
-            emit_stmts(state, (StatementListNode*)node);
+            emit_stmts(state, node);
             break;
 
         case NODE_INTLIT:
-            emit_intlit(state, (IntLitNode*)node);
+            emit_intlit(state, node);
+            break;
+
+        case NODE_FLOATLIT:
+            emit_floatlit(state, node);
             break;
 
         case NODE_STRLIT:
-            emit_strlit(state, (StrLitNode*)node);
+            emit_strlit(state, node);
             break;
 
         case NODE_BINARYOP:
-            emit_binop(state, (BinaryOpNode*)node);
+            emit_binop(state, node);
             break;
 
         case NODE_UNARYOP:
-            emit_unaryop(state, (UnaryOpNode*)node);
+            emit_unaryop(state, node);
             break;
 
         case NODE_VAR:
-            emit_var(state, (VarNode*)node);
+            emit_var(state, node);
             break;
 
         case NODE_ASSIGN:
-            emit_assign(state, (AssignNode*)node);
+            emit_assign(state, node);
             break;
 
         case NODE_IF:
-            emit_if(state, (IfStatementNode*)node);
+            emit_if(state, node);
             break;
 
         case NODE_WHILE:
-            emit_while(state, (WhileNode*)node);
+            emit_while(state, node);
             break;
 
         case NODE_GOTO:
-            emit_goto(state, (GotoNode*)node);
+            emit_goto(state, node);
             break;
 
         case NODE_CALL:
-            emit_call(state, (CallNode*)node);
+            emit_call(state, node);
             break;
 
         case NODE_PRINT:
-            emit_print(state, (PrintNode*)node);
+            emit_print(state, node);
             break;
 
         case NODE_RET:
-            emit_ret(state, (ReturnNode*)node);
+            emit_ret(state, node);
             break;
 
         case NODE_FIELD:
-            emit_field(state, (FieldNode*)node);
+            emit_field(state, node);
             break;
 
         case NODE_INDEXOF:
-            emit_indexof(state, (IndexOfNode*)node);
+            emit_indexof(state, node);
             break;
 
         case NODE_CAST:
-            emit_cast(state, (CastNode*)node);
+            emit_cast(state, node);
+            break;
+
+        case NODE_HINT:
+            emit_node(state, ast_hint(state->ast, node).expr);
             break;
 
         case NODE_ASM:
-            emit_asm(state, (AsmNode*)node);
+            emit_asm(state, node);
             break;
 
         default:
@@ -925,10 +1862,51 @@ static inline void setup_func_state(CodegenState* state,
     state->temp_struct_stack_offset = *sym->stack_size;
 }
 
-static void emit_func(CodegenState* state, FuncSymbolTableEntry* func) {
+// Emit the function frame and body, the arguments and the return address are
+// already on the stack. Leaves the frame to be destroyed by the caller.
+static void emit_func_body(CodegenState* state, FuncSymbolTableEntry* func) {
     setup_func_state(state, func->func_data.return_type, func->func_sym);
 
+    emit_func_start(state, *func->func_sym->stack_size);
+
+    for (int i = 0; i < func->func_data.reg_arg_count; i++) {
+        genf("    movl %s, -%d(%%ebp)", get_reg_arg(i),
+             func->func_sym->reg_arg_offset + (i + 1) * REGISTER_SIZE);
+    }
+
+    emit_node(state, func->node);
+
+    if (is_large_type(func->func_data.return_type)) {
+        // Just in case function has no return but has return type
+        genf("    movl 8(%%ebp), %%eax");
+    }
+
+    genf(".L%d:", state->return_label);
+
+    if (str_eql(func->ident, str("main")) &&
+        is_void(func->func_data.return_type)) {
+        // main returns void type, always returns 0
+        genf("    xorl %%eax, %%eax");
+    }
+}
+
+static void emit_func(CodegenState* state, FuncSymbolTableEntry* func) {
     const FuncMetadata* func_data = &func->func_data;
+
+    int alignment = func_data->alignment;
+    if (func_data->attrs & FUNC_ATTR_HOT) {
+        genf(TEXT_SECTION(".text.hot"));
+        if (alignment == 0) {
+            alignment = HOT_FUNC_ALIGNMENT;
+        }
+    } else if (func_data->attrs & FUNC_ATTR_COLD) {
+        genf(TEXT_SECTION(".text.unlikely"));
+    }
+
+    if (alignment > 1) {
+        genf("    .p2align %d", log2_int(alignment));
+    }
+
     int args_size = get_func_args_size(func_data);
     if (func_data->callconv == CALLCONV_STDCALL) {
         genf(OS_SYM_PREFIX "%.*s@%d:", func->ident.len, func->ident.ptr,
@@ -940,35 +1918,26 @@ static void emit_func(CodegenState* state, FuncSymbolTableEntry* func) {
     if (func->func_data.callconv == CALLCONV_THISCALL) {
         genf("    popl %%edx");   // return address
         genf("    pushl %%ecx");  // thisptr
-        if (func_data->return_type->size > REGISTER_SIZE) {
+        if (is_large_type(func_data->return_type)) {
             genf("    pushl %%eax");  // return value address
         }
         genf("    pushl %%edx");
     }
 
-    emit_func_start(state, *func->func_sym->stack_size);
-
-    emit_node(state, func->node);
-
-    if (func->func_data.return_type->size > REGISTER_SIZE) {
-        // Just in case function has no return but has return type
-        genf("    movl 8(%%ebp), %%eax");
-    }
-
-    genf(".L%d:", state->return_label);
+    state->inline_stack[0] = func;
+    state->inline_depth = 1;
 
-    if (str_eql(func->ident, str("main")) &&
-        is_void(func->func_data.return_type)) {
-        // main returns void type, always returns 0
-        genf("    xorl %%eax, %%eax");
-    }
+    emit_func_body(state, func);
 
-    if (func_data->callconv == CALLCONV_CDECL) {
+    if (func_data->callconv == CALLCONV_CDECL ||
+        func_data->callconv == CALLCONV_REGPARM) {
         emit_func_exit(state, 0);
     } else {
         emit_func_exit(state, args_size);
     }
 
+    emit_cold_blocks(state);
+
     if (func->attr == SYM_ATTR_EXPORT) {
         if (func_data->callconv == CALLCONV_STDCALL) {
             genf(".globl " OS_SYM_PREFIX "%.*s@%d", func->ident.len,
@@ -978,43 +1947,58 @@ static void emit_func(CodegenState* state, FuncSymbolTableEntry* func) {
                  func->ident.ptr);
         }
     }
+
+    if (func_data->attrs & (FUNC_ATTR_HOT | FUNC_ATTR_COLD)) {
+        genf(".text");
+    }
 }
 
-static inline void emit_string_data(CodegenState* state, Str s) {
-    fprintf(state->out, "    .string \"");
+void emit_string_data(CodegenState* state, Str s) {
+    OutBuf* out = state->out;
+    outbuf_puts(out, "    .string \"");
     for (int i = 0; i < s.len; i++) {
         unsigned char c = s.ptr[i];
         switch (c) {
             case '"':
-                fprintf(state->out, "\\\"");
+                outbuf_puts(out, "\\\"");
                 break;
             case '\\':
-                fprintf(state->out, "\\\\");
+                outbuf_puts(out, "\\\\");
                 break;
             case '\n':
-                fprintf(state->out, "\\n");
+                outbuf_puts(out, "\\n");
                 break;
             case '\t':
-                fprintf(state->out, "\\t");
+                outbuf_puts(out, "\\t");
                 break;
             case '\r':
-                fprintf(state->out, "\\r");
+                outbuf_puts(out, "\\r");
                 break;
             case '\0':
-                fprintf(state->out, "\\000");
+                outbuf_puts(out, "\\000");
                 break;
             default:
                 if (c < 0x20 || c >= 0x7f) {
-                    fprintf(state->out, "\\%03o", c);
+                    char escape[] = {'\\', '0' + (c >> 6),
+                                     '0' + ((c >> 3) & 7), '0' + (c & 7)};
+                    outbuf_write(out, escape, sizeof(escape));
                 } else {
-                    fprintf(state->out, "%c", c);
+                    outbuf_putc(out, c);
                 }
         }
     }
     genf("\"");
 }
 
-void codegen(CodegenState* state, ASTNode* node, SymbolTable* sym,
+void emit_float_data(CodegenState* state, unsigned long long bits, int size) {
+    if (size == 4) {
+        genf("    .long 0x%08x", (unsigned int)bits);
+    } else {
+        genf("    .quad 0x%016llx", bits);
+    }
+}
+
+void codegen(CodegenState* state, NodeIndex node, SymbolTable* sym,
              Str entry_sym) {
     int has_user_defined_entry = (symbol_table_find(sym, entry_sym, 1) != NULL);
 
@@ -1028,15 +2012,40 @@ void codegen(CodegenState* state, ASTNode* node, SymbolTable* sym,
             if (var->attr != SYM_ATTR_EXTERN) {
                 genf(OS_SYM_PREFIX "%.*s:", var->ident.len, var->ident.ptr);
                 if (var->init_val) {
-                    switch (var->init_val->type) {
+                    switch (ast_node_type(state->ast, var->init_val)) {
+                        case NODE_FLOATLIT: {
+                            FloatLitNode floatlit =
+                                ast_floatlit(state->ast, var->init_val);
+                            emit_float_data(state,
+                                            get_float_bits(floatlit.val,
+                                                           floatlit.data_type),
+                                            var->data_type->size);
+                        } break;
                         case NODE_INTLIT: {
-                            IntLitNode* intlit = (IntLitNode*)var->init_val;
-                            genf("    .long %d", intlit->val);
+                            IntLitNode intlit =
+                                ast_intlit(state->ast, var->init_val);
+                            if (is_float(var->data_type)) {
+                                double val =
+                                    intlit.data_type == TYPE_U64
+                                        ? (double)(unsigned long long)
+                                              intlit.val
+                                        : (double)intlit.val;
+                                PrimitiveType type =
+                                    var->data_type->primitive_type;
+                                emit_float_data(state,
+                                                get_float_bits(val, type),
+                                                var->data_type->size);
+                            } else if (is_int64(var->data_type)) {
+                                genf("    .quad %lld", intlit.val);
+                            } else {
+                                genf("    .long %d", (int)intlit.val);
+                            }
                         } break;
                         case NODE_STRLIT: {
-                            StrLitNode* strlit = (StrLitNode*)var->init_val;
+                            StrLitNode strlit =
+                                ast_strlit(state->ast, var->init_val);
                             genf("    .long .LC%d",
-                                 add_data(state, strlit->val));
+                                 add_data(state, strlit.val));
                         } break;
                         default:
                             UNREACHABLE();
@@ -1052,7 +2061,7 @@ void codegen(CodegenState* state, ASTNode* node, SymbolTable* sym,
                     genf(".globl " OS_SYM_PREFIX "%.*s", var->ident.len,
                          var->ident.ptr);
                 }
-                fprintf(state->out, "\n");
+                outbuf_end_line(state->out);
             }
         }
         curr = curr->next;
@@ -1067,7 +2076,7 @@ void codegen(CodegenState* state, ASTNode* node, SymbolTable* sym,
             FuncSymbolTableEntry* func = (FuncSymbolTableEntry*)curr;
             if (func->node) {
                 emit_func(state, func);
-                fprintf(state->out, "\n");
+                outbuf_end_line(state->out);
             }
         }
         curr = curr->next;
@@ -1086,10 +2095,12 @@ void codegen(CodegenState* state, ASTNode* node, SymbolTable* sym,
         genf(".L%d:", state->return_label);
         emit_func_exit(state, 0);
 
+        emit_cold_blocks(state);
+
         genf(".globl " OS_SYM_PREFIX "%.*s", entry_sym.len, entry_sym.ptr);
     }
 
-    fprintf(state->out, "\n");
+    outbuf_end_line(state->out);
 
     // Strings
     genf(".data");
@@ -1097,4 +2108,13 @@ void codegen(CodegenState* state, ASTNode* node, SymbolTable* sym,
         genf(".LC%d:", i);
         emit_string_data(state, state->data[i]);
     }
+
+    if (state->float_data.size > 0) {
+        genf(".p2align 3");
+        for (size_t i = 0; i < state->float_data.size; i++) {
+            genf(".LF%d:", (int)i);
+            emit_float_data(state, state->float_data.data[i].bits,
+                            state->float_data.data[i].size);
+        }
+    }
 }
@@ -1,20 +1,91 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
-#include <stdio.h>
-
 #include "ast.h"
+#include "outbuf.h"
+
+#ifndef NDEBUG
+
+#define GEN(out, ...)                                       \
+    do {                                                    \
+        outbuf_printf(out, __VA_ARGS__);                    \
+        outbuf_printf(out, " # %s:%d", __func__, __LINE__); \
+        outbuf_end_line(out);                               \
+    } while (0)
+
+#else
+
+#define GEN(out, ...)                    \
+    do {                                 \
+        outbuf_printf(out, __VA_ARGS__); \
+        outbuf_end_line(out);            \
+    } while (0)
+
+#endif
+
+#define genf(...)                         \
+    do {                                  \
+        if (state->out != NULL) {         \
+            GEN(state->out, __VA_ARGS__); \
+        }                                 \
+    } while (0)
+
+#ifdef _WIN32
+#define OS_SYM_PREFIX "_"
+#define TEXT_SECTION(name) ".section " name ",\"x\""
+#else
+#define OS_SYM_PREFIX ""
+#define TEXT_SECTION(name) ".section " name ",\"ax\",@progbits"
+#endif
 
 #define MAX_DATA_COUNT 256
+#define MAX_INLINE_DEPTH 4
+#define MAX_COLD_BLOCK_COUNT 64
+
+#define HOT_FUNC_ALIGNMENT 16
+
+// Loop headers are aligned to 16 bytes if it takes at most 10 bytes of padding
+#define LOOP_ALIGNMENT_LOG2 4
+#define LOOP_ALIGNMENT_MAX_SKIP 10
+
+// A block moved out of line to the end of the function, with the state it was
+// emitted in
+typedef struct ColdBlock {
+    NodeIndex node;
+    int label;
+    int end_label;
+
+    int return_label;
+    const Type* return_type;
+    int temp_struct_stack_offset;
+
+    int in_loop;
+    int break_label;
+    int continue_label;
+
+    int inline_depth;
+    FuncSymbolTableEntry* inline_stack[MAX_INLINE_DEPTH];
+} ColdBlock;
+
+// Floating-point constant, size is 4 for f32 and 8 for f64
+typedef struct FloatData {
+    unsigned long long bits;
+    int size;
+} FloatData;
+
+typedef UtlVector(FloatData) FloatDataList;
 
 typedef struct CodegenState {
-    FILE* out;
+    OutBuf* out;
+    const AST* ast;
 
     int label_count;
 
     int data_count;
     Str data[MAX_DATA_COUNT];
 
+    FloatDataList float_data;
+
     int return_label;
     const Type* return_type;
     int temp_struct_stack_offset;
@@ -22,9 +93,60 @@ typedef struct CodegenState {
     int in_loop;
     int break_label;
     int continue_label;
+
+    // functions being emitted, the outermost one is the function definition
+    // and the rest are expanded inline
+    int inline_depth;
+    FuncSymbolTableEntry* inline_stack[MAX_INLINE_DEPTH];
+
+    int cold_block_count;
+    ColdBlock cold_blocks[MAX_COLD_BLOCK_COUNT];
+
+    // x86-64 only
+    int stack_depth;         // bytes pushed below the frame
+    int temp_count;          // integer temporaries alive
+    int return_ptr_offset;   // spill slot of the hidden return pointer
 } CodegenState;
 
-void codegen(CodegenState* state, ASTNode* node, SymbolTable* sym,
+// i386
+void codegen(CodegenState* state, NodeIndex node, SymbolTable* sym,
              Str entry_sym);
 
+// x86-64 System V
+void codegen_x86_64(CodegenState* state, NodeIndex node, SymbolTable* sym,
+                    Str entry_sym);
+
+/*
+ * Shared by the backends
+ */
+
+static inline int add_label(CodegenState* state) {
+    return state->label_count++;
+}
+
+// Suffix of the SSE scalar instructions
+static inline const char* float_suffix(const Type* type) {
+    return type->primitive_type == TYPE_F32 ? "ss" : "sd";
+}
+
+static inline int log2_int(int n) {
+    int result = 0;
+    while (n > 1) {
+        n >>= 1;
+        result++;
+    }
+    return result;
+}
+
+// Returns the index of the string in the .LC pool
+int add_data(CodegenState* state, Str str);
+
+unsigned long long get_float_bits(double val, PrimitiveType type);
+
+// Returns the index of the constant in the .LF pool
+int add_float_data(CodegenState* state, double val, PrimitiveType type);
+
+void emit_string_data(CodegenState* state, Str s);
+void emit_float_data(CodegenState* state, unsigned long long bits, int size);
+
 #endif
@@ -0,0 +1,1541 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "abi.h"
+#include "codegen.h"
+
+#define INLINE_COPY_LIMIT 32
+
+// Integer temporaries are kept in R8-R11 before spilling to the stack
+#define TEMP_REG_COUNT 4
+
+static const char* const temp_regs[TEMP_REG_COUNT] = {
+    "%r8",
+    "%r9",
+    "%r10",
+    "%r11",
+};
+
+static const char* const gpr_arg_regs[SYSV_GPR_ARG_COUNT] = {
+    "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9",
+};
+
+// Registers for the INTEGER eightbytes of the return value
+static const char* const gpr_ret_regs[][3] = {
+    {"%rax", "%eax", "%al"},
+    {"%rdx", "%edx", "%dl"},
+};
+
+/*
+ *  local 2         [rbp]-16 <-RSP
+ *  local 1         [rbp]-8
+ *  saved RBP       <-RBP
+ *  return addr
+ *  stack arg 1     [rbp]+16
+ *  stack arg 2     [rbp]+24
+ *
+ * Values are kept in RAX, or XMM0 for floating-point numbers. Values up to 32
+ * bits use the 32-bit registers, and 64-bit integers and pointers use the
+ * 64-bit registers.
+ */
+
+// 64-bit integers and pointers
+static inline int is_wide(const Type* type) {
+    return type->size == 8 && !is_float(type) && !is_large_type(type);
+}
+
+static inline const char* op_suffix(const Type* type) {
+    return is_wide(type) ? "q" : "l";
+}
+
+static inline const char* reg_ax(const Type* type) {
+    return is_wide(type) ? "%rax" : "%eax";
+}
+
+static inline const char* reg_cx(const Type* type) {
+    return is_wide(type) ? "%rcx" : "%ecx";
+}
+
+static void push_temp(CodegenState* state) {
+    if (state->temp_count < TEMP_REG_COUNT) {
+        genf("    movq %%rax, %s", temp_regs[state->temp_count]);
+    } else {
+        genf("    pushq %%rax");
+        state->stack_depth += 8;
+    }
+    state->temp_count++;
+}
+
+static void pop_temp(CodegenState* state, const char* reg) {
+    state->temp_count--;
+    if (state->temp_count < TEMP_REG_COUNT) {
+        genf("    movq %s, %s", temp_regs[state->temp_count], reg);
+    } else {
+        genf("    popq %s", reg);
+        state->stack_depth -= 8;
+    }
+}
+
+// Push the floating-point value in XMM0
+static void push_float(CodegenState* state, const Type* type) {
+    genf("    subq $8, %%rsp");
+    genf("    mov%s %%xmm0, (%%rsp)", float_suffix(type));
+    state->stack_depth += 8;
+}
+
+static void pop_float(CodegenState* state, const Type* type, const char* reg) {
+    genf("    mov%s (%%rsp), %s", float_suffix(type), reg);
+    genf("    addq $8, %%rsp");
+    state->stack_depth -= 8;
+}
+
+// The temporaries in registers are clobbered by calls, returns the number of
+// temporaries to restore.
+static int save_temps(CodegenState* state) {
+    int saved = state->temp_count;
+    for (int i = 0; i < MIN(saved, TEMP_REG_COUNT); i++) {
+        genf("    pushq %s", temp_regs[i]);
+        state->stack_depth += 8;
+    }
+    state->temp_count = 0;
+    return saved;
+}
+
+static void restore_temps(CodegenState* state, int saved) {
+    assert(state->temp_count == 0);
+    for (int i = MIN(saved, TEMP_REG_COUNT) - 1; i >= 0; i--) {
+        genf("    popq %s", temp_regs[i]);
+        state->stack_depth -= 8;
+    }
+    state->temp_count = saved;
+}
+
+static void emit_node(CodegenState* state, NodeIndex node);
+
+static inline void emit_stmts(CodegenState* state, NodeIndex node) {
+    StatementListNode stmts = ast_stmts(state->ast, node);
+    for (int i = 0; i < stmts.stmts.count; i++) {
+        emit_node(state, stmts.stmts.nodes[i]);
+    }
+}
+
+static inline void emit_intlit(CodegenState* state, NodeIndex node) {
+    IntLitNode lit = ast_intlit(state->ast, node);
+    long long val = lit.val;
+    if (lit.data_type != TYPE_I64 && lit.data_type != TYPE_U64) {
+        genf("    movl $%d, %%eax", (int)(unsigned int)val);
+    } else if (val >= INT32_MIN && val <= INT32_MAX) {
+        genf("    movq $%lld, %%rax", val);
+    } else {
+        genf("    movabsq $%lld, %%rax", val);
+    }
+}
+
+static inline void emit_floatlit(CodegenState* state, NodeIndex node) {
+    FloatLitNode lit = ast_floatlit(state->ast, node);
+    const Type* type = get_primitive_type(lit.data_type);
+    if (get_float_bits(lit.val, lit.data_type) == 0) {
+        genf("    xorps %%xmm0, %%xmm0");
+    } else {
+        genf("    mov%s .LF%d(%%rip), %%xmm0", float_suffix(type),
+             add_float_data(state, lit.val, lit.data_type));
+    }
+}
+
+static inline void emit_strlit(CodegenState* state, NodeIndex node) {
+    StrLitNode lit = ast_strlit(state->ast, node);
+    genf("    leaq .LC%d(%%rip), %%rax", add_data(state, lit.val));
+}
+
+// load the value into register if it's not a large type, else do nothing.
+static void emit_load_address(CodegenState* state, const Type* type) {
+    if (is_float(type)) {
+        genf("    mov%s (%%rax), %%xmm0", float_suffix(type));
+        return;
+    }
+
+    if (is_large_type(type)) {
+        return;
+    }
+
+    switch (type->size) {
+        case 8:
+            genf("    movq (%%rax), %%rax");
+            break;
+        case 4:
+            genf("    movl (%%rax), %%eax");
+            break;
+        case 2:
+            if (type->primitive_type == TYPE_I16) {
+                genf("    movswl (%%rax), %%eax");
+            } else {
+                genf("    movzwl (%%rax), %%eax");
+            }
+            break;
+        case 1:
+            if (type->primitive_type == TYPE_I8) {
+                genf("    movsbl (%%rax), %%eax");
+            } else {
+                genf("    movzbl (%%rax), %%eax");
+            }
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+static void emit_int_to_float(CodegenState* state, const Type* from,
+                              const Type* to) {
+    const char* suffix = float_suffix(to);
+
+    switch (from->primitive_type) {
+        case TYPE_U64: {
+            // Halve the values with the top bit set, keeping the lowest bit
+            // for rounding, and double the result
+            int half_label = add_label(state);
+            int end_label = add_label(state);
+            genf("    testq %%rax, %%rax");
+            genf("    js .L%d", half_label);
+            genf("    cvtsi2%sq %%rax, %%xmm0", suffix);
+            genf("    jmp .L%d", end_label);
+            genf(".L%d:", half_label);
+            genf("    movq %%rax, %%rcx");
+            genf("    shrq %%rcx");
+            genf("    andl $1, %%eax");
+            genf("    orq %%rax, %%rcx");
+            genf("    cvtsi2%sq %%rcx, %%xmm0", suffix);
+            genf("    add%s %%xmm0, %%xmm0", suffix);
+            genf(".L%d:", end_label);
+        } break;
+
+        case TYPE_U32:
+            genf("    movl %%eax, %%eax");
+            genf("    cvtsi2%sq %%rax, %%xmm0", suffix);
+            break;
+
+        case TYPE_I64:
+            genf("    cvtsi2%sq %%rax, %%xmm0", suffix);
+            break;
+
+        default:
+            genf("    cvtsi2%sl %%eax, %%xmm0", suffix);
+    }
+}
+
+static void emit_float_to_int(CodegenState* state, const Type* from,
+                              const Type* to) {
+    const char* suffix = float_suffix(from);
+
+    switch (to->primitive_type) {
+        case TYPE_U64: {
+            // Values with the top bit set don't fit in the signed conversion,
+            // they are biased down first and the top bit is put back in RCX.
+            int bias_data = add_float_data(state, 9223372036854775808.0,
+                                           from->primitive_type);
+            int label = add_label(state);
+
+            genf("    xorl %%ecx, %%ecx");
+            genf("    ucomi%s .LF%d(%%rip), %%xmm0", suffix, bias_data);
+            genf("    jb .L%d", label);
+            genf("    sub%s .LF%d(%%rip), %%xmm0", suffix, bias_data);
+            genf("    movabsq $0x8000000000000000, %%rcx");
+            genf(".L%d:", label);
+            genf("    cvtt%s2si %%xmm0, %%rax", suffix);
+            genf("    xorq %%rcx, %%rax");
+        } break;
+
+        case TYPE_U32:
+        case TYPE_I64:
+            genf("    cvtt%s2si %%xmm0, %%rax", suffix);
+            break;
+
+        default:
+            genf("    cvtt%s2si %%xmm0, %%eax", suffix);
+    }
+}
+
+// Convert the value between arithmetic types and pointers
+static void emit_convert(CodegenState* state, const Type* from,
+                         const Type* to) {
+    if (is_float(to)) {
+        if (is_int(from)) {
+            emit_int_to_float(state, from, to);
+        } else if (from->primitive_type != to->primitive_type) {
+            if (to->primitive_type == TYPE_F64) {
+                genf("    cvtss2sd %%xmm0, %%xmm0");
+            } else {
+                genf("    cvtsd2ss %%xmm0, %%xmm0");
+            }
+        }
+        return;
+    }
+
+    if (is_float(from)) {
+        emit_float_to_int(state, from, to);
+        return;
+    }
+
+    if (!is_wide(to) || is_wide(from) || is_large_type(from)) {
+        return;
+    }
+
+    if (is_int(from) && is_signed(from->primitive_type)) {
+        genf("    movslq %%eax, %%rax");
+    } else {
+        genf("    movl %%eax, %%eax");
+    }
+}
+
+static inline int is_float_binop(const AST* ast, BinaryOpNode binop) {
+    const Type* l_type = ast_type_info(ast, binop.left).type;
+    const Type* r_type = ast_type_info(ast, binop.right).type;
+    return is_float(l_type) || is_float(r_type);
+}
+
+static void emit_binop_float(CodegenState* state, NodeIndex node) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    TypeInfo l_info = ast_type_info(state->ast, binop.left);
+    const Type* l_type = l_info.type;
+    TypeInfo r_info = ast_type_info(state->ast, binop.right);
+    const Type* r_type = r_info.type;
+
+    const Type* type = get_primitive_type(
+        implicit_type_convert(l_type->primitive_type, r_type->primitive_type));
+    const char* suffix = float_suffix(type);
+
+    emit_node(state, binop.left);
+    if (l_info.is_address) {
+        emit_load_address(state, l_type);
+    }
+    emit_convert(state, l_type, type);
+    push_float(state, type);
+
+    emit_node(state, binop.right);
+    if (r_info.is_address) {
+        emit_load_address(state, r_type);
+    }
+    emit_convert(state, r_type, type);
+
+    // left = XMM0, right = XMM1
+    genf("    movaps %%xmm0, %%xmm1");
+    pop_float(state, type, "%xmm0");
+
+    switch (binop.op) {
+        case TK_ADD:
+            genf("    add%s %%xmm1, %%xmm0", suffix);
+            break;
+
+        case TK_SUB:
+            genf("    sub%s %%xmm1, %%xmm0", suffix);
+            break;
+
+        case TK_MUL:
+            genf("    mul%s %%xmm1, %%xmm0", suffix);
+            break;
+
+        case TK_DIV:
+            genf("    div%s %%xmm1, %%xmm0", suffix);
+            break;
+
+        // Unordered compares set ZF, PF and CF
+        case TK_EQ:
+            genf("    ucomi%s %%xmm1, %%xmm0", suffix);
+            genf("    sete %%al");
+            genf("    setnp %%cl");
+            genf("    andb %%cl, %%al");
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        case TK_NE:
+            genf("    ucomi%s %%xmm1, %%xmm0", suffix);
+            genf("    setne %%al");
+            genf("    setp %%cl");
+            genf("    orb %%cl, %%al");
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        case TK_GT:
+        case TK_GE:
+            genf("    ucomi%s %%xmm1, %%xmm0", suffix);
+            genf(binop.op == TK_GT ? "    seta %%al" : "    setae %%al");
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        case TK_LT:
+        case TK_LE:
+            genf("    ucomi%s %%xmm0, %%xmm1", suffix);
+            genf(binop.op == TK_LT ? "    seta %%al" : "    setae %%al");
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+static void emit_cond(CodegenState* state, NodeIndex expr) {
+    emit_node(state, expr);
+    TypeInfo expr_info = ast_type_info(state->ast, expr);
+    const Type* type = expr_info.type;
+    if (expr_info.is_address) {
+        emit_load_address(state, type);
+    }
+
+    genf("    test%s %s, %s", op_suffix(type), reg_ax(type), reg_ax(type));
+}
+
+static void emit_logical_binop(CodegenState* state, NodeIndex node) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    int label = add_label(state);
+
+    emit_cond(state, binop.left);
+    if (binop.op == TK_LOR) {
+        genf("    jnz .L%d", label);
+    } else if (binop.op == TK_LAND) {
+        genf("    jz .L%d", label);
+    } else {
+        UNREACHABLE();
+    }
+
+    emit_node(state, binop.right);
+    TypeInfo r_info = ast_type_info(state->ast, binop.right);
+    if (r_info.is_address) {
+        emit_load_address(state, r_info.type);
+    }
+
+    genf(".L%d:", label);
+}
+
+// Type the operands are converted to before the operation
+static const Type* get_binop_type(const AST* ast, BinaryOpNode binop) {
+    const Type* l_type = ast_type_info(ast, binop.left).type;
+    const Type* r_type = ast_type_info(ast, binop.right).type;
+
+    if (is_bool(l_type)) {
+        return l_type;
+    }
+
+    if (binop.op == TK_ADD || binop.op == TK_SUB) {
+        if (is_array_ptr(l_type)) {
+            return l_type;
+        }
+        if (is_array_ptr(r_type)) {
+            return r_type;
+        }
+    }
+
+    int pri_ltype = is_ptr_like(l_type) ? TYPE_U64 : l_type->primitive_type;
+    int pri_rtype = is_ptr_like(r_type) ? TYPE_U64 : r_type->primitive_type;
+    return get_primitive_type(implicit_type_convert(pri_ltype, pri_rtype));
+}
+
+// Convert an operand of the binary operation, the index of pointer arithmetic
+// is extended to 64 bits
+static void emit_convert_operand(CodegenState* state, const Type* from,
+                                 const Type* to) {
+    if (is_array_ptr(to) && !is_array_ptr(from)) {
+        to = get_primitive_type(is_signed(from->primitive_type) ? TYPE_I64
+                                                                : TYPE_U64);
+    }
+    emit_convert(state, from, to);
+}
+
+static void emit_binop(CodegenState* state, NodeIndex node) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    if (binop.op == TK_COMMA) {
+        emit_node(state, binop.left);
+        emit_node(state, binop.right);
+        return;
+    }
+
+    if (binop.op == TK_LOR || binop.op == TK_LAND) {
+        emit_logical_binop(state, node);
+        return;
+    }
+
+    if (is_float_binop(state->ast, binop)) {
+        emit_binop_float(state, node);
+        return;
+    }
+
+    TypeInfo l_info = ast_type_info(state->ast, binop.left);
+    const Type* l_type = l_info.type;
+    TypeInfo r_info = ast_type_info(state->ast, binop.right);
+    const Type* r_type = r_info.type;
+
+    const Type* type = get_binop_type(state->ast, binop);
+
+    emit_node(state, binop.left);
+    if (l_info.is_address) {
+        emit_load_address(state, l_type);
+    }
+    emit_convert_operand(state, l_type, type);
+
+    push_temp(state);
+
+    emit_node(state, binop.right);
+    if (r_info.is_address) {
+        emit_load_address(state, r_type);
+    }
+    emit_convert_operand(state, r_type, type);
+
+    genf("    movq %%rax, %%rcx");
+    pop_temp(state, "%rax");
+
+    // left = RAX, right = RCX
+    const char* suffix = op_suffix(type);
+    const char* ax = reg_ax(type);
+    const char* cx = reg_cx(type);
+
+    switch (binop.op) {
+        case TK_ADD:
+        case TK_SUB: {
+            int l_ptr = is_array_ptr(l_type);
+            int r_ptr = is_array_ptr(r_type);
+
+            if (l_ptr || r_ptr) {  // Pointers
+                const Type* p_type = l_ptr ? l_type : r_type;
+                int size;
+                if (is_void(p_type->inner_type)) {
+                    size = 1;
+                } else if (p_type->inner_type->incomplete) {
+                    UNREACHABLE();
+                } else {
+                    size = p_type->inner_type->size;
+                }
+
+                if (size != 1) {
+                    if (l_ptr) {
+                        genf("    imulq $%d, %%rcx", size);
+                    } else {
+                        genf("    imulq $%d, %%rax", size);
+                    }
+                }
+                suffix = "q";
+                ax = "%rax";
+                cx = "%rcx";
+            }
+
+            if (binop.op == TK_ADD) {
+                genf("    add%s %s, %s", suffix, cx, ax);
+            } else {  // TK_SUB
+                genf("    sub%s %s, %s", suffix, cx, ax);
+            }
+        } break;
+
+        case TK_EQ:
+        case TK_NE:
+        case TK_LT:
+        case TK_LE:
+        case TK_GT:
+        case TK_GE: {
+            int result_signed =
+                !is_bool(type) && is_signed(type->primitive_type);
+
+            genf("    cmp%s %s, %s", suffix, cx, ax);
+            switch (binop.op) {
+                case TK_EQ:
+                    genf("    sete %%al");
+                    break;
+                case TK_NE:
+                    genf("    setne %%al");
+                    break;
+                case TK_LT:
+                    genf(result_signed ? "    setl %%al" : "    setb %%al");
+                    break;
+                case TK_LE:
+                    genf(result_signed ? "    setle %%al" : "    setbe %%al");
+                    break;
+                case TK_GT:
+                    genf(result_signed ? "    setg %%al" : "    seta %%al");
+                    break;
+                case TK_GE:
+                    genf(result_signed ? "    setge %%al" : "    setae %%al");
+                    break;
+                default:
+                    break;
+            }
+            genf("    movzbl %%al, %%eax");
+        } break;
+
+        case TK_MUL:
+            genf("    imul%s %s, %s", suffix, cx, ax);
+            break;
+
+        case TK_DIV:
+        case TK_MOD:
+            if (is_signed(type->primitive_type)) {
+                genf(is_wide(type) ? "    cqto" : "    cltd");
+                genf("    idiv%s %s", suffix, cx);
+            } else {
+                genf("    xorl %%edx, %%edx");
+                genf("    div%s %s", suffix, cx);
+            }
+            if (binop.op == TK_MOD) {
+                genf(is_wide(type) ? "    movq %%rdx, %%rax"
+                                   : "    movl %%edx, %%eax");
+            }
+            break;
+
+        case TK_SHL:
+            genf("    shl%s %%cl, %s", suffix, ax);
+            break;
+
+        case TK_SHR:
+            if (is_signed(type->primitive_type)) {
+                genf("    sar%s %%cl, %s", suffix, ax);
+            } else {
+                genf("    shr%s %%cl, %s", suffix, ax);
+            }
+            break;
+
+        case TK_AND:
+            genf("    and%s %s, %s", suffix, cx, ax);
+            break;
+
+        case TK_XOR:
+            genf("    xor%s %s, %s", suffix, cx, ax);
+            break;
+
+        case TK_OR:
+            genf("    or%s %s, %s", suffix, cx, ax);
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+static void emit_unaryop(CodegenState* state, NodeIndex node) {
+    UnaryOpNode unaryop = ast_unaryop(state->ast, node);
+    emit_node(state, unaryop.node);
+
+    TypeInfo info = ast_type_info(state->ast, unaryop.node);
+    int is_address = info.is_address;
+    const Type* type = info.type;
+
+    if (unaryop.op != TK_AND && is_address) {
+        emit_load_address(state, type);
+    }
+
+    switch (unaryop.op) {
+        case TK_ADD:
+        case TK_MUL:
+        case TK_AND:
+            break;
+
+        case TK_SUB:
+            if (is_float(type)) {
+                genf("    mov%s .LF%d(%%rip), %%xmm1", float_suffix(type),
+                     add_float_data(state, -0.0, type->primitive_type));
+                genf("    xorps %%xmm1, %%xmm0");
+                break;
+            }
+            genf("    neg%s %s", op_suffix(type), reg_ax(type));
+            break;
+
+        case TK_NOT:
+            genf("    not%s %s", op_suffix(type), reg_ax(type));
+            break;
+
+        case TK_LNOT:
+            genf("    test%s %s, %s", op_suffix(type), reg_ax(type),
+                 reg_ax(type));
+            genf("    sete %%al");
+            genf("    movzbl %%al, %%eax");
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+static void emit_var(CodegenState* state, NodeIndex node) {
+    VarNode var = ast_var(state->ast, node);
+    switch (var.ste->type) {
+        case SYM_VAR: {
+            // Variable
+            VarSymbolTableEntry* var_ste = (VarSymbolTableEntry*)var.ste;
+            if (var_ste->attr == SYM_ATTR_EXPORT || var_ste->is_global) {
+                genf("    leaq %.*s(%%rip), %%rax", var_ste->ident.len,
+                     var_ste->ident.ptr);
+            } else if (var_ste->is_arg) {
+                // Argument passed on the stack
+                genf("    leaq %d(%%rbp), %%rax",
+                     var_ste->offset + var_ste->sym->arg_offset);
+            } else {
+                // Local variable
+                genf("    leaq -%d(%%rbp), %%rax", var_ste->offset);
+            }
+        } break;
+        case SYM_FUNC:
+            // Function pointer
+            genf("    leaq %.*s(%%rip), %%rax", var.ste->ident.len,
+                 var.ste->ident.ptr);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+// dest and src cannot be %rdx, %rsi, %rdi
+static void emit_memcpy(CodegenState* state, const char* dest, const char* src,
+                        int size) {
+    if (size <= INLINE_COPY_LIMIT) {
+        int offset = 0;
+        for (; size - offset >= 8; offset += 8) {
+            genf("    movq %d(%s), %%rdx", offset, src);
+            genf("    movq %%rdx, %d(%s)", offset, dest);
+        }
+        if (size - offset >= 4) {
+            genf("    movl %d(%s), %%edx", offset, src);
+            genf("    movl %%edx, %d(%s)", offset, dest);
+            offset += 4;
+        }
+        if (size - offset >= 2) {
+            genf("    movw %d(%s), %%dx", offset, src);
+            genf("    movw %%dx, %d(%s)", offset, dest);
+            offset += 2;
+        }
+        if (size - offset == 1) {
+            genf("    movb %d(%s), %%dl", offset, src);
+            genf("    movb %%dl, %d(%s)", offset, dest);
+        }
+        return;
+    }
+
+    genf("    pushq %%rcx");
+    genf("    movq %s, %%rsi", src);
+    genf("    movq %s, %%rdi", dest);
+    genf("    movl $%d, %%ecx", size);
+    genf("    cld");
+    genf("    rep movsb");
+    genf("    popq %%rcx");
+}
+
+static void emit_assign(CodegenState* state, NodeIndex node) {
+    AssignNode assign = ast_assign(state->ast, node);
+    emit_node(state, assign.left);
+
+    TypeInfo l_info = ast_type_info(state->ast, assign.left);
+    const Type* l_type = l_info.type;
+
+    push_temp(state);
+
+    emit_node(state, assign.right);
+    TypeInfo r_info = ast_type_info(state->ast, assign.right);
+    if (r_info.is_address) {
+        emit_load_address(state, r_info.type);
+    }
+    emit_convert(state, r_info.type, l_type);
+
+    pop_temp(state, "%rcx");
+
+    // rcx = left addr, rax = right
+    if (is_float(l_type)) {
+        genf("    mov%s %%xmm0, (%%rcx)", float_suffix(l_type));
+    } else if (is_large_type(l_type)) {
+        emit_memcpy(state, "%rcx", "%rax", l_type->size);
+    } else {
+        switch (l_type->size) {
+            case 8:
+                genf("    movq %%rax, (%%rcx)");
+                break;
+            case 4:
+                genf("    movl %%eax, (%%rcx)");
+                break;
+            case 2:
+                genf("    movw %%ax, (%%rcx)");
+                break;
+            case 1:
+                genf("    movb %%al, (%%rcx)");
+                break;
+            default:
+                UNREACHABLE();
+        }
+    }
+
+    genf("    movq %%rcx, %%rax");
+}
+
+static void emit_if(CodegenState* state, NodeIndex node) {
+    IfStatementNode if_node = ast_if(state->ast, node);
+    /*
+     *      <cond>
+     *      JZ else_label
+     *      <then_block>
+     *      JMP end_label
+     *  else_label:
+     *      <else_block>
+     *  end_label:
+     */
+    int else_label = add_label(state);
+    int end_label = add_label(state);
+
+    emit_cond(state, if_node.expr);
+    genf("    jz .L%d", else_label);
+
+    emit_node(state, if_node.then_block);
+
+    genf("    jmp .L%d", end_label);
+    genf(".L%d:", else_label);
+
+    if (if_node.else_block) {
+        emit_node(state, if_node.else_block);
+    }
+
+    genf(".L%d:", end_label);
+}
+
+static void emit_while(CodegenState* state, NodeIndex node) {
+    WhileNode while_node = ast_while(state->ast, node);
+    /*
+     *      JMP cond_label
+     *  loop_label:
+     *      <block>
+     *  inc_label:
+     *      <inc>
+     *  cond_label:
+     *      <cond>
+     *      JNZ loop_label
+     *  end_lable:
+     */
+
+    int loop_label = add_label(state);
+    int inc_label = add_label(state);
+    int cond_label = add_label(state);
+    int end_label = add_label(state);
+
+    genf("    jmp .L%d", cond_label);
+    genf("    .p2align %d,,%d", LOOP_ALIGNMENT_LOG2, LOOP_ALIGNMENT_MAX_SKIP);
+    genf(".L%d:", loop_label);
+
+    int prev_in_loop = state->in_loop;
+    int prev_break_label = state->break_label;
+    int prev_continue_label = state->continue_label;
+
+    state->in_loop = 1;
+    state->break_label = end_label;
+    state->continue_label = inc_label;
+
+    emit_node(state, while_node.block);
+
+    state->in_loop = prev_in_loop;
+    state->break_label = prev_break_label;
+    state->continue_label = prev_continue_label;
+
+    genf(".L%d:", inc_label);
+    if (while_node.inc) {
+        emit_node(state, while_node.inc);
+    }
+
+    genf(".L%d:", cond_label);
+    emit_cond(state, while_node.expr);
+    genf("    jnz .L%d", loop_label);
+
+    genf(".L%d:", end_label);
+}
+
+static inline void emit_goto(CodegenState* state, NodeIndex node) {
+    GotoNode goto_node = ast_goto(state->ast, node);
+    switch (goto_node.op) {
+        case TK_BREAK:
+            genf("    jmp .L%d", state->break_label);
+            break;
+        case TK_CONTINUE:
+            genf("    jmp .L%d", state->continue_label);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+typedef struct CallArg {
+    NodeIndex node;
+    const Type* type;  // type passed to the callee
+    SysVArgLoc loc;
+    int offset;  // offset in the outgoing argument area
+} CallArg;
+
+// Store the value of the argument to the outgoing argument area
+static void emit_store_arg(CodegenState* state, const CallArg* arg) {
+    emit_node(state, arg->node);
+
+    TypeInfo info = ast_type_info(state->ast, arg->node);
+    const Type* type = info.type;
+    if (info.is_address) {
+        emit_load_address(state, type);
+    }
+    emit_convert(state, type, arg->type);
+
+    if (is_float(arg->type)) {
+        genf("    mov%s %%xmm0, %d(%%rsp)", float_suffix(arg->type),
+             arg->offset);
+    } else if (is_large_type(arg->type)) {
+        genf("    leaq %d(%%rsp), %%rcx", arg->offset);
+        emit_memcpy(state, "%rcx", "%rax", arg->type->size);
+    } else {
+        genf("    movq %%rax, %d(%%rsp)", arg->offset);
+    }
+}
+
+// Load the argument passed in registers from the outgoing argument area
+static void emit_load_arg(CodegenState* state, const CallArg* arg) {
+    for (int i = 0; i < arg->loc.eightbyte_count; i++) {
+        int offset = arg->offset + i * 8;
+        if (arg->loc.classes[i] == ARG_CLASS_INTEGER) {
+            genf("    movq %d(%%rsp), %s", offset,
+                 gpr_arg_regs[arg->loc.regs[i]]);
+        } else if (is_float(arg->type)) {
+            genf("    mov%s %d(%%rsp), %%xmm%d", float_suffix(arg->type),
+                 offset, arg->loc.regs[i]);
+        } else {
+            genf("    movq %d(%%rsp), %%xmm%d", offset, arg->loc.regs[i]);
+        }
+    }
+}
+
+// Store the struct returned in registers to the temporary space
+static void emit_store_struct_return(CodegenState* state, const Type* type) {
+    ArgClass classes[SYSV_MAX_EIGHTBYTES];
+    int count = sysv_classify(type, classes);
+
+    int gpr_count = 0;
+    int sse_count = 0;
+    for (int i = 0; i < count; i++) {
+        int offset = state->temp_struct_stack_offset - i * 8;
+        if (classes[i] == ARG_CLASS_INTEGER) {
+            genf("    movq %s, -%d(%%rbp)", gpr_ret_regs[gpr_count++][0],
+                 offset);
+        } else {
+            genf("    movq %%xmm%d, -%d(%%rbp)", sse_count++, offset);
+        }
+    }
+
+    genf("    leaq -%d(%%rbp), %%rax", state->temp_struct_stack_offset);
+}
+
+static void emit_sysv_call(CodegenState* state, CallArg* args, int arg_count,
+                           const Type* return_type, int has_va_args,
+                           const char* func_name, NodeIndex func_node) {
+    int saved_temps = save_temps(state);
+
+    SysVArgState arg_state;
+    sysv_init_args(&arg_state, return_type);
+    for (int i = 0; i < arg_count; i++) {
+        sysv_assign_arg(&arg_state, args[i].type, &args[i].loc);
+    }
+
+    /*
+     *  stack arg 1     [rsp]
+     *  stack arg 2     [rsp]+8
+     *  register arg 1
+     *  register arg 2
+     *  padding
+     */
+    int area_size = arg_state.stack_size;
+    for (int i = 0; i < arg_count; i++) {
+        if (args[i].loc.eightbyte_count > 0) {
+            args[i].offset = area_size;
+            area_size += args[i].loc.eightbyte_count * 8;
+        } else {
+            args[i].offset = args[i].loc.stack_offset;
+        }
+    }
+
+    // RSP is 16-byte aligned at the call
+    area_size += (16 - (state->stack_depth + area_size) % 16) % 16;
+    if (area_size > 0) {
+        genf("    subq $%d, %%rsp", area_size);
+        state->stack_depth += area_size;
+    }
+
+    for (int i = arg_count - 1; i >= 0; i--) {
+        emit_store_arg(state, &args[i]);
+    }
+
+    if (func_node) {
+        emit_node(state, func_node);
+        TypeInfo info = ast_type_info(state->ast, func_node);
+        if (info.is_address) {
+            emit_load_address(state, info.type);
+        }
+        genf("    movq %%rax, %%r11");
+    }
+
+    if (sysv_ret_in_memory(return_type)) {
+        genf("    leaq -%d(%%rbp), %%rdi", state->temp_struct_stack_offset);
+    }
+
+    for (int i = 0; i < arg_count; i++) {
+        emit_load_arg(state, &args[i]);
+    }
+
+    if (has_va_args) {
+        // number of vector registers used
+        genf("    movl $%d, %%eax", arg_state.sse_count);
+    }
+
+    if (func_node) {
+        genf("    call *%%r11");
+    } else {
+        genf("    call %s", func_name);
+    }
+
+    if (area_size > 0) {
+        genf("    addq $%d, %%rsp", area_size);
+        state->stack_depth -= area_size;
+    }
+
+    if (is_large_type(return_type) && !sysv_ret_in_memory(return_type)) {
+        emit_store_struct_return(state, return_type);
+    } else if (return_type->type == METADATA_PRIMITIVE) {
+        // Small integers are extended by the caller
+        switch (return_type->primitive_type) {
+            case TYPE_BOOL:
+            case TYPE_U8:
+                genf("    movzbl %%al, %%eax");
+                break;
+            case TYPE_I8:
+                genf("    movsbl %%al, %%eax");
+                break;
+            case TYPE_U16:
+                genf("    movzwl %%ax, %%eax");
+                break;
+            case TYPE_I16:
+                genf("    movswl %%ax, %%eax");
+                break;
+            default:
+                break;
+        }
+    }
+
+    restore_temps(state, saved_temps);
+}
+
+static void emit_call(CodegenState* state, NodeIndex node) {
+    CallNode call = ast_call(state->ast, node);
+    TypeInfo func_info = ast_type_info(state->ast, call.node);
+    const Type* func_type = func_info.type;
+    assert(func_type->type == METADATA_FUNC);
+    const FuncMetadata* func_data = &func_type->func_data;
+
+    int arg_count = call.args.count;
+    CallArg* args = malloc(sizeof(CallArg) * (arg_count > 0 ? arg_count : 1));
+
+    // Both lists are in reverse order
+    for (int i = 0; i < arg_count; i++) {
+        args[i].node = call.args.nodes[arg_count - 1 - i];
+        args[i].type = ast_type_info(state->ast, args[i].node).type;
+        if (is_float(args[i].type)) {
+            // default argument promotion
+            args[i].type = get_primitive_type(TYPE_F64);
+        }
+    }
+
+    int param_count = 0;
+    ArgList* param = func_data->args;
+    while (param) {
+        param_count++;
+        param = param->next;
+    }
+
+    int i = param_count - 1;
+    param = func_data->args;
+    while (param) {
+        args[i--].type = param->type;
+        param = param->next;
+    }
+
+    // Direct calls use the symbol
+    const SymbolTableEntry* ste = NULL;
+    if (ast_node_type(state->ast, call.node) == NODE_VAR) {
+        ste = ast_var(state->ast, call.node).ste;
+        if (ste->type != SYM_FUNC) {
+            ste = NULL;
+        }
+    }
+
+    if (ste) {
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", ste->ident.len, ste->ident.ptr);
+        emit_sysv_call(state, args, arg_count, func_data->return_type,
+                       func_data->has_va_args, name, 0);
+    } else {
+        emit_sysv_call(state, args, arg_count, func_data->return_type,
+                       func_data->has_va_args, NULL, call.node);
+    }
+
+    free(args);
+}
+
+static void emit_print(CodegenState* state, NodeIndex node) {
+    PrintNode print_node = ast_print(state->ast, node);
+    int arg_count = print_node.args.count + 1;
+
+    CallArg* args = malloc(sizeof(CallArg) * arg_count);
+
+    args[0].node = print_node.fmt;
+    args[0].type = get_string_type();
+
+    for (int i = 1; i < arg_count; i++) {
+        args[i].node = print_node.args.nodes[arg_count - 1 - i];
+        args[i].type = ast_type_info(state->ast, args[i].node).type;
+        if (is_float(args[i].type)) {
+            // printf takes double
+            args[i].type = get_primitive_type(TYPE_F64);
+        }
+    }
+
+    emit_sysv_call(state, args, arg_count, get_primitive_type(TYPE_I32), 1,
+                   "printf", 0);
+
+    free(args);
+}
+
+// Load the eightbyte at offset of the struct in RCX
+static void emit_load_eightbyte(CodegenState* state, const char* const* reg,
+                                int offset, int size) {
+    switch (size) {
+        case 8:
+            genf("    movq %d(%%rcx), %s", offset, reg[0]);
+            break;
+        case 4:
+            genf("    movl %d(%%rcx), %s", offset, reg[1]);
+            break;
+        case 2:
+            genf("    movzwl %d(%%rcx), %s", offset, reg[1]);
+            break;
+        case 1:
+            genf("    movzbl %d(%%rcx), %s", offset, reg[1]);
+            break;
+        default:
+            genf("    xorl %s, %s", reg[1], reg[1]);
+            for (int i = size - 1; i >= 0; i--) {
+                genf("    shlq $8, %s", reg[0]);
+                genf("    movb %d(%%rcx), %s", offset + i, reg[2]);
+            }
+    }
+}
+
+static void emit_ret(CodegenState* state, NodeIndex node) {
+    ReturnNode ret = ast_ret(state->ast, node);
+    if (ret.expr) {
+        emit_node(state, ret.expr);
+        TypeInfo expr_info = ast_type_info(state->ast, ret.expr);
+        if (expr_info.is_address) {
+            emit_load_address(state, expr_info.type);
+        }
+
+        const Type* return_type = ast_type_info(state->ast, ret.expr).type;
+        emit_convert(state, return_type, state->return_type);
+        if (sysv_ret_in_memory(return_type)) {
+            genf("    movq -%d(%%rbp), %%rcx", state->return_ptr_offset);
+            emit_memcpy(state, "%rcx", "%rax", return_type->size);
+            genf("    movq %%rcx, %%rax");
+        } else if (is_large_type(return_type)) {
+            // Returned in registers
+            ArgClass classes[SYSV_MAX_EIGHTBYTES];
+            int count = sysv_classify(return_type, classes);
+
+            genf("    movq %%rax, %%rcx");
+            int gpr_count = 0;
+            int sse_count = 0;
+            for (int i = 0; i < count; i++) {
+                int size = MIN(8, return_type->size - i * 8);
+                if (classes[i] == ARG_CLASS_INTEGER) {
+                    emit_load_eightbyte(state, gpr_ret_regs[gpr_count++], i * 8,
+                                        size);
+                } else {
+                    genf("    mov%s %d(%%rcx), %%xmm%d",
+                         size == 4 ? "ss" : "q", i * 8, sse_count++);
+                }
+            }
+        }
+    }
+
+    genf("    jmp .L%d", state->return_label);
+}
+
+static void emit_field(CodegenState* state, NodeIndex node) {
+    FieldNode field = ast_field(state->ast, node);
+    emit_node(state, field.node);
+
+    const Type* l_type = ast_type_info(state->ast, field.node).type;
+    if (l_type->type == METADATA_POINTER && l_type->pointer_level == 1) {
+        // member access through pointer
+        emit_load_address(state, l_type);
+        l_type = l_type->inner_type;
+    }
+
+    const TypeSymbolTableEntry* type_ste = l_type->type_ste;
+    FieldSymbolTableEntry* ste = (FieldSymbolTableEntry*)symbol_table_find(
+        type_ste->name_space, field.ident, 1);
+    assert(ste != NULL && ste->type == SYM_FIELD);
+
+    genf("    leaq %d(%%rax), %%rax", ste->offset);
+}
+
+static void emit_indexof(CodegenState* state, NodeIndex node) {
+    IndexOfNode idxof = ast_indexof(state->ast, node);
+    emit_node(state, idxof.left);
+
+    TypeInfo l_info = ast_type_info(state->ast, idxof.left);
+    const Type* l_type = l_info.type;
+    if (l_info.is_address && l_type->array_size == 0) {
+        emit_load_address(state, l_info.type);
+    }
+
+    push_temp(state);
+
+    emit_node(state, idxof.right);
+
+    TypeInfo r_info = ast_type_info(state->ast, idxof.right);
+    const Type* r_type = r_info.type;
+    if (r_info.is_address) {
+        emit_load_address(state, r_type);
+    }
+    emit_convert(state, r_type,
+                 get_primitive_type(is_signed(r_type->primitive_type)
+                                        ? TYPE_I64
+                                        : TYPE_U64));
+
+    pop_temp(state, "%rcx");
+    // rcx = array, rax = index
+    if (l_type->inner_type->size != 1) {
+        genf("    imulq $%d, %%rax", l_type->inner_type->size);
+    }
+    genf("    addq %%rcx, %%rax");
+}
+
+static void emit_cast(CodegenState* state, NodeIndex node) {
+    CastNode cast = ast_cast(state->ast, node);
+    emit_node(state, cast.expr);
+
+    TypeInfo expr_info = ast_type_info(state->ast, cast.expr);
+    if (expr_info.is_address) {
+        emit_load_address(state, expr_info.type);
+    }
+    emit_convert(state, expr_info.type, cast.data_type);
+}
+
+static void emit_asm(CodegenState* state, NodeIndex node) {
+    AsmNode asm_node = ast_asm(state->ast, node);
+    genf("%.*s", asm_node.asm_str.len, asm_node.asm_str.ptr);
+}
+
+static void emit_node(CodegenState* state, NodeIndex node) {
+    switch (ast_node_type(state->ast, node)) {
+        case NODE_STMTS:
+            emit_stmts(state, node);
+            break;
+
+        case NODE_INTLIT:
+            emit_intlit(state, node);
+            break;
+
+        case NODE_FLOATLIT:
+            emit_floatlit(state, node);
+            break;
+
+        case NODE_STRLIT:
+            emit_strlit(state, node);
+            break;
+
+        case NODE_BINARYOP:
+            emit_binop(state, node);
+            break;
+
+        case NODE_UNARYOP:
+            emit_unaryop(state, node);
+            break;
+
+        case NODE_VAR:
+            emit_var(state, node);
+            break;
+
+        case NODE_ASSIGN:
+            emit_assign(state, node);
+            break;
+
+        case NODE_IF:
+            emit_if(state, node);
+            break;
+
+        case NODE_WHILE:
+            emit_while(state, node);
+            break;
+
+        case NODE_GOTO:
+            emit_goto(state, node);
+            break;
+
+        case NODE_CALL:
+            emit_call(state, node);
+            break;
+
+        case NODE_PRINT:
+            emit_print(state, node);
+            break;
+
+        case NODE_RET:
+            emit_ret(state, node);
+            break;
+
+        case NODE_FIELD:
+            emit_field(state, node);
+            break;
+
+        case NODE_INDEXOF:
+            emit_indexof(state, node);
+            break;
+
+        case NODE_CAST:
+            emit_cast(state, node);
+            break;
+
+        case NODE_HINT:
+            emit_node(state, ast_hint(state->ast, node).expr);
+            break;
+
+        case NODE_ASM:
+            emit_asm(state, node);
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+static inline void emit_func_start(CodegenState* state, int stack_size) {
+    // Keep RSP 16-byte aligned
+    stack_size += (16 - stack_size % 16) % 16;
+
+    genf("    pushq %%rbp");
+    genf("    movq %%rsp, %%rbp");
+    if (stack_size > 0) {
+        genf("    subq $%d, %%rsp", stack_size);
+    }
+}
+
+static inline void setup_func_state(CodegenState* state,
+                                    const Type* return_type,
+                                    const SymbolTable* sym) {
+    state->return_label = add_label(state);
+    state->return_type = return_type;
+    state->temp_struct_stack_offset = *sym->stack_size;
+    state->return_ptr_offset = sym->reg_arg_offset + REGISTER_SIZE;
+    state->stack_depth = 0;
+    state->temp_count = 0;
+}
+
+// Spill the arguments passed in registers, in the same layout as sema
+static void emit_spill_args(CodegenState* state, ArgList* arg,
+                            SysVArgState* arg_state, int reg_arg_offset,
+                            int* spill_size) {
+    if (arg == NULL) {
+        return;
+    }
+
+    // args are stored in reverse order
+    emit_spill_args(state, arg->next, arg_state, reg_arg_offset, spill_size);
+
+    SysVArgLoc loc;
+    sysv_assign_arg(arg_state, arg->type, &loc);
+    if (loc.eightbyte_count == 0) {
+        return;
+    }
+
+    *spill_size += loc.eightbyte_count * REGISTER_SIZE;
+    int offset = reg_arg_offset + *spill_size;
+    for (int i = 0; i < loc.eightbyte_count; i++) {
+        if (loc.classes[i] == ARG_CLASS_INTEGER) {
+            genf("    movq %s, -%d(%%rbp)", gpr_arg_regs[loc.regs[i]],
+                 offset - i * 8);
+        } else {
+            genf("    movq %%xmm%d, -%d(%%rbp)", loc.regs[i], offset - i * 8);
+        }
+    }
+}
+
+static void emit_func(CodegenState* state, FuncSymbolTableEntry* func) {
+    const FuncMetadata* func_data = &func->func_data;
+    SymbolTable* func_sym = func->func_sym;
+
+    int alignment = func_data->alignment;
+    if (func_data->attrs & FUNC_ATTR_HOT) {
+        genf(TEXT_SECTION(".text.hot"));
+        if (alignment == 0) {
+            alignment = HOT_FUNC_ALIGNMENT;
+        }
+    } else if (func_data->attrs & FUNC_ATTR_COLD) {
+        genf(TEXT_SECTION(".text.unlikely"));
+    }
+
+    if (alignment > 1) {
+        genf("    .p2align %d", log2_int(alignment));
+    }
+
+    genf("%.*s:", func->ident.len, func->ident.ptr);
+
+    setup_func_state(state, func_data->return_type, func_sym);
+    emit_func_start(state, *func_sym->stack_size);
+
+    SysVArgState arg_state;
+    sysv_init_args(&arg_state, func_data->return_type);
+
+    int spill_size = 0;
+    if (arg_state.gpr_count > 0) {
+        // hidden return pointer
+        spill_size += REGISTER_SIZE;
+        genf("    movq %%rdi, -%d(%%rbp)", state->return_ptr_offset);
+    }
+    emit_spill_args(state, func_data->args, &arg_state,
+                    func_sym->reg_arg_offset, &spill_size);
+
+    emit_node(state, func->node);
+
+    if (sysv_ret_in_memory(func_data->return_type)) {
+        // Just in case function has no return but has return type
+        genf("    movq -%d(%%rbp), %%rax", state->return_ptr_offset);
+    }
+
+    genf(".L%d:", state->return_label);
+
+    if (str_eql(func->ident, str("main")) && is_void(func_data->return_type)) {
+        // main returns void type, always returns 0
+        genf("    xorl %%eax, %%eax");
+    }
+
+    genf("    leave");
+    genf("    ret");
+
+    if (func->attr == SYM_ATTR_EXPORT) {
+        genf(".globl %.*s", func->ident.len, func->ident.ptr);
+    }
+
+    if (func_data->attrs & (FUNC_ATTR_HOT | FUNC_ATTR_COLD)) {
+        genf(".text");
+    }
+}
+
+// Global variables take a multiple of 8 bytes
+static void emit_global_var(CodegenState* state, VarSymbolTableEntry* var) {
+    int size = var->data_type->size;
+
+    if (var->init_val == 0) {
+        genf("    .zero %d", size + (8 - size % 8) % 8);
+        return;
+    }
+
+    switch (ast_node_type(state->ast, var->init_val)) {
+        case NODE_FLOATLIT: {
+            FloatLitNode floatlit = ast_floatlit(state->ast, var->init_val);
+            emit_float_data(state,
+                            get_float_bits(floatlit.val, floatlit.data_type),
+                            size);
+        } break;
+        case NODE_INTLIT: {
+            IntLitNode intlit = ast_intlit(state->ast, var->init_val);
+            if (is_float(var->data_type)) {
+                double val = intlit.data_type == TYPE_U64
+                                 ? (double)(unsigned long long)intlit.val
+                                 : (double)intlit.val;
+                PrimitiveType type = var->data_type->primitive_type;
+                emit_float_data(state, get_float_bits(val, type), size);
+            } else if (size == 8) {
+                genf("    .quad %lld", intlit.val);
+            } else {
+                genf("    .long %d", (int)intlit.val);
+                size = 4;
+            }
+        } break;
+        case NODE_STRLIT: {
+            StrLitNode strlit = ast_strlit(state->ast, var->init_val);
+            genf("    .quad .LC%d", add_data(state, strlit.val));
+        } break;
+        default:
+            UNREACHABLE();
+    }
+
+    if (size % 8 != 0) {
+        genf("    .zero %d", 8 - size % 8);
+    }
+}
+
+void codegen_x86_64(CodegenState* state, NodeIndex node, SymbolTable* sym,
+                    Str entry_sym) {
+    int has_user_defined_entry = (symbol_table_find(sym, entry_sym, 1) != NULL);
+
+    // Global variables
+    genf(".data");
+
+    SymbolTableEntry* curr = sym->ste;
+    while (curr) {
+        if (curr->type == SYM_VAR) {
+            VarSymbolTableEntry* var = (VarSymbolTableEntry*)curr;
+            if (var->attr != SYM_ATTR_EXTERN) {
+                genf("%.*s:", var->ident.len, var->ident.ptr);
+                emit_global_var(state, var);
+
+                if (var->attr == SYM_ATTR_EXPORT) {
+                    genf(".globl %.*s", var->ident.len, var->ident.ptr);
+                }
+                outbuf_end_line(state->out);
+            }
+        }
+        curr = curr->next;
+    }
+
+    // Functions
+    genf(".text");
+
+    curr = sym->ste;
+    while (curr) {
+        if (curr->type == SYM_FUNC) {
+            FuncSymbolTableEntry* func = (FuncSymbolTableEntry*)curr;
+            if (func->node) {
+                emit_func(state, func);
+                outbuf_end_line(state->out);
+            }
+        }
+        curr = curr->next;
+    }
+
+    // entry function
+    if (!has_user_defined_entry) {
+        setup_func_state(state, get_primitive_type(TYPE_U8), sym);
+
+        genf("%.*s:", entry_sym.len, entry_sym.ptr);
+        emit_func_start(state, *sym->stack_size);
+
+        emit_node(state, node);
+
+        genf("    xorl %%eax, %%eax");
+        genf(".L%d:", state->return_label);
+        genf("    leave");
+        genf("    ret");
+
+        genf(".globl %.*s", entry_sym.len, entry_sym.ptr);
+    }
+
+    outbuf_end_line(state->out);
+
+    // Strings
+    genf(".data");
+    for (int i = 0; i < state->data_count; i++) {
+        genf(".LC%d:", i);
+        emit_string_data(state, state->data[i]);
+    }
+
+    if (state->float_data.size > 0) {
+        genf(".p2align 3");
+        for (size_t i = 0; i < state->float_data.size; i++) {
+            genf(".LF%d:", (int)i);
+            emit_float_data(state, state->float_data.data[i].bits,
+                            state->float_data.data[i].size);
+        }
+    }
+
+    genf(".section .note.GNU-stack,\"\",@progbits");
+}
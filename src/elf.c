@@ -0,0 +1,341 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asm.h"
+#include "utils.h"
+
+// Writer for ELF relocatable objects. ELF32 uses REL relocations with the
+// addend stored in the section data; ELF64 uses RELA.
+
+#define ET_REL 1
+#define EM_386 3
+#define EM_X86_64 62
+
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_RELA 4
+#define SHT_REL 9
+
+#define SHF_WRITE 0x1
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+#define SHF_INFO_LINK 0x40
+
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_NOTYPE 0
+#define STT_SECTION 3
+
+#define R_386_32 1
+#define R_386_PC32 2
+
+#define R_X86_64_64 1
+#define R_X86_64_PC32 2
+#define R_X86_64_PLT32 4
+#define R_X86_64_32 10
+#define R_X86_64_32S 11
+
+typedef UtlVector(unsigned char) ByteBuffer;
+
+typedef struct ElfWriter {
+    const AsmObject* obj;
+    int is64;
+    ByteBuffer out;
+    ByteBuffer strtab;
+    ByteBuffer shstrtab;
+    ByteBuffer shdrs;
+    int shnum;
+} ElfWriter;
+
+static void put(ByteBuffer* buf, unsigned long long val, int size) {
+    for (int i = 0; i < size; i++) {
+        // Bytes past the value are zero, as for padding
+        unsigned char c = i < 8 ? (val >> (i * 8)) & 0xFF : 0;
+        utlvector_push(buf, c);
+    }
+}
+
+static void put_word(ElfWriter* w, ByteBuffer* buf, unsigned long long val) {
+    put(buf, val, w->is64 ? 8 : 4);
+}
+
+static void align_to(ByteBuffer* buf, int alignment) {
+    while (buf->size % alignment != 0) {
+        put(buf, 0, 1);
+    }
+}
+
+static int add_string(ByteBuffer* buf, Str s) {
+    int offset = buf->size;
+    utlvector_pushall(buf, s.ptr, s.len);
+    put(buf, 0, 1);
+    return offset;
+}
+
+static void add_shdr(ElfWriter* w, int name, int type, int flags, int offset,
+                     int size, int link, int info, int alignment,
+                     int entsize) {
+    ByteBuffer* buf = &w->shdrs;
+    put(buf, name, 4);
+    put(buf, type, 4);
+    put_word(w, buf, flags);
+    put_word(w, buf, 0);  // addr
+    put_word(w, buf, offset);
+    put_word(w, buf, size);
+    put(buf, link, 4);
+    put(buf, info, 4);
+    put_word(w, buf, alignment);
+    put_word(w, buf, entsize);
+    w->shnum++;
+}
+
+static int reloc_type(const ElfWriter* w, AsmRelocType type) {
+    if (w->is64) {
+        switch (type) {
+            case ASM_RELOC_ABS32:
+                return R_X86_64_32;
+            case ASM_RELOC_ABS32S:
+                return R_X86_64_32S;
+            case ASM_RELOC_ABS64:
+                return R_X86_64_64;
+            case ASM_RELOC_PC32:
+                return R_X86_64_PC32;
+            case ASM_RELOC_PLT32:
+                return R_X86_64_PLT32;
+        }
+    } else {
+        switch (type) {
+            case ASM_RELOC_ABS32:
+            case ASM_RELOC_ABS32S:
+                return R_386_32;
+            case ASM_RELOC_PC32:
+            case ASM_RELOC_PLT32:
+                return R_386_PC32;
+            case ASM_RELOC_ABS64:
+                break;
+        }
+    }
+    UNREACHABLE();
+}
+
+static int section_flags(int flags) {
+    int result = 0;
+    if (flags & ASM_SECTION_ALLOC) {
+        result |= SHF_ALLOC;
+    }
+    if (flags & ASM_SECTION_WRITE) {
+        result |= SHF_WRITE;
+    }
+    if (flags & ASM_SECTION_EXEC) {
+        result |= SHF_EXECINSTR;
+    }
+    return result;
+}
+
+static int is_written_symbol(const AsmSymbol* sym) {
+    return !sym->is_section && !asm_is_temp_symbol(sym);
+}
+
+static int is_global_symbol(const AsmSymbol* sym) {
+    return sym->is_global || sym->section < 0;
+}
+
+int elf_write(const AsmObject* obj, FILE* fp) {
+    ElfWriter w = {
+        .obj = obj,
+        .is64 = obj->bits == 64,
+        .out = utlvector_init(&never_fail_allocator),
+        .strtab = utlvector_init(&never_fail_allocator),
+        .shstrtab = utlvector_init(&never_fail_allocator),
+        .shdrs = utlvector_init(&never_fail_allocator),
+    };
+
+    int section_count = obj->sections.size;
+    int ehsize = w.is64 ? 64 : 52;
+    int word = w.is64 ? 8 : 4;
+
+    // Symbol order: null, sections, locals, globals
+    int* sym_index = never_fail_allocator.alloc(
+        &never_fail_allocator, (obj->symbols.size + 1) * sizeof(int));
+    int sym_count = 1;
+    for (int i = 0; i < (int)obj->symbols.size; i++) {
+        if (obj->symbols.data[i].is_section) {
+            sym_index[i] = sym_count++;
+        }
+    }
+    for (int i = 0; i < (int)obj->symbols.size; i++) {
+        const AsmSymbol* sym = &obj->symbols.data[i];
+        if (is_written_symbol(sym) && !is_global_symbol(sym)) {
+            sym_index[i] = sym_count++;
+        }
+    }
+    int first_global = sym_count;
+    for (int i = 0; i < (int)obj->symbols.size; i++) {
+        const AsmSymbol* sym = &obj->symbols.data[i];
+        if (is_written_symbol(sym) && is_global_symbol(sym)) {
+            sym_index[i] = sym_count++;
+        }
+    }
+
+    int symtab_shndx = section_count + 1;
+    for (int i = 0; i < section_count; i++) {
+        if (obj->sections.data[i].relocs.size > 0) {
+            symtab_shndx++;
+        }
+    }
+
+    put(&w.out, 0, ehsize);
+    put(&w.strtab, 0, 1);
+    put(&w.shstrtab, 0, 1);
+    add_shdr(&w, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    // Section contents
+    for (int i = 0; i < section_count; i++) {
+        const AsmSection* section = &obj->sections.data[i];
+        align_to(&w.out, section->alignment);
+        int offset = w.out.size;
+        if (section->data.size > 0) {
+            utlvector_pushall(&w.out, section->data.data, section->data.size);
+        }
+
+        if (!w.is64) {
+            // REL stores the addend in place
+            for (size_t j = 0; j < section->relocs.size; j++) {
+                const AsmReloc* reloc = &section->relocs.data[j];
+                unsigned long long addend = reloc->addend;
+                for (int k = 0; k < 4; k++) {
+                    w.out.data[offset + reloc->offset + k] =
+                        (addend >> (k * 8)) & 0xFF;
+                }
+            }
+        }
+
+        add_shdr(&w, add_string(&w.shstrtab, section->name), SHT_PROGBITS,
+                 section_flags(section->flags), offset, section->data.size, 0,
+                 0, section->alignment, 0);
+    }
+
+    // Relocations
+    for (int i = 0; i < section_count; i++) {
+        const AsmSection* section = &obj->sections.data[i];
+        if (section->relocs.size == 0) {
+            continue;
+        }
+
+        align_to(&w.out, word);
+        int offset = w.out.size;
+        for (size_t j = 0; j < section->relocs.size; j++) {
+            const AsmReloc* reloc = &section->relocs.data[j];
+            int sym = sym_index[reloc->symbol];
+            int type = reloc_type(&w, reloc->type);
+            if (w.is64) {
+                put(&w.out, reloc->offset, 8);
+                put(&w.out, ((unsigned long long)sym << 32) | type, 8);
+                put(&w.out, reloc->addend, 8);
+            } else {
+                put(&w.out, reloc->offset, 4);
+                put(&w.out, (sym << 8) | type, 4);
+            }
+        }
+
+        char name[256];
+        snprintf(name, sizeof(name), "%s%.*s", w.is64 ? ".rela" : ".rel",
+                 section->name.len, section->name.ptr);
+        add_shdr(&w, add_string(&w.shstrtab, str(name)),
+                 w.is64 ? SHT_RELA : SHT_REL, SHF_INFO_LINK, offset,
+                 w.out.size - offset, symtab_shndx, i + 1, word,
+                 w.is64 ? 24 : 8);
+    }
+
+    // Symbol table
+    align_to(&w.out, word);
+    int symtab_offset = w.out.size;
+    put(&w.out, 0, w.is64 ? 24 : 16);
+    for (int pass = 0; pass < 3; pass++) {
+        for (int i = 0; i < (int)obj->symbols.size; i++) {
+            const AsmSymbol* sym = &obj->symbols.data[i];
+            int kind = sym->is_section         ? 0
+                       : !is_written_symbol(sym) ? -1
+                       : is_global_symbol(sym)   ? 2
+                                                 : 1;
+            if (kind != pass) {
+                continue;
+            }
+
+            int name = sym->is_section ? 0 : add_string(&w.strtab, sym->name);
+            int info = sym->is_section
+                           ? (STB_LOCAL << 4) | STT_SECTION
+                           : ((kind == 2 ? STB_GLOBAL : STB_LOCAL) << 4) |
+                                 STT_NOTYPE;
+            int shndx = sym->section >= 0 ? sym->section + 1 : 0;
+
+            put(&w.out, name, 4);
+            if (w.is64) {
+                put(&w.out, info, 1);
+                put(&w.out, 0, 1);
+                put(&w.out, shndx, 2);
+                put(&w.out, sym->offset, 8);
+                put(&w.out, 0, 8);
+            } else {
+                put(&w.out, sym->offset, 4);
+                put(&w.out, 0, 4);
+                put(&w.out, info, 1);
+                put(&w.out, 0, 1);
+                put(&w.out, shndx, 2);
+            }
+        }
+    }
+    add_shdr(&w, add_string(&w.shstrtab, str(".symtab")), SHT_SYMTAB, 0,
+             symtab_offset, w.out.size - symtab_offset, symtab_shndx + 1,
+             first_global, word, w.is64 ? 24 : 16);
+
+    int strtab_offset = w.out.size;
+    utlvector_pushall(&w.out, w.strtab.data, w.strtab.size);
+    add_shdr(&w, add_string(&w.shstrtab, str(".strtab")), SHT_STRTAB, 0,
+             strtab_offset, w.strtab.size, 0, 0, 1, 0);
+
+    int shstrtab_name = add_string(&w.shstrtab, str(".shstrtab"));
+    int shstrtab_offset = w.out.size;
+    utlvector_pushall(&w.out, w.shstrtab.data, w.shstrtab.size);
+    add_shdr(&w, shstrtab_name, SHT_STRTAB, 0, shstrtab_offset,
+             w.shstrtab.size, 0, 0, 1, 0);
+
+    align_to(&w.out, word);
+    int shoff = w.out.size;
+    utlvector_pushall(&w.out, w.shdrs.data, w.shdrs.size);
+
+    // ELF header
+    ByteBuffer header = utlvector_init(&never_fail_allocator);
+    static const unsigned char ident[] = {0x7F, 'E', 'L', 'F'};
+    utlvector_pushall(&header, ident, 4);
+    put(&header, w.is64 ? 2 : 1, 1);  // class
+    put(&header, 1, 1);               // little endian
+    put(&header, 1, 1);               // version
+    put(&header, 0, 9);
+    put(&header, ET_REL, 2);
+    put(&header, w.is64 ? EM_X86_64 : EM_386, 2);
+    put(&header, 1, 4);
+    put_word(&w, &header, 0);  // entry
+    put_word(&w, &header, 0);  // phoff
+    put_word(&w, &header, shoff);
+    put(&header, 0, 4);  // flags
+    put(&header, ehsize, 2);
+    put(&header, 0, 2);  // phentsize
+    put(&header, 0, 2);  // phnum
+    put(&header, w.is64 ? 64 : 40, 2);
+    put(&header, w.shnum, 2);
+    put(&header, w.shnum - 1, 2);  // .shstrtab is last
+    memcpy(w.out.data, header.data, ehsize);
+
+    int result = fwrite(w.out.data, 1, w.out.size, fp) != w.out.size;
+
+    utlvector_deinit(&header);
+    utlvector_deinit(&w.out);
+    utlvector_deinit(&w.strtab);
+    utlvector_deinit(&w.shstrtab);
+    utlvector_deinit(&w.shdrs);
+    never_fail_allocator.free(&never_fail_allocator, sym_index);
+    return result;
+}
@@ -9,12 +9,11 @@ void print_message(LogType level, const SourceState* src, Error* err) {
     }
 #endif
 
-    const SourceFile* file = &src->files.data[err->pos.line.file_index];
+    const SourceLine* src_line = source_find_line(src, err->pos);
+    int file_index = src_line ? src_line->file_index : 0;
+
+    const SourceFile* file = &src->files.data[file_index];
     const char* filename = file->filename;
-    const char* line = err->pos.line.content;
-    int lineno = err->pos.line.lineno;
-    int pos = err->pos.index;
-    int included_by = file->pos.line.file_index;
 
     if (file->is_open == 0) {
         fprintf(stderr, "%s: ", filename);
@@ -22,17 +21,25 @@ void print_message(LogType level, const SourceState* src, Error* err) {
         return;
     }
 
-    if (err->pos.line.file_index != 0) {
+    const char* line = src_line->content;
+    int line_len = src_line->len;
+    int lineno = src_line->lineno;
+    int pos = err->pos.offset - src_line->offset;
+
+    if (file_index != 0) {
+        const SourceLine* include_line = source_find_line(src, file->pos);
+        int included_by = include_line->file_index;
         const SourceFile* included_file = &src->files.data[included_by];
         fprintf(stderr, "In file included from %s:%d%c\n",
-                included_file->filename, file->pos.line.lineno,
+                included_file->filename, include_line->lineno,
                 included_by == 0 ? ':' : ',');
         file = included_file;
         while (included_by != 0) {
-            included_by = file->pos.line.file_index;
+            include_line = source_find_line(src, file->pos);
+            included_by = include_line->file_index;
             included_file = &src->files.data[included_by];
             fprintf(stderr, "                 from %s:%d%c\n",
-                    included_file->filename, file->pos.line.lineno,
+                    included_file->filename, include_line->lineno,
                     included_by == 0 ? ':' : ',');
             file = included_file;
         }
@@ -41,7 +48,7 @@ void print_message(LogType level, const SourceState* src, Error* err) {
     fprintf(stderr, "%s:%d:%d: ", filename, lineno, pos);
     ika_log(level, "%s\n", err->msg);
 
-    fprintf(stderr, "%5d | %s\n", lineno, line);
+    fprintf(stderr, "%5d | %.*s\n", lineno, line_len, line);
 
     if (pos > 0) {
         fprintf(stderr, "      | %*c^\n", pos, ' ');
@@ -0,0 +1,95 @@
+#include "intern.h"
+
+#include <string.h>
+
+#define INTERN_MIN_SLOTS 1024
+
+typedef struct InternSlot {
+    const char* ptr;
+    int len;
+    unsigned int hash;
+} InternSlot;
+
+typedef struct Interner {
+    UtlArenaAllocator* arena;
+    InternSlot* slots;
+    int slot_count;  // power of two
+    int count;
+} Interner;
+
+static Interner interner;
+
+static inline unsigned int djb2_hash(Str s) {
+    unsigned int hash = 5381;
+    for (int i = 0; i < s.len; i++) {
+        hash = ((hash << 5) + hash) + (unsigned char)s.ptr[i];
+    }
+
+    return hash;
+}
+
+static InternSlot* alloc_slots(int slot_count) {
+    InternSlot* slots =
+        utlarena_alloc(interner.arena, slot_count * sizeof(InternSlot));
+    memset(slots, 0, slot_count * sizeof(InternSlot));
+    return slots;
+}
+
+void intern_init(UtlArenaAllocator* arena) {
+    interner.arena = arena;
+    interner.slot_count = INTERN_MIN_SLOTS;
+    interner.slots = alloc_slots(interner.slot_count);
+    interner.count = 0;
+}
+
+static void intern_grow(void) {
+    int slot_count = interner.slot_count * 2;
+    unsigned int mask = slot_count - 1;
+    InternSlot* slots = alloc_slots(slot_count);
+
+    for (int i = 0; i < interner.slot_count; i++) {
+        InternSlot* slot = &interner.slots[i];
+        if (slot->ptr == NULL) {
+            continue;
+        }
+        unsigned int j = slot->hash & mask;
+        while (slots[j].ptr != NULL) {
+            j = (j + 1) & mask;
+        }
+        slots[j] = *slot;
+    }
+
+    interner.slots = slots;
+    interner.slot_count = slot_count;
+}
+
+Str intern(Str s) {
+    assert(interner.arena);
+
+    unsigned int hash = djb2_hash(s);
+    unsigned int mask = interner.slot_count - 1;
+    unsigned int i = hash & mask;
+
+    while (interner.slots[i].ptr != NULL) {
+        InternSlot* slot = &interner.slots[i];
+        if (slot->hash == hash && slot->len == s.len &&
+            memcmp(slot->ptr, s.ptr, s.len) == 0) {
+            return (Str){slot->ptr, slot->len};
+        }
+        i = (i + 1) & mask;
+    }
+
+    char* ptr = utlarena_alloc(interner.arena, s.len + 1);
+    memcpy(ptr, s.ptr, s.len);
+    ptr[s.len] = '\0';
+
+    interner.slots[i] = (InternSlot){ptr, s.len, hash};
+    interner.count++;
+
+    // Keep the load factor at most 1/2
+    if (2 * interner.count > interner.slot_count) {
+        intern_grow();
+    }
+
+    return (Str){ptr, s.len};
+}
@@ -0,0 +1,26 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+
+#include "str.h"
+#include "utl/allocator/utlarena.h"
+
+/*
+ * Global string interner for identifiers. Each distinct identifier is copied
+ * once into the arena, so two interned strings are equal if and only if their
+ * pointers are equal.
+ */
+
+void intern_init(UtlArenaAllocator* arena);
+
+// Return the canonical copy of s (null-terminated)
+Str intern(Str s);
+
+// Hash of an interned string, computed from its address
+static inline int intern_hash(Str s) {
+    uintptr_t p = (uintptr_t)s.ptr;
+    return (int)(unsigned int)((p ^ (p >> 15)) * 2654435761u);
+}
+
+#endif
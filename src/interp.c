@@ -0,0 +1,707 @@
+#include "interp.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "abi.h"
+#include "utils.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+#include <dlfcn.h>
+
+#ifdef __GNUC__
+// Labels as values
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define THREADED_DISPATCH
+#endif
+
+#define VM_STACK_SIZE (8 << 20)
+
+// Native code can call back into at most this many functions
+#define CALLBACK_COUNT 16
+
+typedef struct Vm {
+    const BcProgram* prog;
+    uint64_t* consts;
+    unsigned char* stack;  // lowest address
+    unsigned char* sp;     // bottom of the current frame
+    void* libs[2];
+    const BcFunc* callbacks[CALLBACK_COUNT];
+    int callback_count;
+} Vm;
+
+// The VM running the callbacks
+static Vm* current_vm;
+
+static BcValue execute(Vm* vm, const BcFunc* func, const BcValue* args,
+                       int arg_count, void* ret_buf);
+
+/*
+ * Native calls go through a function pointer taking all argument registers,
+ * followed by the stack arguments. It's variadic so AL is set for variadic
+ * callees. The return type picks the registers for the two eightbytes.
+ */
+
+#define NATIVE_PARAMS                                                   \
+    uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, double, \
+        double, double, double, double, double, double, double, ...
+
+#define NATIVE_ARGS                                                           \
+    gpr[0], gpr[1], gpr[2], gpr[3], gpr[4], gpr[5], sse[0], sse[1], sse[2],   \
+        sse[3], sse[4], sse[5], sse[6], sse[7], stack[0], stack[1], stack[2], \
+        stack[3], stack[4], stack[5], stack[6], stack[7], stack[8],           \
+        stack[9], stack[10], stack[11], stack[12], stack[13], stack[14],      \
+        stack[15]
+
+typedef struct RetII {
+    uint64_t a;
+    uint64_t b;
+} RetII;
+
+typedef struct RetSS {
+    double a;
+    double b;
+} RetSS;
+
+typedef struct RetIS {
+    uint64_t a;
+    double b;
+} RetIS;
+
+typedef struct RetSI {
+    double a;
+    uint64_t b;
+} RetSI;
+
+typedef RetII (*NativeII)(NATIVE_PARAMS);
+typedef RetSS (*NativeSS)(NATIVE_PARAMS);
+typedef RetIS (*NativeIS)(NATIVE_PARAMS);
+typedef RetSI (*NativeSI)(NATIVE_PARAMS);
+
+static uint64_t load_eightbyte(const unsigned char* p, int size) {
+    uint64_t val = 0;
+    memcpy(&val, p, size < 8 ? size : 8);
+    return val;
+}
+
+static inline uint64_t double_bits(double val) {
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+
+static inline double bits_double(uint64_t bits) {
+    double val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+static BcValue call_native(uintptr_t addr, const BcCallSig* sig,
+                           const BcValue* args, void* ret_buf) {
+    uint64_t gpr[SYSV_GPR_ARG_COUNT] = {0};
+    double sse[SYSV_SSE_ARG_COUNT] = {0};
+    uint64_t stack[BC_MAX_NATIVE_STACK_ARGS] = {0};
+
+    const Type* return_type = sig->return_type;
+    int in_memory = sysv_ret_in_memory(return_type);
+
+    SysVArgState arg_state;
+    sysv_init_args(&arg_state, return_type);
+    if (in_memory) {
+        gpr[0] = (uintptr_t)ret_buf;
+    }
+
+    for (int i = 0; i < sig->arg_count; i++) {
+        const Type* type = sig->arg_types[i];
+        int large = is_large_type(type);
+
+        SysVArgLoc loc;
+        sysv_assign_arg(&arg_state, type, &loc);
+
+        if (loc.eightbyte_count == 0) {
+            unsigned char* p = (unsigned char*)&stack[loc.stack_offset / 8];
+            if (large) {
+                memcpy(p, args[i].p, type->size);
+            } else {
+                memcpy(p, &args[i].u, 8);
+            }
+            continue;
+        }
+
+        for (int j = 0; j < loc.eightbyte_count; j++) {
+            uint64_t val = args[i].u;
+            if (large) {
+                val = load_eightbyte((unsigned char*)args[i].p + j * 8,
+                                     type->size - j * 8);
+            }
+
+            if (loc.classes[j] == ARG_CLASS_SSE) {
+                sse[loc.regs[j]] = bits_double(val);
+            } else {
+                gpr[loc.regs[j]] = val;
+            }
+        }
+    }
+
+    ArgClass classes[SYSV_MAX_EIGHTBYTES] = {ARG_CLASS_INTEGER,
+                                             ARG_CLASS_INTEGER};
+    if (is_float(return_type)) {
+        classes[0] = ARG_CLASS_SSE;
+        classes[1] = ARG_CLASS_SSE;
+    } else if (is_large_type(return_type) && !in_memory) {
+        if (sysv_classify(return_type, classes) == 1) {
+            classes[1] = classes[0];
+        }
+    }
+
+    uint64_t words[SYSV_MAX_EIGHTBYTES];
+    if (classes[0] == ARG_CLASS_SSE) {
+        if (classes[1] == ARG_CLASS_SSE) {
+            RetSS ret = ((NativeSS)addr)(NATIVE_ARGS);
+            words[0] = double_bits(ret.a);
+            words[1] = double_bits(ret.b);
+        } else {
+            RetSI ret = ((NativeSI)addr)(NATIVE_ARGS);
+            words[0] = double_bits(ret.a);
+            words[1] = ret.b;
+        }
+    } else {
+        if (classes[1] == ARG_CLASS_SSE) {
+            RetIS ret = ((NativeIS)addr)(NATIVE_ARGS);
+            words[0] = ret.a;
+            words[1] = double_bits(ret.b);
+        } else {
+            RetII ret = ((NativeII)addr)(NATIVE_ARGS);
+            words[0] = ret.a;
+            words[1] = ret.b;
+        }
+    }
+
+    BcValue result;
+    if (is_large_type(return_type)) {
+        if (!in_memory) {
+            memcpy(ret_buf, words, return_type->size);
+        }
+        result.p = ret_buf;
+    } else {
+        result.u = words[0];
+    }
+    return result;
+}
+
+/*
+ * Function pointers passed to native code point to one of these. Only
+ * functions with all arguments in registers can be called back.
+ */
+
+typedef struct CallbackRet {
+    uint64_t i;
+    double f;
+} CallbackRet;
+
+static CallbackRet run_callback(int index, const uint64_t* gpr,
+                                const double* sse) {
+    const BcFunc* func = current_vm->callbacks[index];
+
+    BcValue args[SYSV_GPR_ARG_COUNT + SYSV_SSE_ARG_COUNT];
+    SysVArgState arg_state;
+    sysv_init_args(&arg_state, func->return_type);
+    for (int i = 0; i < func->param_count; i++) {
+        SysVArgLoc loc;
+        sysv_assign_arg(&arg_state, func->param_types[i], &loc);
+        if (loc.classes[0] == ARG_CLASS_SSE) {
+            args[i].u = double_bits(sse[loc.regs[0]]);
+        } else {
+            args[i].u = gpr[loc.regs[0]];
+        }
+    }
+
+    BcValue result = execute(current_vm, func, args, func->param_count, NULL);
+    CallbackRet ret = {
+        .i = result.u,
+        .f = bits_double(result.u),
+    };
+    return ret;
+}
+
+#define CALLBACK(n)                                                       \
+    static CallbackRet callback##n(uint64_t g0, uint64_t g1, uint64_t g2, \
+                                   uint64_t g3, uint64_t g4, uint64_t g5, \
+                                   double x0, double x1, double x2,       \
+                                   double x3, double x4, double x5,       \
+                                   double x6, double x7) {                \
+        uint64_t gpr[] = {g0, g1, g2, g3, g4, g5};                        \
+        double sse[] = {x0, x1, x2, x3, x4, x5, x6, x7};                  \
+        return run_callback(n, gpr, sse);                                 \
+    }
+
+CALLBACK(0)
+CALLBACK(1)
+CALLBACK(2)
+CALLBACK(3)
+CALLBACK(4)
+CALLBACK(5)
+CALLBACK(6)
+CALLBACK(7)
+CALLBACK(8)
+CALLBACK(9)
+CALLBACK(10)
+CALLBACK(11)
+CALLBACK(12)
+CALLBACK(13)
+CALLBACK(14)
+CALLBACK(15)
+
+typedef CallbackRet (*CallbackFunc)(uint64_t, uint64_t, uint64_t, uint64_t,
+                                    uint64_t, uint64_t, double, double,
+                                    double, double, double, double, double,
+                                    double);
+
+static const CallbackFunc callback_funcs[CALLBACK_COUNT] = {
+    callback0,  callback1,  callback2,  callback3, callback4,  callback5,
+    callback6,  callback7,  callback8,  callback9, callback10, callback11,
+    callback12, callback13, callback14, callback15,
+};
+
+static int can_call_back(const BcFunc* func) {
+    if (func->has_va_args || is_large_type(func->return_type)) {
+        return 0;
+    }
+
+    SysVArgState arg_state;
+    sysv_init_args(&arg_state, func->return_type);
+    for (int i = 0; i < func->param_count; i++) {
+        SysVArgLoc loc;
+        sysv_assign_arg(&arg_state, func->param_types[i], &loc);
+        if (loc.eightbyte_count == 0 || is_large_type(func->param_types[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Address of a function, callable from native code if possible
+static uintptr_t get_func_addr(Vm* vm, int index) {
+    const BcFunc* func = &vm->prog->funcs.data[index];
+    for (int i = 0; i < vm->callback_count; i++) {
+        if (vm->callbacks[i] == func) {
+            return (uintptr_t)callback_funcs[i];
+        }
+    }
+
+    if (vm->callback_count < CALLBACK_COUNT && can_call_back(func)) {
+        vm->callbacks[vm->callback_count] = func;
+        return (uintptr_t)callback_funcs[vm->callback_count++];
+    }
+    return (uintptr_t)func;
+}
+
+// Returns NULL if the address is a native function
+static const BcFunc* find_func(const Vm* vm, uintptr_t addr) {
+    const BcProgram* prog = vm->prog;
+    if (addr >= (uintptr_t)prog->funcs.data &&
+        addr < (uintptr_t)(prog->funcs.data + prog->funcs.size)) {
+        return (const BcFunc*)addr;
+    }
+
+    for (int i = 0; i < vm->callback_count; i++) {
+        if (addr == (uintptr_t)callback_funcs[i]) {
+            return vm->callbacks[i];
+        }
+    }
+    return NULL;
+}
+
+static void* lookup_extern(Vm* vm, const char* name) {
+    if (!vm->libs[0]) {
+        vm->libs[0] = dlopen(NULL, RTLD_LAZY);
+    }
+
+    void* addr = vm->libs[0] ? dlsym(vm->libs[0], name) : NULL;
+    if (!addr) {
+        // ikac itself does not link libm
+        if (!vm->libs[1]) {
+            vm->libs[1] = dlopen("libm.so.6", RTLD_LAZY);
+        }
+        if (vm->libs[1]) {
+            addr = dlsym(vm->libs[1], name);
+        }
+    }
+    return addr;
+}
+
+static int link_program(Vm* vm) {
+    const BcProgram* prog = vm->prog;
+    for (size_t i = 0; i < prog->refs.size; i++) {
+        const BcSymbolRef* ref = &prog->refs.data[i];
+        if (ref->func >= 0) {
+            vm->consts[ref->const_index] = get_func_addr(vm, ref->func);
+            continue;
+        }
+
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", ref->name.len, ref->name.ptr);
+        void* addr = lookup_extern(vm, name);
+        if (!addr) {
+            ika_log(LOG_ERROR, "undefined symbol: %s\n", name);
+            return 0;
+        }
+        vm->consts[ref->const_index] = (uintptr_t)addr;
+    }
+    return 1;
+}
+
+// Float to integer conversions behave like CVTTSD2SI
+static inline uint64_t cvt_i32(double val) {
+    if (val > -2147483649.0 && val < 2147483648.0) {
+        return (uint32_t)(int32_t)val;
+    }
+    return 0x80000000u;
+}
+
+static inline uint64_t cvt_i64(double val) {
+    if (val >= -9223372036854775808.0 && val < 9223372036854775808.0) {
+        return (uint64_t)(int64_t)val;
+    }
+    return 0x8000000000000000ull;
+}
+
+static inline uint64_t cvt_u64(double val) {
+    if (val >= 9223372036854775808.0) {
+        return cvt_i64(val - 9223372036854775808.0) ^ 0x8000000000000000ull;
+    }
+    return cvt_i64(val);
+}
+
+#define R(x) regs[insn->x]
+#define U32(x) ((uint32_t)R(x).u)
+#define I32(x) ((int32_t)R(x).u)
+#define MEM(x) ((unsigned char*)R(x).p + insn->imm)
+
+#ifdef THREADED_DISPATCH
+#define CASE(name) L_##name:
+#define NEXT()                    \
+    do {                          \
+        insn = ip++;              \
+        goto* dispatch[insn->op]; \
+    } while (0)
+#else
+#define CASE(name) case BC_##name:
+#define NEXT() continue
+#endif
+
+#define BINOP32(name, expr)        \
+    CASE(name) {                   \
+        R(a).u = (uint32_t)(expr); \
+        NEXT();                    \
+    }
+
+#define BINOP(name, field, expr) \
+    CASE(name) {                 \
+        R(a).field = (expr);     \
+        NEXT();                  \
+    }
+
+#define LOAD(name, type, ext)              \
+    CASE(name) {                           \
+        type val;                          \
+        memcpy(&val, MEM(b), sizeof(val)); \
+        R(a).u = (ext)val;                 \
+        NEXT();                            \
+    }
+
+#define STORE(name, type)                  \
+    CASE(name) {                           \
+        type val = (type)R(b).u;           \
+        memcpy(MEM(a), &val, sizeof(val)); \
+        NEXT();                            \
+    }
+
+static BcValue execute(Vm* vm, const BcFunc* func, const BcValue* args,
+                       int arg_count, void* ret_buf) {
+#ifdef THREADED_DISPATCH
+#define LABEL_ADDR(name) &&L_##name,
+    static const void* const dispatch[] = {BC_OPS(LABEL_ADDR)};
+#undef LABEL_ADDR
+#endif
+
+    const BcProgram* prog = vm->prog;
+    const uint64_t* consts = vm->consts;
+
+    // Arguments on the stack are above the frame pointer and the registers
+    // are below the local variables
+    unsigned char* prev_sp = vm->sp;
+    uintptr_t fp_addr = ((uintptr_t)prev_sp - func->arg_size) & ~(uintptr_t)15;
+    unsigned char* fp = (unsigned char*)fp_addr;
+    BcValue* regs = (BcValue*)(((uintptr_t)fp - func->frame_size -
+                                func->reg_count * sizeof(BcValue)) &
+                               ~(uintptr_t)15);
+    if ((unsigned char*)regs < vm->stack) {
+        ika_log(LOG_ERROR, "stack overflow in %.*s\n", func->name.len,
+                func->name.ptr);
+        exit(1);
+    }
+    vm->sp = (unsigned char*)regs;
+
+    regs[0].p = fp;
+    memcpy(regs + 1, args, arg_count * sizeof(BcValue));
+
+    BcValue result;
+    const BcInsn* code = func->code.data;
+    const BcInsn* ip = code;
+    const BcInsn* insn;
+
+#ifdef THREADED_DISPATCH
+    NEXT();
+#else
+    for (;;) {
+        insn = ip++;
+        switch ((BcOp)insn->op) {
+#endif
+
+    CASE(MOV) {
+        R(a) = R(b);
+        NEXT();
+    }
+    CASE(LOADI) {
+        R(a).i = insn->imm;
+        NEXT();
+    }
+    CASE(LOADK) {
+        R(a).u = consts[insn->imm];
+        NEXT();
+    }
+    CASE(LEA) {
+        R(a).u = R(b).u + (int64_t)insn->imm;
+        NEXT();
+    }
+
+    LOAD(LD8S, int8_t, uint32_t)
+    LOAD(LD8U, uint8_t, uint32_t)
+    LOAD(LD16S, int16_t, uint32_t)
+    LOAD(LD16U, uint16_t, uint32_t)
+    LOAD(LD32, uint32_t, uint32_t)
+    LOAD(LD64, uint64_t, uint64_t)
+
+    STORE(ST8, uint8_t)
+    STORE(ST16, uint16_t)
+    STORE(ST32, uint32_t)
+    STORE(ST64, uint64_t)
+
+    CASE(COPY) {
+        memmove(R(a).p, R(b).p, insn->imm);
+        NEXT();
+    }
+
+    BINOP32(ADD32, R(b).u + R(c).u)
+    BINOP32(SUB32, R(b).u - R(c).u)
+    BINOP32(MUL32, U32(b) * U32(c))
+    BINOP32(DIVS32, I32(b) / I32(c))
+    BINOP32(DIVU32, U32(b) / U32(c))
+    BINOP32(MODS32, I32(b) % I32(c))
+    BINOP32(MODU32, U32(b) % U32(c))
+    BINOP32(SHL32, U32(b) << (R(c).u & 31))
+    BINOP32(SHRS32, I32(b) >> (R(c).u & 31))
+    BINOP32(SHRU32, U32(b) >> (R(c).u & 31))
+    BINOP32(AND32, R(b).u & R(c).u)
+    BINOP32(OR32, R(b).u | R(c).u)
+    BINOP32(XOR32, R(b).u ^ R(c).u)
+    BINOP32(ADDI32, R(b).u + (int64_t)insn->imm)
+    BINOP32(NEG32, -R(b).u)
+    BINOP32(NOT32, ~R(b).u)
+    BINOP32(LNOT32, U32(b) == 0)
+    BINOP32(EQ32, U32(b) == U32(c))
+    BINOP32(NE32, U32(b) != U32(c))
+    BINOP32(LTS32, I32(b) < I32(c))
+    BINOP32(LES32, I32(b) <= I32(c))
+    BINOP32(LTU32, U32(b) < U32(c))
+    BINOP32(LEU32, U32(b) <= U32(c))
+
+    BINOP(ADD64, u, R(b).u + R(c).u)
+    BINOP(SUB64, u, R(b).u - R(c).u)
+    BINOP(MUL64, u, R(b).u * R(c).u)
+    BINOP(DIVS64, i, R(b).i / R(c).i)
+    BINOP(DIVU64, u, R(b).u / R(c).u)
+    BINOP(MODS64, i, R(b).i % R(c).i)
+    BINOP(MODU64, u, R(b).u % R(c).u)
+    BINOP(SHL64, u, R(b).u << (R(c).u & 63))
+    BINOP(SHRS64, i, R(b).i >> (R(c).u & 63))
+    BINOP(SHRU64, u, R(b).u >> (R(c).u & 63))
+    BINOP(AND64, u, R(b).u & R(c).u)
+    BINOP(OR64, u, R(b).u | R(c).u)
+    BINOP(XOR64, u, R(b).u ^ R(c).u)
+    BINOP(MULI64, u, R(b).u * (uint64_t)(int64_t)insn->imm)
+    BINOP(NEG64, u, -R(b).u)
+    BINOP(NOT64, u, ~R(b).u)
+    BINOP(LNOT64, u, R(b).u == 0)
+    BINOP(EQ64, u, R(b).u == R(c).u)
+    BINOP(NE64, u, R(b).u != R(c).u)
+    BINOP(LTS64, u, R(b).i < R(c).i)
+    BINOP(LES64, u, R(b).i <= R(c).i)
+    BINOP(LTU64, u, R(b).u < R(c).u)
+    BINOP(LEU64, u, R(b).u <= R(c).u)
+
+    BINOP(ADDF32, f32, R(b).f32 + R(c).f32)
+    BINOP(SUBF32, f32, R(b).f32 - R(c).f32)
+    BINOP(MULF32, f32, R(b).f32 * R(c).f32)
+    BINOP(DIVF32, f32, R(b).f32 / R(c).f32)
+    BINOP(NEGF32, f32, -R(b).f32)
+    BINOP(EQF32, u, R(b).f32 == R(c).f32)
+    BINOP(NEF32, u, R(b).f32 != R(c).f32)
+    BINOP(LTF32, u, R(b).f32 < R(c).f32)
+    BINOP(LEF32, u, R(b).f32 <= R(c).f32)
+
+    BINOP(ADDF64, f64, R(b).f64 + R(c).f64)
+    BINOP(SUBF64, f64, R(b).f64 - R(c).f64)
+    BINOP(MULF64, f64, R(b).f64 * R(c).f64)
+    BINOP(DIVF64, f64, R(b).f64 / R(c).f64)
+    BINOP(NEGF64, f64, -R(b).f64)
+    BINOP(EQF64, u, R(b).f64 == R(c).f64)
+    BINOP(NEF64, u, R(b).f64 != R(c).f64)
+    BINOP(LTF64, u, R(b).f64 < R(c).f64)
+    BINOP(LEF64, u, R(b).f64 <= R(c).f64)
+
+    BINOP32(SEXT8, (int8_t)R(b).u)
+    BINOP32(ZEXT8, (uint8_t)R(b).u)
+    BINOP32(SEXT16, (int16_t)R(b).u)
+    BINOP32(ZEXT16, (uint16_t)R(b).u)
+    BINOP(SEXT32, i, I32(b))
+    BINOP(ZEXT32, u, U32(b))
+
+    BINOP(I32TOF32, f32, (float)I32(b))
+    BINOP(U32TOF32, f32, (float)U32(b))
+    BINOP(I64TOF32, f32, (float)R(b).i)
+    BINOP(U64TOF32, f32, (float)R(b).u)
+    BINOP(I32TOF64, f64, (double)I32(b))
+    BINOP(U32TOF64, f64, (double)U32(b))
+    BINOP(I64TOF64, f64, (double)R(b).i)
+    BINOP(U64TOF64, f64, (double)R(b).u)
+
+    BINOP(F32TOI32, u, cvt_i32(R(b).f32))
+    BINOP(F32TOI64, u, cvt_i64(R(b).f32))
+    BINOP(F32TOU64, u, cvt_u64(R(b).f32))
+    BINOP(F64TOI32, u, cvt_i32(R(b).f64))
+    BINOP(F64TOI64, u, cvt_i64(R(b).f64))
+    BINOP(F64TOU64, u, cvt_u64(R(b).f64))
+    BINOP(F32TOF64, f64, (double)R(b).f32)
+    BINOP(F64TOF32, f32, (float)R(b).f64)
+
+    CASE(JMP) {
+        ip = code + insn->imm;
+        NEXT();
+    }
+    CASE(JZ32) {
+        if (U32(a) == 0) {
+            ip = code + insn->imm;
+        }
+        NEXT();
+    }
+    CASE(JNZ32) {
+        if (U32(a) != 0) {
+            ip = code + insn->imm;
+        }
+        NEXT();
+    }
+    CASE(JZ64) {
+        if (R(a).u == 0) {
+            ip = code + insn->imm;
+        }
+        NEXT();
+    }
+    CASE(JNZ64) {
+        if (R(a).u != 0) {
+            ip = code + insn->imm;
+        }
+        NEXT();
+    }
+
+    CASE(CALL) {
+        R(a) = execute(vm, &prog->funcs.data[insn->imm], &R(b), insn->c,
+                       R(a).p);
+        NEXT();
+    }
+    CASE(CALLI) {
+        const BcFunc* callee = find_func(vm, R(b).u);
+        if (callee) {
+            R(a) = execute(vm, callee, &regs[insn->b + 1], insn->c, R(a).p);
+        } else {
+            R(a) = call_native(R(b).u, &prog->sigs.data[insn->imm],
+                               &regs[insn->b + 1], R(a).p);
+        }
+        NEXT();
+    }
+    CASE(CALLX) {
+        R(a) = call_native(R(b).u, &prog->sigs.data[insn->imm],
+                           &regs[insn->b + 1], R(a).p);
+        NEXT();
+    }
+
+    CASE(RET) {
+        result = R(a);
+        goto done;
+    }
+    CASE(RETC) {
+        memcpy(ret_buf, R(a).p, insn->imm);
+        result.p = ret_buf;
+        goto done;
+    }
+    CASE(RETV) {
+        result.u = 0;
+        goto done;
+    }
+
+#ifndef THREADED_DISPATCH
+            default:
+                UNREACHABLE();
+        }
+    }
+#endif
+
+done:
+    vm->sp = prev_sp;
+    return result;
+}
+
+int interp_run(const BcProgram* prog, int argc, char* argv[], int* exit_code) {
+    Vm vm = {
+        .prog = prog,
+    };
+
+    size_t consts_size = (prog->consts.size + 1) * sizeof(uint64_t);
+    vm.consts = never_fail_allocator.alloc(&never_fail_allocator, consts_size);
+    memcpy(vm.consts, prog->consts.data, prog->consts.size * sizeof(uint64_t));
+
+    vm.stack = never_fail_allocator.alloc(&never_fail_allocator, VM_STACK_SIZE);
+    vm.sp = vm.stack + VM_STACK_SIZE;
+
+    Vm* prev_vm = current_vm;
+    current_vm = &vm;
+
+    int result = 1;
+    if (link_program(&vm)) {
+        const BcFunc* entry = &prog->funcs.data[prog->entry];
+        BcValue args[2];
+        args[0].i = argc;
+        args[1].p = argv;
+
+        BcValue ret = execute(&vm, entry, args, MIN(entry->param_count, 2),
+                              NULL);
+        fflush(stdout);
+        *exit_code = (int)ret.u;
+        result = 0;
+    }
+
+    current_vm = prev_vm;
+    for (int i = 0; i < (int)ARRAY_SIZE(vm.libs); i++) {
+        if (vm.libs[i]) {
+            dlclose(vm.libs[i]);
+        }
+    }
+    never_fail_allocator.free(&never_fail_allocator, vm.stack);
+    never_fail_allocator.free(&never_fail_allocator, vm.consts);
+    return result;
+}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include "bytecode.h"
+
+// Run the entry function of the bytecode program with argc and argv.
+// Returns 0 on success and stores the value returned by the entry function in
+// exit_code.
+int interp_run(const BcProgram* prog, int argc, char* argv[], int* exit_code);
+
+#endif
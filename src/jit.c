@@ -0,0 +1,376 @@
+#include "jit.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "asm.h"
+#include "utils.h"
+
+#ifndef _WIN32
+
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#define HOST_BITS 64
+#elif defined(__i386__)
+#define HOST_BITS 32
+#else
+#define HOST_BITS 0
+#endif
+
+// jmp *0(%rip) followed by the target address
+#define STUB_SIZE 16
+
+typedef int (*EntryFunc)(int argc, char* argv[]);
+
+typedef struct JitState {
+    const AsmObject* obj;
+    unsigned char* base;
+    size_t size;
+    size_t exec_size;    // size of the executable part
+    size_t* section_off;  // -1 for sections not loaded
+    uintptr_t* sym_addr;
+    void* libs[2];
+} JitState;
+
+static void* lookup_extern(JitState* jit, const char* name) {
+    if (!jit->libs[0]) {
+        jit->libs[0] = dlopen(NULL, RTLD_LAZY);
+    }
+
+    void* addr = jit->libs[0] ? dlsym(jit->libs[0], name) : NULL;
+    if (!addr) {
+        // ikac itself does not link libm
+        if (!jit->libs[1]) {
+            jit->libs[1] = dlopen("libm.so.6", RTLD_LAZY);
+        }
+        if (jit->libs[1]) {
+            addr = dlsym(jit->libs[1], name);
+        }
+    }
+    return addr;
+}
+
+static int resolve_externs(JitState* jit) {
+    const AsmObject* obj = jit->obj;
+    for (size_t i = 0; i < obj->symbols.size; i++) {
+        const AsmSymbol* sym = &obj->symbols.data[i];
+        if (sym->section >= 0 || sym->is_section) {
+            continue;
+        }
+
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", sym->name.len, sym->name.ptr);
+        void* addr = lookup_extern(jit, name);
+        if (!addr) {
+            ika_log(LOG_ERROR, "undefined symbol: %s\n", name);
+            return 0;
+        }
+        jit->sym_addr[i] = (uintptr_t)addr;
+    }
+    return 1;
+}
+
+static size_t align_up(size_t n, size_t alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+// Place executable sections and stubs first, then data on separate pages
+static void layout(JitState* jit, size_t page_size) {
+    const AsmObject* obj = jit->obj;
+    size_t size = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        int want_exec = (pass == 0);
+        for (size_t i = 0; i < obj->sections.size; i++) {
+            const AsmSection* section = &obj->sections.data[i];
+            if (!(section->flags & ASM_SECTION_ALLOC)) {
+                continue;
+            }
+            if (!!(section->flags & ASM_SECTION_EXEC) != want_exec) {
+                continue;
+            }
+            size = align_up(size, section->alignment);
+            jit->section_off[i] = size;
+            size += section->data.size;
+        }
+
+        if (want_exec) {
+            size = align_up(size, STUB_SIZE);
+            jit->section_off[obj->sections.size] = size;
+            if (obj->bits == 64) {
+                size += STUB_SIZE * obj->symbols.size;
+            }
+            size = align_up(size, page_size);
+            jit->exec_size = size;
+        }
+    }
+
+    jit->size = align_up(size == 0 ? 1 : size, page_size);
+}
+
+static void* map_memory(JitState* jit, size_t page_size) {
+    void* hint = NULL;
+    if (jit->obj->bits == 64) {
+        // Stay within rel32 reach of the host libraries for extern variables
+        for (size_t i = 0; i < jit->obj->symbols.size; i++) {
+            uintptr_t addr = jit->sym_addr[i];
+            if (addr > ((uintptr_t)1 << 30)) {
+                hint =
+                    (void*)((addr - ((uintptr_t)1 << 30)) & ~(page_size - 1));
+                break;
+            }
+        }
+    }
+
+    void* mem = mmap(hint, jit->size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+static void write_le(unsigned char* p, uint64_t val, int size) {
+    for (int i = 0; i < size; i++) {
+        p[i] = (val >> (i * 8)) & 0xFF;
+    }
+}
+
+// Address of a stub jumping to an extern function
+static uintptr_t get_stub(JitState* jit, int symbol) {
+    unsigned char* stub = jit->base +
+                          jit->section_off[jit->obj->sections.size] +
+                          symbol * STUB_SIZE;
+    if (stub[0] == 0) {
+        static const unsigned char jmp[] = {0xFF, 0x25, 0, 0, 0, 0};
+        memcpy(stub, jmp, sizeof(jmp));
+        write_le(stub + sizeof(jmp), jit->sym_addr[symbol], 8);
+    }
+    return (uintptr_t)stub;
+}
+
+static int apply_relocs(JitState* jit) {
+    const AsmObject* obj = jit->obj;
+    for (size_t i = 0; i < obj->sections.size; i++) {
+        const AsmSection* section = &obj->sections.data[i];
+        if (jit->section_off[i] == (size_t)-1) {
+            continue;
+        }
+
+        unsigned char* data = jit->base + jit->section_off[i];
+        for (size_t j = 0; j < section->relocs.size; j++) {
+            const AsmReloc* reloc = &section->relocs.data[j];
+            const AsmSymbol* sym = &obj->symbols.data[reloc->symbol];
+            unsigned char* p = data + reloc->offset;
+            uintptr_t s = jit->sym_addr[reloc->symbol];
+            int64_t val;
+
+            switch (reloc->type) {
+                case ASM_RELOC_ABS64:
+                    write_le(p, s + reloc->addend, 8);
+                    continue;
+
+                case ASM_RELOC_ABS32:
+                    val = (int64_t)(s + reloc->addend);
+                    if (obj->bits == 64 && (uint64_t)val > UINT32_MAX) {
+                        goto out_of_range;
+                    }
+                    break;
+
+                case ASM_RELOC_ABS32S:
+                    val = (int64_t)(s + reloc->addend);
+                    if (val < INT32_MIN || val > INT32_MAX) {
+                        goto out_of_range;
+                    }
+                    break;
+
+                case ASM_RELOC_PLT32:
+                    if (obj->bits == 64 && sym->section < 0) {
+                        s = get_stub(jit, reloc->symbol);
+                    }
+                    // fallthrough
+                case ASM_RELOC_PC32:
+                    val = (int64_t)(s + reloc->addend - (uintptr_t)p);
+                    if (obj->bits == 64 &&
+                        (val < INT32_MIN || val > INT32_MAX)) {
+                        goto out_of_range;
+                    }
+                    break;
+
+                default:
+                    UNREACHABLE();
+            }
+
+            write_le(p, val, 4);
+            continue;
+
+        out_of_range:
+            ika_log(LOG_ERROR, "relocation against '%.*s' is out of range\n",
+                    sym->name.len, sym->name.ptr);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int compare_addr(const void* a, const void* b) {
+    uintptr_t x = ((const uintptr_t*)a)[0];
+    uintptr_t y = ((const uintptr_t*)b)[0];
+    return (x > y) - (x < y);
+}
+
+// Symbol map read by perf to name JIT frames
+static void write_perf_map(JitState* jit) {
+    const AsmObject* obj = jit->obj;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        return;
+    }
+
+    // (address, symbol) pairs of functions
+    uintptr_t* funcs = never_fail_allocator.alloc(
+        &never_fail_allocator, (obj->symbols.size + 1) * 2 * sizeof(uintptr_t));
+    size_t count = 0;
+    for (size_t i = 0; i < obj->symbols.size; i++) {
+        const AsmSymbol* sym = &obj->symbols.data[i];
+        if (sym->section < 0 || sym->is_section || asm_is_temp_symbol(sym) ||
+            !(obj->sections.data[sym->section].flags & ASM_SECTION_EXEC)) {
+            continue;
+        }
+        funcs[count * 2] = jit->sym_addr[i];
+        funcs[count * 2 + 1] = i;
+        count++;
+    }
+    qsort(funcs, count, 2 * sizeof(uintptr_t), compare_addr);
+
+    for (size_t i = 0; i < count; i++) {
+        const AsmSymbol* sym = &obj->symbols.data[funcs[i * 2 + 1]];
+        const AsmSection* section = &obj->sections.data[sym->section];
+        uintptr_t end = (uintptr_t)jit->base + jit->section_off[sym->section] +
+                        section->data.size;
+        if (i + 1 < count && funcs[(i + 1) * 2] < end) {
+            end = funcs[(i + 1) * 2];
+        }
+        fprintf(fp, "%lx %lx %.*s\n", (unsigned long)funcs[i * 2],
+                (unsigned long)(end - funcs[i * 2]), sym->name.len,
+                sym->name.ptr);
+    }
+
+    never_fail_allocator.free(&never_fail_allocator, funcs);
+    fclose(fp);
+}
+
+static int load(JitState* jit) {
+    const AsmObject* obj = jit->obj;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+
+    if (!resolve_externs(jit)) {
+        return 0;
+    }
+
+    layout(jit, page_size);
+    jit->base = map_memory(jit, page_size);
+    if (!jit->base) {
+        ika_log(LOG_ERROR, "mmap failed\n");
+        return 0;
+    }
+
+    for (size_t i = 0; i < obj->sections.size; i++) {
+        if (jit->section_off[i] == (size_t)-1) {
+            continue;
+        }
+        const AsmSection* section = &obj->sections.data[i];
+        memcpy(jit->base + jit->section_off[i], section->data.data,
+               section->data.size);
+    }
+
+    for (size_t i = 0; i < obj->symbols.size; i++) {
+        const AsmSymbol* sym = &obj->symbols.data[i];
+        if (sym->section >= 0) {
+            if (jit->section_off[sym->section] == (size_t)-1) {
+                continue;
+            }
+            jit->sym_addr[i] = (uintptr_t)jit->base +
+                               jit->section_off[sym->section] + sym->offset;
+        }
+    }
+
+    if (!apply_relocs(jit)) {
+        return 0;
+    }
+
+    if (mprotect(jit->base, jit->exec_size, PROT_READ | PROT_EXEC) != 0) {
+        ika_log(LOG_ERROR, "mprotect failed\n");
+        return 0;
+    }
+
+    write_perf_map(jit);
+    return 1;
+}
+
+int jit_run(const char* asm_src, int bits, const char* entry, int argc,
+            char* argv[], int* exit_code) {
+    if (bits != HOST_BITS) {
+        ika_log(LOG_ERROR, "-run requires the %s target\n",
+                HOST_BITS == 64 ? "x86_64" : "i386");
+        return 1;
+    }
+
+    AsmObject obj;
+    char err[256];
+    if (asm_assemble(&obj, bits, asm_src, err, sizeof(err)) != 0) {
+        ika_log(LOG_ERROR, "cannot assemble the program: %s\n", err);
+        return 1;
+    }
+
+    JitState jit = {
+        .obj = &obj,
+    };
+    jit.section_off = never_fail_allocator.alloc(
+        &never_fail_allocator, (obj.sections.size + 1) * sizeof(size_t));
+    memset(jit.section_off, 0xFF, (obj.sections.size + 1) * sizeof(size_t));
+    jit.sym_addr = never_fail_allocator.alloc(
+        &never_fail_allocator, (obj.symbols.size + 1) * sizeof(uintptr_t));
+    memset(jit.sym_addr, 0, (obj.symbols.size + 1) * sizeof(uintptr_t));
+
+    int result = 1;
+    if (load(&jit)) {
+        uintptr_t entry_addr = 0;
+        for (size_t i = 0; i < obj.symbols.size; i++) {
+            const AsmSymbol* sym = &obj.symbols.data[i];
+            if (sym->section >= 0 && str_eql(sym->name, str(entry))) {
+                entry_addr = jit.sym_addr[i];
+                break;
+            }
+        }
+
+        if (entry_addr) {
+            EntryFunc func = (EntryFunc)entry_addr;
+            *exit_code = func(argc, argv);
+            fflush(stdout);
+            result = 0;
+        } else {
+            ika_log(LOG_ERROR, "entry symbol %s not found\n", entry);
+        }
+    }
+
+    if (jit.base) {
+        munmap(jit.base, jit.size);
+    }
+    for (int i = 0; i < (int)ARRAY_SIZE(jit.libs); i++) {
+        if (jit.libs[i]) {
+            dlclose(jit.libs[i]);
+        }
+    }
+    never_fail_allocator.free(&never_fail_allocator, jit.section_off);
+    never_fail_allocator.free(&never_fail_allocator, jit.sym_addr);
+    asm_free(&obj);
+    return result;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef JIT_H
+#define JIT_H
+
+// Assemble the program into executable memory and call its entry function
+// with argc and argv. Returns 0 on success and stores the value returned by
+// the entry function in exit_code.
+int jit_run(const char* asm_src, int bits, const char* entry, int argc,
+            char* argv[], int* exit_code);
+
+#endif
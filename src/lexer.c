@@ -1,6 +1,10 @@
 #include "lexer.h"
 
+#include <stdlib.h>
+
+#include "intern.h"
 #include "parser.h"
+#include "scan.h"
 #include "utl/allocator/utlstackfallback.h"
 #include "utl/utlvector.h"
 
@@ -35,6 +39,25 @@ static inline int is_letter(char c) {
     return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
 }
 
+// Decimal digits followed by a fraction or an exponent
+static inline int is_float_literal(const char* p) {
+    p = scan_digits(p);
+
+    if (*p == '.') {
+        return is_digit(*(p + 1));
+    }
+
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') {
+            p++;
+        }
+        return is_digit(*p);
+    }
+
+    return 0;
+}
+
 static const StrToken str_tk[] = {
     {"var", TK_DECL},      {"const", TK_CONST},   {"if", TK_IF},
     {"else", TK_ELSE},     {"while", TK_WHILE},   {"fn", TK_FUNC},
@@ -45,9 +68,67 @@ static const StrToken str_tk[] = {
     {"u32", TK_U32},       {"i8", TK_I8},         {"i16", TK_I16},
     {"i32", TK_I32},       {"bool", TK_BOOL},     {"true", TK_TRUE},
     {"false", TK_FALSE},   {"null", TK_NULL},     {"as", TK_CAST},
-    {"asm", TK_ASM},
+    {"asm", TK_ASM},       {"u64", TK_U64},       {"i64", TK_I64},
+    {"f32", TK_F32},       {"f64", TK_F64},
 };
 
+static KeywordTable keyword_table = KEYWORD_TABLE(str_tk);
+
+static inline unsigned int keyword_hash(Str s, unsigned int seed) {
+    unsigned int x = (unsigned char)s.ptr[0] |
+                     (unsigned char)s.ptr[s.len / 2] << 8 |
+                     (unsigned char)s.ptr[s.len - 1] << 16 |
+                     (unsigned int)s.len << 24;
+    x *= seed;
+    x ^= x >> 15;
+    x *= 0x2c1b3c6du;
+    return (x & 0xffffffffu) >> (32 - KEYWORD_SLOT_BITS);
+}
+
+// Find a seed that maps every keyword to its own slot
+static void keyword_table_init(KeywordTable* table) {
+    assert(table->keyword_count < KEYWORD_SLOT_COUNT / 2);
+
+    for (unsigned int seed = 1; seed < 1 << 20; seed += 2) {
+        memset(table->slots, -1, sizeof(table->slots));
+
+        int i;
+        for (i = 0; i < table->keyword_count; i++) {
+            unsigned int h = keyword_hash(str(table->keywords[i].s), seed);
+            if (table->slots[h] >= 0) {
+                break;
+            }
+            table->slots[h] = i;
+            table->lens[h] = strlen(table->keywords[i].s);
+        }
+
+        if (i == table->keyword_count) {
+            table->seed = seed;
+            table->ready = 1;
+            return;
+        }
+    }
+    UNREACHABLE();
+}
+
+int keyword_find(KeywordTable* table, Str s) {
+    if (!table->ready) {
+        keyword_table_init(table);
+    }
+
+    if (s.len == 0) {
+        return -1;
+    }
+
+    unsigned int h = keyword_hash(s, table->seed);
+    int i = table->slots[h];
+    if (i < 0 || table->lens[h] != s.len ||
+        memcmp(table->keywords[i].s, s.ptr, s.len) != 0) {
+        return -1;
+    }
+    return table->keywords[i].token_type;
+}
+
 // Parse escape sequence in string literal
 // - p: null-terminated string start with '\'
 // - size: return the size of the escape sequence
@@ -67,6 +148,7 @@ static inline Token handle_string_escape(const char* p, int* size) {
         case '\'':
         case '"':
         case '\\':
+            tk.val = c;
             break;
         case '0':
             tk.val = '\0';
@@ -115,22 +197,21 @@ static inline Token handle_string_escape(const char* p, int* size) {
 
 Token next_token_from_line(UtlArenaAllocator* arena,
                            UtlAllocator* temp_allocator, const char* p,
-                           const StrToken* keywords, int keyword_count,
-                           int* start_offset, int* end_offset) {
+                           KeywordTable* keywords, int* start_offset,
+                           int* end_offset) {
     Token tk;
     int pos = 0;
 
     *start_offset = 0;
     *end_offset = 0;
 
-    while (*p == ' ' || *p == '\t') {
-        p++;
-        pos++;
-    }
+    const char* blanks_end = scan_blanks(p);
+    pos += blanks_end - p;
+    p = blanks_end;
 
     *start_offset = pos;
 
-    if (*p == '\0' || (*p == '/' && *(p + 1) == '/')) {
+    if (is_line_end(p) || (*p == '/' && *(p + 1) == '/')) {
         tk.type = TK_EOF;
         return tk;
     }
@@ -344,9 +425,38 @@ Token next_token_from_line(UtlArenaAllocator* arena,
             }
             break;
 
+        case '@': {
+            p++;
+            pos++;
+            if (!is_letter(*p) && *p != '_') {
+                tk.type = TK_ERR;
+                tk.str = str("expected a builtin name after '@'");
+                break;
+            }
+
+            Str ident = {
+                .ptr = p,
+                .len = scan_ident(p) - p,
+            };
+            p += ident.len;
+            pos += ident.len;
+
+            tk.type = TK_BUILTIN;
+            tk.str = ident;
+        } break;
+
         case '"': {
             tk.type = TK_STR;
 
+            // Literals without escapes are used in place
+            const char* str_end = scan_string(p + 1);
+            if (*str_end == '"') {
+                tk.str.ptr = p + 1;
+                tk.str.len = str_end - (p + 1);
+                pos += tk.str.len + 2;
+                break;
+            }
+
             char buffer[DEFAULT_STR_SIZE];
             UtlStackFallbackAllocator sf =
                 utlstackfallback_init(buffer, sizeof(buffer), temp_allocator);
@@ -356,26 +466,30 @@ Token next_token_from_line(UtlArenaAllocator* arena,
 
             p++;
             pos++;
-            while (*p != '"' && *p != '\0') {
-                char c = *p;
-                if (*p == '\\') {
-                    int size;
-                    Token result = handle_string_escape(p, &size);
-                    p += size;
-                    pos += size;
-
-                    if (result.type == TK_ERR) {
-                        tk = result;
-                        break;
+            while (*p != '"' && !is_line_end(p)) {
+                if (*p != '\\') {
+                    // Copy the characters up to the next escape at once
+                    const char* run_end = scan_string(p);
+                    if (run_end == p) {
+                        run_end++;  // '\r' inside the line
                     }
+                    utlvector_pushall(&s, p, run_end - p);
+                    pos += run_end - p;
+                    p = run_end;
+                    continue;
+                }
 
-                    c = result.val;
-                } else {
-                    p++;
-                    pos++;
+                int size;
+                Token result = handle_string_escape(p, &size);
+                p += size;
+                pos += size;
+
+                if (result.type == TK_ERR) {
+                    tk = result;
+                    break;
                 }
 
-                utlvector_push(&s, c);
+                utlvector_push(&s, (char)result.val);
             }
 
             if (tk.type != TK_ERR) {
@@ -405,7 +519,7 @@ Token next_token_from_line(UtlArenaAllocator* arena,
 
             p++;
             pos++;
-            while (*p != '\'' && *p != '\0') {
+            while (*p != '\'' && !is_line_end(p)) {
                 unsigned char c = *p;
                 if (*p == '\\') {
                     int size;
@@ -439,7 +553,18 @@ Token next_token_from_line(UtlArenaAllocator* arena,
             break;
 
         default: {
-            if (is_digit(*p)) {
+            if (is_digit(*p) && is_float_literal(p)) {
+                char* end;
+                tk.type = TK_FLOAT;
+                tk.fval = strtod(p, &end);
+                pos += end - p;
+                p = end;
+
+                if (is_letter(*p) || *p == '_') {
+                    tk.type = TK_ERR;
+                    tk.str = str("invalid suffix on floating constant");
+                }
+            } else if (is_digit(*p)) {
                 if (*p == '0') {
                     char next = *(p + 1);
                     if (next == 'x' || next == 'X') {  // hex
@@ -514,11 +639,12 @@ Token next_token_from_line(UtlArenaAllocator* arena,
                 } else {  // dec
                     tk.type = TK_INT;
                     tk.val = 0;
-                    while (is_digit(*p)) {
+                    const char* digits_end = scan_digits(p);
+                    pos += digits_end - p;
+                    while (p < digits_end) {
                         tk.val *= 10;
                         tk.val += *p - '0';
                         p++;
-                        pos++;
                     }
 
                     if (is_letter(*p)) {
@@ -531,25 +657,18 @@ Token next_token_from_line(UtlArenaAllocator* arena,
             } else if (is_letter(*p) || *p == '_') {
                 Str ident = {
                     .ptr = p,
-                    .len = 1,
+                    .len = scan_ident(p) - p,
                 };
+                p += ident.len;
+                pos += ident.len;
 
-                p++;
-                pos++;
-                while (is_letter(*p) || is_digit(*p) || *p == '_') {
-                    ident.len++;
-                    p++;
-                    pos++;
-                }
-
-                tk.type = TK_IDENT;
-                tk.str = ident;
-
-                for (int i = 0; i < keyword_count; i++) {
-                    if (str_eql(str(keywords[i].s), ident)) {
-                        tk.type = keywords[i].token_type;
-                        break;
-                    }
+                int keyword = keyword_find(keywords, ident);
+                if (keyword >= 0) {
+                    tk.type = keyword;
+                    tk.str = ident;
+                } else {
+                    tk.type = TK_IDENT;
+                    tk.str = intern(ident);
                 }
 
             } else {
@@ -563,77 +682,100 @@ Token next_token_from_line(UtlArenaAllocator* arena,
     return tk;
 }
 
-static Token next_token_internal(ParserState* parser, int peek) {
-    Token tk;
+void lex_tokens(LexTokens* tokens, const SourceRanges* lines,
+                UtlArenaAllocator* arena, UtlAllocator* temp_allocator) {
+    if (lines->size == 0) {
+        LexToken eof = {.tk.type = TK_EOF};
+        utlvector_push(tokens, eof);
+        return;
+    }
 
-    SourceLine* line = parser->line;
-    assert(line);
-
-    size_t pos = parser->pos;
-
-    SourcePos prev_token_end = {
-        .index = pos,
-        .line = *line,
-    };
-
-    // skip to next token start
-    char* p = &line->content[pos];
-    while (*p == ' ' || *p == '\t' || *p == '\0' || *p == '/') {
-        if (*p == '\0' || (*p == '/' && *(p + 1) == '/')) {
-            // next line
-            if (line->next == NULL) {
-                if (!peek) {
-                    SourcePos curr_pos = {
-                        .index = pos,
-                        .line = *line,
+    const SourceRange* range = lines->data;
+    const SourceRange* last_range = &lines->data[lines->size - 1];
+    const SourceLine* line = range->lines;
+    size_t pos = 0;
+    while (1) {
+        // skip to next token start
+        const char* p = &line->content[pos];
+        while (*p == ' ' || *p == '\t' || *p == '/' || is_line_end(p)) {
+            if (is_line_end(p) || (*p == '/' && *(p + 1) == '/')) {
+                // next line
+                if (line != &range->lines[range->count - 1]) {
+                    line++;
+                } else if (range != last_range) {
+                    range++;
+                    line = range->lines;
+                } else {
+                    LexToken eof = {
+                        .tk.type = TK_EOF,
+                        .start = source_pos(line, pos),
+                        .end = source_pos(line, pos),
                     };
-                    parser->prev_token_end = prev_token_end;
-                    parser->token_start = curr_pos;
-                    parser->token_end = curr_pos;
+                    utlvector_push(tokens, eof);
+                    return;
                 }
-                tk.type = TK_EOF;
-                return tk;
+                pos = 0;
+                p = line->content;
+            } else if (*p == '/') {
+                break;
+            } else {
+                const char* blanks_end = scan_blanks(p);
+                pos += blanks_end - p;
+                p = blanks_end;
             }
-            line = line->next;
-            pos = 0;
-            p = line->content;
-        } else if (*p == '/') {
-            break;
-        } else {
-            pos++;
-            p++;
         }
-    }
 
-    SourcePos token_start = {
-        .index = pos,
-        .line = *line,
-    };
-
-    int start_offset, end_offset;
-    tk = next_token_from_line(parser->arena, parser->temp_allocator, p, str_tk,
-                              ARRAY_SIZE(str_tk), &start_offset, &end_offset);
-    pos += end_offset;
-
-    SourcePos token_end = {
-        .index = pos,
-        .line = *line,
-    };
-
-    if (!peek) {
-        parser->prev_token_end = prev_token_end;
-        parser->token_start = token_start;
-        parser->token_end = token_end;
-        parser->line = line;
-        parser->pos = pos;
+        int start_offset, end_offset;
+        LexToken tk = {
+            .start = source_pos(line, pos),
+        };
+        tk.tk = next_token_from_line(arena, temp_allocator, p, &keyword_table,
+                                     &start_offset, &end_offset);
+        pos += end_offset;
+        tk.end = source_pos(line, pos);
+        utlvector_push(tokens, tk);
+
+        // The parser stops at the first error
+        if (tk.tk.type == TK_ERR) {
+            return;
+        }
     }
-
-    return tk;
 }
 
 Token next_token(ParserState* parser) {
-    parser->token = next_token_internal(parser, 0);
+    const LexToken* tokens = parser->tokens.data;
+    size_t index = parser->token_index;
+
+    if (index == 0) {
+        parser->prev_token_end = tokens[0].start;
+    } else {
+        parser->prev_token_end = tokens[index - 1].end;
+    }
+
+    const LexToken* curr = &tokens[index];
+    parser->token_start = curr->start;
+    parser->token_end = curr->end;
+
+    // The last token (EOF or error) is returned again on further calls
+    if (index + 1 < parser->tokens.size) {
+        parser->token_index++;
+    }
+
+    parser->token = curr->tk;
     return parser->token;
 }
 
-Token peek_token(ParserState* parser) { return next_token_internal(parser, 1); }
+Token peek_token_n(ParserState* parser, size_t n) {
+    size_t last = parser->tokens.size - 1;
+    size_t index = parser->token_index;
+    if (n > last - index) {
+        index = last;
+    } else {
+        index += n;
+    }
+    return parser->tokens.data[index].tk;
+}
+
+Token peek_token(ParserState* parser) {
+    return peek_token_n(parser, 0);
+}
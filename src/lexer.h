@@ -1,6 +1,7 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "source.h"
 #include "str.h"
 #include "utl/allocator/utlarena.h"
 
@@ -9,6 +10,7 @@ typedef enum TkType {
     TK_EOF = 0,
     TK_IDENT,
     TK_INT,
+    TK_FLOAT,
     TK_STR,
     TK_DECL,
     TK_CONST,
@@ -29,6 +31,7 @@ typedef enum TkType {
     TK_SIZEOF,
     TK_CAST,
     TK_ASM,
+    TK_BUILTIN,  // @name
 
     TK_MUL,
     TK_DIV,
@@ -84,15 +87,20 @@ typedef enum TkType {
     TK_U8,
     TK_U16,
     TK_U32,
+    TK_U64,
     TK_I8,
     TK_I16,
     TK_I32,
+    TK_I64,
+    TK_F32,
+    TK_F64,
 } TkType;
 
 typedef struct Token {
     TkType type;
     union {
-        unsigned int val;
+        unsigned long long val;
+        double fval;
         Str str;
     };
 } Token;
@@ -102,20 +110,56 @@ typedef struct StrToken {
     int token_type;
 } StrToken;
 
+#define KEYWORD_SLOT_BITS 7
+#define KEYWORD_SLOT_COUNT (1 << KEYWORD_SLOT_BITS)
+
+// Perfect hash table over a keyword list, built on first use
+typedef struct KeywordTable {
+    const StrToken* keywords;
+    int keyword_count;
+    int ready;
+    unsigned int seed;
+    signed char slots[KEYWORD_SLOT_COUNT];  // index into keywords, or -1
+    unsigned char lens[KEYWORD_SLOT_COUNT];
+} KeywordTable;
+
+#define KEYWORD_TABLE(keywords) {keywords, ARRAY_SIZE(keywords), 0, 0, {0}, {0}}
+
+// Return the token type of the keyword, or -1 if s is not a keyword
+int keyword_find(KeywordTable* table, Str s);
+
+// Token with its position in the source
+typedef struct LexToken {
+    Token tk;
+    SourcePos start;
+    SourcePos end;
+} LexToken;
+
+typedef UtlVector(LexToken) LexTokens;
+
 struct ParserState;
 
 // Return the next token in the line
 // - arena: for string token
 // - p: the source line
-// - search_keywords: return as keyword token or just return as identifier token
+// - keywords: identifiers found in the table are returned as keyword tokens
 // - start_offset: token start pos
 // - end_offset: token end pos
 Token next_token_from_line(UtlArenaAllocator* arena,
                            UtlAllocator* temp_allocator, const char* p,
-                           const StrToken* keywords, int keyword_count,
-                           int* start_offset, int* end_offset);
+                           KeywordTable* keywords, int* start_offset,
+                           int* end_offset);
+
+// Lex all the source lines into tokens, ending with TK_EOF or TK_ERR
+void lex_tokens(LexTokens* tokens, const SourceRanges* lines,
+                UtlArenaAllocator* arena, UtlAllocator* temp_allocator);
+
 Token next_token(struct ParserState* parser);
 
+// The token after the next n tokens, the last token (EOF or error) if there
+// aren't that many
+Token peek_token_n(struct ParserState* parser, size_t n);
+
 Token peek_token(struct ParserState* parser);
 
 #endif
@@ -2,20 +2,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #else
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #endif
 
+#include "asm.h"
+#include "bytecode.h"
 #include "codegen.h"
 #include "error.h"
+#include "intern.h"
+#include "interp.h"
+#include "jit.h"
 #include "opt.h"
 #include "parser.h"
+#include "pch.h"
 #include "preprocessor.h"
 #include "sema.h"
 #include "symbol_table.h"
@@ -31,30 +39,251 @@ void usage(void) {
         "  -E               Preprocess only; do not compile, assemble or "
         "link.\n"
         "  -S               Compile only; do not assemble or link.\n"
+        "  -c               Compile and assemble, but do not link.\n"
         "  -o <file>        Place the output into <file>.\n"
         "  -e <entry>       Specify the program entry point.\n"
         "  -D <macro>       Define a <macro>.\n"
         "  -I <dir>         Add <dir> to the end of the main include path.\n"
+        "  -target <arch>   Generate code for <arch> (i386, x86_64).\n"
+        "  -pipe            Stream the assembly to the system assembler\n"
+        "                   instead of the built-in one.\n"
+        "  -run             Compile and run in memory; following arguments\n"
+        "                   are passed to the program.\n"
+        "  -interp          Run with the bytecode interpreter; following\n"
+        "                   arguments are passed to the program.\n"
+        "  -lex-bench       Preprocess and lex only, and report the number\n"
+        "                   of tokens lexed per second.\n"
+        "  -emit-pch        Write a precompiled header of file to <file>, or\n"
+        "                   to file.ikapch by default.\n"
         "  -?               Display this information.\n");
 }
 
+#ifdef _WIN32
+#define os_unlink _unlink
+#else
+#define os_unlink unlink
+#endif
+
+#ifdef _WIN32
+static void build_command_line(const char* const args[], char* cmd,
+                               int size) {
+    int len = 0;
+    cmd[0] = '\0';
+    for (int i = 0; args[i] && len < size; i++) {
+        len += snprintf(cmd + len, size - len, i == 0 ? "%s" : " \"%s\"",
+                        args[i]);
+    }
+}
+#endif
+
+// Run a command and wait for it. Returns 0 on success.
+static int run_command(const char* const args[]) {
+#ifdef _WIN32
+    char cmd[1024];
+    build_command_line(args, cmd, sizeof(cmd));
+    return system(cmd) != 0;
+#else
+    pid_t pid = fork();
+    if (pid == -1) {
+        ika_log(LOG_ERROR, "fork failed\n");
+        return 1;
+    }
+
+    if (pid == 0) {
+        execvp(args[0], (char* const*)args);
+        ika_log(LOG_ERROR, "exec failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    return status != 0;
+#endif
+}
+
+typedef struct Command {
+    FILE* in;  // stdin of the command
+#ifndef _WIN32
+    pid_t pid;
+#endif
+} Command;
+
+// Start a command reading from a pipe. Returns 0 on success.
+static int open_command(Command* command, const char* const args[]) {
+#ifdef _WIN32
+    char cmd[1024];
+    build_command_line(args, cmd, sizeof(cmd));
+    command->in = _popen(cmd, "w");
+    if (!command->in) {
+        ika_log(LOG_ERROR, "cannot run %s\n", args[0]);
+        return 1;
+    }
+    return 0;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) {
+        ika_log(LOG_ERROR, "pipe failed\n");
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        ika_log(LOG_ERROR, "fork failed\n");
+        close(fds[0]);
+        close(fds[1]);
+        return 1;
+    }
+
+    if (pid == 0) {
+        dup2(fds[0], STDIN_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execvp(args[0], (char* const*)args);
+        ika_log(LOG_ERROR, "exec failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    close(fds[0]);
+    command->pid = pid;
+    command->in = fdopen(fds[1], "w");
+    if (!command->in) {
+        close(fds[1]);
+        waitpid(pid, NULL, 0);
+        ika_log(LOG_ERROR, "fdopen failed\n");
+        return 1;
+    }
+
+    // Report a failed command instead of dying on a write to the pipe
+    signal(SIGPIPE, SIG_IGN);
+    return 0;
+#endif
+}
+
+// Close the pipe and wait for the command. Returns 0 on success.
+static int close_command(Command* command) {
+#ifdef _WIN32
+    return _pclose(command->in) != 0;
+#else
+    int result = fclose(command->in) != 0;
+    int status;
+    waitpid(command->pid, &status, 0);
+    return result || status != 0;
+#endif
+}
+
+#ifndef _WIN32
+// Assemble the code in src into an object file with the integrated
+// assembler, falling back to the system assembler for code it cannot
+// assemble. Returns 0 on success.
+static int assemble(const char* src, const char* obj_path, TargetArch target,
+                    const char* arch_flag) {
+    AsmObject obj;
+    char err[256];
+    int bits = target == TARGET_X86_64 ? 64 : 32;
+    if (asm_assemble(&obj, bits, src, err, sizeof(err)) != 0) {
+        ika_log(LOG_NOTE, "using the system assembler: %s\n", err);
+
+        const char* args[] = {
+            "gcc", arch_flag, "-c", "-o", obj_path, "-x", "assembler", "-",
+            NULL,
+        };
+        Command command;
+        if (open_command(&command, args) != 0) {
+            return 1;
+        }
+        fputs(src, command.in);
+        return close_command(&command);
+    }
+
+    int result = 1;
+    FILE* fp = fopen(obj_path, "wb");
+    if (fp) {
+        result = elf_write(&obj, fp);
+        result |= fclose(fp) != 0;
+    }
+    if (result != 0) {
+        ika_log(LOG_ERROR, "cannot write file %s: %s\n", obj_path,
+                strerror(errno));
+    }
+
+    asm_free(&obj);
+    return result;
+}
+#endif
+
+// Returns 0 on success
+static int generate(TargetArch target, FILE* out, UtlArenaAllocator* arena,
+                    const AST* ast, NodeIndex node, SymbolTable* sym,
+                    Str entry_sym) {
+    OutBuf buf;
+    outbuf_init(&buf, out, arena);
+
+    CodegenState codegen_state = {
+        .out = &buf,
+        .ast = ast,
+        .float_data = utlvector_init(utlarena_allocator(arena)),
+    };
+
+    if (target == TARGET_X86_64) {
+        codegen_x86_64(&codegen_state, node, sym, entry_sym);
+    } else {
+        codegen(&codegen_state, node, sym, entry_sym);
+    }
+
+    return outbuf_flush(&buf);
+}
+
+// Lex the preprocessed source repeatedly for about half a second
+static void lex_benchmark(const SourceState* src, UtlArenaAllocator* arena,
+                          UtlAllocator* temp_allocator) {
+    LexTokens tokens = utlvector_init(temp_allocator);
+    unsigned long long token_count = 0;
+    int runs = 0;
+
+    clock_t start = clock();
+    clock_t elapsed;
+    do {
+        utlvector_clear(&tokens);
+        lex_tokens(&tokens, &src->lines, arena, temp_allocator);
+        token_count += tokens.size;
+        runs++;
+        elapsed = clock() - start;
+    } while (elapsed < CLOCKS_PER_SEC / 2);
+
+    utlvector_deinit(&tokens);
+
+    double seconds = (double)elapsed / CLOCKS_PER_SEC;
+    printf("%llu tokens in %d runs, %.3f s, %.0f tokens/s\n", token_count,
+           runs, seconds, token_count / seconds);
+}
+
 int main(int argc, char* argv[]) {
     const char* entrypoint = "main";
     const char* src_path;
     const char* out_path = NULL;
-    const char* asm_out_path = NULL;
     int s_flag = 0;
+    int c_flag = 0;
+    int run_flag = 0;
+    int interp_flag = 0;
+    int pipe_flag = 0;
     int e_flag = 0;
+    int lex_bench_flag = 0;
+    int emit_pch_flag = 0;
+    TargetArch target = TARGET_I386;
+    int target_set = 0;
 
     UtlArenaAllocator arena = utlarena_init(ARENA_SIZE, &never_fail_allocator);
     UtlAllocator* temp_allocator = &never_fail_allocator;
+    intern_init(&arena);
+    type_table_init(&arena);
 
     Paths include_paths = utlvector_init(temp_allocator);
 
     SymbolTable define_sym;  // symbol table for #define
     symbol_table_init(&define_sym, 0, NULL, 0, &arena);
 
-#define DEFINE_MACRO(name) symbol_table_append_sym(&define_sym, str(name))
+#define DEFINE_MACRO(name) \
+    symbol_table_append_sym(&define_sym, intern(str(name)))
 
     // Arg parse
     FOR_OPTS(argc, argv) {
@@ -64,18 +293,76 @@ int main(int argc, char* argv[]) {
         case 'S':
             s_flag = 1;
             break;
+        case 'c':
+            c_flag = 1;
+            break;
         case 'E':
             e_flag = 1;
             break;
-        case 'e':
-            entrypoint = OPTARG(argc, argv);
-            break;
+        case 'e': {
+            const char* arg = OPTARG(argc, argv);
+            if (strcmp(arg, "mit-pch") == 0) {
+                // -emit-pch
+                emit_pch_flag = 1;
+            } else {
+                entrypoint = arg;
+            }
+        } break;
         case 'D':
             DEFINE_MACRO(OPTARG(argc, argv));
             break;
         case 'I':
             utlvector_push(&include_paths, OPTARG(argc, argv));
             break;
+        case 't': {
+            const char* arch = OPTARG(argc, argv);
+            if (strcmp(arch, "arget") == 0) {
+                // -target <arch>
+                arch = OPTARG(argc, argv);
+            }
+
+            if (strcmp(arch, "i386") == 0) {
+                target = TARGET_I386;
+            } else if (strcmp(arch, "x86_64") == 0) {
+                target = TARGET_X86_64;
+            } else {
+                ika_log(LOG_ERROR, "unknown target: %s\n", arch);
+                return 1;
+            }
+            target_set = 1;
+        } break;
+        case 'r':
+            // -run
+            if (strcmp(OPTARG(argc, argv), "un") != 0) {
+                ika_log(LOG_ERROR, "unknown argument: -r\n");
+                return 1;
+            }
+            run_flag = 1;
+            break;
+        case 'p':
+            // -pipe
+            if (strcmp(OPTARG(argc, argv), "ipe") != 0) {
+                ika_log(LOG_ERROR, "unknown argument: -p\n");
+                return 1;
+            }
+            pipe_flag = 1;
+            break;
+        case 'i':
+            // -interp
+            if (strcmp(OPTARG(argc, argv), "nterp") != 0) {
+                ika_log(LOG_ERROR, "unknown argument: -i\n");
+                return 1;
+            }
+            interp_flag = 1;
+            break;
+        case 'l':
+            // -lex-bench
+            if (strcmp(OPTARG(argc, argv), "ex-bench") != 0) {
+                ika_log(LOG_ERROR, "unknown argument: -l\n");
+                return 1;
+            }
+            lex_bench_flag = 1;
+            break;
         case '?':
             usage();
             return 0;
@@ -90,6 +377,44 @@ int main(int argc, char* argv[]) {
 
     src_path = *argv;
 
+#ifdef _WIN32
+    if (run_flag) {
+        ika_log(LOG_ERROR, "-run is not supported on this platform\n");
+        return 1;
+    }
+#endif
+
+#ifdef __x86_64__
+    if (run_flag && !target_set) {
+        // -run executes in this process
+        target = TARGET_X86_64;
+    }
+#endif
+
+#if defined(__x86_64__) && !defined(_WIN32)
+    if (interp_flag) {
+        // The interpreter shares memory with native code
+        if (target_set && target != TARGET_X86_64) {
+            ika_log(LOG_ERROR, "-interp requires the x86_64 target\n");
+            return 1;
+        }
+        target = TARGET_X86_64;
+    }
+#else
+    if (interp_flag) {
+        ika_log(LOG_ERROR, "-interp is not supported on this platform\n");
+        return 1;
+    }
+#endif
+
+    set_target(target);
+
+    if (target == TARGET_X86_64) {
+        DEFINE_MACRO("__x86_64__");
+    } else {
+        DEFINE_MACRO("__i386__");
+    }
+
 #ifdef __unix__
     DEFINE_MACRO("__unix__");
 #endif
@@ -102,13 +427,27 @@ int main(int argc, char* argv[]) {
     // Add more targets here
 #endif
 
+    SymbolTable sym;
+    symbol_table_init(&sym, 0, NULL, 1, &arena);
+
     PPState pp_state;
     const SourceState* src = &pp_state.src;
     pp_init(&pp_state, &arena, temp_allocator, &include_paths, &define_sym);
+    if (!e_flag && !lex_bench_flag && !emit_pch_flag) {
+        pp_state.pch_sym = &sym;
+    }
+
+    PchWriter pch;
+    if (emit_pch_flag) {
+        pch_writer_init(&pch, &arena, &define_sym);
+    }
 
     // Read input file
 
     Error* err = pp_expand(&pp_state, src_path);
+    if (err == NULL && emit_pch_flag) {
+        pch_add_files(&pch, &pp_state);
+    }
     pp_finalize(&pp_state);
     utlvector_deinit(&include_paths);
 
@@ -130,10 +469,12 @@ int main(int argc, char* argv[]) {
             }
         }
 
-        SourceLine* line = src->lines;
-        while (line) {
-            fprintf(pp_out, "%s\n", line->content);
-            line = line->next;
+        for (size_t i = 0; i < src->lines.size; i++) {
+            const SourceRange* range = &src->lines.data[i];
+            for (size_t j = 0; j < range->count; j++) {
+                const SourceLine* line = &range->lines[j];
+                fprintf(pp_out, "%.*s\n", (int)line->len, line->content);
+            }
         }
 
         if (out_path) {
@@ -144,26 +485,61 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
-    // Parse
-    SymbolTable sym;
-    symbol_table_init(&sym, 0, NULL, 1, &arena);
+    if (lex_bench_flag) {
+        lex_benchmark(src, &arena, temp_allocator);
+        utlarena_deinit(&arena);
+        return 0;
+    }
 
+    // Parse
     ParserState parser;
     parser_init(&parser, &sym, &arena, temp_allocator);
 
-    ASTNode* node = parser_parse(&parser, src);
-    if (node->type == NODE_ERR) {
-        err = ((ErrorNode*)node)->val;
+    AST ast;
+    NodeIndex node = parser_parse(&parser, src, &ast);
+    if (ast_node_type(&ast, node) == NODE_ERR) {
+        err = ast_error(&ast, node).val;
         print_err(src, err);
         utlarena_deinit(&arena);
         return 1;
     }
 
-    Str entry_sym = str(entrypoint);
+    if (emit_pch_flag) {
+        err = pch_add_decls(&pch, &arena, &ast, node, &sym);
+        if (err != NULL) {
+            print_err(src, err);
+            utlarena_deinit(&arena);
+            return 1;
+        }
+
+        if (!out_path) {
+            out_path = pch_get_path(utlarena_allocator(&arena), str(src_path));
+        }
+
+        FILE* pch_out = fopen(out_path, "wb");
+        if (!pch_out) {
+            ika_log(LOG_ERROR, "cannot open file %s: %s\n", out_path,
+                    strerror(errno));
+            utlarena_deinit(&arena);
+            return 1;
+        }
+
+        int write_err = pch_write(&pch, pch_out);
+        write_err |= fclose(pch_out) != 0;
+        if (write_err) {
+            ika_log(LOG_ERROR, "cannot write file %s\n", out_path);
+        }
+
+        utlarena_deinit(&arena);
+        return write_err;
+    }
+
+    Str entry_sym = intern(str(entrypoint));
 
     // Semantic analysis
     SemaState sema_state = {
         .arena = &arena,
+        .ast = &ast,
     };
 
     err = sema(&sema_state, node, &sym, entry_sym);
@@ -173,13 +549,79 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+#if defined(__x86_64__) && !defined(_WIN32)
+    if (interp_flag) {
+        BcProgram prog;
+        err = bytecode_compile(&prog, &arena, &ast, node, &sym, entry_sym);
+        if (err != NULL) {
+            print_err(src, err);
+            bytecode_free(&prog);
+            utlarena_deinit(&arena);
+            return 1;
+        }
+
+        int exit_code;
+        int result = interp_run(&prog, argc, argv, &exit_code);
+        bytecode_free(&prog);
+        utlarena_deinit(&arena);
+        return result == 0 ? exit_code : 1;
+    }
+#endif
+
     // Code generation
+#ifndef _WIN32
+    if (run_flag) {
+        char* asm_buf;
+        size_t asm_size;
+        FILE* out = open_memstream(&asm_buf, &asm_size);
+        if (!out) {
+            ika_log(LOG_ERROR, "open_memstream failed: %s\n", strerror(errno));
+            utlarena_deinit(&arena);
+            return 1;
+        }
+
+        generate(target, out, &arena, &ast, node, &sym, entry_sym);
+        fclose(out);
+
+        utlarena_deinit(&arena);
+
+        int exit_code;
+        int bits = target == TARGET_X86_64 ? 64 : 32;
+        int result =
+            jit_run(asm_buf, bits, entrypoint, argc, argv, &exit_code);
+        free(asm_buf);
+        return result == 0 ? exit_code : 1;
+    }
+#endif
+
     if (s_flag) {
-        asm_out_path = out_path;
+        if (!out_path) {
+            out_path = "out.s";
+        }
+
+        FILE* out = fopen(out_path, "w");
+        if (!out) {
+            ika_log(LOG_ERROR, "cannot open file %s: %s\n", out_path,
+                    strerror(errno));
+            utlarena_deinit(&arena);
+            return 1;
+        }
+
+        int write_err =
+            generate(target, out, &arena, &ast, node, &sym, entry_sym);
+        write_err |= fclose(out) != 0;
+
+        utlarena_deinit(&arena);
+
+        if (write_err) {
+            ika_log(LOG_ERROR, "cannot write file %s\n", out_path);
+            return 1;
+        }
+        return 0;
     }
 
-    if (!asm_out_path) {
-        asm_out_path = "out.s";
+    if (!out_path && c_flag) {
+        out_path = "out.o";
     }
 
     if (!out_path) {
@@ -190,66 +632,116 @@ int main(int argc, char* argv[]) {
 #endif
     }
 
-    FILE* out = fopen(asm_out_path, "w");
+    const char* arch_flag = target == TARGET_X86_64 ? "-m64" : "-m32";
+
+#ifdef _WIN32
+    // There is no integrated assembler for COFF, stream the code to gcc
+    pipe_flag = 1;
+#endif
+
+    if (pipe_flag) {
+        // Assemble while the code is being generated
+        const char* args[10];
+        int arg_count = 0;
+        args[arg_count++] = "gcc";
+        args[arg_count++] = arch_flag;
+        if (c_flag) {
+            args[arg_count++] = "-c";
+        } else {
+#ifndef _WIN32
+            args[arg_count++] = "-no-pie";
+#endif
+        }
+        args[arg_count++] = "-o";
+        args[arg_count++] = out_path;
+        args[arg_count++] = "-x";
+        args[arg_count++] = "assembler";
+        args[arg_count++] = "-";
+#ifndef _WIN32
+        if (!c_flag) {
+            args[arg_count++] = "-lm";
+        }
+#endif
+        args[arg_count] = NULL;
+
+        Command command;
+        if (open_command(&command, args) != 0) {
+            utlarena_deinit(&arena);
+            return 1;
+        }
+
+        generate(target, command.in, &arena, &ast, node, &sym, entry_sym);
+        utlarena_deinit(&arena);
+
+        if (close_command(&command) != 0) {
+            ika_log(LOG_ERROR, "failed to compile %s into %s\n", src_path,
+                    out_path);
+            return 1;
+        }
+        return 0;
+    }
+
+#ifndef _WIN32
+    // Generate the code in memory and assemble it straight into an object
+    char* asm_buf;
+    size_t asm_size;
+    FILE* out = open_memstream(&asm_buf, &asm_size);
     if (!out) {
-        ika_log(LOG_ERROR, "cannot open file %s: %s\n", out_path,
-                strerror(errno));
+        ika_log(LOG_ERROR, "open_memstream failed: %s\n", strerror(errno));
         utlarena_deinit(&arena);
         return 1;
     }
 
-    CodegenState codegen_state = {
-        .out = out,
-    };
-
-    codegen(&codegen_state, node, &sym, entry_sym);
+    generate(target, out, &arena, &ast, node, &sym, entry_sym);
     fclose(out);
 
     utlarena_deinit(&arena);
 
-    // Invoke cc
-    if (!s_flag) {
-#ifdef _WIN32
-        char cmd[1024];
-        sprintf(cmd, "gcc -m32 -o \"%s\" \"%s\"", out_path, asm_out_path);
-        if (system(cmd) != 0) {
-            ika_log(LOG_ERROR, "failed to compile %s into %s\n", asm_out_path,
-                    out_path);
-            _unlink(asm_out_path);
-            exit(EXIT_FAILURE);
+    // The object is only needed until it is linked
+    char tmp_obj_path[] = "/tmp/ikac-XXXXXX";
+    const char* obj_path = out_path;
+    if (!c_flag) {
+        int fd = mkstemp(tmp_obj_path);
+        if (fd == -1) {
+            ika_log(LOG_ERROR, "cannot create file %s: %s\n", tmp_obj_path,
+                    strerror(errno));
+            free(asm_buf);
+            return 1;
         }
-        _unlink(asm_out_path);
-#else
-        char* const args[] = {
-            "gcc", "-m32",          "-no-pie",
-            "-o",  (char*)out_path, (char*)asm_out_path,
-            NULL,
-        };
+        close(fd);
+        obj_path = tmp_obj_path;
+    }
 
-        pid_t pid = fork();
-        if (pid == -1) {
-            ika_log(LOG_ERROR, "fork failed");
-            exit(EXIT_FAILURE);
-        }
+    int result = assemble(asm_buf, obj_path, target, arch_flag);
+    free(asm_buf);
 
-        if (pid > 0) {
-            int status;
-            waitpid(pid, &status, 0);
-            if (status != 0) {
-                ika_log(LOG_ERROR, "failed to compile %s into %s\n",
-                        asm_out_path, out_path);
-                unlink(asm_out_path);
-                exit(EXIT_FAILURE);
-            }
-        } else {
-            execvp(args[0], args);
-            ika_log(LOG_ERROR, "exec failed");
-            exit(EXIT_FAILURE);
+    if (result != 0) {
+        ika_log(LOG_ERROR, "failed to assemble %s into %s\n", src_path,
+                obj_path);
+        if (!c_flag) {
+            os_unlink(obj_path);
         }
+        return 1;
+    }
 
-        unlink(asm_out_path);
-#endif
+    if (c_flag) {
+        return 0;
+    }
+
+    // Invoke cc to link
+    const char* args[] = {
+        "gcc", arch_flag, "-no-pie", "-o", out_path, obj_path, "-lm", NULL,
+    };
+
+    int status = run_command(args);
+    os_unlink(obj_path);
+
+    if (status != 0) {
+        ika_log(LOG_ERROR, "failed to compile %s into %s\n", src_path,
+                out_path);
+        return 1;
     }
+#endif
 
     return 0;
 }
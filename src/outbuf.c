@@ -0,0 +1,200 @@
+#include "outbuf.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define os_write _write
+#else
+#include <unistd.h>
+#define os_write write
+#endif
+
+void outbuf_init(OutBuf* buf, FILE* fp, UtlArenaAllocator* arena) {
+    *buf = (OutBuf){
+        .fp = fp,
+        .fd = -1,
+        .data = utlarena_alloc(arena, OUTBUF_SIZE),
+    };
+
+    // Nothing else writes to fp until the buffer is flushed
+    if (fflush(fp) == 0) {
+        buf->fd = fileno(fp);
+    }
+}
+
+int outbuf_flush(OutBuf* buf) {
+    const char* p = buf->data;
+    size_t len = buf->size;
+    buf->size = 0;
+
+    if (buf->fd < 0) {
+        if (fwrite(p, 1, len, buf->fp) != len) {
+            buf->error = 1;
+        }
+        return buf->error;
+    }
+
+    while (len > 0) {
+        int n = os_write(buf->fd, p, len);
+        if (n <= 0) {
+            buf->error = 1;
+            break;
+        }
+        p += n;
+        len -= n;
+    }
+    return buf->error;
+}
+
+void outbuf_write_slow(OutBuf* buf, const char* s, size_t len) {
+    while (len > 0) {
+        if (buf->size == OUTBUF_SIZE) {
+            outbuf_flush(buf);
+        }
+        size_t n = MIN(len, OUTBUF_SIZE - buf->size);
+        memcpy(buf->data + buf->size, s, n);
+        buf->size += n;
+        s += n;
+        len -= n;
+    }
+}
+
+// Digits of val in reverse order, returns the number of digits
+static int format_digits(char* digits, unsigned long long val, int base) {
+    int count = 0;
+    do {
+        digits[count++] = "0123456789abcdef"[val % base];
+        val /= base;
+    } while (val != 0);
+    return count;
+}
+
+static void write_number(OutBuf* buf, unsigned long long val, int negative,
+                         int base, int width, int zero_pad) {
+    char digits[24];
+    int count = format_digits(digits, val, base);
+    int len = count + negative;
+
+    if (!zero_pad) {
+        for (; width > len; width--) {
+            outbuf_putc(buf, ' ');
+        }
+    }
+    if (negative) {
+        outbuf_putc(buf, '-');
+    }
+    for (; width > len; width--) {
+        outbuf_putc(buf, '0');
+    }
+    while (count > 0) {
+        outbuf_putc(buf, digits[--count]);
+    }
+}
+
+void outbuf_int(OutBuf* buf, long long val) {
+    if (val < 0) {
+        write_number(buf, -(unsigned long long)val, 1, 10, 0, 0);
+    } else {
+        write_number(buf, val, 0, 10, 0, 0);
+    }
+}
+
+void outbuf_printf(OutBuf* buf, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+
+    const char* p = fmt;
+    while (*p) {
+        const char* start = p;
+        while (*p && *p != '%') {
+            p++;
+        }
+        outbuf_write(buf, start, p - start);
+        if (*p == '\0') {
+            break;
+        }
+        p++;
+
+        int zero_pad = 0;
+        if (*p == '0') {
+            zero_pad = 1;
+            p++;
+        }
+
+        int width = 0;
+        while (*p >= '0' && *p <= '9') {
+            width = width * 10 + (*p++ - '0');
+        }
+
+        int precision = -1;
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                precision = va_arg(ap, int);
+                p++;
+            } else {
+                precision = 0;
+                while (*p >= '0' && *p <= '9') {
+                    precision = precision * 10 + (*p++ - '0');
+                }
+            }
+        }
+
+        int long_count = 0;
+        while (*p == 'l') {
+            long_count++;
+            p++;
+        }
+
+        switch (*p++) {
+            case '%':
+                outbuf_putc(buf, '%');
+                break;
+
+            case 'c':
+                outbuf_putc(buf, (char)va_arg(ap, int));
+                break;
+
+            case 's': {
+                const char* s = va_arg(ap, const char*);
+                outbuf_write(buf, s, precision >= 0 ? (size_t)precision
+                                                    : strlen(s));
+            } break;
+
+            case 'd': {
+                long long val;
+                if (long_count == 0) {
+                    val = va_arg(ap, int);
+                } else if (long_count == 1) {
+                    val = va_arg(ap, long);
+                } else {
+                    val = va_arg(ap, long long);
+                }
+                unsigned long long abs_val = val < 0 ? -(unsigned long long)val
+                                                     : (unsigned long long)val;
+                write_number(buf, abs_val, val < 0, 10, width, zero_pad);
+            } break;
+
+            case 'u':
+            case 'x': {
+                unsigned long long val;
+                if (long_count == 0) {
+                    val = va_arg(ap, unsigned int);
+                } else if (long_count == 1) {
+                    val = va_arg(ap, unsigned long);
+                } else {
+                    val = va_arg(ap, unsigned long long);
+                }
+                write_number(buf, val, 0, p[-1] == 'x' ? 16 : 10, width,
+                             zero_pad);
+            } break;
+
+            default:
+                UNREACHABLE();
+        }
+    }
+
+    va_end(ap);
+}
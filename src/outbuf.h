@@ -0,0 +1,69 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "utl/allocator/utlarena.h"
+
+// Size of the chunk written to the file at once
+#define OUTBUF_SIZE (1 << 16)
+
+#ifdef __GNUC__
+#define OUTBUF_FORMAT(fmt_index, first_arg) \
+    __attribute__((format(printf, fmt_index, first_arg)))
+#else
+#define OUTBUF_FORMAT(fmt_index, first_arg)
+#endif
+
+/*
+ * Output buffer of the code generators. Text is collected in a large chunk
+ * and written to the file when the chunk is full, bypassing stdio where the
+ * file has a descriptor. Every line of assembly ends with outbuf_end_line.
+ */
+typedef struct OutBuf {
+    FILE* fp;
+    int fd;  // -1 if fp has no file descriptor
+    char* data;
+    size_t size;
+    int error;
+} OutBuf;
+
+void outbuf_init(OutBuf* buf, FILE* fp, UtlArenaAllocator* arena);
+
+// Write out the buffered text. Returns 0 on success.
+int outbuf_flush(OutBuf* buf);
+
+void outbuf_write_slow(OutBuf* buf, const char* s, size_t len);
+
+static inline void outbuf_write(OutBuf* buf, const char* s, size_t len) {
+    if (buf->size + len <= OUTBUF_SIZE) {
+        memcpy(buf->data + buf->size, s, len);
+        buf->size += len;
+    } else {
+        outbuf_write_slow(buf, s, len);
+    }
+}
+
+static inline void outbuf_putc(OutBuf* buf, char c) {
+    if (buf->size == OUTBUF_SIZE) {
+        outbuf_flush(buf);
+    }
+    buf->data[buf->size++] = c;
+}
+
+static inline void outbuf_puts(OutBuf* buf, const char* s) {
+    outbuf_write(buf, s, strlen(s));
+}
+
+void outbuf_int(OutBuf* buf, long long val);
+
+static inline void outbuf_end_line(OutBuf* buf) {
+    outbuf_putc(buf, '\n');
+}
+
+// Supports %d, %u, %x, %c and %s with the 0 flag, width, precision (.* for
+// strings) and the l and ll length modifiers
+void outbuf_printf(OutBuf* buf, const char* fmt, ...) OUTBUF_FORMAT(2, 3);
+
+#endif
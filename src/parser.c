@@ -4,85 +4,157 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-static ASTNode* primary(ParserState* parser);
-static ASTNode* expr(ParserState* parser, int min_precedence);
-static ASTNode* data_type(ParserState* parser, int allow_incomplete);
-static ASTNode* var_decl(ParserState* parser, SymbolAttr attr);
-static ASTNode* def_decl(ParserState* parser);
-static ASTNode* struct_decl(ParserState* parser);
-static ASTNode* enum_decl(ParserState* parser);
-static ASTNode* func_decl(ParserState* parser, SymbolAttr attr);
-static ASTNode* return_stmt(ParserState* parser);
-static ASTNode* if_stmt(ParserState* parser);
-static ASTNode* while_stmt(ParserState* parser);
-static ASTNode* asm_stmt(ParserState* parser);
-static ASTNode* scope(ParserState* parser);
-static ASTNode* stmt(ParserState* parser);
-static ASTNode* stmt_list(ParserState* parser, int in_scope);
-
-static ASTNode* error(ParserState* parser, SourcePos pos, const char* fmt,
-                      ...) {
-    ErrorNode* err = utlarena_alloc(parser->arena, sizeof(ErrorNode));
-    err->type = NODE_ERR;
-    err->pos = pos;
+static NodeIndex primary(ParserState* parser);
+static NodeIndex expr(ParserState* parser, int min_precedence);
+static NodeIndex data_type(ParserState* parser, int allow_incomplete);
+static NodeIndex var_decl(ParserState* parser, SymbolAttr attr);
+static NodeIndex def_decl(ParserState* parser);
+static NodeIndex struct_decl(ParserState* parser);
+static NodeIndex enum_decl(ParserState* parser);
+static NodeIndex func_attrs(ParserState* parser, int* attrs, int* alignment);
+static NodeIndex func_decl(ParserState* parser, SymbolAttr attr, int attrs,
+                           int alignment);
+static NodeIndex return_stmt(ParserState* parser);
+static NodeIndex if_stmt(ParserState* parser);
+static NodeIndex while_stmt(ParserState* parser);
+static NodeIndex asm_stmt(ParserState* parser);
+static NodeIndex scope(ParserState* parser);
+static NodeIndex stmt(ParserState* parser);
+static NodeIndex stmt_list(ParserState* parser, int in_scope);
+
+static inline ASTNodeType node_type(const ParserState* parser,
+                                    NodeIndex node) {
+    return ast_node_type(parser->ast, node);
+}
+
+// The type of a NODE_TYPE node
+static inline const Type* node_data_type(const ParserState* parser,
+                                         NodeIndex node) {
+    return ast_type_node(parser->ast, node).data_type;
+}
+
+// Pop the nodes pushed onto the node stack since start. The list points into
+// the stack, it stays valid until the next push.
+static ASTNodeList pop_node_list(ParserState* parser, size_t start,
+                                 int reverse) {
+    ASTNodeList list = {
+        .nodes = NULL,
+        .count = parser->node_stack.size - start,
+    };
+
+    if (list.count > 0) {
+        NodeIndex* nodes = &parser->node_stack.data[start];
+        for (int i = 0; reverse && i < list.count / 2; i++) {
+            NodeIndex temp = nodes[i];
+            nodes[i] = nodes[list.count - 1 - i];
+            nodes[list.count - 1 - i] = temp;
+        }
+        list.nodes = nodes;
+    }
 
-    err->val = utlarena_alloc(parser->arena, sizeof(Error));
-    err->val->pos = pos;
+    parser->node_stack.size = start;
+    return list;
+}
+
+static NodeIndex error(ParserState* parser, SourcePos pos, const char* fmt,
+                       ...) {
+    Error* err = utlarena_alloc(parser->arena, sizeof(Error));
+    err->pos = pos;
 
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(err->val->msg, ERROR_MAX_LENGTH, fmt, ap);
+    vsnprintf(err->msg, ERROR_MAX_LENGTH, fmt, ap);
     va_end(ap);
 
-    return (ASTNode*)err;
+    return ast_new_error(parser->ast, pos, (ErrorNode){err});
 }
 
-static inline PrimitiveType get_intlit_type(unsigned int val) {
-    if (val & (1 << 31)) {
+static inline PrimitiveType get_intlit_type(unsigned long long val) {
+    if (val > UINT32_MAX) {
+        if (val > INT64_MAX) {
+            return TYPE_U64;
+        }
+        return TYPE_I64;
+    }
+
+    if (val & (1u << 31)) {
         return TYPE_U32;
     }
     return TYPE_I32;
 }
 
-static ASTNode* primary(ParserState* parser) {
+// Wrap the value to the range of the integer type
+static inline long long normalize_int(long long val, PrimitiveType type) {
+    switch (type) {
+        case TYPE_I32:
+            return (int32_t)val;
+        case TYPE_U32:
+            return (uint32_t)val;
+        case TYPE_I64:
+        case TYPE_U64:
+            return val;
+        default:
+            UNREACHABLE();
+    }
+}
+
+// Returns 1 if the node is an i32 or u32 literal
+static inline int is_int32_lit(const ParserState* parser, NodeIndex node) {
+    if (node_type(parser, node) != NODE_INTLIT) {
+        return 0;
+    }
+
+    PrimitiveType type = ast_intlit(parser->ast, node).data_type;
+    return type == TYPE_I32 || type == TYPE_U32;
+}
+
+static inline int is_intlit_type(PrimitiveType type) {
+    return type == TYPE_I32 || type == TYPE_U32 || type == TYPE_I64 ||
+           type == TYPE_U64;
+}
+
+static NodeIndex primary(ParserState* parser) {
+    AST* ast = parser->ast;
     Token tk = next_token(parser);
 
-    ASTNode* node = NULL;
+    NodeIndex node = 0;
 
     switch (tk.type) {
         case TK_INT:
         case TK_TRUE:
         case TK_FALSE:
         case TK_NULL: {
-            IntLitNode* intlit =
-                utlarena_alloc(parser->arena, sizeof(IntLitNode));
-            intlit->type = NODE_INTLIT;
-            intlit->pos = parser->token_start;
+            IntLitNode intlit;
             if (tk.type == TK_INT) {
-                intlit->data_type = get_intlit_type(tk.val);
-                intlit->val = tk.val;
+                intlit.data_type = get_intlit_type(tk.val);
+                intlit.val = tk.val;
             } else if (tk.type == TK_NULL) {
-                intlit->data_type = TYPE_VOID;  // This is actually void pointer
-                intlit->val = 0;
+                intlit.data_type = TYPE_VOID;  // This is actually void pointer
+                intlit.val = 0;
             } else {
-                intlit->data_type = TYPE_BOOL;
-                intlit->val = tk.type == TK_TRUE;
+                intlit.data_type = TYPE_BOOL;
+                intlit.val = tk.type == TK_TRUE;
             }
-            node = (ASTNode*)intlit;
+            node = ast_new_intlit(ast, parser->token_start, intlit);
+        } break;
+
+        case TK_FLOAT: {
+            FloatLitNode floatlit = {
+                .val = tk.fval,
+                .data_type = TYPE_F64,
+            };
+            node = ast_new_floatlit(ast, parser->token_start, floatlit);
         } break;
 
         case TK_SIZEOF: {
-            IntLitNode* intlit =
-                utlarena_alloc(parser->arena, sizeof(IntLitNode));
-            intlit->type = NODE_INTLIT;
-            intlit->pos = parser->token_start;
+            SourcePos pos = parser->token_start;
             tk = next_token(parser);
             if (tk.type != TK_LPAREN) {
                 return error(parser, parser->prev_token_end, "expected '('");
             }
 
-            ASTNode* type_node = data_type(parser, 0);
-            if (type_node->type == NODE_ERR) {
+            NodeIndex type_node = data_type(parser, 0);
+            if (node_type(parser, type_node) == NODE_ERR) {
                 return type_node;
             }
 
@@ -91,58 +163,89 @@ static ASTNode* primary(ParserState* parser) {
                 return error(parser, parser->prev_token_end, "expected ')'");
             }
 
-            intlit->data_type = TYPE_U32;
-            assert(type_node->type == NODE_TYPE);
-            intlit->val = ((TypeNode*)type_node)->data_type->size;
-
-            node = (ASTNode*)intlit;
+            assert(node_type(parser, type_node) == NODE_TYPE);
+            IntLitNode intlit = {
+                .val = node_data_type(parser, type_node)->size,
+                .data_type = TYPE_U32,
+            };
+            node = ast_new_intlit(ast, pos, intlit);
         } break;
 
         case TK_CAST: {
-            CastNode* cast = utlarena_alloc(parser->arena, sizeof(CastNode));
-            cast->type = NODE_CAST;
-            cast->pos = parser->token_start;
+            SourcePos pos = parser->token_start;
             tk = next_token(parser);
             if (tk.type != TK_LPAREN) {
                 return error(parser, parser->prev_token_end, "expected '('");
             }
 
-            TypeNode* type_node = (TypeNode*)data_type(parser, 0);
-            if (type_node->type == NODE_ERR) {
-                return (ASTNode*)type_node;
+            NodeIndex type_node = data_type(parser, 0);
+            if (node_type(parser, type_node) == NODE_ERR) {
+                return type_node;
             }
-            assert(type_node->type == NODE_TYPE);
+            assert(node_type(parser, type_node) == NODE_TYPE);
 
-            cast->data_type = type_node->data_type;
+            CastNode cast;
+            cast.data_type = node_data_type(parser, type_node);
 
             tk = next_token(parser);
             if (tk.type != TK_COMMA) {
                 return error(parser, parser->prev_token_end, "expected ','");
             }
 
-            ASTNode* expr_node = expr(parser, 1);
-            if (expr_node->type == NODE_ERR) {
+            NodeIndex expr_node = expr(parser, 1);
+            if (node_type(parser, expr_node) == NODE_ERR) {
                 return expr_node;
             }
-            cast->expr = expr_node;
+            cast.expr = expr_node;
 
             tk = next_token(parser);
             if (tk.type != TK_RPAREN) {
                 return error(parser, parser->prev_token_end, "expected ')'");
             }
 
-            node = (ASTNode*)cast;
+            node = ast_new_cast(ast, pos, cast);
         } break;
 
-        case TK_STR: {
-            StrLitNode* strlit =
-                utlarena_alloc(parser->arena, sizeof(StrLitNode));
-            strlit->type = NODE_STRLIT;
-            strlit->pos = parser->token_start;
-            strlit->val = tk.str;
-            node = (ASTNode*)strlit;
+        case TK_BUILTIN: {
+            int likely;
+            if (str_eql(tk.str, str("likely"))) {
+                likely = 1;
+            } else if (str_eql(tk.str, str("unlikely"))) {
+                likely = 0;
+            } else {
+                return error(parser, parser->token_start,
+                             "unknown builtin '@%.*s'", tk.str.len,
+                             tk.str.ptr);
+            }
+
+            SourcePos pos = parser->token_start;
+            BranchHintNode hint;
+            hint.likely = likely;
+
+            tk = next_token(parser);
+            if (tk.type != TK_LPAREN) {
+                return error(parser, parser->prev_token_end, "expected '('");
+            }
+
+            NodeIndex expr_node = expr(parser, 0);
+            if (node_type(parser, expr_node) == NODE_ERR) {
+                return expr_node;
+            }
+            hint.expr = expr_node;
+
+            tk = next_token(parser);
+            if (tk.type != TK_RPAREN) {
+                return error(parser, parser->prev_token_end, "expected ')'");
+            }
+
+            node = ast_new_hint(ast, pos, hint);
         } break;
 
+        case TK_STR:
+            node = ast_new_strlit(ast, parser->token_start,
+                                  (StrLitNode){tk.str});
+            break;
+
         case TK_IDENT: {
             SymbolTableEntry* ste = symbol_table_find(parser->sym, tk.str, 0);
             if (!ste) {
@@ -153,31 +256,26 @@ static ASTNode* primary(ParserState* parser) {
             switch (ste->type) {
                 case SYM_VAR:
                 case SYM_FUNC: {
-                    VarNode* var_node =
-                        utlarena_alloc(parser->arena, sizeof(VarNode));
-                    var_node->type = NODE_VAR;
-                    var_node->pos = parser->token_start;
-                    var_node->ste = ste;
-                    node = (ASTNode*)var_node;
+                    node = ast_new_var(ast, parser->token_start,
+                                       (VarNode){ste});
+
+                    if (ste->type == SYM_FUNC &&
+                        peek_token(parser).type != TK_LPAREN) {
+                        ((FuncSymbolTableEntry*)ste)->address_taken = 1;
+                    }
                 } break;
 
                 case SYM_DEF: {
                     DefSymbolTableEntry* def = (DefSymbolTableEntry*)ste;
                     if (def->val.is_str) {
-                        StrLitNode* strlit =
-                            utlarena_alloc(parser->arena, sizeof(StrLitNode));
-                        strlit->type = NODE_STRLIT;
-                        strlit->pos = parser->token_start;
-                        strlit->val = def->val.str;
-                        node = (ASTNode*)strlit;
+                        node = ast_new_strlit(ast, parser->token_start,
+                                              (StrLitNode){def->val.str});
                     } else {
-                        IntLitNode* intlit =
-                            utlarena_alloc(parser->arena, sizeof(IntLitNode));
-                        intlit->type = NODE_INTLIT;
-                        intlit->pos = parser->token_start;
-                        intlit->data_type = def->val.data_type;
-                        intlit->val = def->val.val;
-                        node = (ASTNode*)intlit;
+                        IntLitNode intlit = {
+                            .val = def->val.val,
+                            .data_type = def->val.data_type,
+                        };
+                        node = ast_new_intlit(ast, parser->token_start, intlit);
                     }
                 } break;
 
@@ -193,7 +291,7 @@ static ASTNode* primary(ParserState* parser) {
 
         case TK_LPAREN: {
             node = expr(parser, 0);
-            if (node->type == NODE_ERR) {
+            if (node_type(parser, node) == NODE_ERR) {
                 return node;
             }
             tk = next_token(parser);
@@ -208,46 +306,58 @@ static ASTNode* primary(ParserState* parser) {
         case TK_LNOT:
         case TK_MUL:
         case TK_AND: {
-            ASTNode* right = primary(parser);
-            if (right->type == NODE_ERR) {
+            NodeIndex right = primary(parser);
+            if (node_type(parser, right) == NODE_ERR) {
                 return right;
             }
 
-            if (right->type == NODE_INTLIT) {
-                IntLitNode* intlit = (IntLitNode*)right;
-                if (intlit->data_type == TYPE_BOOL && tk.type == TK_LNOT) {
-                    intlit->val = !intlit->val;
-                    node = (ASTNode*)intlit;
+            if (node_type(parser, right) == NODE_INTLIT) {
+                IntLitNode intlit = ast_intlit(ast, right);
+                if (intlit.data_type == TYPE_BOOL && tk.type == TK_LNOT) {
+                    intlit.val = !intlit.val;
+                    ast_set_intlit(ast, right, intlit);
+                    node = right;
                 } else if (tk.type == TK_ADD || tk.type == TK_SUB ||
                            tk.type == TK_NOT) {
-                    int val = intlit->val;
+                    int is_64 = (intlit.data_type == TYPE_I64 ||
+                                 intlit.data_type == TYPE_U64);
+                    unsigned long long val = intlit.val;
                     switch (tk.type) {
                         case TK_ADD:
-                            intlit->data_type = TYPE_I32;
+                            intlit.data_type = is_64 ? TYPE_I64 : TYPE_I32;
                             break;
                         case TK_SUB:
-                            intlit->data_type = TYPE_I32;
-                            intlit->val = (-val);
+                            intlit.data_type = is_64 ? TYPE_I64 : TYPE_I32;
+                            val = -val;
                             break;
                         case TK_NOT:
-                            intlit->data_type = TYPE_U32;
-                            intlit->val = (~val);
+                            intlit.data_type = is_64 ? TYPE_U64 : TYPE_U32;
+                            val = ~val;
                             break;
                         default:
                             UNREACHABLE();
                     }
-                    node = (ASTNode*)intlit;
+                    intlit.val = normalize_int(val, intlit.data_type);
+                    ast_set_intlit(ast, right, intlit);
+                    node = right;
+                }
+            } else if (node_type(parser, right) == NODE_FLOATLIT) {
+                FloatLitNode floatlit = ast_floatlit(ast, right);
+                if (tk.type == TK_ADD) {
+                    node = right;
+                } else if (tk.type == TK_SUB) {
+                    floatlit.val = -floatlit.val;
+                    ast_set_floatlit(ast, right, floatlit);
+                    node = right;
                 }
             }
 
-            if (node == NULL) {
-                UnaryOpNode* unary_node =
-                    utlarena_alloc(parser->arena, sizeof(UnaryOpNode));
-                unary_node->type = NODE_UNARYOP;
-                unary_node->pos = parser->token_start;
-                unary_node->op = tk.type;
-                unary_node->node = right;
-                node = (ASTNode*)unary_node;
+            if (node == 0) {
+                UnaryOpNode unary_node = {
+                    .op = tk.type,
+                    .node = right,
+                };
+                node = ast_new_unaryop(ast, parser->token_start, unary_node);
             }
         } break;
 
@@ -265,32 +375,30 @@ static ASTNode* primary(ParserState* parser) {
         switch (tk.type) {
             case TK_DOT: {
                 next_token(parser);
-                FieldNode* field =
-                    utlarena_alloc(parser->arena, sizeof(FieldNode));
-                field->type = NODE_FIELD;
-                field->pos = parser->token_start;
-                field->node = node;
+                SourcePos pos = parser->token_start;
                 tk = next_token(parser);
                 if (tk.type != TK_IDENT) {
                     return error(parser, parser->prev_token_end,
                                  "expected an identifier");
                 }
-                field->ident = tk.str;
-                node = (ASTNode*)field;
+                FieldNode field = {
+                    .node = node,
+                    .ident = tk.str,
+                };
+                node = ast_new_field(ast, pos, field);
             } break;
 
             case TK_LBRACKET: {
                 next_token(parser);
-                IndexOfNode* indexof =
-                    utlarena_alloc(parser->arena, sizeof(IndexOfNode));
-                indexof->type = NODE_INDEXOF;
-                indexof->pos = parser->token_start;
-                indexof->left = node;
-                indexof->right = expr(parser, 0);
-                if (indexof->right->type == NODE_ERR) {
-                    return indexof->right;
+                SourcePos pos = parser->token_start;
+                IndexOfNode indexof = {
+                    .left = node,
+                    .right = expr(parser, 0),
+                };
+                if (node_type(parser, indexof.right) == NODE_ERR) {
+                    return indexof.right;
                 }
-                node = (ASTNode*)indexof;
+                node = ast_new_indexof(ast, pos, indexof);
 
                 tk = next_token(parser);
                 if (tk.type != TK_RBRACKET) {
@@ -301,28 +409,20 @@ static ASTNode* primary(ParserState* parser) {
 
             case TK_LPAREN: {
                 next_token(parser);
-                CallNode* call_node =
-                    utlarena_alloc(parser->arena, sizeof(CallNode));
-                call_node->type = NODE_CALL;
-                call_node->pos = parser->token_start;
-                call_node->node = node;
-                call_node->args = NULL;
+                SourcePos pos = parser->token_start;
+                size_t args_start = parser->node_stack.size;
 
                 tk = peek_token(parser);
                 if (tk.type == TK_RPAREN) {
                     next_token(parser);
                 } else {
                     while (tk.type != TK_RPAREN) {
-                        ASTNode* arg_node = expr(parser, 1);
-                        if (arg_node->type == NODE_ERR) {
+                        NodeIndex arg_node = expr(parser, 1);
+                        if (node_type(parser, arg_node) == NODE_ERR) {
                             return arg_node;
                         }
 
-                        ASTNodeList* arg =
-                            utlarena_alloc(parser->arena, sizeof(ASTNodeList));
-                        arg->node = arg_node;
-                        arg->next = call_node->args;
-                        call_node->args = arg;
+                        utlvector_push(&parser->node_stack, arg_node);
 
                         tk = next_token(parser);
                         if (tk.type != TK_COMMA && tk.type != TK_RPAREN) {
@@ -331,7 +431,11 @@ static ASTNode* primary(ParserState* parser) {
                         }
                     }
                 }
-                node = (ASTNode*)call_node;
+                CallNode call_node = {
+                    .node = node,
+                    .args = pop_node_list(parser, args_start, 1),
+                };
+                node = ast_new_call(ast, pos, call_node);
             } break;
 
             default:
@@ -445,9 +549,10 @@ static inline int is_left_associative(TkType type) {
     }
 }
 
-static ASTNode* expr(ParserState* parser, int min_precedence) {
-    ASTNode* node = primary(parser);
-    if (node->type == NODE_ERR) {
+static NodeIndex expr(ParserState* parser, int min_precedence) {
+    AST* ast = parser->ast;
+    NodeIndex node = primary(parser);
+    if (node_type(parser, node) == NODE_ERR) {
         return node;
     }
 
@@ -466,17 +571,16 @@ static ASTNode* expr(ParserState* parser, int min_precedence) {
 
         switch (tk.type) {
             case TK_ASSIGN: {
-                AssignNode* assign =
-                    utlarena_alloc(parser->arena, sizeof(AssignNode));
-                assign->type = NODE_ASSIGN;
-                assign->pos = parser->token_start;
-                assign->left = node;
-                assign->right = expr(parser, next_precedence);
-                assign->from_decl = 0;
-                if (assign->right->type == NODE_ERR) {
-                    return assign->right;
+                SourcePos pos = parser->token_start;
+                AssignNode assign = {
+                    .left = node,
+                    .right = expr(parser, next_precedence),
+                    .from_decl = 0,
+                };
+                if (node_type(parser, assign.right) == NODE_ERR) {
+                    return assign.right;
                 }
-                node = (ASTNode*)assign;
+                node = ast_new_assign(ast, pos, assign);
             } break;
 
             case TK_AADD:
@@ -489,121 +593,124 @@ static ASTNode* expr(ParserState* parser, int min_precedence) {
             case TK_AAND:
             case TK_AXOR:
             case TK_AOR: {
-                AssignNode* assign =
-                    utlarena_alloc(parser->arena, sizeof(AssignNode));
-                assign->type = NODE_ASSIGN;
-                assign->pos = parser->token_start;
-                assign->left = node;
-                assign->from_decl = 0;
-
-                BinaryOpNode* binop =
-                    utlarena_alloc(parser->arena, sizeof(BinaryOpNode));
-                binop->type = NODE_BINARYOP;
-                binop->pos = parser->token_start;
+                SourcePos pos = parser->token_start;
+                AssignNode assign = {
+                    .left = node,
+                    .from_decl = 0,
+                };
+
+                BinaryOpNode binop;
                 switch (tk.type) {
                     case TK_AADD:
-                        binop->op = TK_ADD;
+                        binop.op = TK_ADD;
                         break;
                     case TK_ASUB:
-                        binop->op = TK_SUB;
+                        binop.op = TK_SUB;
                         break;
                     case TK_AMUL:
-                        binop->op = TK_MUL;
+                        binop.op = TK_MUL;
                         break;
                     case TK_ADIV:
-                        binop->op = TK_DIV;
+                        binop.op = TK_DIV;
                         break;
                     case TK_AMOD:
-                        binop->op = TK_MOD;
+                        binop.op = TK_MOD;
                         break;
                     case TK_ASHL:
-                        binop->op = TK_SHL;
+                        binop.op = TK_SHL;
                         break;
                     case TK_ASHR:
-                        binop->op = TK_SHR;
+                        binop.op = TK_SHR;
                         break;
                     case TK_AAND:
-                        binop->op = TK_AND;
+                        binop.op = TK_AND;
                         break;
                     case TK_AXOR:
-                        binop->op = TK_XOR;
+                        binop.op = TK_XOR;
                         break;
                     case TK_AOR:
-                        binop->op = TK_OR;
+                        binop.op = TK_OR;
                         break;
                     default:
                         UNREACHABLE();
                 }
-                binop->left = assign->left;
-                binop->right = expr(parser, next_precedence);
-                if (binop->right->type == NODE_ERR) {
-                    return binop->right;
+                binop.left = assign.left;
+                binop.right = expr(parser, next_precedence);
+                if (node_type(parser, binop.right) == NODE_ERR) {
+                    return binop.right;
                 }
 
-                assign->right = (ASTNode*)binop;
-                node = (ASTNode*)assign;
+                assign.right = ast_new_binop(ast, pos, binop);
+                node = ast_new_assign(ast, pos, assign);
             } break;
 
             default: {
                 SourcePos pos = parser->token_start;
-                ASTNode* out = NULL;
-                ASTNode* left = node;
-                ASTNode* right = expr(parser, next_precedence);
-                if (right->type == NODE_ERR) {
+                NodeIndex out = 0;
+                NodeIndex left = node;
+                NodeIndex right = expr(parser, next_precedence);
+                if (node_type(parser, right) == NODE_ERR) {
                     return right;
                 }
 
-                if (tk.type != TK_COMMA && left->type == NODE_INTLIT &&
-                    right->type == NODE_INTLIT) {
-                    IntLitNode* l_lit = (IntLitNode*)left;
-                    IntLitNode* r_lit = (IntLitNode*)right;
-
-                    unsigned int a = l_lit->val;
-                    unsigned int b = r_lit->val;
+                if (tk.type != TK_COMMA &&
+                    node_type(parser, left) == NODE_INTLIT &&
+                    node_type(parser, right) == NODE_INTLIT) {
+                    IntLitNode l_lit = ast_intlit(ast, left);
+                    IntLitNode r_lit = ast_intlit(ast, right);
 
-                    if (l_lit->data_type == TYPE_BOOL &&
-                        r_lit->data_type == TYPE_BOOL) {
-                        out = (ASTNode*)l_lit;
+                    if (l_lit.data_type == TYPE_BOOL &&
+                        r_lit.data_type == TYPE_BOOL) {
+                        out = left;
                         switch (tk.type) {
                             case TK_LOR:
-                                l_lit->val = (a || b);
+                                l_lit.val = (l_lit.val || r_lit.val);
                                 break;
 
                             case TK_LAND:
-                                l_lit->val = (a && b);
+                                l_lit.val = (l_lit.val && r_lit.val);
                                 break;
 
                             default:
-                                out = NULL;
+                                out = 0;
                                 break;
                         }
-                    } else if ((l_lit->data_type == TYPE_I32 ||
-                                l_lit->data_type == TYPE_U32) &&
-                               (r_lit->data_type == TYPE_I32 ||
-                                r_lit->data_type == TYPE_U32)) {
-                        out = (ASTNode*)l_lit;
-                        int has_unsigned = (l_lit->data_type == TYPE_U32 ||
-                                            r_lit->data_type == TYPE_U32);
+                        if (out != 0) {
+                            ast_set_intlit(ast, left, l_lit);
+                        }
+                    } else if (is_intlit_type(l_lit.data_type) &&
+                               is_intlit_type(r_lit.data_type)) {
+                        out = left;
+                        PrimitiveType result_type = implicit_type_convert(
+                            l_lit.data_type, r_lit.data_type);
+                        int result_signed = is_signed(result_type);
+                        int bits = (result_type == TYPE_I64 ||
+                                    result_type == TYPE_U64)
+                                       ? 64
+                                       : 32;
+
+                        unsigned long long a = normalize_int(
+                            normalize_int(l_lit.val, l_lit.data_type),
+                            result_type);
+                        unsigned long long b = normalize_int(
+                            normalize_int(r_lit.val, r_lit.data_type),
+                            result_type);
+                        long long sa = a;
+                        long long sb = b;
+
+                        unsigned long long val = 0;
+                        int is_cmp = 0;
                         switch (tk.type) {
                             case TK_ADD:
-                                l_lit->val = (a + b);
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                }
+                                val = a + b;
                                 break;
 
                             case TK_SUB:
-                                l_lit->val = (a - b);
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                }
+                                val = a - b;
                                 break;
 
                             case TK_MUL:
-                                l_lit->val = (a * b);
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                }
+                                val = a * b;
                                 break;
 
                             case TK_DIV:
@@ -612,13 +719,12 @@ static ASTNode* expr(ParserState* parser, int min_precedence) {
                                                  "division by zero");
                                 }
 
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                    l_lit->val = (a / b);
+                                if (!result_signed) {
+                                    val = a / b;
+                                } else if (sb == -1) {
+                                    val = -a;
                                 } else {
-                                    int sa = a;
-                                    int sb = b;
-                                    l_lit->data_type = (sa / sb);
+                                    val = sa / sb;
                                 }
                                 break;
 
@@ -627,100 +733,93 @@ static ASTNode* expr(ParserState* parser, int min_precedence) {
                                     return error(parser, pos, "modulo by zero");
                                 }
 
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                    l_lit->val = (a % b);
+                                if (!result_signed) {
+                                    val = a % b;
+                                } else if (sb == -1) {
+                                    val = 0;
                                 } else {
-                                    int sa = a;
-                                    int sb = b;
-                                    l_lit->data_type = (sa % sb);
+                                    val = sa % sb;
                                 }
                                 break;
 
                             case TK_SHL:
-                                l_lit->val = (a << b);
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                }
+                                val = a << (b & (bits - 1));
                                 break;
 
                             case TK_SHR:
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                    l_lit->val = (a >> b);
+                                if (result_signed) {
+                                    val = sa >> (b & (bits - 1));
                                 } else {
-                                    int sa = a;
-                                    int sb = b;
-                                    l_lit->data_type = (sa >> sb);
+                                    val = a >> (b & (bits - 1));
                                 }
                                 break;
 
                             case TK_AND:
-                                l_lit->val = (a & b);
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                }
+                                val = a & b;
                                 break;
 
                             case TK_XOR:
-                                l_lit->val = (a ^ b);
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                }
+                                val = a ^ b;
                                 break;
 
                             case TK_OR:
-                                l_lit->val = (a | b);
-                                if (has_unsigned) {
-                                    l_lit->data_type = TYPE_U32;
-                                }
+                                val = a | b;
                                 break;
 
                             case TK_EQ:
-                                l_lit->val = (a == b);
-                                l_lit->data_type = TYPE_BOOL;
+                                is_cmp = 1;
+                                val = (a == b);
                                 break;
 
                             case TK_NE:
-                                l_lit->val = (a != b);
-                                l_lit->data_type = TYPE_BOOL;
+                                is_cmp = 1;
+                                val = (a != b);
                                 break;
 
                             case TK_LT:
-                                l_lit->val = (a < b);
-                                l_lit->data_type = TYPE_BOOL;
+                                is_cmp = 1;
+                                val = result_signed ? (sa < sb) : (a < b);
                                 break;
 
                             case TK_LE:
-                                l_lit->val = (a <= b);
-                                l_lit->data_type = TYPE_BOOL;
+                                is_cmp = 1;
+                                val = result_signed ? (sa <= sb) : (a <= b);
                                 break;
 
                             case TK_GT:
-                                l_lit->val = (a > b);
-                                l_lit->data_type = TYPE_BOOL;
+                                is_cmp = 1;
+                                val = result_signed ? (sa > sb) : (a > b);
                                 break;
 
                             case TK_GE:
-                                l_lit->val = (a >= b);
-                                l_lit->data_type = TYPE_BOOL;
+                                is_cmp = 1;
+                                val = result_signed ? (sa >= sb) : (a >= b);
                                 break;
 
                             default:
-                                out = NULL;
+                                out = 0;
+                        }
+
+                        if (out != 0) {
+                            if (is_cmp) {
+                                l_lit.data_type = TYPE_BOOL;
+                                l_lit.val = val;
+                            } else {
+                                l_lit.data_type = result_type;
+                                l_lit.val = normalize_int(val, result_type);
+                            }
+                            ast_set_intlit(ast, left, l_lit);
                         }
                     }
                 }
 
-                if (out == NULL) {
-                    BinaryOpNode* binop =
-                        utlarena_alloc(parser->arena, sizeof(BinaryOpNode));
-                    binop->type = NODE_BINARYOP;
-                    binop->pos = pos;
-                    binop->op = tk.type;
-                    binop->left = left;
-                    binop->right = right;
-                    out = (ASTNode*)binop;
+                if (out == 0) {
+                    BinaryOpNode binop = {
+                        .op = tk.type,
+                        .left = left,
+                        .right = right,
+                    };
+                    out = ast_new_binop(ast, pos, binop);
                 }
                 node = out;
             }
@@ -739,9 +838,13 @@ static inline int is_primitive_type(Token tk) {
         case TK_U8:
         case TK_U16:
         case TK_U32:
+        case TK_U64:
         case TK_I8:
         case TK_I16:
         case TK_I32:
+        case TK_I64:
+        case TK_F32:
+        case TK_F64:
             return 1;
         default:
             return 0;
@@ -760,12 +863,20 @@ static inline PrimitiveType primitive_type_token_to_type(Token tk) {
             return TYPE_U16;
         case TK_U32:
             return TYPE_U32;
+        case TK_U64:
+            return TYPE_U64;
         case TK_I8:
             return TYPE_I8;
         case TK_I16:
             return TYPE_I16;
         case TK_I32:
             return TYPE_I32;
+        case TK_I64:
+            return TYPE_I64;
+        case TK_F32:
+            return TYPE_F32;
+        case TK_F64:
+            return TYPE_F64;
         default:
             UNREACHABLE();
     }
@@ -782,12 +893,36 @@ static StrCallConv str_callconv[] = {
     {"thiscall", CALLCONV_THISCALL},
 };
 
-static ASTNode* data_type(ParserState* parser, int allow_incomplete) {
-    Token tk = next_token(parser);
+typedef struct StrFuncAttr {
+    const char* s;
+    FuncAttr attr;
+} StrFuncAttr;
+
+static StrFuncAttr str_func_attr[] = {
+    {"inline", FUNC_ATTR_INLINE},
+    {"noinline", FUNC_ATTR_NOINLINE},
+    {"hot", FUNC_ATTR_HOT},
+    {"cold", FUNC_ATTR_COLD},
+    {"align", FUNC_ATTR_NONE},  // takes an argument
+};
 
-    TypeNode* type_node = utlarena_alloc(parser->arena, sizeof(TypeNode));
-    type_node->type = NODE_TYPE;
-    type_node->pos = parser->token_start;
+static inline int is_func_attr(Token tk) {
+    if (tk.type != TK_BUILTIN) {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(str_func_attr); i++) {
+        if (str_eql(str(str_func_attr[i].s), tk.str)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static NodeIndex data_type(ParserState* parser, int allow_incomplete) {
+    AST* ast = parser->ast;
+    Token tk = next_token(parser);
+    SourcePos pos = parser->token_start;
 
     if (is_primitive_type(tk)) {
         // Primitive type
@@ -798,102 +933,80 @@ static ASTNode* data_type(ParserState* parser, int allow_incomplete) {
                              "incomplete type is not allowed");
             }
         }
-        type_node->data_type = get_primitive_type(primitive);
-        return (ASTNode*)type_node;
+        return ast_new_type_node(ast, pos,
+                                 (TypeNode){get_primitive_type(primitive)});
     }
 
-    Type* type = utlarena_alloc(parser->arena, sizeof(Type));
+    const Type* type;
     switch (tk.type) {
         case TK_MUL: {
-            type->incomplete = 0;
-            type->size = PTR_SIZE;
-            type->alignment = PTR_SIZE;
-
             // Pointer
-            type->type = METADATA_POINTER;
-            type->pointer_level = 1;
+            int pointer_level = 1;
             tk = peek_token(parser);
             while (tk.type == TK_MUL) {
-                type->pointer_level++;
+                pointer_level++;
                 next_token(parser);
                 tk = peek_token(parser);
             }
 
-            ASTNode* inner = data_type(parser, 1);
-            if (inner->type == NODE_ERR) {
+            NodeIndex inner = data_type(parser, 1);
+            if (node_type(parser, inner) == NODE_ERR) {
                 return inner;
             }
-            type->inner_type = ((TypeNode*)inner)->data_type;
+            type = get_pointer_type(node_data_type(parser, inner),
+                                    pointer_level);
 
         } break;
 
         case TK_LBRACKET: {
             // Array
-            type->type = METADATA_ARRAY;
-
             if (peek_token(parser).type == TK_RBRACKET) {
                 // Unknown size array (a pointer)
                 tk = next_token(parser);
 
-                type->array_size = 0;
-
-                type->incomplete = 0;
-                type->size = PTR_SIZE;
-                type->alignment = PTR_SIZE;
-
-                ASTNode* inner = data_type(parser, 1);
-                if (inner->type == NODE_ERR) {
+                NodeIndex inner = data_type(parser, 1);
+                if (node_type(parser, inner) == NODE_ERR) {
                     return inner;
                 }
-                assert(inner->type == NODE_TYPE);
-                type->inner_type = ((TypeNode*)inner)->data_type;
+                assert(node_type(parser, inner) == NODE_TYPE);
+                type = get_array_type(node_data_type(parser, inner), 0);
             } else {
                 // Regular array
-                ASTNode* size_node = expr(parser, 0);
+                NodeIndex size_node = expr(parser, 0);
 
-                if (size_node->type == NODE_ERR) {
+                if (node_type(parser, size_node) == NODE_ERR) {
                     return size_node;
                 }
 
-                IntLitNode* size_lit = (IntLitNode*)size_node;
-                if (size_node->type != NODE_INTLIT ||
-                    (size_lit->data_type != TYPE_I32 &&
-                     size_lit->data_type != TYPE_U32)) {
-                    return error(parser, size_node->pos,
+                if (!is_int32_lit(parser, size_node)) {
+                    return error(parser, ast_pos(ast, size_node),
                                  "size of the array type is not a compile-time "
                                  "constant integer");
                 }
 
-                int size = size_lit->val;
+                int size = ast_intlit(ast, size_node).val;
                 if (size <= 0) {
                     return error(
-                        parser, size_lit->pos,
+                        parser, ast_pos(ast, size_node),
                         "size of the array type is not a positive integer");
                 }
-                type->array_size = size;
 
                 tk = next_token(parser);
                 if (tk.type != TK_RBRACKET) {
                     return error(parser, parser->token_start, "expected ']'");
                 }
 
-                ASTNode* inner = data_type(parser, 0);
-                if (inner->type == NODE_ERR) {
+                NodeIndex inner = data_type(parser, 0);
+                if (node_type(parser, inner) == NODE_ERR) {
                     return inner;
                 }
-                assert(inner->type == NODE_TYPE);
-                type->inner_type = ((TypeNode*)inner)->data_type;
-
-                type->incomplete = 0;
-                type->size = type->inner_type->size * size;
-                type->alignment = type->inner_type->alignment;
+                assert(node_type(parser, inner) == NODE_TYPE);
+                type = get_array_type(node_data_type(parser, inner), size);
             }
         } break;
 
         case TK_IDENT: {
             // Custom type
-            type->type = METADATA_TYPE;
-
             Str ident = tk.str;
             SymbolTableEntry* ste =
                 symbol_table_find(parser->global_sym, ident, 0);
@@ -907,28 +1020,15 @@ static ASTNode* data_type(ParserState* parser, int allow_incomplete) {
             }
 
             TypeSymbolTableEntry* type_ste = (TypeSymbolTableEntry*)ste;
-            type->type_ste = type_ste;
-
-            if (!type_ste->incomplete) {
-                type->incomplete = 0;
-                type->size = type_ste->size;
-                type->alignment = type_ste->alignment;
-            } else if (allow_incomplete) {
-                type->incomplete = 1;
-            } else {
+            if (type_ste->incomplete && !allow_incomplete) {
                 return error(parser, parser->token_start,
                              "incomplete type is not allowed");
             }
+            type = &type_ste->struct_type;
         } break;
 
         case TK_FUNC: {
             // Function pointer
-            type->type = METADATA_FUNC;
-
-            type->incomplete = 0;
-            type->size = PTR_SIZE;
-            type->alignment = PTR_SIZE;
-
             tk = next_token(parser);
             CallConvType call_type = CALLCONV_CDECL;
             SourcePos callconv_pos = parser->token_start;
@@ -957,6 +1057,9 @@ static ASTNode* data_type(ParserState* parser, int allow_incomplete) {
             func_data.args = NULL;
             func_data.callconv = call_type;
             func_data.has_va_args = 0;
+            func_data.reg_arg_count = 0;
+            func_data.attrs = FUNC_ATTR_NONE;
+            func_data.alignment = 0;
 
             int has_thisptr = 0;
             int first_arg = 1;
@@ -992,21 +1095,21 @@ static ASTNode* data_type(ParserState* parser, int allow_incomplete) {
                                      "expected ':'");
                     }
 
-                    ASTNode* arg_type = data_type(parser, 0);
-                    if (arg_type->type == NODE_ERR) {
+                    NodeIndex arg_type = data_type(parser, 0);
+                    if (node_type(parser, arg_type) == NODE_ERR) {
                         return arg_type;
                     }
-                    assert(arg_type->type == NODE_TYPE);
+                    assert(node_type(parser, arg_type) == NODE_TYPE);
 
                     if (first_arg) {
                         first_arg = 0;
-                        has_thisptr = is_ptr(((TypeNode*)arg_type)->data_type);
+                        has_thisptr = is_ptr(node_data_type(parser, arg_type));
                     }
 
                     ArgList* arg =
                         utlarena_alloc(parser->arena, sizeof(ArgList));
                     arg->next = func_data.args;
-                    arg->type = ((TypeNode*)arg_type)->data_type;
+                    arg->type = node_data_type(parser, arg_type);
                     func_data.args = arg;
 
                     tk = next_token(parser);
@@ -1026,27 +1129,25 @@ static ASTNode* data_type(ParserState* parser, int allow_incomplete) {
                 next_token(parser);
                 func_data.return_type = get_primitive_type(TYPE_VOID);
             } else {
-                ASTNode* return_type = data_type(parser, 0);
-                if (return_type->type == NODE_ERR) {
+                NodeIndex return_type = data_type(parser, 0);
+                if (node_type(parser, return_type) == NODE_ERR) {
                     return return_type;
                 }
-                assert(return_type->type == NODE_TYPE);
-                func_data.return_type = ((TypeNode*)return_type)->data_type;
+                assert(node_type(parser, return_type) == NODE_TYPE);
+                func_data.return_type = node_data_type(parser, return_type);
             }
 
-            type->func_data = func_data;
+            type = get_func_type(&func_data);
         } break;
 
         default:
             return error(parser, parser->token_start, "expected a type");
     }
 
-    type_node->data_type = type;
-
-    return (ASTNode*)type_node;
+    return ast_new_type_node(ast, pos, (TypeNode){type});
 }
 
-static ASTNode* var_decl(ParserState* parser, SymbolAttr attr) {
+static NodeIndex var_decl(ParserState* parser, SymbolAttr attr) {
     Token tk = next_token(parser);
     assert(tk.type == TK_DECL);
 
@@ -1067,15 +1168,15 @@ static ASTNode* var_decl(ParserState* parser, SymbolAttr attr) {
         return error(parser, parser->token_start, "expected ':'");
     }
 
-    ASTNode* var_type = data_type(parser, 0);
-    if (var_type->type == NODE_ERR) {
+    NodeIndex var_type = data_type(parser, 0);
+    if (node_type(parser, var_type) == NODE_ERR) {
         return var_type;
     }
-    assert(var_type->type == NODE_TYPE);
+    assert(node_type(parser, var_type) == NODE_TYPE);
 
     VarSymbolTableEntry* ste =
         symbol_table_append_var(parser->sym, ident, 0, attr,
-                                ((TypeNode*)var_type)->data_type, ident_pos);
+                                node_data_type(parser, var_type), ident_pos);
 
     tk = peek_token(parser);
     if (tk.type == TK_ASSIGN) {
@@ -1085,33 +1186,31 @@ static ASTNode* var_decl(ParserState* parser, SymbolAttr attr) {
                          "initializing extern variable is not allowed");
         }
 
-        VarNode* var = utlarena_alloc(parser->arena, sizeof(VarNode));
-        var->type = NODE_VAR;
-        var->pos = parser->token_start;
-        var->ste = (SymbolTableEntry*)ste;
+        NodeIndex var = ast_new_var(parser->ast, parser->token_start,
+                                    (VarNode){(SymbolTableEntry*)ste});
 
         next_token(parser);
 
-        AssignNode* assign = utlarena_alloc(parser->arena, sizeof(AssignNode));
-        assign->type = NODE_ASSIGN;
-        assign->pos = parser->token_start;
-        assign->left = (ASTNode*)var;
-        assign->right = expr(parser, 0);
-        assign->from_decl = 1;
-        if (assign->right->type == NODE_ERR) {
-            return assign->right;
+        SourcePos pos = parser->token_start;
+        AssignNode assign = {
+            .left = var,
+            .right = expr(parser, 0),
+            .from_decl = 1,
+        };
+        if (node_type(parser, assign.right) == NODE_ERR) {
+            return assign.right;
         }
-        return (ASTNode*)assign;
+        return ast_new_assign(parser->ast, pos, assign);
     } else if (tk.type != TK_SEMICOLON) {
         next_token(parser);
         return error(parser, parser->prev_token_end,
                      "expected '=' or ';' after declaration");
     }
 
-    return NULL;
+    return 0;
 }
 
-static ASTNode* def_decl(ParserState* parser) {
+static NodeIndex def_decl(ParserState* parser) {
     Token tk = next_token(parser);
     assert(tk.type == TK_CONST);
 
@@ -1136,21 +1235,21 @@ static ASTNode* def_decl(ParserState* parser) {
 
     SourcePos pos = parser->prev_token_end;
 
-    ASTNode* val_node = expr(parser, 0);
-    if (val_node->type == NODE_ERR) {
+    NodeIndex val_node = expr(parser, 0);
+    if (node_type(parser, val_node) == NODE_ERR) {
         return val_node;
     }
 
     DefSymbolValue def_val = {0};
-    if (val_node->type == NODE_INTLIT) {
-        IntLitNode* lit = (IntLitNode*)val_node;
+    if (node_type(parser, val_node) == NODE_INTLIT) {
+        IntLitNode lit = ast_intlit(parser->ast, val_node);
         def_val.is_str = 0;
-        def_val.val = lit->val;
-        def_val.data_type = lit->data_type;
-    } else if (val_node->type == NODE_STRLIT) {
-        StrLitNode* lit = (StrLitNode*)val_node;
+        def_val.val = lit.val;
+        def_val.data_type = lit.data_type;
+    } else if (node_type(parser, val_node) == NODE_STRLIT) {
+        StrLitNode lit = ast_strlit(parser->ast, val_node);
         def_val.is_str = 1;
-        def_val.str = lit->val;
+        def_val.str = lit.val;
     } else {
         return error(parser, pos,
                      "defined element is not a compile-time constant integer "
@@ -1159,10 +1258,10 @@ static ASTNode* def_decl(ParserState* parser) {
 
     symbol_table_append_def(parser->sym, ident, def_val, ident_pos);
 
-    return NULL;
+    return 0;
 }
 
-static ASTNode* struct_decl(ParserState* parser) {
+static NodeIndex struct_decl(ParserState* parser) {
     Token tk = next_token(parser);
     assert(tk.type == TK_STRUCT || tk.type == TK_PACKED);
 
@@ -1199,7 +1298,7 @@ static ASTNode* struct_decl(ParserState* parser) {
     tk = peek_token(parser);
     if (tk.type == TK_SEMICOLON) {
         // Forward declaration
-        return NULL;
+        return 0;
     }
 
     if (tk.type != TK_LBRACE) {
@@ -1233,13 +1332,13 @@ static ASTNode* struct_decl(ParserState* parser) {
             return error(parser, parser->token_start, "expected ':'");
         }
 
-        ASTNode* type_node = data_type(parser, 0);
-        if (type_node->type == NODE_ERR) {
+        NodeIndex type_node = data_type(parser, 0);
+        if (node_type(parser, type_node) == NODE_ERR) {
             return type_node;
         }
-        assert(type_node->type == NODE_TYPE);
+        assert(node_type(parser, type_node) == NODE_TYPE);
 
-        const Type* type = ((TypeNode*)type_node)->data_type;
+        const Type* type = node_data_type(parser, type_node);
         symbol_table_append_field(name_space, ident, type, packed, ident_pos);
         if (type->alignment > alignment) {
             alignment = type->alignment;
@@ -1264,10 +1363,14 @@ static ASTNode* struct_decl(ParserState* parser) {
     type_ste->alignment = alignment;
     type_ste->incomplete = 0;
 
-    return NULL;
+    type_ste->struct_type.incomplete = 0;
+    type_ste->struct_type.size = struct_size;
+    type_ste->struct_type.alignment = alignment;
+
+    return 0;
 }
 
-static ASTNode* enum_decl(ParserState* parser) {
+static NodeIndex enum_decl(ParserState* parser) {
     Token tk = next_token(parser);
     assert(tk.type == TK_ENUM);
 
@@ -1295,25 +1398,23 @@ static ASTNode* enum_decl(ParserState* parser) {
         if (peek.type == TK_ASSIGN) {
             next_token(parser);
             SourcePos pos = parser->prev_token_end;
-            ASTNode* lit_node = expr(parser, 1);
-            if (lit_node->type == NODE_ERR) {
+            NodeIndex lit_node = expr(parser, 1);
+            if (node_type(parser, lit_node) == NODE_ERR) {
                 return lit_node;
             }
 
-            IntLitNode* lit = (IntLitNode*)lit_node;
-            if (lit->type != NODE_INTLIT ||
-                (lit->data_type != TYPE_I32 && lit->data_type != TYPE_U32)) {
+            if (!is_int32_lit(parser, lit_node)) {
                 return error(parser, pos,
                              "expected a compile-time constant integer");
             }
 
-            enum_val = lit->val;
+            enum_val = ast_intlit(parser->ast, lit_node).val;
         }
 
         DefSymbolValue def_val = {
             .is_str = 0,
             .val = enum_val,
-            .data_type = get_intlit_type(enum_val),
+            .data_type = get_intlit_type((unsigned int)enum_val),
         };
         symbol_table_append_def(parser->sym, ident, def_val, ident_pos);
         enum_val++;
@@ -1330,13 +1431,83 @@ static ASTNode* enum_decl(ParserState* parser) {
         }
     }
 
-    return NULL;
+    return 0;
+}
+
+static NodeIndex func_attrs(ParserState* parser, int* attrs, int* alignment) {
+    *attrs = FUNC_ATTR_NONE;
+    *alignment = 0;
+
+    Token tk = peek_token(parser);
+    while (is_func_attr(tk)) {
+        next_token(parser);
+        SourcePos attr_pos = parser->token_start;
+
+        if (str_eql(tk.str, str("align"))) {
+            tk = next_token(parser);
+            if (tk.type != TK_LPAREN) {
+                return error(parser, parser->prev_token_end, "expected '('");
+            }
+
+            NodeIndex align_node = expr(parser, 0);
+            if (node_type(parser, align_node) == NODE_ERR) {
+                return align_node;
+            }
+
+            SourcePos align_pos = ast_pos(parser->ast, align_node);
+            if (!is_int32_lit(parser, align_node)) {
+                return error(parser, align_pos,
+                             "alignment is not a compile-time constant "
+                             "integer");
+            }
+
+            int val = ast_intlit(parser->ast, align_node).val;
+            if (val <= 0 || (val & (val - 1)) != 0) {
+                return error(parser, align_pos,
+                             "alignment is not a positive power of 2");
+            }
+            *alignment = val;
+
+            tk = next_token(parser);
+            if (tk.type != TK_RPAREN) {
+                return error(parser, parser->prev_token_end, "expected ')'");
+            }
+        } else {
+            for (unsigned int i = 0; i < ARRAY_SIZE(str_func_attr); i++) {
+                if (str_eql(str(str_func_attr[i].s), tk.str)) {
+                    *attrs |= str_func_attr[i].attr;
+                    break;
+                }
+            }
+        }
+
+        if ((*attrs & FUNC_ATTR_INLINE) && (*attrs & FUNC_ATTR_NOINLINE)) {
+            return error(parser, attr_pos,
+                         "'@inline' conflicts with '@noinline'");
+        }
+
+        if ((*attrs & FUNC_ATTR_HOT) && (*attrs & FUNC_ATTR_COLD)) {
+            return error(parser, attr_pos, "'@hot' conflicts with '@cold'");
+        }
+
+        tk = peek_token(parser);
+    }
+
+    return 0;
 }
 
-static ASTNode* func_decl(ParserState* parser, SymbolAttr attr) {
+static NodeIndex func_decl(ParserState* parser, SymbolAttr attr, int attrs,
+                          int alignment) {
     Token tk = next_token(parser);
     assert(tk.type == TK_FUNC);
 
+    if (attr == SYM_ATTR_EXTERN &&
+        ((attrs & (FUNC_ATTR_INLINE | FUNC_ATTR_NOINLINE)) || alignment)) {
+        return error(parser, parser->token_start,
+                     "'@inline', '@noinline' and '@align' are not allowed "
+                     "on extern function");
+    }
+
     tk = next_token(parser);
     CallConvType call_type = CALLCONV_CDECL;
     SourcePos callconv_pos = parser->token_start;
@@ -1368,9 +1539,27 @@ static ASTNode* func_decl(ParserState* parser, SymbolAttr attr) {
     if (ste == NULL) {
         func = symbol_table_append_func(parser->sym, ident, attr, ident_pos);
     } else if (ste->type == SYM_FUNC &&
-               ((FuncSymbolTableEntry*)ste)->node == NULL) {
+               ((FuncSymbolTableEntry*)ste)->node == 0) {
         // forward declaration
         func = (FuncSymbolTableEntry*)ste;
+
+        // attributes are merged with the ones from forward declaration
+        attrs |= func->func_data.attrs;
+        if (alignment == 0) {
+            alignment = func->func_data.alignment;
+        }
+
+        if ((attrs & FUNC_ATTR_INLINE) && (attrs & FUNC_ATTR_NOINLINE)) {
+            return error(parser, ident_pos,
+                         "'@inline' conflicts with '@noinline' from previous "
+                         "declaration");
+        }
+
+        if ((attrs & FUNC_ATTR_HOT) && (attrs & FUNC_ATTR_COLD)) {
+            return error(parser, ident_pos,
+                         "'@hot' conflicts with '@cold' from previous "
+                         "declaration");
+        }
     } else {
         return error(parser, ident_pos, "redefinition of '%.*s'", tk.str.len,
                      tk.str.ptr);
@@ -1392,6 +1581,9 @@ static ASTNode* func_decl(ParserState* parser, SymbolAttr attr) {
     func_data.args = NULL;
     func_data.callconv = call_type;
     func_data.has_va_args = 0;
+    func_data.reg_arg_count = 0;
+    func_data.attrs = attrs;
+    func_data.alignment = alignment;
 
     int has_thisptr = 0;
     int first_arg = 1;
@@ -1433,24 +1625,24 @@ static ASTNode* func_decl(ParserState* parser, SymbolAttr attr) {
                 return error(parser, parser->prev_token_end, "expected ':'");
             }
 
-            ASTNode* arg_type = data_type(parser, 0);
-            if (arg_type->type == NODE_ERR) {
+            NodeIndex arg_type = data_type(parser, 0);
+            if (node_type(parser, arg_type) == NODE_ERR) {
                 return arg_type;
             }
-            assert(arg_type->type == NODE_TYPE);
+            assert(node_type(parser, arg_type) == NODE_TYPE);
 
             if (first_arg) {
                 first_arg = 0;
-                has_thisptr = is_ptr(((TypeNode*)arg_type)->data_type);
+                has_thisptr = is_ptr(node_data_type(parser, arg_type));
             }
 
             symbol_table_append_var(parser->sym, ident, 1, 0,
-                                    ((TypeNode*)arg_type)->data_type,
+                                    node_data_type(parser, arg_type),
                                     ident_pos);
 
             ArgList* arg = utlarena_alloc(parser->arena, sizeof(ArgList));
             arg->next = func_data.args;
-            arg->type = ((TypeNode*)arg_type)->data_type;
+            arg->type = node_data_type(parser, arg_type);
             func_data.args = arg;
 
             tk = next_token(parser);
@@ -1470,14 +1662,14 @@ static ASTNode* func_decl(ParserState* parser, SymbolAttr attr) {
         next_token(parser);
         func_data.return_type = get_primitive_type(TYPE_VOID);
     } else {
-        ASTNode* return_type = data_type(parser, 0);
-        if (return_type->type == NODE_ERR) {
+        NodeIndex return_type = data_type(parser, 0);
+        if (node_type(parser, return_type) == NODE_ERR) {
             return return_type;
         }
-        assert(return_type->type == NODE_TYPE);
-        func_data.return_type = ((TypeNode*)return_type)->data_type;
-        if (func_data.return_type->size > REGISTER_SIZE) {
-            // space for hidden arguemnt (return struct address)
+        assert(node_type(parser, return_type) == NODE_TYPE);
+        func_data.return_type = node_data_type(parser, return_type);
+        if (is_large_type(func_data.return_type)) {
+            // space for hidden argument (return struct address)
             parser->sym->arg_offset += PTR_SIZE;
         }
     }
@@ -1492,8 +1684,8 @@ static ASTNode* func_decl(ParserState* parser, SymbolAttr attr) {
                          "implementing extern function is not allowed");
         }
 
-        ASTNode* node = scope(parser);
-        if (node->type == NODE_ERR) {
+        NodeIndex node = scope(parser);
+        if (node_type(parser, node) == NODE_ERR) {
             return node;
         }
         func->node = node;
@@ -1506,45 +1698,43 @@ static ASTNode* func_decl(ParserState* parser, SymbolAttr attr) {
 
     func->func_sym = sym;
 
-    return NULL;
+    return 0;
 }
 
-static ASTNode* return_stmt(ParserState* parser) {
+static NodeIndex return_stmt(ParserState* parser) {
     Token tk = next_token(parser);
     assert(tk.type == TK_RET);
 
     tk = peek_token(parser);
-    ReturnNode* ret_node = utlarena_alloc(parser->arena, sizeof(ReturnNode));
-    ret_node->type = NODE_RET;
-    ret_node->pos = parser->token_start;
+    SourcePos pos = parser->token_start;
+    ReturnNode ret_node;
     if (tk.type == TK_SEMICOLON) {
-        ret_node->expr = NULL;
+        ret_node.expr = 0;
     } else {
-        ret_node->expr = expr(parser, 0);
-        if (ret_node->expr->type == NODE_ERR) {
-            return ret_node->expr;
+        ret_node.expr = expr(parser, 0);
+        if (node_type(parser, ret_node.expr) == NODE_ERR) {
+            return ret_node.expr;
         }
     }
 
-    return (ASTNode*)ret_node;
+    return ast_new_ret(parser->ast, pos, ret_node);
 }
 
-static ASTNode* if_stmt(ParserState* parser) {
+static NodeIndex if_stmt(ParserState* parser) {
     Token tk = next_token(parser);
     assert(tk.type == TK_IF);
 
-    IfStatementNode* if_node =
-        utlarena_alloc(parser->arena, sizeof(IfStatementNode));
-    if_node->type = NODE_IF;
+    SourcePos pos = parser->token_start;
+    IfStatementNode if_node;
 
     tk = next_token(parser);
     if (tk.type != TK_LPAREN) {
         return error(parser, parser->prev_token_end, "expected '('");
     }
 
-    if_node->expr = expr(parser, 0);
-    if (if_node->expr->type == NODE_ERR) {
-        return if_node->expr;
+    if_node.expr = expr(parser, 0);
+    if (node_type(parser, if_node.expr) == NODE_ERR) {
+        return if_node.expr;
     }
 
     tk = next_token(parser);
@@ -1552,42 +1742,43 @@ static ASTNode* if_stmt(ParserState* parser) {
         return error(parser, parser->prev_token_end, "expected ')'");
     }
 
-    if_node->then_block = stmt(parser);
-    if (if_node->then_block && if_node->then_block->type == NODE_ERR) {
-        return if_node->then_block;
+    if_node.then_block = stmt(parser);
+    if (if_node.then_block &&
+        node_type(parser, if_node.then_block) == NODE_ERR) {
+        return if_node.then_block;
     }
 
     tk = peek_token(parser);
     if (tk.type == TK_ELSE) {
         next_token(parser);
 
-        if_node->else_block = stmt(parser);
-        if (if_node->else_block && if_node->else_block->type == NODE_ERR) {
-            return if_node->else_block;
+        if_node.else_block = stmt(parser);
+        if (if_node.else_block &&
+            node_type(parser, if_node.else_block) == NODE_ERR) {
+            return if_node.else_block;
         }
     } else {
-        if_node->else_block = NULL;
+        if_node.else_block = 0;
     }
 
-    return (ASTNode*)if_node;
+    return ast_new_if(parser->ast, pos, if_node);
 }
 
-static ASTNode* while_stmt(ParserState* parser) {
+static NodeIndex while_stmt(ParserState* parser) {
     Token tk = next_token(parser);
     assert(tk.type == TK_WHILE);
 
-    WhileNode* while_node = utlarena_alloc(parser->arena, sizeof(WhileNode));
-    while_node->type = NODE_WHILE;
-    while_node->pos = parser->token_start;
+    SourcePos pos = parser->token_start;
+    WhileNode while_node;
 
     tk = next_token(parser);
     if (tk.type != TK_LPAREN) {
         return error(parser, parser->prev_token_end, "expected '('");
     }
 
-    while_node->expr = expr(parser, 0);
-    if (while_node->expr->type == NODE_ERR) {
-        return while_node->expr;
+    while_node.expr = expr(parser, 0);
+    if (node_type(parser, while_node.expr) == NODE_ERR) {
+        return while_node.expr;
     }
 
     tk = next_token(parser);
@@ -1598,29 +1789,27 @@ static ASTNode* while_stmt(ParserState* parser) {
     tk = peek_token(parser);
     if (tk.type == TK_COLON) {
         next_token(parser);
-        while_node->inc = expr(parser, 0);
-        if (while_node->inc->type == NODE_ERR) {
-            return while_node->inc;
+        while_node.inc = expr(parser, 0);
+        if (node_type(parser, while_node.inc) == NODE_ERR) {
+            return while_node.inc;
         }
     } else {
-        while_node->inc = NULL;
+        while_node.inc = 0;
     }
 
-    while_node->block = stmt(parser);
-    if (while_node->block && while_node->block->type == NODE_ERR) {
-        return while_node->block;
+    while_node.block = stmt(parser);
+    if (while_node.block && node_type(parser, while_node.block) == NODE_ERR) {
+        return while_node.block;
     }
 
-    return (ASTNode*)while_node;
+    return ast_new_while(parser->ast, pos, while_node);
 }
 
-static ASTNode* asm_stmt(ParserState* parser) {
+static NodeIndex asm_stmt(ParserState* parser) {
     Token tk = next_token(parser);
     assert(tk.type == TK_ASM);
 
-    AsmNode* asm_node = utlarena_alloc(parser->arena, sizeof(AsmNode));
-    asm_node->type = NODE_ASM;
-    asm_node->pos = parser->token_start;
+    SourcePos pos = parser->token_start;
 
     tk = next_token(parser);
     if (tk.type != TK_LPAREN) {
@@ -1631,17 +1820,17 @@ static ASTNode* asm_stmt(ParserState* parser) {
     if (tk.type != TK_STR) {
         return error(parser, parser->prev_token_end, "expected string literal");
     }
-    asm_node->asm_str = tk.str;
+    AsmNode asm_node = {tk.str};
 
     tk = next_token(parser);
     if (tk.type != TK_RPAREN) {
         return error(parser, parser->prev_token_end, "expected ')'");
     }
 
-    return (ASTNode*)asm_node;
+    return ast_new_asm(parser->ast, pos, asm_node);
 }
 
-static ASTNode* scope(ParserState* parser) {
+static NodeIndex scope(ParserState* parser) {
     Token tk = next_token(parser);
     assert(tk.type == TK_LBRACE);
 
@@ -1651,8 +1840,8 @@ static ASTNode* scope(ParserState* parser) {
     sym->parent = parser->sym;
     parser->sym = sym;
 
-    ASTNode* node = stmt_list(parser, 1);
-    if (node->type == NODE_ERR)
+    NodeIndex node = stmt_list(parser, 1);
+    if (node_type(parser, node) == NODE_ERR)
         return node;
 
     tk = next_token(parser);
@@ -1665,17 +1854,17 @@ static ASTNode* scope(ParserState* parser) {
     return node;
 }
 
-static ASTNode* stmt(ParserState* parser) {
-    ASTNode* node;
+static NodeIndex stmt(ParserState* parser) {
+    NodeIndex node;
     Token tk = peek_token(parser);
     switch (tk.type) {
         case TK_SEMICOLON:
             tk = next_token(parser);
-            return NULL;
+            return 0;
 
         case TK_RET:
             node = return_stmt(parser);
-            if (node->type == NODE_ERR)
+            if (node_type(parser, node) == NODE_ERR)
                 return node;
 
             tk = next_token(parser);
@@ -1687,7 +1876,7 @@ static ASTNode* stmt(ParserState* parser) {
 
         case TK_ASM:
             node = asm_stmt(parser);
-            if (node->type == NODE_ERR)
+            if (node_type(parser, node) == NODE_ERR)
                 return node;
             tk = next_token(parser);
             if (tk.type != TK_SEMICOLON) {
@@ -1698,47 +1887,42 @@ static ASTNode* stmt(ParserState* parser) {
 
         case TK_IF:
             node = if_stmt(parser);
-            if (node->type == NODE_ERR)
+            if (node_type(parser, node) == NODE_ERR)
                 return node;
             break;
 
         case TK_WHILE:
             node = while_stmt(parser);
-            if (node->type == NODE_ERR)
+            if (node_type(parser, node) == NODE_ERR)
                 return node;
             break;
 
         case TK_LBRACE:
             node = scope(parser);
-            if (node->type == NODE_ERR)
+            if (node_type(parser, node) == NODE_ERR)
                 return node;
             break;
 
         case TK_STR: {
             next_token(parser);
-            PrintNode* print_node =
-                utlarena_alloc(parser->arena, sizeof(PrintNode));
-            node = (ASTNode*)print_node;
-
-            print_node->type = NODE_PRINT;
-            print_node->pos = parser->token_start;
-            print_node->fmt = tk.str;
-            print_node->args = NULL;
+            SourcePos pos = parser->token_start;
+            PrintNode print_node;
+            print_node.fmt =
+                ast_new_strlit(parser->ast, pos, (StrLitNode){tk.str});
+            size_t args_start = parser->node_stack.size;
 
             tk = next_token(parser);
             while (tk.type == TK_COMMA) {
-                ASTNode* arg_node = expr(parser, 1);
-                if (arg_node->type == NODE_ERR)
+                NodeIndex arg_node = expr(parser, 1);
+                if (node_type(parser, arg_node) == NODE_ERR)
                     return arg_node;
 
-                ASTNodeList* arg =
-                    utlarena_alloc(parser->arena, sizeof(ASTNodeList));
-                arg->node = arg_node;
-                arg->next = print_node->args;
-                print_node->args = arg;
+                utlvector_push(&parser->node_stack, arg_node);
 
                 tk = next_token(parser);
             }
+            print_node.args = pop_node_list(parser, args_start, 1);
+            node = ast_new_print(parser->ast, pos, print_node);
 
             if (tk.type != TK_COMMA && tk.type != TK_SEMICOLON) {
                 return error(parser, parser->prev_token_end,
@@ -1750,12 +1934,8 @@ static ASTNode* stmt(ParserState* parser) {
         case TK_CONTINUE: {
             next_token(parser);
 
-            GotoNode* goto_node =
-                utlarena_alloc(parser->arena, sizeof(GotoNode));
-            node = (ASTNode*)goto_node;
-            goto_node->type = NODE_GOTO;
-            goto_node->pos = parser->token_start;
-            goto_node->op = tk.type;
+            node = ast_new_goto(parser->ast, parser->token_start,
+                                (GotoNode){tk.type});
 
             tk = next_token(parser);
             if (tk.type != TK_SEMICOLON) {
@@ -1771,7 +1951,7 @@ static ASTNode* stmt(ParserState* parser) {
 
         default:
             node = expr(parser, 0);
-            if (node->type == NODE_ERR)
+            if (node_type(parser, node) == NODE_ERR)
                 return node;
 
             tk = next_token(parser);
@@ -1783,24 +1963,22 @@ static ASTNode* stmt(ParserState* parser) {
     return node;
 }
 
-static ASTNode* stmt_list(ParserState* parser, int in_scope) {
-    StatementListNode* stmts =
-        utlarena_alloc(parser->arena, sizeof(StatementListNode));
-    stmts->type = NODE_STMTS;
-    stmts->pos = parser->token_start;
-    stmts->stmts = NULL;
+static NodeIndex stmt_list(ParserState* parser, int in_scope) {
+    SourcePos pos = parser->token_start;
+    size_t stmts_start = parser->node_stack.size;
 
     for (Token tk = peek_token(parser);
          tk.type != TK_EOF && (!in_scope || tk.type != TK_RBRACE);
          tk = peek_token(parser)) {
-        ASTNode* node = NULL;
+        NodeIndex node = 0;
 
         SymbolAttr attr = SYM_ATTR_NONE;
         if (tk.type == TK_EXTERN || tk.type == TK_PUB) {
             Token attr_tk = tk;
             next_token(parser);
             tk = peek_token(parser);
-            if (tk.type != TK_FUNC && tk.type != TK_DECL) {
+            if (tk.type != TK_FUNC && tk.type != TK_DECL &&
+                !is_func_attr(tk)) {
                 next_token(parser);
                 return error(parser, parser->token_start,
                              "expected function or variable declaration");
@@ -1809,6 +1987,22 @@ static ASTNode* stmt_list(ParserState* parser, int in_scope) {
                 (attr_tk.type == TK_EXTERN) ? SYM_ATTR_EXTERN : SYM_ATTR_EXPORT;
         }
 
+        int func_attr = FUNC_ATTR_NONE;
+        int func_alignment = 0;
+        if (is_func_attr(tk)) {
+            node = func_attrs(parser, &func_attr, &func_alignment);
+            if (node != 0) {
+                return node;
+            }
+
+            tk = peek_token(parser);
+            if (tk.type != TK_FUNC) {
+                next_token(parser);
+                return error(parser, parser->token_start,
+                             "expected function declaration");
+            }
+        }
+
         switch (tk.type) {
             case TK_FUNC:
                 if (in_scope) {
@@ -1816,8 +2010,8 @@ static ASTNode* stmt_list(ParserState* parser, int in_scope) {
                     return error(parser, parser->token_start,
                                  "function definition is not allowed here");
                 }
-                node = func_decl(parser, attr);
-                if (node && node->type == NODE_ERR) {
+                node = func_decl(parser, attr, func_attr, func_alignment);
+                if (node && node_type(parser, node) == NODE_ERR) {
                     return node;
                 }
                 break;
@@ -1830,7 +2024,7 @@ static ASTNode* stmt_list(ParserState* parser, int in_scope) {
                                  "struct definition is not allowed here");
                 }
                 node = struct_decl(parser);
-                if (node && node->type == NODE_ERR) {
+                if (node && node_type(parser, node) == NODE_ERR) {
                     return node;
                 }
 
@@ -1843,7 +2037,7 @@ static ASTNode* stmt_list(ParserState* parser, int in_scope) {
 
             case TK_DECL:
                 node = var_decl(parser, attr);
-                if (node && node->type == NODE_ERR) {
+                if (node && node_type(parser, node) == NODE_ERR) {
                     return node;
                 }
 
@@ -1856,7 +2050,7 @@ static ASTNode* stmt_list(ParserState* parser, int in_scope) {
 
             case TK_CONST:
                 node = def_decl(parser);
-                if (node && node->type == NODE_ERR) {
+                if (node && node_type(parser, node) == NODE_ERR) {
                     return node;
                 }
 
@@ -1869,7 +2063,7 @@ static ASTNode* stmt_list(ParserState* parser, int in_scope) {
 
             case TK_ENUM:
                 node = enum_decl(parser);
-                if (node && node->type == NODE_ERR) {
+                if (node && node_type(parser, node) == NODE_ERR) {
                     return node;
                 }
 
@@ -1884,25 +2078,18 @@ static ASTNode* stmt_list(ParserState* parser, int in_scope) {
                 node = stmt(parser);
         }
 
-        if (node == NULL) {
+        if (node == 0) {
             continue;
         }
 
-        if (node->type == NODE_ERR) {
+        if (node_type(parser, node) == NODE_ERR) {
             return node;
         }
 
-        ASTNodeList* list = utlarena_alloc(parser->arena, sizeof(ASTNodeList));
-        list->node = node;
-        list->next = NULL;
-        if (!stmts->stmts) {
-            stmts->stmts = list;
-        } else {
-            stmts->_tail->next = list;
-        }
-        stmts->_tail = list;
+        utlvector_push(&parser->node_stack, node);
     }
-    return (ASTNode*)stmts;
+    StatementListNode stmts = {pop_node_list(parser, stmts_start, 0)};
+    return ast_new_stmts(parser->ast, pos, stmts);
 }
 
 void parser_init(ParserState* parser, SymbolTable* sym,
@@ -1912,10 +2099,19 @@ void parser_init(ParserState* parser, SymbolTable* sym,
     parser->sym = parser->global_sym = sym;
 }
 
-ASTNode* parser_parse(ParserState* parser, const SourceState* src) {
+NodeIndex parser_parse(ParserState* parser, const SourceState* src, AST* ast) {
     parser->src = src;
-    parser->line = parser->src->lines;
-    parser->pos = 0;
-
-    return stmt_list(parser, 0);
+    parser->tokens = (LexTokens)utlvector_init(parser->temp_allocator);
+    parser->token_index = 0;
+    lex_tokens(&parser->tokens, &src->lines, parser->arena,
+               parser->temp_allocator);
+    parser->node_stack = (ASTNodes)utlvector_init(parser->temp_allocator);
+    parser->ast = ast;
+    ast_init(ast, parser->temp_allocator);
+
+    NodeIndex node = stmt_list(parser, 0);
+    utlvector_deinit(&parser->tokens);
+    utlvector_deinit(&parser->node_stack);
+    ast_finish(ast, parser->arena);
+    return node;
 }
@@ -6,15 +6,19 @@
 #include "source.h"
 #include "symbol_table.h"
 
+typedef UtlVector(NodeIndex) ASTNodes;
+
 typedef struct ParserState {
     UtlArenaAllocator* arena;
     UtlAllocator* temp_allocator;
+    AST* ast;
+    ASTNodes node_stack;  // nodes of the lists being parsed
     SymbolTable* sym;
     SymbolTable* global_sym;
 
     const SourceState* src;
-    SourceLine* line;
-    size_t pos;  // current pos
+    LexTokens tokens;
+    size_t token_index;  // index of the next token
 
     Token token;
     SourcePos prev_token_end;
@@ -24,6 +28,6 @@ typedef struct ParserState {
 
 void parser_init(ParserState* parser, SymbolTable* sym,
                  UtlArenaAllocator* arena, UtlAllocator* temp_allocator);
-ASTNode* parser_parse(ParserState* parser, const SourceState* src);
+NodeIndex parser_parse(ParserState* parser, const SourceState* src, AST* ast);
 
 #endif
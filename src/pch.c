@@ -0,0 +1,933 @@
+#include "pch.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "intern.h"
+#include "utils.h"
+
+#define PCH_MAGIC "IKAPCH"
+#define PCH_VERSION 1
+
+/*
+ * Layout, integers are stored in the byte order of the compiler:
+ *   magic, version, target
+ *   defines before the header: count, names
+ *   files read: count, (path, hash of the contents, #pragma once, guard),
+ *   the header comes first
+ *   defines after the header: count, names
+ *   types: count, offset of each record, size of the records, records
+ *   entries of the global symbol table in order of insertion: count, records
+ * Types and entries refer to each other by index.
+ */
+
+static Error* error(UtlArenaAllocator* arena, SourcePos pos, const char* fmt,
+                    ...) {
+    Error* error = utlarena_alloc(arena, sizeof(Error));
+    error->pos = pos;
+
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(error->msg, ERROR_MAX_LENGTH, fmt, ap);
+    va_end(ap);
+
+    return error;
+}
+
+// FNV-1a
+static uint64_t hash_src(const char* src) {
+    uint64_t hash = 14695981039346656037ull;
+    for (; *src; src++) {
+        hash ^= (unsigned char)*src;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint32_t count_defines(const SymbolTable* defines) {
+    uint32_t count = 0;
+    for (const SymbolTableEntry* curr = defines->ste; curr; curr = curr->next) {
+        count++;
+    }
+    return count;
+}
+
+// Writing
+
+static void write_bytes(PchBuffer* buf, const void* data, size_t size) {
+    utlvector_pushall(buf, (const char*)data, size);
+}
+
+static void write_u32(PchBuffer* buf, uint32_t val) {
+    write_bytes(buf, &val, sizeof(val));
+}
+
+static void write_u64(PchBuffer* buf, uint64_t val) {
+    write_bytes(buf, &val, sizeof(val));
+}
+
+static void write_str(PchBuffer* buf, Str s) {
+    write_u32(buf, s.len);
+    write_bytes(buf, s.ptr, s.len);
+}
+
+static void write_defines(PchBuffer* buf, const SymbolTable* defines) {
+    write_u32(buf, count_defines(defines));
+    for (const SymbolTableEntry* curr = defines->ste; curr; curr = curr->next) {
+        write_str(buf, curr->ident);
+    }
+}
+
+void pch_writer_init(PchWriter* writer, UtlArenaAllocator* arena,
+                     const SymbolTable* defines) {
+    UtlAllocator* allocator = utlarena_allocator(arena);
+    writer->buf = (PchBuffer)utlvector_init(allocator);
+    writer->type_offsets = (PchBuffer)utlvector_init(allocator);
+    writer->types = (PchBuffer)utlvector_init(allocator);
+    writer->entries = (PchBuffer)utlvector_init(allocator);
+    writer->type_list = (PchTypes)utlvector_init(allocator);
+    writer->entry_list = (PchEntries)utlvector_init(allocator);
+
+    write_bytes(&writer->buf, PCH_MAGIC, sizeof(PCH_MAGIC));
+    write_u32(&writer->buf, PCH_VERSION);
+    write_u32(&writer->buf, target_info.arch);
+    write_defines(&writer->buf, defines);
+}
+
+void pch_add_files(PchWriter* writer, const PPState* pp) {
+    const PP_IncludedFiles* files = &pp->included_files;
+    write_u32(&writer->buf, files->size);
+    for (size_t i = 0; i < files->size; i++) {
+        const PP_IncludedFile* file = &files->data[i];
+        write_str(&writer->buf, file->path);
+        write_u64(&writer->buf, hash_src(file->src));
+        write_u32(&writer->buf, file->once);
+        write_str(&writer->buf, file->guard.ptr ? file->guard : str(""));
+    }
+
+    write_defines(&writer->buf, pp->sym);
+}
+
+static int find_entry(const PchWriter* writer, const SymbolTableEntry* ste) {
+    for (size_t i = 0; i < writer->entry_list.size; i++) {
+        if (writer->entry_list.data[i] == ste) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint32_t add_type(PchWriter* writer, const Type* type);
+
+static void write_func_data(PchWriter* writer, PchBuffer* buf,
+                            const FuncMetadata* func_data) {
+    write_u32(buf, add_type(writer, func_data->return_type));
+    write_u32(buf, func_data->callconv);
+    write_u32(buf, func_data->has_va_args);
+    write_u32(buf, func_data->reg_arg_count);
+    write_u32(buf, func_data->attrs);
+    write_u32(buf, func_data->alignment);
+
+    uint32_t arg_count = 0;
+    for (const ArgList* arg = func_data->args; arg; arg = arg->next) {
+        arg_count++;
+    }
+
+    write_u32(buf, arg_count);
+    for (const ArgList* arg = func_data->args; arg; arg = arg->next) {
+        write_u32(buf, add_type(writer, arg->type));
+    }
+}
+
+// Index of the type, its record is written if it's not there yet
+static uint32_t add_type(PchWriter* writer, const Type* type) {
+    for (size_t i = 0; i < writer->type_list.size; i++) {
+        if (writer->type_list.data[i] == type) {
+            return i;
+        }
+    }
+
+    // Components go first, so their records don't end up inside this one
+    if (type->type == METADATA_ARRAY || type->type == METADATA_POINTER) {
+        add_type(writer, type->inner_type);
+    } else if (type->type == METADATA_FUNC) {
+        add_type(writer, type->func_data.return_type);
+        for (const ArgList* arg = type->func_data.args; arg; arg = arg->next) {
+            add_type(writer, arg->type);
+        }
+    }
+
+    PchBuffer* buf = &writer->types;
+    write_u32(&writer->type_offsets, buf->size);
+    write_u32(buf, type->type);
+
+    switch (type->type) {
+        case METADATA_PRIMITIVE:
+            write_u32(buf, type->primitive_type);
+            break;
+
+        case METADATA_TYPE: {
+            int index =
+                find_entry(writer, (const SymbolTableEntry*)type->type_ste);
+            assert(index >= 0);
+            write_u32(buf, index);
+        } break;
+
+        case METADATA_ARRAY:
+            write_u32(buf, add_type(writer, type->inner_type));
+            write_u32(buf, type->array_size);
+            break;
+
+        case METADATA_POINTER:
+            write_u32(buf, add_type(writer, type->inner_type));
+            write_u32(buf, type->pointer_level);
+            break;
+
+        case METADATA_FUNC:
+            write_func_data(writer, buf, &type->func_data);
+            break;
+
+        default:
+            UNREACHABLE();
+    }
+
+    utlvector_push(&writer->type_list, type);
+    return writer->type_list.size - 1;
+}
+
+// Entries of the symbol table in order of insertion
+static void get_entries(PchEntries* entries, const SymbolTable* sym) {
+    size_t start = entries->size;
+    for (const SymbolTableEntry* curr = sym->ste; curr; curr = curr->next) {
+        utlvector_push(entries, curr);
+    }
+
+    size_t i = start;
+    size_t j = entries->size;
+    while (i + 1 < j) {
+        j--;
+        const SymbolTableEntry* tmp = entries->data[i];
+        entries->data[i] = entries->data[j];
+        entries->data[j] = tmp;
+        i++;
+    }
+}
+
+static void write_entry(PchWriter* writer, const SymbolTableEntry* ste) {
+    PchBuffer* buf = &writer->entries;
+    write_u32(buf, ste->type);
+    write_str(buf, ste->ident);
+
+    switch (ste->type) {
+        case SYM_VAR: {
+            const VarSymbolTableEntry* var = (const VarSymbolTableEntry*)ste;
+            write_u32(buf, var->attr);
+            write_u32(buf, add_type(writer, var->data_type));
+        } break;
+
+        case SYM_DEF: {
+            const DefSymbolTableEntry* def = (const DefSymbolTableEntry*)ste;
+            write_u32(buf, def->val.is_str);
+            if (def->val.is_str) {
+                write_str(buf, def->val.str);
+            } else {
+                write_u64(buf, def->val.val);
+                write_u32(buf, def->val.data_type);
+            }
+        } break;
+
+        case SYM_FUNC: {
+            const FuncSymbolTableEntry* func = (const FuncSymbolTableEntry*)ste;
+            write_u32(buf, func->attr);
+            write_func_data(writer, buf, &func->func_data);
+
+            // Names of the arguments, in order
+            PchEntries args = utlvector_init(writer->entries.allocator);
+            get_entries(&args, func->func_sym);
+            for (size_t i = 0; i < args.size; i++) {
+                write_str(buf, args.data[i]->ident);
+            }
+        } break;
+
+        case SYM_TYPE: {
+            const TypeSymbolTableEntry* type_ste =
+                (const TypeSymbolTableEntry*)ste;
+            write_u32(buf, type_ste->incomplete);
+            if (type_ste->incomplete) {
+                break;
+            }
+
+            write_u32(buf, type_ste->size);
+            write_u32(buf, type_ste->alignment);
+
+            PchEntries fields = utlvector_init(writer->entries.allocator);
+            get_entries(&fields, type_ste->name_space);
+            write_u32(buf, fields.size);
+            for (size_t i = 0; i < fields.size; i++) {
+                const FieldSymbolTableEntry* field =
+                    (const FieldSymbolTableEntry*)fields.data[i];
+                write_str(buf, field->ident);
+                write_u32(buf, add_type(writer, field->data_type));
+                write_u32(buf, field->offset);
+            }
+        } break;
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+Error* pch_add_decls(PchWriter* writer, UtlArenaAllocator* arena,
+                     const AST* ast, NodeIndex node, const SymbolTable* sym) {
+    assert(ast_node_type(ast, node) == NODE_STMTS);
+    StatementListNode stmts = ast_stmts(ast, node);
+    if (stmts.stmts.count > 0) {
+        return error(arena, ast_pos(ast, stmts.stmts.nodes[0]),
+                     "precompiled header can only contain declarations");
+    }
+
+    get_entries(&writer->entry_list, sym);
+    for (size_t i = 0; i < writer->entry_list.size; i++) {
+        const SymbolTableEntry* ste = writer->entry_list.data[i];
+        if (ste->type == SYM_FUNC && ((FuncSymbolTableEntry*)ste)->node) {
+            return error(arena, ste->pos,
+                         "precompiled header can only contain declarations");
+        }
+        write_entry(writer, ste);
+    }
+
+    return NULL;
+}
+
+// Returns 0 on success
+static int write_buffer(const PchBuffer* buf, FILE* out) {
+    return buf->size > 0 && fwrite(buf->data, 1, buf->size, out) != buf->size;
+}
+
+int pch_write(const PchWriter* writer, FILE* out) {
+    uint32_t type_count = writer->type_list.size;
+    uint32_t types_size = writer->types.size;
+    uint32_t entry_count = writer->entry_list.size;
+
+    int result = 0;
+    result |= write_buffer(&writer->buf, out);
+    result |= fwrite(&type_count, sizeof(type_count), 1, out) != 1;
+    result |= write_buffer(&writer->type_offsets, out);
+    result |= fwrite(&types_size, sizeof(types_size), 1, out) != 1;
+    result |= write_buffer(&writer->types, out);
+    result |= fwrite(&entry_count, sizeof(entry_count), 1, out) != 1;
+    result |= write_buffer(&writer->entries, out);
+    return result;
+}
+
+char* pch_get_path(UtlAllocator* allocator, Str path) {
+    Str ext = str(".ika");
+    if (path.len >= ext.len &&
+        str_eql((Str){path.ptr + path.len - ext.len, ext.len}, ext)) {
+        path.len -= ext.len;
+    }
+
+    size_t size = path.len + sizeof(PCH_EXT);
+    char* pch_path = allocator->alloc(allocator, size);
+    snprintf(pch_path, size, "%.*s" PCH_EXT, path.len, path.ptr);
+    return pch_path;
+}
+
+// Reading
+
+typedef struct PchReader {
+    const char* p;
+    const char* end;
+    int error;  // read past the end or found an invalid value
+} PchReader;
+
+static void read_bytes(PchReader* r, void* data, size_t size) {
+    if (r->error || (size_t)(r->end - r->p) < size) {
+        r->error = 1;
+        memset(data, 0, size);
+        return;
+    }
+    memcpy(data, r->p, size);
+    r->p += size;
+}
+
+static uint32_t read_u32(PchReader* r) {
+    uint32_t val;
+    read_bytes(r, &val, sizeof(val));
+    return val;
+}
+
+static uint64_t read_u64(PchReader* r) {
+    uint64_t val;
+    read_bytes(r, &val, sizeof(val));
+    return val;
+}
+
+// Start of the next size bytes
+static const char* read_block(PchReader* r, size_t size) {
+    if (r->error || (size_t)(r->end - r->p) < size) {
+        r->error = 1;
+        return r->p;
+    }
+
+    const char* block = r->p;
+    r->p += size;
+    return block;
+}
+
+// The string points into the file
+static Str read_str(PchReader* r) {
+    uint32_t len = read_u32(r);
+    const char* ptr = read_block(r, len);
+    if (r->error) {
+        return str("");
+    }
+    return (Str){ptr, len};
+}
+
+// Is the precompiled header built from the same files, with the same defines
+// and for the same target. The files are added to files.
+static int pch_matches(PPState* state, PchReader* r, int header,
+                       PP_IncludedFiles* files) {
+    char magic[sizeof(PCH_MAGIC)];
+    read_bytes(r, magic, sizeof(magic));
+    if (memcmp(magic, PCH_MAGIC, sizeof(magic)) != 0 ||
+        read_u32(r) != PCH_VERSION || read_u32(r) != target_info.arch) {
+        return 0;
+    }
+
+    uint32_t define_count = read_u32(r);
+    if (define_count != count_defines(state->sym)) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < define_count; i++) {
+        Str ident = read_str(r);
+        if (r->error || !symbol_table_find(state->sym, intern(ident), 1)) {
+            return 0;
+        }
+    }
+
+    uint32_t file_count = read_u32(r);
+    if (file_count == 0) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < file_count; i++) {
+        PP_IncludedFile file = {
+            .path = intern(read_str(r)),
+        };
+        uint64_t hash = read_u64(r);
+        file.once = read_u32(r);
+        Str guard = read_str(r);
+        if (r->error) {
+            return 0;
+        }
+        if (guard.len > 0) {
+            file.guard = intern(guard);
+        }
+
+        if (i == 0) {
+            file.real_path = state->included_files.data[header].real_path;
+            file.src = state->included_files.data[header].src;
+            file.size = state->included_files.data[header].size;
+        } else {
+            // Files included by the header. The declarations of one that was
+            // already included would be added again.
+            file.real_path = pp_get_real_path(file.path);
+            if (pp_find_included_file(state, file.real_path) >= 0) {
+                return 0;
+            }
+            file.src = map_entire_file(utlarena_allocator(state->arena),
+                                       file.path.ptr, &file.size);
+            if (!file.src) {
+                return 0;
+            }
+        }
+
+        if (hash_src(file.src) != hash) {
+            return 0;
+        }
+        utlvector_push(files, file);
+    }
+
+    return !r->error;
+}
+
+// Mark the header and the files it includes as included, so a later #include
+// of them honors their #pragma once and include guards
+static void add_included_files(PPState* state, int header,
+                               const PP_IncludedFiles* files) {
+    PP_IncludedFile* header_file = &state->included_files.data[header];
+    header_file->once = files->data[0].once;
+    header_file->guard = files->data[0].guard;
+
+    for (size_t i = 1; i < files->size; i++) {
+        pp_add_included_file(state, files->data[i]);
+    }
+}
+
+// Replace the defines with the ones after the header
+static void apply_defines(PPState* state, PchReader* r) {
+    uint32_t define_count = read_u32(r);
+    if (r->error || define_count > (size_t)(r->end - r->p)) {
+        r->error = 1;
+        return;
+    }
+
+    UtlAllocator* allocator = state->temp_allocator;
+    Str* defines = allocator->alloc(allocator, sizeof(Str) * define_count);
+    for (uint32_t i = 0; i < define_count; i++) {
+        defines[i] = intern(read_str(r));
+    }
+
+    SymbolTableEntry* curr = state->sym->ste;
+    while (curr) {
+        SymbolTableEntry* next = curr->next;
+        int kept = 0;
+        for (uint32_t i = 0; i < define_count; i++) {
+            if (defines[i].ptr == curr->ident.ptr) {
+                kept = 1;
+                break;
+            }
+        }
+        if (!kept) {
+            symbol_table_remove(state->sym, curr->ident);
+        }
+        curr = next;
+    }
+
+    for (uint32_t i = 0; i < define_count; i++) {
+        symbol_table_append_sym(state->sym, defines[i]);
+    }
+
+    allocator->free(allocator, defines);
+}
+
+typedef struct PchLoadedEntry {
+    SymbolTableEntry* ste;
+    const char* fields;  // record of a struct that isn't completed yet
+} PchLoadedEntry;
+
+typedef struct PchLoader {
+    PchReader r;
+    UtlArenaAllocator* arena;
+    SymbolTable* sym;
+    SourcePos pos;
+
+    uint32_t type_count;
+    const char* type_offsets;
+    const char* type_records;
+    const char* types_end;
+    const Type** types;  // decoded so far
+
+    uint32_t entry_count;
+    PchLoadedEntry* entries;
+} PchLoader;
+
+static const Type* get_type(PchLoader* loader, uint32_t index);
+static const Type* get_complete_type(PchLoader* loader, uint32_t index);
+
+static void complete_struct(PchLoader* loader, PchLoadedEntry* entry) {
+    PchReader r = {entry->fields, loader->r.end, 0};
+    entry->fields = NULL;
+
+    TypeSymbolTableEntry* type_ste = (TypeSymbolTableEntry*)entry->ste;
+    int size = read_u32(&r);
+    int alignment = read_u32(&r);
+    uint32_t field_count = read_u32(&r);
+
+    SymbolTable* name_space =
+        utlarena_alloc(loader->sym->arena, sizeof(SymbolTable));
+    symbol_table_init(name_space, 0, NULL, 0, loader->sym->arena);
+
+    for (uint32_t i = 0; i < field_count && !r.error; i++) {
+        Str ident = intern(read_str(&r));
+        uint32_t type_index = read_u32(&r);
+        int offset = read_u32(&r);
+        if (r.error || symbol_table_find(name_space, ident, 1)) {
+            r.error = 1;
+            break;
+        }
+
+        const Type* type = get_complete_type(loader, type_index);
+        if (type->incomplete) {
+            r.error = 1;
+            break;
+        }
+
+        // The layout is stored as is, the struct may be packed
+        FieldSymbolTableEntry* field = symbol_table_append_field(
+            name_space, ident, type, 1, loader->pos);
+        field->offset = offset;
+    }
+
+    if (r.error) {
+        loader->r.error = 1;
+        return;
+    }
+
+    type_ste->size = size;
+    type_ste->name_space = name_space;
+    type_ste->alignment = alignment;
+    type_ste->incomplete = 0;
+
+    type_ste->struct_type.incomplete = 0;
+    type_ste->struct_type.size = size;
+    type_ste->struct_type.alignment = alignment;
+}
+
+// Structs are completed when their size is needed, by then every struct in
+// them has been declared, just like when the header was parsed
+static const Type* get_complete_type(PchLoader* loader, uint32_t index) {
+    const Type* type = get_type(loader, index);
+    if (type->type != METADATA_TYPE || !type->incomplete) {
+        return type;
+    }
+
+    for (uint32_t i = 0; i < loader->entry_count; i++) {
+        PchLoadedEntry* entry = &loader->entries[i];
+        if (entry->ste == (SymbolTableEntry*)type->type_ste && entry->fields) {
+            complete_struct(loader, entry);
+            break;
+        }
+    }
+    return type;
+}
+
+static void read_func_data(PchLoader* loader, PchReader* r,
+                           FuncMetadata* func_data) {
+    func_data->return_type = get_complete_type(loader, read_u32(r));
+    func_data->callconv = read_u32(r);
+    func_data->has_va_args = read_u32(r);
+    func_data->reg_arg_count = read_u32(r);
+    func_data->attrs = read_u32(r);
+    func_data->alignment = read_u32(r);
+
+    uint32_t arg_count = read_u32(r);
+    func_data->args = NULL;
+    ArgList** tail = &func_data->args;
+    for (uint32_t i = 0; i < arg_count && !r->error; i++) {
+        ArgList* arg = utlarena_alloc(loader->arena, sizeof(ArgList));
+        arg->next = NULL;
+        arg->type = get_complete_type(loader, read_u32(r));
+        *tail = arg;
+        tail = &arg->next;
+    }
+}
+
+static const Type* get_type(PchLoader* loader, uint32_t index) {
+    const Type* type = get_primitive_type(TYPE_VOID);
+    if (index >= loader->type_count) {
+        loader->r.error = 1;
+        return type;
+    }
+
+    if (loader->types[index]) {
+        return loader->types[index];
+    }
+
+    // Placeholder, so a corrupt file can't make a type contain itself
+    loader->types[index] = type;
+
+    uint32_t offset;
+    memcpy(&offset, loader->type_offsets + index * sizeof(offset),
+           sizeof(offset));
+    PchReader r = {loader->type_records, loader->types_end, 0};
+    read_block(&r, offset);
+
+    switch (read_u32(&r)) {
+        case METADATA_PRIMITIVE: {
+            uint32_t primitive_type = read_u32(&r);
+            if (primitive_type > TYPE_F64) {
+                r.error = 1;
+                break;
+            }
+            type = get_primitive_type(primitive_type);
+        } break;
+
+        case METADATA_TYPE: {
+            uint32_t entry = read_u32(&r);
+            if (entry >= loader->entry_count || !loader->entries[entry].ste ||
+                loader->entries[entry].ste->type != SYM_TYPE) {
+                r.error = 1;
+                break;
+            }
+            type = &((TypeSymbolTableEntry*)loader->entries[entry].ste)
+                        ->struct_type;
+        } break;
+
+        case METADATA_ARRAY: {
+            uint32_t inner = read_u32(&r);
+            int array_size = read_u32(&r);
+            const Type* inner_type = array_size == 0
+                                         ? get_type(loader, inner)
+                                         : get_complete_type(loader, inner);
+            type = get_array_type(inner_type, array_size);
+        } break;
+
+        case METADATA_POINTER: {
+            const Type* inner_type = get_type(loader, read_u32(&r));
+            type = get_pointer_type(inner_type, read_u32(&r));
+        } break;
+
+        case METADATA_FUNC: {
+            FuncMetadata func_data;
+            read_func_data(loader, &r, &func_data);
+            type = get_func_type(&func_data);
+        } break;
+
+        default:
+            r.error = 1;
+    }
+
+    if (r.error) {
+        loader->r.error = 1;
+    }
+
+    loader->types[index] = type;
+    return type;
+}
+
+static Error* redefinition(PchLoader* loader, Str ident) {
+    return error(loader->arena, loader->pos, "redefinition of '%.*s'",
+                 ident.len, ident.ptr);
+}
+
+static Error* load_func(PchLoader* loader, Str ident, SymbolTableEntry* ste,
+                        PchLoadedEntry* entry) {
+    PchReader* r = &loader->r;
+    SymbolAttr attr = read_u32(r);
+
+    FuncMetadata func_data;
+    read_func_data(loader, r, &func_data);
+
+    FuncSymbolTableEntry* func;
+    if (ste == NULL) {
+        func = symbol_table_append_func(loader->sym, ident, attr, loader->pos);
+    } else if (ste->type == SYM_FUNC &&
+               ((FuncSymbolTableEntry*)ste)->node == 0) {
+        // forward declaration
+        func = (FuncSymbolTableEntry*)ste;
+        func_data.attrs |= func->func_data.attrs;
+        if (func_data.alignment == 0) {
+            func_data.alignment = func->func_data.alignment;
+        }
+    } else {
+        return redefinition(loader, ident);
+    }
+
+    SymbolTable* func_sym =
+        utlarena_alloc(loader->sym->arena, sizeof(SymbolTable));
+    symbol_table_init(func_sym, 0, NULL, 0, loader->sym->arena);
+    func_sym->parent = loader->sym;
+
+    // args are stored in reverse order
+    int arg_count = 0;
+    for (ArgList* arg = func_data.args; arg; arg = arg->next) {
+        arg_count++;
+    }
+
+    for (int i = 0; i < arg_count; i++) {
+        ArgList* arg = func_data.args;
+        for (int j = 0; j < arg_count - i - 1; j++) {
+            arg = arg->next;
+        }
+
+        Str arg_ident = intern(read_str(r));
+        if (r->error || symbol_table_find(func_sym, arg_ident, 1)) {
+            r->error = 1;
+            return NULL;
+        }
+        symbol_table_append_var(func_sym, arg_ident, 1, 0, arg->type,
+                                loader->pos);
+    }
+
+    if (is_large_type(func_data.return_type)) {
+        // space for hidden argument (return struct address)
+        func_sym->arg_offset += PTR_SIZE;
+    }
+
+    func->func_data = func_data;
+    func->func_sym = func_sym;
+    entry->ste = (SymbolTableEntry*)func;
+    return NULL;
+}
+
+static Error* load_type(PchLoader* loader, Str ident, SymbolTableEntry* ste,
+                        PchLoadedEntry* entry) {
+    PchReader* r = &loader->r;
+
+    TypeSymbolTableEntry* type_ste;
+    if (ste == NULL) {
+        type_ste = symbol_table_append_type(loader->sym, ident, loader->pos);
+    } else if (ste->type == SYM_TYPE &&
+               ((TypeSymbolTableEntry*)ste)->incomplete) {
+        type_ste = (TypeSymbolTableEntry*)ste;
+    } else {
+        return redefinition(loader, ident);
+    }
+    entry->ste = (SymbolTableEntry*)type_ste;
+
+    if (read_u32(r)) {
+        // Forward declaration
+        return NULL;
+    }
+
+    // Skip the fields until the struct is completed
+    entry->fields = r->p;
+    read_u32(r);
+    read_u32(r);
+    uint32_t field_count = read_u32(r);
+    for (uint32_t i = 0; i < field_count && !r->error; i++) {
+        read_str(r);
+        read_u32(r);
+        read_u32(r);
+    }
+
+    return NULL;
+}
+
+static Error* load_entry(PchLoader* loader, PchLoadedEntry* entry) {
+    PchReader* r = &loader->r;
+    SymbolType type = read_u32(r);
+    Str ident = intern(read_str(r));
+    if (r->error) {
+        return NULL;
+    }
+
+    SymbolTableEntry* ste = symbol_table_find(loader->sym, ident, 1);
+
+    switch (type) {
+        case SYM_VAR: {
+            if (ste != NULL) {
+                return redefinition(loader, ident);
+            }
+
+            SymbolAttr attr = read_u32(r);
+            const Type* data_type = get_complete_type(loader, read_u32(r));
+            if (r->error || data_type->incomplete) {
+                r->error = 1;
+                return NULL;
+            }
+            entry->ste = (SymbolTableEntry*)symbol_table_append_var(
+                loader->sym, ident, 0, attr, data_type, loader->pos);
+        } break;
+
+        case SYM_DEF: {
+            if (ste != NULL) {
+                return redefinition(loader, ident);
+            }
+
+            DefSymbolValue val = {0};
+            val.is_str = read_u32(r);
+            if (val.is_str) {
+                Str s = read_str(r);
+                char* copy = utlarena_alloc(loader->arena, s.len + 1);
+                memcpy(copy, s.ptr, s.len);
+                copy[s.len] = '\0';
+                val.str = (Str){copy, s.len};
+            } else {
+                val.val = read_u64(r);
+                val.data_type = read_u32(r);
+            }
+            entry->ste = (SymbolTableEntry*)symbol_table_append_def(
+                loader->sym, ident, val, loader->pos);
+        } break;
+
+        case SYM_FUNC:
+            return load_func(loader, ident, ste, entry);
+
+        case SYM_TYPE:
+            return load_type(loader, ident, ste, entry);
+
+        default:
+            r->error = 1;
+    }
+
+    return NULL;
+}
+
+static Error* load_decls(PPState* state, PchReader* r, const char* pch_path,
+                         SourcePos pos) {
+    PchLoader loader = {
+        .arena = state->arena,
+        .sym = state->pch_sym,
+        .pos = pos,
+    };
+
+    loader.type_count = read_u32(r);
+    loader.type_offsets =
+        read_block(r, (size_t)loader.type_count * sizeof(uint32_t));
+    uint32_t types_size = read_u32(r);
+    loader.type_records = read_block(r, types_size);
+    loader.types_end = loader.type_records + types_size;
+
+    // Each entry takes at least 8 bytes
+    loader.entry_count = read_u32(r);
+    if (r->error || loader.entry_count > (size_t)(r->end - r->p) / 8) {
+        return error(state->arena, pos, "invalid precompiled header %s",
+                     pch_path);
+    }
+    loader.r = *r;
+
+    UtlAllocator* allocator = state->temp_allocator;
+    size_t types_bytes = sizeof(Type*) * loader.type_count;
+    loader.types = allocator->alloc(allocator, types_bytes);
+    memset(loader.types, 0, types_bytes);
+
+    size_t entries_bytes = sizeof(PchLoadedEntry) * loader.entry_count;
+    loader.entries = allocator->alloc(allocator, entries_bytes);
+    memset(loader.entries, 0, entries_bytes);
+
+    Error* err = NULL;
+    for (uint32_t i = 0; i < loader.entry_count && !loader.r.error; i++) {
+        err = load_entry(&loader, &loader.entries[i]);
+        if (err != NULL) {
+            break;
+        }
+    }
+
+    // Structs nothing in the header needed the size of
+    for (uint32_t i = 0; i < loader.entry_count && err == NULL; i++) {
+        if (loader.entries[i].fields) {
+            complete_struct(&loader, &loader.entries[i]);
+        }
+    }
+
+    if (err == NULL && loader.r.error) {
+        err = error(state->arena, pos, "invalid precompiled header %s",
+                    pch_path);
+    }
+
+    allocator->free(allocator, loader.types);
+    allocator->free(allocator, loader.entries);
+    return err;
+}
+
+Error* pch_load(PPState* state, int header, const char* pch_path,
+                SourcePos pos, int* loaded) {
+    *loaded = 0;
+
+    size_t size;
+    char* data = read_entire_file(state->temp_allocator, pch_path, &size);
+    if (!data) {
+        return NULL;
+    }
+
+    Error* err = NULL;
+    PchReader r = {data, data + size, 0};
+    PP_IncludedFiles files = utlvector_init(state->temp_allocator);
+    if (pch_matches(state, &r, header, &files)) {
+        apply_defines(state, &r);
+        err = load_decls(state, &r, pch_path, pos);
+        add_included_files(state, header, &files);
+        *loaded = 1;
+    }
+
+    utlvector_deinit(&files);
+    state->temp_allocator->free(state->temp_allocator, data);
+    return err;
+}
@@ -0,0 +1,61 @@
+#ifndef PCH_H
+#define PCH_H
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "error.h"
+#include "preprocessor.h"
+#include "str.h"
+#include "symbol_table.h"
+
+/*
+ * A precompiled header holds the global declarations of a header after it is
+ * parsed, along with the #define state before and after preprocessing it.
+ * When a file is included for the first time and there is a precompiled
+ * header next to it (libc.ika and libc.ikapch), its declarations are loaded
+ * instead of preprocessing, lexing and parsing the file again, as long as the
+ * files it was built from, the defines and the target still match.
+ */
+
+#define PCH_EXT ".ikapch"
+
+typedef UtlVector(char) PchBuffer;
+typedef UtlVector(const Type*) PchTypes;
+typedef UtlVector(const SymbolTableEntry*) PchEntries;
+
+typedef struct PchWriter {
+    PchBuffer buf;           // everything before the declarations
+    PchBuffer type_offsets;  // offset of each type record
+    PchBuffer types;         // type records
+    PchBuffer entries;       // entry records
+    PchTypes type_list;
+    PchEntries entry_list;
+} PchWriter;
+
+// Start a precompiled header, defines is the preprocessor symbol table before
+// the header is preprocessed
+void pch_writer_init(PchWriter* writer, UtlArenaAllocator* arena,
+                     const SymbolTable* defines);
+
+// Record the files read by the preprocessor and the defines after it
+void pch_add_files(PchWriter* writer, const PPState* pp);
+
+// Record the global declarations of the parsed header
+Error* pch_add_decls(PchWriter* writer, UtlArenaAllocator* arena,
+                     const AST* ast, NodeIndex node, const SymbolTable* sym);
+
+// Returns 0 on success
+int pch_write(const PchWriter* writer, FILE* out);
+
+// Path of the precompiled header for the file at path
+char* pch_get_path(UtlAllocator* allocator, Str path);
+
+// Load the precompiled header at pch_path for the included file at index
+// header. If it matches, *loaded is set, the defines are updated, the
+// declarations are added to state->pch_sym and the files the header includes
+// are marked as included.
+Error* pch_load(PPState* state, int header, const char* pch_path,
+                SourcePos pos, int* loaded);
+
+#endif
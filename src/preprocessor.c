@@ -7,10 +7,80 @@
 #include <string.h>
 
 #include "error.h"
+#include "intern.h"
 #include "lexer.h"
+#include "pch.h"
 #include "symbol_table.h"
 #include "utils.h"
 
+#define PP_INDEX_MIN_SLOTS 8
+
+static void pp_index_insert_slot(PP_IndexSlot* slots, int slot_count,
+                                 PP_IndexSlot slot) {
+    unsigned int mask = slot_count - 1;
+    unsigned int i = (unsigned int)intern_hash(str(slot.key)) & mask;
+    while (slots[i].key != NULL) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = slot;
+}
+
+static void pp_index_grow(PPState* state, PP_Index* index) {
+    int slot_count = PP_INDEX_MIN_SLOTS;
+    while (slot_count < 4 * (index->used_count + 1)) {
+        slot_count *= 2;
+    }
+
+    UtlAllocator* allocator = state->temp_allocator;
+    PP_IndexSlot* slots =
+        allocator->alloc(allocator, slot_count * sizeof(PP_IndexSlot));
+    memset(slots, 0, slot_count * sizeof(PP_IndexSlot));
+
+    for (int i = 0; i < index->slot_count; i++) {
+        if (index->slots[i].key != NULL) {
+            pp_index_insert_slot(slots, slot_count, index->slots[i]);
+        }
+    }
+
+    allocator->free(allocator, index->slots);
+    index->slots = slots;
+    index->slot_count = slot_count;
+}
+
+static void pp_index_insert(PPState* state, PP_Index* index, Str key,
+                            int value) {
+    // Keep the load factor at most 3/4
+    if (4 * (index->used_count + 1) > 3 * index->slot_count) {
+        pp_index_grow(state, index);
+    }
+    PP_IndexSlot slot = {key.ptr, value};
+    pp_index_insert_slot(index->slots, index->slot_count, slot);
+    index->used_count++;
+}
+
+// Index stored for the interned key, or -1
+static int pp_index_find(const PP_Index* index, Str key) {
+    if (index->slot_count == 0) {
+        return -1;
+    }
+
+    unsigned int mask = index->slot_count - 1;
+    unsigned int i = (unsigned int)intern_hash(key) & mask;
+    while (index->slots[i].key != NULL) {
+        if (index->slots[i].key == key.ptr) {
+            return index->slots[i].index;
+        }
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+static void pp_index_deinit(PPState* state, PP_Index* index) {
+    UtlAllocator* allocator = state->temp_allocator;
+    allocator->free(allocator, index->slots);
+    *index = (PP_Index){0};
+}
+
 void pp_init(PPState* state, UtlArenaAllocator* arena,
              UtlAllocator* temp_allocator, const Paths* include_paths,
              SymbolTable* sym) {
@@ -18,10 +88,19 @@ void pp_init(PPState* state, UtlArenaAllocator* arena,
     state->temp_allocator = temp_allocator;
 
     state->src.files = (SourceFiles)utlvector_init(state->temp_allocator);
-    state->src.lines = NULL;
+    state->src.lines = (SourceRanges)utlvector_init(state->temp_allocator);
+    state->src.line_map = (SourceRanges)utlvector_init(state->temp_allocator);
+    state->src.size = 0;
+    state->included_files =
+        (PP_IncludedFiles)utlvector_init(state->temp_allocator);
+    state->included_file_index = (PP_Index){0};
+    state->include_lookups =
+        (PP_IncludeLookups)utlvector_init(state->temp_allocator);
+    state->include_lookup_index = (PP_Index){0};
 
     state->include_paths = include_paths;
     state->sym = sym;
+    state->pch_sym = NULL;
 }
 
 void pp_finalize(PPState* state) {
@@ -30,6 +109,22 @@ void pp_finalize(PPState* state) {
     utlvector_pushall(&new_files, state->src.files.data, state->src.files.size);
     utlvector_deinit(&state->src.files);
     state->src.files = new_files;
+
+    SourceRanges new_lines = utlvector_init(allocator);
+    utlvector_pushall(&new_lines, state->src.lines.data, state->src.lines.size);
+    utlvector_deinit(&state->src.lines);
+    state->src.lines = new_lines;
+
+    SourceRanges new_line_map = utlvector_init(allocator);
+    utlvector_pushall(&new_line_map, state->src.line_map.data,
+                      state->src.line_map.size);
+    utlvector_deinit(&state->src.line_map);
+    state->src.line_map = new_line_map;
+
+    utlvector_deinit(&state->included_files);
+    pp_index_deinit(state, &state->included_file_index);
+    utlvector_deinit(&state->include_lookups);
+    pp_index_deinit(state, &state->include_lookup_index);
 }
 
 static Error* error(UtlArenaAllocator* arena, SourcePos pos, const char* fmt,
@@ -65,13 +160,13 @@ typedef struct PP_ParserState {
 
 static void pp_parser_init(PP_ParserState* state, UtlArenaAllocator* arena,
                            UtlAllocator* temp_allocator, SymbolTable* sym,
-                           SourcePos pos) {
+                           const char* line, SourcePos pos) {
     state->arena = arena;
     state->temp_allocator = temp_allocator;
     state->sym = sym;
 
     state->line_pos = pos;
-    state->line = pos.line.content + pos.index;
+    state->line = line;
     state->pos = 0;
 
     state->prev_token_end = pos;
@@ -84,15 +179,18 @@ static const StrToken str_tf[] = {
     {"false", TK_FALSE},
 };
 
+static KeywordTable tf_table = KEYWORD_TABLE(str_tf);
+
 static Token pp_next_token_internal(PP_ParserState* state, int peek) {
     int start, end;
     Token tk = next_token_from_line(state->arena, state->temp_allocator,
-                                    state->line + state->pos, str_tf,
-                                    ARRAY_SIZE(str_tf), &start, &end);
+                                    state->line + state->pos, &tf_table,
+                                    &start, &end);
     if (!peek) {
         state->prev_token_end = state->token_end;
-        state->token_start.index = state->line_pos.index + state->pos + start;
-        state->token_end.index = state->line_pos.index + state->pos + end;
+        uint32_t offset = state->line_pos.offset + state->pos;
+        state->token_start.offset = offset + start;
+        state->token_end.offset = offset + end;
         state->pos += end;
     }
 
@@ -234,6 +332,7 @@ typedef enum PP_Type {
     PP_ENDIF,
     PP_WARNING,
     PP_ERROR,
+    PP_PRAGMA,
 } PP_Type;
 
 typedef struct PP_IfFrame {
@@ -252,107 +351,287 @@ static const StrToken str_pp[] = {
     {"include", PP_INCLUDE}, {"define", PP_DEFINE},   {"undef", PP_UNDEF},
     {"if", PP_IF},           {"elif", PP_ELIF},       {"else", PP_ELSE},
     {"endif", PP_ENDIF},     {"warning", PP_WARNING}, {"error", PP_ERROR},
+    {"pragma", PP_PRAGMA},
 };
 
-void read_lines(UtlAllocator* allocator, char* src, int file_index,
-                SourceLine** start, SourceLine** end) {
-    SourceLine* lines = NULL;
-    SourceLine* curr = NULL;
-
-    size_t pos = 0;
-    char c = *(src + pos);
-    int lineno = 1;
-    do {
-        size_t start_pos = pos;
-        while (c != '\n' && c != '\0') {
-            pos++;
-            c = *(src + pos);
-        }
+static KeywordTable pp_table = KEYWORD_TABLE(str_pp);
+
+typedef UtlVector(SourceLine) SourceLines;
+
+// Split the size bytes of src into lines, allocated together
+static SourceRange read_lines(PPState* state, const char* src, size_t size,
+                              int file_index) {
+    SourceState* src_state = &state->src;
+    const char* end = src + size;
 
-        size_t line_len = pos - start_pos;
-        SourceLine* line = allocator->alloc(allocator, sizeof(SourceLine));
-        line->next = NULL;
-        line->file_index = file_index;
-        line->lineno = lineno;
-        lineno++;
-
-        line->content = src + start_pos;
-        if (c != '\0') {
-            pos++;
-            c = *(src + pos);
+    SourceLines lines = utlvector_init(state->temp_allocator);
+    const char* p = src;
+    for (;;) {
+        const char* line_end = memchr(p, '\n', end - p);
+        if (!line_end) {
+            line_end = end;
         }
-        line->content[line_len] = '\0';
+
+        size_t line_len = line_end - p;
+        SourceLine line = {
+            .file_index = file_index,
+            .lineno = lines.size + 1,
+            .offset = src_state->size,
+            .content = p,
+        };
+        src_state->size += line_len + 1;
 
         // fix CRLF
-        if (line->content[line_len - 1] == '\r') {
-            line->content[line_len - 1] = '\0';
+        if (line_len > 0 && p[line_len - 1] == '\r') {
+            line_len--;
+        }
+        line.len = line_len;
+        utlvector_push(&lines, line);
+
+        // The last line has no line break, unless the file ends with one
+        if (line_end == end || line_end + 1 == end) {
+            break;
         }
+        p = line_end + 1;
+    }
+
+    // Copy to a buffer of the exact size in the arena
+    UtlAllocator* allocator = utlarena_allocator(state->arena);
+    SourceLine* data =
+        allocator->alloc(allocator, sizeof(SourceLine) * lines.size);
+    memcpy(data, lines.data, sizeof(SourceLine) * lines.size);
+
+    SourceRange range = {data, lines.size};
+    utlvector_deinit(&lines);
+    utlvector_push(&src_state->line_map, range);
+    return range;
+}
 
-        if (!lines) {
-            lines = line;
-            curr = line;
-        } else {
-            curr->next = line;
-            curr = line;
+// Append a line to the preprocessed lines
+static void emit_line(SourceState* src_state, const SourceLine* line) {
+    if (src_state->lines.size > 0) {
+        SourceRange* last = &src_state->lines.data[src_state->lines.size - 1];
+        if (last->lines + last->count == line) {
+            last->count++;
+            return;
         }
-    } while (c != '\0');
+    }
+
+    SourceRange range = {line, 1};
+    utlvector_push(&src_state->lines, range);
+}
 
-    *start = lines;
-    *end = curr;
+typedef enum PP_GuardState {
+    PP_GUARD_START,   // only blank lines so far
+    PP_GUARD_OPEN,    // inside the #if !GUARD
+    PP_GUARD_CLOSED,  // after its #endif
+    PP_GUARD_NONE,    // the file is not wrapped in a guard
+} PP_GuardState;
+
+typedef struct PP_IncludeFrame {
+    SourceRange file;
+    size_t index;       // next line
+    int included_file;  // index into included_files
+
+    PP_GuardState guard_state;
+    Str guard;
+    size_t guard_depth;  // size of the if stack outside the guard
+} PP_IncludeFrame;
+
+Str pp_get_real_path(Str path) {
+    char* real_path = get_real_path(path.ptr);
+    if (!real_path) {
+        return path;
+    }
+    Str result = intern(str(real_path));
+    free(real_path);
+    return result;
+}
+
+int pp_find_included_file(const PPState* state, Str real_path) {
+    return pp_index_find(&state->included_file_index, real_path);
+}
+
+int pp_add_included_file(PPState* state, PP_IncludedFile file) {
+    int index = state->included_files.size;
+    utlvector_push(&state->included_files, file);
+    pp_index_insert(state, &state->included_file_index, file.real_path, index);
+    return index;
+}
+
+static int add_included_file(PPState* state, Str path, Str real_path,
+                             const char* src, size_t size) {
+    PP_IncludedFile file = {
+        .path = path,
+        .real_path = real_path,
+        .src = src,
+        .size = size,
+    };
+    return pp_add_included_file(state, file);
+}
+
+// Interned dir/name
+static Str join_path(PPState* state, Str dir, Str name) {
+    UtlAllocator* allocator = state->temp_allocator;
+    int size = dir.len + (int)strlen(OS_PATH_SEP) + name.len;
+    char* buf = allocator->alloc(allocator, size + 1);
+    snprintf(buf, size + 1, "%.*s" OS_PATH_SEP "%.*s", dir.len, dir.ptr,
+             name.len, name.ptr);
+    Str path = intern((Str){buf, size});
+    allocator->free(allocator, buf);
+    return path;
+}
+
+// First include path with the file, or an empty Str. The include paths are
+// the same for every #include, so they are only checked once for each name.
+static Str find_in_include_paths(PPState* state, Str name) {
+    name = intern(name);
+    int index = pp_index_find(&state->include_lookup_index, name);
+    if (index >= 0) {
+        return state->include_lookups.data[index].path;
+    }
+
+    PP_IncludeLookup lookup = {
+        .name = name,
+    };
+    for (size_t i = 0; i < state->include_paths->size; i++) {
+        Str path = join_path(state, str(state->include_paths->data[i]), name);
+        if (file_is_readable(path.ptr)) {
+            lookup.path = path;
+            break;
+        }
+    }
+    pp_index_insert(state, &state->include_lookup_index, name,
+                    state->include_lookups.size);
+    utlvector_push(&state->include_lookups, lookup);
+    return lookup.path;
+}
+
+// Load the precompiled header next to the included file instead of the file,
+// if there is one that is up to date
+static Error* include_pch(PPState* state, int included_file, SourcePos pos,
+                          int* loaded) {
+    UtlAllocator* allocator = state->temp_allocator;
+    Str path = state->included_files.data[included_file].path;
+    char* pch_path = pch_get_path(allocator, path);
+
+    Error* err = NULL;
+    if (file_is_readable(pch_path)) {
+        err = pch_load(state, included_file, pch_path, pos, loaded);
+    }
+
+    allocator->free(allocator, pch_path);
+    return err;
+}
+
+// Is the #if expression just !GUARD
+static int is_guard_expr(PP_ParserState parser, Str* guard) {
+    if (pp_next_token(&parser).type != TK_LNOT) {
+        return 0;
+    }
+
+    Token tk = pp_next_token(&parser);
+    if (tk.type != TK_IDENT || pp_next_token(&parser).type != TK_EOF) {
+        return 0;
+    }
+
+    *guard = tk.str;
+    return 1;
+}
+
+// Follow a non-blank line of the file to see if the whole file is inside an
+// #if !GUARD, so that later includes can be skipped while GUARD is defined
+static void update_guard(PP_IncludeFrame* frame, PP_Type type,
+                         const PP_ParserState* parser, size_t if_depth) {
+    switch (frame->guard_state) {
+        case PP_GUARD_START:
+            frame->guard_state = PP_GUARD_NONE;
+            if (type == PP_IF && is_guard_expr(*parser, &frame->guard)) {
+                frame->guard_state = PP_GUARD_OPEN;
+                frame->guard_depth = if_depth;
+            }
+            break;
+
+        case PP_GUARD_OPEN:
+            if (if_depth != frame->guard_depth + 1) {
+                break;
+            }
+            if (type == PP_ELIF || type == PP_ELSE) {
+                frame->guard_state = PP_GUARD_NONE;
+            } else if (type == PP_ENDIF) {
+                frame->guard_state = PP_GUARD_CLOSED;
+            }
+            break;
+
+        case PP_GUARD_CLOSED:
+            frame->guard_state = PP_GUARD_NONE;
+            break;
+
+        case PP_GUARD_NONE:
+            break;
+    }
 }
 
 Error* pp_expand(PPState* state, const char* filename) {
+    Str main_path = intern(str(filename));
+
     SourceFile orig_file = {0};
-    size_t size = strlen(filename) + 1;
-    orig_file.filename = utlarena_alloc(state->arena, size);
-    memcpy(orig_file.filename, filename, size);
-    orig_file.pos.index = 0;
+    orig_file.filename = main_path.ptr;
     orig_file.is_open = 0;
     utlvector_push(&state->src.files, orig_file);
 
     UtlAllocator* allocator = utlarena_allocator(state->arena);
-    char* src = read_entire_file(allocator, filename);
+    size_t size;
+    const char* src = map_entire_file(allocator, filename, &size);
     if (!src) {
         return error(state->arena, state->src.files.data[0].pos,
                      "failed to read file: %s", strerror(errno));
     }
     state->src.files.data[0].is_open = 1;
 
-    SourceLine* start;
-    SourceLine* end;
-    read_lines(allocator, src, 0, &start, &end);
-    state->src.lines = start;
-
     int include_depth = 0;
-    SourceLine* include_stack[MAX_INCLUDE_DEPTH];
-
-    SourceLine* prev_line = NULL;
-    SourceLine* line = start;
+    PP_IncludeFrame include_stack[MAX_INCLUDE_DEPTH + 1];
+    include_stack[0] = (PP_IncludeFrame){
+        .file = read_lines(state, src, size, 0),
+        .included_file = add_included_file(
+            state, main_path, pp_get_real_path(main_path), src, size),
+    };
 
     Error* err = NULL;
     UtlVector(PP_IfFrame) if_stack = utlvector_init(state->temp_allocator);
 
-    while (line) {
-        if (include_depth > 0 && line == include_stack[include_depth - 1]) {
+    while (1) {
+        PP_IncludeFrame* frame = &include_stack[include_depth];
+        if (frame->index == frame->file.count) {
+            if (frame->guard_state == PP_GUARD_CLOSED) {
+                state->included_files.data[frame->included_file].guard =
+                    frame->guard;
+            }
+            if (include_depth == 0) {
+                break;
+            }
             include_depth--;
+            continue;
         }
+        const SourceLine* line = &frame->file.lines[frame->index++];
 
         int is_active = (if_stack.size == 0 ||
                          if_stack.data[if_stack.size - 1].this_active);
 
         // process line
-        char* p = line->content;
+        const char* p = line->content;
 
         while (*p == ' ' || *p == '\t') {
             p++;
         }
 
         if (*p != '#') {
-            if (!is_active) {
-                goto remove_line;
+            if (!is_line_end(p) && !(p[0] == '/' && p[1] == '/')) {
+                update_guard(frame, PP_NONE, NULL, if_stack.size);
+            }
+            if (is_active) {
+                emit_line(&state->src, line);
             }
-            prev_line = line;
-            line = line->next;
             continue;
         }
         p++;
@@ -361,27 +640,25 @@ Error* pp_expand(PPState* state, const char* filename) {
             p++;
         }
 
-        SourcePos pp_start_pos;
-        pp_start_pos.line = *line;
-        pp_start_pos.index = p - line->content;
+        SourcePos pp_start_pos = source_pos(line, p - line->content);
+
+        Str directive = {p, 0};
+        while (p[directive.len] >= 'a' && p[directive.len] <= 'z') {
+            directive.len++;
+        }
 
         PP_Type pp_type = PP_NONE;
-        for (unsigned int i = 0; i < ARRAY_SIZE(str_pp); i++) {
-            int pp_len = strlen(str_pp[i].s);
-            if (strncmp(str_pp[i].s, p, pp_len) == 0) {
-                pp_type = str_pp[i].token_type;
-                p += pp_len;
-                break;
-            }
+        int pp_found = keyword_find(&pp_table, directive);
+        if (pp_found >= 0) {
+            pp_type = pp_found;
+            p += directive.len;
         }
 
-        SourcePos curr_pos;
-        curr_pos.line = *line;
-        curr_pos.index = p - line->content;
+        SourcePos curr_pos = source_pos(line, p - line->content);
 
         if (pp_type == PP_NONE) {
             if (!is_active) {
-                goto remove_line;
+                continue;
             }
             err = error(state->arena, curr_pos,
                         "invalid preprocessing directive");
@@ -390,7 +667,8 @@ Error* pp_expand(PPState* state, const char* filename) {
 
         PP_ParserState parser;
         pp_parser_init(&parser, state->arena, state->temp_allocator, state->sym,
-                       curr_pos);
+                       p, curr_pos);
+        update_guard(frame, pp_type, &parser, if_stack.size);
 
 #define PP_NO_MORE_TOKENS()                                             \
     do {                                                                \
@@ -430,59 +708,65 @@ Error* pp_expand(PPState* state, const char* filename) {
                     goto defer;
                 }
 
-                char inc_path[OS_PATH_MAX];
-                int inc_path_size = 0;
-                for (size_t i = 0; i < state->include_paths->size; i++) {
-                    int path_size = snprintf(
-                        inc_path, sizeof(inc_path), "%s" OS_PATH_SEP "%.*s",
-                        state->include_paths->data[i], tk.str.len, tk.str.ptr);
-                    if (file_is_readable(inc_path)) {
-                        inc_path_size = path_size;
-                        break;
-                    }
-                }
-
-                if (inc_path_size <= 0) {
+                Str path = find_in_include_paths(state, tk.str);
+                if (path.len == 0) {
                     Str dir = get_dir_name(
                         str(state->src.files.data[line->file_index].filename));
                     if (str_eql(dir, str("."))) {
-                        inc_path_size =
-                            snprintf(inc_path, sizeof(inc_path), "%.*s",
-                                     tk.str.len, tk.str.ptr);
+                        path = intern(tk.str);
                     } else {
-                        inc_path_size =
-                            snprintf(inc_path, sizeof(inc_path),
-                                     "%.*s" OS_PATH_SEP "%.*s", dir.len,
-                                     dir.ptr, tk.str.len, tk.str.ptr);
+                        path = join_path(state, dir, tk.str);
                     }
                 }
 
-                assert(inc_path_size > 0);
+                Str real_path = pp_get_real_path(path);
+                int included_file = pp_find_included_file(state, real_path);
+                if (included_file >= 0) {
+                    const PP_IncludedFile* f =
+                        &state->included_files.data[included_file];
+                    if (f->once ||
+                        (f->guard.ptr &&
+                         symbol_table_find(state->sym, f->guard, 1))) {
+                        break;
+                    }
+                    src = f->src;
+                    size = f->size;
+                } else {
+                    src = map_entire_file(allocator, path.ptr, &size);
+                    if (!src) {
+                        err = error(state->arena, str_pos,
+                                    "failed to read file: %s", strerror(errno));
+                        goto defer;
+                    }
+                    included_file = add_included_file(state, path, real_path,
+                                                      src, size);
+
+                    if (state->pch_sym) {
+                        int loaded = 0;
+                        err = include_pch(state, included_file, str_pos,
+                                          &loaded);
+                        if (err != NULL) {
+                            goto defer;
+                        }
+                        if (loaded) {
+                            break;
+                        }
+                    }
+                }
 
                 SourceFile file = {0};
-                file.filename = utlarena_alloc(state->arena, inc_path_size);
-                memcpy(file.filename, inc_path, inc_path_size);
+                file.filename = path.ptr;
                 file.pos = parser.token_start;
-                file.is_open = 0;
+                file.is_open = 1;
 
                 size_t file_index = state->src.files.size;
                 utlvector_push(&state->src.files, file);
 
-                src = read_entire_file(allocator, inc_path);
-                if (!src) {
-                    err = error(state->arena, str_pos,
-                                "failed to read file: %s", strerror(errno));
-                    goto defer;
-                }
-
-                state->src.files.data[file_index].is_open = 1;
-
-                read_lines(allocator, src, file_index, &start, &end);
-                include_stack[include_depth] = end;
                 include_depth++;
-
-                end->next = line->next;
-                line->next = start;
+                include_stack[include_depth] = (PP_IncludeFrame){
+                    .file = read_lines(state, src, size, file_index),
+                    .included_file = included_file,
+                };
             } break;
 
             case PP_DEFINE: {
@@ -627,7 +911,8 @@ Error* pp_expand(PPState* state, const char* filename) {
                 while (*p == ' ' || *p == '\t') {
                     p++;
                 }
-                err = error(state->arena, pp_start_pos, "%s", p);
+                err = error(state->arena, pp_start_pos, "%.*s",
+                            (int)(line->content + line->len - p), p);
                 goto defer;
 
             case PP_WARNING:
@@ -639,20 +924,28 @@ Error* pp_expand(PPState* state, const char* filename) {
                     p++;
                 }
                 print_warn(&state->src,
-                           error(state->arena, pp_start_pos, "%s", p));
+                           error(state->arena, pp_start_pos, "%.*s",
+                                 (int)(line->content + line->len - p), p));
                 break;
 
+            case PP_PRAGMA: {
+                if (!is_active) {
+                    break;
+                }
+
+                // Unknown pragmas are ignored
+                Token tk = pp_next_token(&parser);
+                if (tk.type == TK_IDENT && str_eql(tk.str, str("once"))) {
+                    PP_NO_MORE_TOKENS();
+                    int included_file =
+                        include_stack[include_depth].included_file;
+                    state->included_files.data[included_file].once = 1;
+                }
+            } break;
+
             default:
                 UNREACHABLE();
         }
-
-    remove_line:
-        if (!prev_line) {
-            state->src.lines = line->next;
-        } else {
-            prev_line->next = line->next;
-        }
-        line = line->next;
     }
 
     if (if_stack.size != 0) {
@@ -2,6 +2,7 @@
 #define PREPROCESSOR_H
 
 #include "source.h"
+#include "str.h"
 #include "utl/allocator/utlarena.h"
 
 #define MAX_INCLUDE_DEPTH 15
@@ -10,13 +11,53 @@ struct SymbolTable;
 
 typedef UtlVector(const char*) Paths;
 
+// A file read by the preprocessor, reused when the same file is included again
+typedef struct PP_IncludedFile {
+    Str path;       // interned, as spelled by the first #include
+    Str real_path;  // interned, the same for every path to the file
+    const char* src;
+    size_t size;
+    Str guard;  // macro of an #if !GUARD wrapping the whole file, if any
+    int once;   // has #pragma once
+} PP_IncludedFile;
+
+typedef UtlVector(PP_IncludedFile) PP_IncludedFiles;
+
+typedef struct PP_IndexSlot {
+    const char* key;  // interned, NULL if the slot is empty
+    int index;
+} PP_IndexSlot;
+
+// Open addressing hash table from interned strings to indices into a vector
+typedef struct PP_Index {
+    PP_IndexSlot* slots;
+    int slot_count;
+    int used_count;
+} PP_Index;
+
+// Where the include paths have a file, looked up once per #include name
+typedef struct PP_IncludeLookup {
+    Str name;  // interned
+    Str path;  // interned, or empty if no include path has the file
+} PP_IncludeLookup;
+
+typedef UtlVector(PP_IncludeLookup) PP_IncludeLookups;
+
 typedef struct PPState {
     UtlArenaAllocator* arena;
     UtlAllocator* temp_allocator;
     SourceState src;
+    PP_IncludedFiles included_files;
+    PP_Index included_file_index;  // by real_path
+    PP_IncludeLookups include_lookups;
+    PP_Index include_lookup_index;  // by name
 
     const Paths* include_paths;
     struct SymbolTable* sym;  // for #define
+
+    // Global symbol table for declarations from precompiled headers, NULL to
+    // always include the files themselves
+    struct SymbolTable* pch_sym;
 } PPState;
 
 struct SymbolTable;
@@ -27,6 +68,15 @@ void pp_init(PPState* state, UtlArenaAllocator* arena,
 
 void pp_finalize(PPState* state);
 
+// Interned real path of the file, or the path itself if it can't be resolved
+Str pp_get_real_path(Str path);
+
+// Index of the included file with the interned real path, or -1
+int pp_find_included_file(const PPState* state, Str real_path);
+
+// Add a file to the included files and return its index
+int pp_add_included_file(PPState* state, PP_IncludedFile file);
+
 struct Error;
 
 struct Error* pp_expand(PPState* state, const char* filename);
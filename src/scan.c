@@ -0,0 +1,26 @@
+#include "scan.h"
+
+#define S SCAN_STRING
+#define B (SCAN_BLANK | S)
+#define I (SCAN_IDENT | S)
+#define D (SCAN_DIGIT | I)
+
+// Classes of every byte, 16 per row
+const unsigned char scan_classes[256] = {
+    0, S, S, S, S, S, S, S, S, B, 0, S, S, 0, S, S,  // 0x00
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0x10
+    B, S, 0, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0x20
+    D, D, D, D, D, D, D, D, D, D, S, S, S, S, S, S,  // 0x30
+    S, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  // 0x40
+    I, I, I, I, I, I, I, I, I, I, I, S, 0, S, S, I,  // 0x50
+    S, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  // 0x60
+    I, I, I, I, I, I, I, I, I, I, I, S, S, S, S, S,  // 0x70
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0x80
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0x90
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0xa0
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0xb0
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0xc0
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0xd0
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0xe0
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,  // 0xf0
+};
@@ -0,0 +1,150 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * Find the end of a run of blanks, identifier characters, digits or plain
+ * string literal characters. Short runs are scanned with a class table,
+ * longer ones a whole vector at a time where SSE2 or AVX2 is available. The
+ * vector loads are aligned, so they never cross into a page past the one
+ * holding the character that ends the run. The text has to end with a
+ * character outside the class, like the '\0' after the contents of a source
+ * file.
+ */
+
+#define SCAN_BLANK 0x1
+#define SCAN_IDENT 0x2  // letters, digits and '_'
+#define SCAN_DIGIT 0x4
+#define SCAN_STRING 0x8  // anything but '"', '\\', '\0', '\n' and '\r'
+
+// Runs at most this long are scanned one character at a time
+#define SCAN_SHORT_RUN 8
+
+extern const unsigned char scan_classes[256];
+
+static inline int scan_is(char c, int class) {
+    return scan_classes[(unsigned char)c] & class;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+#include <immintrin.h>
+
+#ifdef __AVX2__
+#define SCAN_WIDTH 32
+#define SCAN_ALL 0xffffffffu
+typedef __m256i ScanVec;
+#define scan_load(p) _mm256_load_si256((const __m256i*)(p))
+#define scan_set1 _mm256_set1_epi8
+#define scan_or _mm256_or_si256
+#define scan_eq _mm256_cmpeq_epi8
+#define scan_sub _mm256_sub_epi8
+#define scan_min _mm256_min_epu8
+#define scan_zero _mm256_setzero_si256
+#define scan_mask(v) ((uint32_t)_mm256_movemask_epi8(v))
+#else
+#define SCAN_WIDTH 16
+#define SCAN_ALL 0xffffu
+typedef __m128i ScanVec;
+#define scan_load(p) _mm_load_si128((const __m128i*)(p))
+#define scan_set1 _mm_set1_epi8
+#define scan_or _mm_or_si128
+#define scan_eq _mm_cmpeq_epi8
+#define scan_sub _mm_sub_epi8
+#define scan_min _mm_min_epu8
+#define scan_zero _mm_setzero_si128
+#define scan_mask(v) ((uint32_t)_mm_movemask_epi8(v))
+#endif
+
+// Bytes in [lo, hi] as an unsigned comparison
+static inline ScanVec scan_in_range(ScanVec c, char lo, char hi) {
+    ScanVec x = scan_sub(c, scan_set1(lo));
+    return scan_eq(scan_min(x, scan_set1(hi - lo)), x);
+}
+
+static inline ScanVec scan_vec_class(ScanVec c, int class) {
+    switch (class) {
+        case SCAN_BLANK:
+            return scan_or(scan_eq(c, scan_set1(' ')),
+                           scan_eq(c, scan_set1('\t')));
+
+        case SCAN_IDENT: {
+            ScanVec lower = scan_or(c, scan_set1(0x20));
+            return scan_or(scan_or(scan_in_range(lower, 'a', 'z'),
+                                   scan_in_range(c, '0', '9')),
+                           scan_eq(c, scan_set1('_')));
+        }
+
+        case SCAN_DIGIT:
+            return scan_in_range(c, '0', '9');
+
+        case SCAN_STRING: {
+            ScanVec quote = scan_or(scan_eq(c, scan_set1('"')),
+                                    scan_eq(c, scan_set1('\\')));
+            ScanVec end = scan_or(scan_or(scan_eq(c, scan_zero()),
+                                          scan_eq(c, scan_set1('\n'))),
+                                  scan_eq(c, scan_set1('\r')));
+            return scan_eq(scan_or(quote, end), scan_zero());
+        }
+
+        default:
+            UNREACHABLE();
+    }
+}
+
+static inline const char* scan_run(const char* p, int class) {
+    for (int i = 0; i < SCAN_SHORT_RUN; i++) {
+        if (!scan_is(*p, class)) {
+            return p;
+        }
+        p++;
+    }
+
+    uintptr_t skip = (uintptr_t)p % SCAN_WIDTH;
+    const char* block = p - skip;
+    uint32_t stop = ~scan_mask(scan_vec_class(scan_load(block), class));
+    stop = (stop & SCAN_ALL) >> skip;
+    if (stop != 0) {
+        return p + __builtin_ctz(stop);
+    }
+
+    while (1) {
+        block += SCAN_WIDTH;
+        stop = ~scan_mask(scan_vec_class(scan_load(block), class)) & SCAN_ALL;
+        if (stop != 0) {
+            return block + __builtin_ctz(stop);
+        }
+    }
+}
+
+#else
+
+static inline const char* scan_run(const char* p, int class) {
+    while (scan_is(*p, class)) {
+        p++;
+    }
+    return p;
+}
+
+#endif
+
+static inline const char* scan_blanks(const char* p) {
+    return scan_run(p, SCAN_BLANK);
+}
+
+static inline const char* scan_ident(const char* p) {
+    return scan_run(p, SCAN_IDENT);
+}
+
+static inline const char* scan_digits(const char* p) {
+    return scan_run(p, SCAN_DIGIT);
+}
+
+static inline const char* scan_string(const char* p) {
+    return scan_run(p, SCAN_STRING);
+}
+
+#endif
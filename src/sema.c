@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "abi.h"
+
 static Error* error(SemaState* state, SourcePos pos, const char* fmt, ...) {
     Error* result = utlarena_alloc(state->arena, sizeof(Error));
     result->pos = pos;
@@ -16,115 +18,138 @@ static Error* error(SemaState* state, SourcePos pos, const char* fmt, ...) {
     return result;
 }
 
-static Error* type_check_node(SemaState* state, ASTNode* node);
+static Error* type_check_node(SemaState* state, NodeIndex node);
+
+static inline const Type* type_of(SemaState* state, NodeIndex node) {
+    return ast_type_info(state->ast, node).type;
+}
+
+// Float literals are f64, they are converted at compile time instead
+static void convert_float_lit(SemaState* state, NodeIndex node,
+                              const Type* type) {
+    if (ast_node_type(state->ast, node) != NODE_FLOATLIT || !is_float(type)) {
+        return;
+    }
+
+    FloatLitNode lit = ast_floatlit(state->ast, node);
+    lit.data_type = type->primitive_type;
+    ast_set_floatlit(state->ast, node, lit);
+
+    TypeInfo info = ast_type_info(state->ast, node);
+    info.type = type;
+    ast_set_type_info(state->ast, node, info);
+}
 
-static Error* type_check_stmts(SemaState* state, StatementListNode* stmts) {
-    ASTNodeList* iter = stmts->stmts;
-    while (iter) {
-        Error* err = type_check_node(state, iter->node);
+static Error* type_check_stmts(SemaState* state, NodeIndex node) {
+    StatementListNode stmts = ast_stmts(state->ast, node);
+    for (int i = 0; i < stmts.stmts.count; i++) {
+        Error* err = type_check_node(state, stmts.stmts.nodes[i]);
         if (err != NULL) {
             return err;
         }
-
-        iter = iter->next;
     }
 
     return NULL;
 }
 
-static Error* type_check_binop(SemaState* state, BinaryOpNode* binop) {
-    Error* err = type_check_node(state, binop->left);
+static Error* type_check_binop(SemaState* state, NodeIndex node) {
+    BinaryOpNode binop = ast_binop(state->ast, node);
+    SourcePos pos = ast_pos(state->ast, node);
+    TypeInfo info = {0};
+
+    Error* err = type_check_node(state, binop.left);
     if (err != NULL) {
         return err;
     }
 
-    if (binop->op == TK_COMMA) {
-        err = type_check_node(state, binop->right);
+    if (binop.op == TK_COMMA) {
+        err = type_check_node(state, binop.right);
         if (err != NULL) {
             return err;
         }
 
-        binop->type_info = as_typed_ast(binop->right)->type_info;
+        ast_set_type_info(state->ast, node,
+                          ast_type_info(state->ast, binop.right));
         return NULL;
     }
 
-    const Type* l_type = &(as_typed_ast(binop->left)->type_info.type);
-    if (!(is_bool(l_type) || is_int(l_type) || is_ptr_like(l_type))) {
-        return error(state, binop->pos,
-                     "invalid left operand to do binary operation");
+    const Type* l_type = type_of(state, binop.left);
+    if (!(is_bool(l_type) || is_arithmetic(l_type) || is_ptr_like(l_type))) {
+        return error(state, pos, "invalid left operand to do binary operation");
     }
 
     if (is_bool(l_type)) {
         // Boolean operations
-        if (binop->op == TK_EQ || binop->op == TK_NE) {
-            err = type_check_node(state, binop->right);
+        if (binop.op == TK_EQ || binop.op == TK_NE) {
+            err = type_check_node(state, binop.right);
             if (err != NULL) {
                 return err;
             }
 
-            const Type* r_type = &(as_typed_ast(binop->right)->type_info.type);
+            const Type* r_type = type_of(state, binop.right);
             if (!is_bool(r_type)) {
-                return error(state, binop->pos,
+                return error(state, pos,
                              "invalid right operand to do boolean operation");
             }
         } else {
-            if (binop->op != TK_LOR && binop->op != TK_LAND) {
-                return error(state, binop->pos, "invalid boolean operator");
+            if (binop.op != TK_LOR && binop.op != TK_LAND) {
+                return error(state, pos, "invalid boolean operator");
             }
 
-            err = type_check_node(state, binop->right);
+            err = type_check_node(state, binop.right);
             if (err != NULL) {
                 return err;
             }
 
-            const Type* r_type = &(as_typed_ast(binop->right)->type_info.type);
+            const Type* r_type = type_of(state, binop.right);
             if (!is_bool(r_type)) {
-                return error(state, binop->pos,
+                return error(state, pos,
                              "invalid right operand to do boolean operation");
             }
         }
-        binop->type_info.is_lvalue = 0;
-        binop->type_info.is_address = 0;
-        binop->type_info.type = *get_primitive_type(TYPE_BOOL);
+        info.type = get_primitive_type(TYPE_BOOL);
     } else {
-        err = type_check_node(state, binop->right);
+        err = type_check_node(state, binop.right);
         if (err != NULL) {
             return err;
         }
 
-        const Type* r_type = &(as_typed_ast(binop->right)->type_info.type);
-        if (!is_int(r_type) && !is_ptr_like(r_type)) {
-            return error(state, binop->pos,
+        const Type* r_type = type_of(state, binop.right);
+        if (!is_arithmetic(r_type) && !is_ptr_like(r_type)) {
+            return error(state, pos,
                          "invalid right operand to do binary operation");
         }
 
-        // At this point, both operands are either pointer or integer.
-        switch (binop->op) {
+        // At this point, both operands are either pointer or number.
+        convert_float_lit(state, binop.left, r_type);
+        convert_float_lit(state, binop.right, l_type);
+
+        switch (binop.op) {
             case TK_ADD:
             case TK_SUB: {
                 int l_ptr = is_array_ptr(l_type);
                 int r_ptr = is_array_ptr(r_type);
 
                 if (l_ptr || r_ptr) {  // Pointers
-                    if (l_ptr && r_ptr) {
-                        return error(state, binop->pos,
+                    if ((l_ptr && r_ptr) || is_float(l_type) ||
+                        is_float(r_type)) {
+                        return error(state, pos,
                                      "invalid operands to do binary operation");
                     }
 
                     const Type* p_type = l_ptr ? l_type : r_type;
                     if (!is_void(p_type->inner_type) &&
                         p_type->inner_type->incomplete) {
-                        return error(state, binop->pos,
-                                     "use of incomplete tyoe");
+                        return error(state, pos, "use of incomplete tyoe");
                     }
 
-                    binop->type_info.type = *p_type;
-                } else if (is_int(l_type) && is_int(r_type)) {  // Integers
-                    binop->type_info.type =
-                        *get_primitive_type(implicit_type_convert(
-                            l_type->primitive_type, r_type->primitive_type));
+                    info.type = p_type;
+                } else if (is_arithmetic(l_type) &&
+                           is_arithmetic(r_type)) {  // Numbers
+                    info.type = get_primitive_type(implicit_type_convert(
+                        l_type->primitive_type, r_type->primitive_type));
                 } else {
-                    return error(state, binop->pos,
+                    return error(state, pos,
                                  "invalid operands to do binary operation");
                 }
             } break;
@@ -136,8 +161,8 @@ static Error* type_check_binop(SemaState* state, BinaryOpNode* binop) {
             case TK_GT:
             case TK_GE: {
                 int is_valid_types = 0;
-                if (binop->op == TK_EQ || binop->op == TK_NE) {
-                    if (is_int(l_type) && is_int(r_type)) {
+                if (binop.op == TK_EQ || binop.op == TK_NE) {
+                    if (is_arithmetic(l_type) && is_arithmetic(r_type)) {
                         is_valid_types = 1;
                     } else if (is_void_ptr(l_type) && is_ptr_like(r_type)) {
                         is_valid_types = 1;
@@ -147,7 +172,7 @@ static Error* type_check_binop(SemaState* state, BinaryOpNode* binop) {
                         is_valid_types = 1;
                     }
                 } else {
-                    if (is_int(l_type) && is_int(r_type)) {
+                    if (is_arithmetic(l_type) && is_arithmetic(r_type)) {
                         is_valid_types = 1;
                     } else if (is_array_ptr(l_type) &&
                                is_equal_type(l_type, r_type)) {
@@ -156,109 +181,110 @@ static Error* type_check_binop(SemaState* state, BinaryOpNode* binop) {
                 }
 
                 if (!is_valid_types) {
-                    return error(state, binop->pos,
+                    return error(state, pos,
                                  "invalid operands for comparison operation");
                 }
-                binop->type_info.type = *get_primitive_type(TYPE_BOOL);
+                info.type = get_primitive_type(TYPE_BOOL);
+            } break;
+
+            case TK_MUL:
+            case TK_DIV: {
+                if (!is_arithmetic(l_type) || !is_arithmetic(r_type)) {
+                    return error(state, pos,
+                                 "invalid operands to do binary operation");
+                }
+
+                PrimitiveType result_type = implicit_type_convert(
+                    l_type->primitive_type, r_type->primitive_type);
+                info.type = get_primitive_type(result_type);
             } break;
 
             default: {
                 if (!is_int(l_type) || !is_int(r_type)) {
-                    return error(state, binop->pos,
+                    return error(state, pos,
                                  "invalid operands to do binary operation");
                 }
 
                 PrimitiveType result_type = implicit_type_convert(
                     l_type->primitive_type, r_type->primitive_type);
-                binop->type_info.type = *get_primitive_type(result_type);
+                info.type = get_primitive_type(result_type);
             }
         }
-        binop->type_info.is_lvalue = 0;
-        binop->type_info.is_address = 0;
     }
 
+    ast_set_type_info(state->ast, node, info);
     return NULL;
 }
 
-static Error* type_check_unaryop(SemaState* state, UnaryOpNode* unaryop) {
-    Error* err = type_check_node(state, unaryop->node);
+static Error* type_check_unaryop(SemaState* state, NodeIndex node) {
+    UnaryOpNode unaryop = ast_unaryop(state->ast, node);
+    SourcePos pos = ast_pos(state->ast, node);
+
+    Error* err = type_check_node(state, unaryop.node);
     if (err != NULL) {
         return err;
     }
 
-    const TypedASTNode* node = as_typed_ast(unaryop->node);
-    int is_lvalue = node->type_info.is_lvalue;
-    const Type* type = &node->type_info.type;
+    TypeInfo operand = ast_type_info(state->ast, unaryop.node);
+    int is_lvalue = operand.is_lvalue;
+    const Type* type = operand.type;
 
-    unaryop->type_info.is_lvalue = 0;
-    unaryop->type_info.is_address = 0;
-    unaryop->type_info.type = *type;
+    TypeInfo info = {0};
+    info.type = type;
 
-    switch (unaryop->op) {
+    switch (unaryop.op) {
         case TK_ADD:
-            if (!is_int(type)) {
-                return error(state, unaryop->pos,
-                             "invalid type to do unary operation");
+            if (!is_arithmetic(type)) {
+                return error(state, pos, "invalid type to do unary operation");
             }
             break;
 
         case TK_SUB:
-            if (!is_int(type)) {
-                return error(state, unaryop->pos,
-                             "invalid type to do unary operation");
+            if (!is_arithmetic(type)) {
+                return error(state, pos, "invalid type to do unary operation");
             }
             break;
 
         case TK_NOT:
             if (!is_int(type)) {
-                return error(state, unaryop->pos,
-                             "invalid type to do unary operation");
+                return error(state, pos, "invalid type to do unary operation");
             }
             break;
 
         case TK_LNOT:
             if (!is_bool(type)) {
-                return error(state, unaryop->pos,
-                             "invalid type to do unary operation");
+                return error(state, pos, "invalid type to do unary operation");
             }
             break;
 
         case TK_MUL:
             if (!is_ptr_like(type)) {
-                return error(state, unaryop->pos,
+                return error(state, pos,
                              "indirection requires pointer operand");
             }
 
-            if (is_ptr(type)) {
-                unaryop->type_info.type.pointer_level--;
-                if (unaryop->type_info.type.pointer_level == 0) {
-                    unaryop->type_info.type =
-                        *unaryop->type_info.type.inner_type;
-                }
+            if (is_ptr(type) && type->pointer_level > 1) {
+                info.type =
+                    get_pointer_type(type->inner_type, type->pointer_level - 1);
             } else {
-                unaryop->type_info.type = *unaryop->type_info.type.inner_type;
+                info.type = type->inner_type;
             }
 
-            unaryop->type_info.is_lvalue = 1;
-            unaryop->type_info.is_address = 1;
+            info.is_lvalue = 1;
+            info.is_address = 1;
             break;
 
         case TK_AND:
             if (is_lvalue == 0) {
-                return error(state, unaryop->pos,
+                return error(state, pos,
                              "lvalue required as unary '&' operand");
             }
 
             if (is_ptr(type)) {
-                unaryop->type_info.type.pointer_level++;
+                info.type =
+                    get_pointer_type(type->inner_type, type->pointer_level + 1);
             } else {
-                Type* inner = utlarena_alloc(state->arena, sizeof(Type));
-                *inner = unaryop->type_info.type;
-                unaryop->type_info.type.type = METADATA_POINTER;
-                unaryop->type_info.type.size = PTR_SIZE;
-                unaryop->type_info.type.alignment = PTR_SIZE;
-                unaryop->type_info.type.pointer_level = 1;
-                unaryop->type_info.type.inner_type = inner;
+                info.type = get_pointer_type(type, 1);
             }
             break;
 
@@ -266,34 +292,34 @@ static Error* type_check_unaryop(SemaState* state, UnaryOpNode* unaryop) {
             UNREACHABLE();
     }
 
+    ast_set_type_info(state->ast, node, info);
     return NULL;
 }
 
-static Error* type_check_var(SemaState* state, VarNode* var) {
-    UNUSED(state);
+static Error* type_check_var(SemaState* state, NodeIndex node) {
+    VarNode var = ast_var(state->ast, node);
+    TypeInfo info = {0};
 
-    switch (var->ste->type) {
+    switch (var.ste->type) {
         case SYM_VAR: {
             // Variable
-            VarSymbolTableEntry* var_ste = (VarSymbolTableEntry*)var->ste;
-            var->type_info.is_lvalue = 1;
-            var->type_info.is_address = 1;
-            var->type_info.type = *var_ste->data_type;
+            VarSymbolTableEntry* var_ste = (VarSymbolTableEntry*)var.ste;
+            info.is_lvalue = 1;
+            info.is_address = 1;
+            info.type = var_ste->data_type;
         } break;
         case SYM_FUNC: {
             // Function pointer
-            FuncSymbolTableEntry* func_ste = (FuncSymbolTableEntry*)var->ste;
-            var->type_info.is_lvalue = 0;
-            var->type_info.is_address = 0;
-            var->type_info.type.type = METADATA_FUNC;
-            var->type_info.type.incomplete = 0;
-            var->type_info.type.size = PTR_SIZE;
-            var->type_info.type.alignment = PTR_SIZE;
-            var->type_info.type.func_data = func_ste->func_data;
+            FuncSymbolTableEntry* func_ste = (FuncSymbolTableEntry*)var.ste;
+            info.is_lvalue = 0;
+            info.is_address = 0;
+            info.type = get_func_type(&func_ste->func_data);
         } break;
         default:
             UNREACHABLE();
     }
+
+    ast_set_type_info(state->ast, node, info);
     return NULL;
 }
 
@@ -307,6 +333,11 @@ static inline int is_allowed_type_convert(const Type* left, const Type* right) {
         return 1;
     }
 
+    // floating-point conversion, float to integer requires a cast
+    if (is_float(left) && is_arithmetic(right)) {
+        return 1;
+    }
+
     // void pointer conversion
     if ((is_ptr_like(right) || is_func_ptr(right)) && is_void_ptr(left)) {
         return 1;
@@ -328,54 +359,58 @@ static inline int is_allowed_type_convert(const Type* left, const Type* right) {
     return 0;
 }
 
-static Error* type_check_assign(SemaState* state, AssignNode* assign) {
-    Error* err = type_check_node(state, assign->left);
+static Error* type_check_assign(SemaState* state, NodeIndex node) {
+    AssignNode assign = ast_assign(state->ast, node);
+    SourcePos pos = ast_pos(state->ast, node);
+
+    Error* err = type_check_node(state, assign.left);
     if (err != NULL) {
         return err;
     }
 
-    const TypedASTNode* l_node = as_typed_ast(assign->left);
-    if (l_node->type_info.is_lvalue == 0) {
-        return error(state, assign->pos,
+    TypeInfo l_info = ast_type_info(state->ast, assign.left);
+    if (l_info.is_lvalue == 0) {
+        return error(state, pos,
                      "lvalue required as left operand of assignment");
     }
 
-    err = type_check_node(state, assign->right);
+    err = type_check_node(state, assign.right);
     if (err != NULL) {
         return err;
     }
 
-    const TypedASTNode* r_node = as_typed_ast(assign->right);
-    const Type* l_type = &l_node->type_info.type;
-    const Type* r_type = &r_node->type_info.type;
+    const Type* l_type = l_info.type;
+    const Type* r_type = type_of(state, assign.right);
 
     if (!is_allowed_type_convert(l_type, r_type)) {
-        return error(state, assign->pos, "type is not assignable");
+        return error(state, pos, "type is not assignable");
     }
+    convert_float_lit(state, assign.right, l_type);
 
-    assign->type_info.is_lvalue = 1;
-    assign->type_info.is_address = 1;
-    assign->type_info.type = *l_type;
+    ast_set_type_info(state->ast, node, (TypeInfo){1, 1, l_type});
     return NULL;
 }
 
-static Error* type_check_if(SemaState* state, IfStatementNode* if_node) {
-    Error* err = type_check_node(state, if_node->expr);
+static Error* type_check_if(SemaState* state, NodeIndex node) {
+    IfStatementNode if_node = ast_if(state->ast, node);
+
+    Error* err = type_check_node(state, if_node.expr);
     if (err != NULL) {
         return err;
     }
 
-    if (!is_bool(&(as_typed_ast(if_node->expr)->type_info.type))) {
-        return error(state, if_node->expr->pos, "expected type 'bool'");
+    if (!is_bool(type_of(state, if_node.expr))) {
+        return error(state, ast_pos(state->ast, if_node.expr),
+                     "expected type 'bool'");
     }
 
-    err = type_check_node(state, if_node->then_block);
+    err = type_check_node(state, if_node.then_block);
     if (err != NULL) {
         return err;
     }
 
-    if (if_node->else_block) {
-        err = type_check_node(state, if_node->else_block);
+    if (if_node.else_block) {
+        err = type_check_node(state, if_node.else_block);
         if (err != NULL) {
             return err;
         }
@@ -384,29 +419,32 @@ static Error* type_check_if(SemaState* state, IfStatementNode* if_node) {
     return NULL;
 }
 
-static Error* type_check_while(SemaState* state, WhileNode* while_node) {
-    Error* err = type_check_node(state, while_node->expr);
+static Error* type_check_while(SemaState* state, NodeIndex node) {
+    WhileNode while_node = ast_while(state->ast, node);
+
+    Error* err = type_check_node(state, while_node.expr);
     if (err != NULL) {
         return err;
     }
 
-    if (!is_bool(&(as_typed_ast(while_node->expr)->type_info.type))) {
-        return error(state, while_node->expr->pos, "expected type 'bool'");
+    if (!is_bool(type_of(state, while_node.expr))) {
+        return error(state, ast_pos(state->ast, while_node.expr),
+                     "expected type 'bool'");
     }
 
     int prev_in_loop = state->in_loop;
 
     state->in_loop = 1;
 
-    err = type_check_node(state, while_node->block);
+    err = type_check_node(state, while_node.block);
     if (err != NULL) {
         return err;
     }
 
     state->in_loop = prev_in_loop;
 
-    if (while_node->inc) {
-        err = type_check_node(state, while_node->inc);
+    if (while_node.inc) {
+        err = type_check_node(state, while_node.inc);
         if (err != NULL) {
             return err;
         }
@@ -415,17 +453,17 @@ static Error* type_check_while(SemaState* state, WhileNode* while_node) {
     return NULL;
 }
 
-static Error* type_check_goto(SemaState* state, GotoNode* node) {
-    switch (node->op) {
+static Error* type_check_goto(SemaState* state, NodeIndex node) {
+    switch (ast_goto(state->ast, node).op) {
         case TK_BREAK:
             if (state->in_loop == 0) {
-                return error(state, node->pos,
+                return error(state, ast_pos(state->ast, node),
                              "break statement not within a loop");
             }
             break;
         case TK_CONTINUE:
             if (state->in_loop == 0) {
-                return error(state, node->pos,
+                return error(state, ast_pos(state->ast, node),
                              "continue statement not within a loop");
             }
             break;
@@ -436,23 +474,26 @@ static Error* type_check_goto(SemaState* state, GotoNode* node) {
     return NULL;
 }
 
-static Error* type_check_call(SemaState* state, CallNode* call) {
-    Error* err = type_check_node(state, call->node);
+static Error* type_check_call(SemaState* state, NodeIndex node) {
+    CallNode call = ast_call(state->ast, node);
+    SourcePos pos = ast_pos(state->ast, node);
+
+    Error* err = type_check_node(state, call.node);
     if (err != NULL) {
         return err;
     }
 
-    const Type* func_type = &(as_typed_ast(call->node)->type_info.type);
+    const Type* func_type = type_of(state, call.node);
     if (func_type->type != METADATA_FUNC) {
-        return error(state, call->pos,
+        return error(state, pos,
                      "called object is not a function or function pointer");
     }
 
-    ASTNodeList* curr = call->args;
     ArgList* arg_type = func_type->func_data.args;
     int has_va_args = func_type->func_data.has_va_args;
-    while (curr) {
-        err = type_check_node(state, curr->node);
+    for (int i = 0; i < call.args.count; i++) {
+        NodeIndex arg = call.args.nodes[i];
+        err = type_check_node(state, arg);
         if (err != NULL) {
             return err;
         }
@@ -460,232 +501,270 @@ static Error* type_check_call(SemaState* state, CallNode* call) {
         if (arg_type != NULL) {
             // TODO: Add va_args type check
             if (!has_va_args &&
-                !is_allowed_type_convert(
-                    arg_type->type,
-                    &(as_typed_ast(curr->node)->type_info.type))) {
-                return error(state, curr->node->pos,
+                !is_allowed_type_convert(arg_type->type, type_of(state, arg))) {
+                return error(state, ast_pos(state->ast, arg),
                              "passing argument with invalid type");
             }
+            if (!has_va_args) {
+                convert_float_lit(state, arg, arg_type->type);
+            }
             arg_type = arg_type->next;
         } else if (!has_va_args) {
-            return error(state, call->pos, "too many arguments");
+            return error(state, pos, "too many arguments");
         }
-        curr = curr->next;
     }
 
     if (arg_type != NULL) {
-        return error(state, call->pos, "too few arguments");
+        return error(state, pos, "too few arguments");
     }
 
     const Type* return_type = func_type->func_data.return_type;
 
-    call->type_info.is_lvalue = 0;
-    call->type_info.is_address = 0;
-    call->type_info.type = *return_type;
+    TypeInfo info = {0};
+    info.type = return_type;
 
-    if (return_type->size > REGISTER_SIZE) {
-        call->type_info.is_address = 1;
+    if (is_large_type(return_type)) {
+        info.is_address = 1;
         state->max_struct_return_size =
             MAX(state->max_struct_return_size, return_type->size);
     }
 
+    ast_set_type_info(state->ast, node, info);
     return NULL;
 }
 
-static Error* type_check_print(SemaState* state, PrintNode* print_node) {
-    ASTNodeList* curr = print_node->args;
-    while (curr) {
-        Error* err = type_check_node(state, curr->node);
+static Error* type_check_print(SemaState* state, NodeIndex node) {
+    PrintNode print_node = ast_print(state->ast, node);
+
+    Error* err = type_check_node(state, print_node.fmt);
+    if (err != NULL) {
+        return err;
+    }
+
+    for (int i = 0; i < print_node.args.count; i++) {
+        NodeIndex arg = print_node.args.nodes[i];
+        err = type_check_node(state, arg);
         if (err != NULL) {
             return err;
         }
 
-        if (as_typed_ast(curr->node)->type_info.type.size > REGISTER_SIZE) {
-            return error(state, curr->node->pos,
+        if (is_large_type(type_of(state, arg))) {
+            return error(state, ast_pos(state->ast, arg),
                          "passing argument with invalid type");
         }
-
-        curr = curr->next;
     }
 
     return NULL;
 }
 
-static Error* type_check_ret(SemaState* state, ReturnNode* ret) {
+static Error* type_check_ret(SemaState* state, NodeIndex node) {
+    ReturnNode ret = ast_ret(state->ast, node);
     const Type* return_type = get_primitive_type(TYPE_VOID);
 
-    if (ret->expr) {
-        Error* err = type_check_node(state, ret->expr);
+    if (ret.expr) {
+        Error* err = type_check_node(state, ret.expr);
         if (err != NULL) {
             return err;
         }
-        return_type = &(as_typed_ast(ret->expr)->type_info.type);
+        return_type = type_of(state, ret.expr);
     }
 
     if (!is_allowed_type_convert(state->return_type, return_type)) {
-        return error(state, ret->pos, "invalid return type");
+        return error(state, ast_pos(state->ast, node), "invalid return type");
+    }
+
+    if (ret.expr) {
+        convert_float_lit(state, ret.expr, state->return_type);
     }
 
     return NULL;
 }
 
-static Error* type_check_field(SemaState* state, FieldNode* field) {
-    Error* err = type_check_node(state, field->node);
+static Error* type_check_field(SemaState* state, NodeIndex node) {
+    FieldNode field = ast_field(state->ast, node);
+    SourcePos pos = ast_pos(state->ast, node);
+
+    Error* err = type_check_node(state, field.node);
     if (err != NULL) {
         return err;
     }
 
-    const TypedASTNode* node = as_typed_ast(field->node);
-    const Type* type = &node->type_info.type;
+    TypeInfo operand = ast_type_info(state->ast, field.node);
+    const Type* type = operand.type;
     if (type->type == METADATA_POINTER && type->pointer_level == 1) {
         // member access through pointer
         type = type->inner_type;
     }
 
     if (type->type != METADATA_TYPE) {
-        return error(state, field->pos,
+        return error(state, pos,
                      "request for member in something not a struct");
     }
 
     const TypeSymbolTableEntry* type_ste = type->type_ste;
     FieldSymbolTableEntry* ste = (FieldSymbolTableEntry*)symbol_table_find(
-        type_ste->name_space, field->ident, 1);
+        type_ste->name_space, field.ident, 1);
     if (ste == NULL || ste->type != SYM_FIELD) {
-        return error(state, field->pos, "type has no member '%.*s'",
-                     field->ident.len, field->ident.ptr);
+        return error(state, pos, "type has no member '%.*s'", field.ident.len,
+                     field.ident.ptr);
     }
 
-    field->type_info.is_lvalue = node->type_info.is_lvalue;
-    field->type_info.is_address = 1;
-    field->type_info.type = *ste->data_type;
+    ast_set_type_info(state->ast, node,
+                      (TypeInfo){operand.is_lvalue, 1, ste->data_type});
     return NULL;
 }
 
-static Error* type_check_indexof(SemaState* state, IndexOfNode* idxof) {
-    Error* err = type_check_node(state, idxof->left);
+static Error* type_check_indexof(SemaState* state, NodeIndex node) {
+    IndexOfNode idxof = ast_indexof(state->ast, node);
+    SourcePos pos = ast_pos(state->ast, node);
+
+    Error* err = type_check_node(state, idxof.left);
     if (err != NULL) {
         return err;
     }
 
-    const TypedASTNode* l_node = as_typed_ast(idxof->left);
-    const Type* l_type = &l_node->type_info.type;
+    TypeInfo l_info = ast_type_info(state->ast, idxof.left);
+    const Type* l_type = l_info.type;
     if (l_type->type != METADATA_ARRAY) {
-        return error(state, idxof->pos,
+        return error(state, pos,
                      "subscripted value is neither array nor array pointer");
     }
 
-    err = type_check_node(state, idxof->right);
+    err = type_check_node(state, idxof.right);
     if (err != NULL) {
         return err;
     }
 
-    const TypedASTNode* r_node = as_typed_ast(idxof->right);
-    const Type* r_type = &r_node->type_info.type;
+    const Type* r_type = type_of(state, idxof.right);
     if (!is_int(r_type)) {
-        return error(state, idxof->pos, "array subscript is not an integer");
+        return error(state, pos, "array subscript is not an integer");
     }
 
-    idxof->type_info.is_lvalue = l_node->type_info.is_lvalue;
-    idxof->type_info.is_address = 1;
-    idxof->type_info.type = *l_type->inner_type;
+    ast_set_type_info(state->ast, node,
+                      (TypeInfo){l_info.is_lvalue, 1, l_type->inner_type});
     return NULL;
 }
 
-static Error* type_check_cast(SemaState* state, CastNode* cast) {
-    Error* err = type_check_node(state, cast->expr);
+static Error* type_check_cast(SemaState* state, NodeIndex node) {
+    CastNode cast = ast_cast(state->ast, node);
+    SourcePos pos = ast_pos(state->ast, node);
+
+    Error* err = type_check_node(state, cast.expr);
     if (err != NULL) {
         return err;
     }
 
-    TypedASTNode* node = as_typed_ast(cast->expr);
-    const Type* type = &node->type_info.type;
+    const Type* type = type_of(state, cast.expr);
 
-    if (is_int(cast->data_type)) {
-        if (is_int(type) || is_ptr_like(type) || is_func_ptr(type)) {
-            cast->type_info.type = *cast->data_type;
-            cast->type_info.is_lvalue = 0;
-            cast->type_info.is_address = 0;
-        } else {
-            return error(state, cast->pos, "cannot convert to a integer type");
+    if (is_int(cast.data_type)) {
+        if (!(is_arithmetic(type) || is_ptr_like(type) || is_func_ptr(type))) {
+            return error(state, pos, "cannot convert to a integer type");
         }
-    } else if (is_ptr_like(cast->data_type) || is_func_ptr(cast->data_type)) {
-        if (is_int(type) || is_ptr_like(type) || is_func_ptr(type)) {
-            cast->type_info.type = *cast->data_type;
-            cast->type_info.is_lvalue = 0;
-            cast->type_info.is_address = 0;
-        } else {
-            return error(state, cast->pos, "cannot convert to a pointer type");
+    } else if (is_float(cast.data_type)) {
+        if (!is_arithmetic(type)) {
+            return error(state, pos, "cannot convert to a floating-point type");
+        }
+    } else if (is_ptr_like(cast.data_type) || is_func_ptr(cast.data_type)) {
+        if (!(is_int(type) || is_ptr_like(type) || is_func_ptr(type))) {
+            return error(state, pos, "cannot convert to a pointer type");
         }
     } else {
-        return error(state, cast->pos, "invalid type conversion");
+        return error(state, pos, "invalid type conversion");
+    }
+
+    ast_set_type_info(state->ast, node, (TypeInfo){0, 0, cast.data_type});
+    return NULL;
+}
+
+static Error* type_check_hint(SemaState* state, NodeIndex node) {
+    BranchHintNode hint = ast_hint(state->ast, node);
+
+    Error* err = type_check_node(state, hint.expr);
+    if (err != NULL) {
+        return err;
+    }
+
+    TypeInfo info = ast_type_info(state->ast, hint.expr);
+    if (!is_bool(info.type)) {
+        return error(state, ast_pos(state->ast, hint.expr),
+                     "expected type 'bool'");
     }
 
+    info.is_lvalue = 0;
+    ast_set_type_info(state->ast, node, info);
     return NULL;
 }
 
-static Error* type_check_node(SemaState* state, ASTNode* node) {
-    switch (node->type) {
+static Error* type_check_node(SemaState* state, NodeIndex node) {
+    switch (ast_node_type(state->ast, node)) {
         case NODE_STMTS:
-            return type_check_stmts(state, (StatementListNode*)node);
+            return type_check_stmts(state, node);
 
         case NODE_INTLIT: {
-            IntLitNode* lit = (IntLitNode*)node;
-            lit->type_info.is_lvalue = 0;
-            lit->type_info.is_address = 0;
-            if (lit->data_type == TYPE_VOID) {
-                lit->type_info.type = *get_void_ptr_type();
+            IntLitNode lit = ast_intlit(state->ast, node);
+            TypeInfo info = {0};
+            if (lit.data_type == TYPE_VOID) {
+                info.type = get_void_ptr_type();
             } else {
-                lit->type_info.type = *get_primitive_type(lit->data_type);
+                info.type = get_primitive_type(lit.data_type);
             }
+            ast_set_type_info(state->ast, node, info);
         }
             return NULL;
 
-        case NODE_STRLIT: {
-            StrLitNode* lit = (StrLitNode*)node;
-            lit->type_info.is_lvalue = 0;
-            lit->type_info.is_address = 0;
-            lit->type_info.type = *get_string_type();
+        case NODE_FLOATLIT: {
+            FloatLitNode lit = ast_floatlit(state->ast, node);
+            TypeInfo info = {0, 0, get_primitive_type(lit.data_type)};
+            ast_set_type_info(state->ast, node, info);
         }
             return NULL;
 
+        case NODE_STRLIT:
+            ast_set_type_info(state->ast, node,
+                              (TypeInfo){0, 0, get_string_type()});
+            return NULL;
+
         case NODE_BINARYOP:
-            return type_check_binop(state, (BinaryOpNode*)node);
+            return type_check_binop(state, node);
 
         case NODE_UNARYOP:
-            return type_check_unaryop(state, (UnaryOpNode*)node);
+            return type_check_unaryop(state, node);
 
         case NODE_VAR:
-            return type_check_var(state, (VarNode*)node);
+            return type_check_var(state, node);
 
         case NODE_ASSIGN:
-            return type_check_assign(state, (AssignNode*)node);
+            return type_check_assign(state, node);
 
         case NODE_IF:
-            return type_check_if(state, (IfStatementNode*)node);
+            return type_check_if(state, node);
 
         case NODE_WHILE:
-            return type_check_while(state, (WhileNode*)node);
+            return type_check_while(state, node);
 
         case NODE_GOTO:
-            return type_check_goto(state, (GotoNode*)node);
+            return type_check_goto(state, node);
 
         case NODE_CALL:
-            return type_check_call(state, (CallNode*)node);
+            return type_check_call(state, node);
 
         case NODE_PRINT:
-            return type_check_print(state, (PrintNode*)node);
+            return type_check_print(state, node);
 
         case NODE_RET:
-            return type_check_ret(state, (ReturnNode*)node);
+            return type_check_ret(state, node);
 
         case NODE_FIELD:
-            return type_check_field(state, (FieldNode*)node);
+            return type_check_field(state, node);
 
         case NODE_INDEXOF:
-            return type_check_indexof(state, (IndexOfNode*)node);
+            return type_check_indexof(state, node);
 
         case NODE_CAST:
-            return type_check_cast(state, (CastNode*)node);
+            return type_check_cast(state, node);
+
+        case NODE_HINT:
+            return type_check_hint(state, node);
 
         case NODE_ASM:
             return NULL;
@@ -695,7 +774,7 @@ static Error* type_check_node(SemaState* state, ASTNode* node) {
     }
 }
 
-static Error* type_check_func(SemaState* state, ASTNode* func,
+static Error* type_check_func(SemaState* state, NodeIndex func,
                               const Type* return_type, SymbolTable* sym) {
     state->return_type = return_type;
     state->max_struct_return_size = 0;
@@ -718,57 +797,182 @@ static Error* type_check_func(SemaState* state, ASTNode* func,
     return NULL;
 }
 
-static Error* type_check_global(SemaState* state, ASTNode* node) {
-    assert(node->type == NODE_STMTS);
-    StatementListNode* stmts = (StatementListNode*)node;
+static Error* type_check_global(SemaState* state, NodeIndex node) {
+    assert(ast_node_type(state->ast, node) == NODE_STMTS);
+    StatementListNode stmts = ast_stmts(state->ast, node);
 
-    ASTNodeList* iter = stmts->stmts;
-    while (iter) {
-        if (iter->node->type != NODE_ASSIGN ||
-            !((AssignNode*)iter->node)->from_decl) {
-            return error(state, iter->node->pos, "expected declaration");
+    for (int i = 0; i < stmts.stmts.count; i++) {
+        NodeIndex decl = stmts.stmts.nodes[i];
+        SourcePos pos = ast_pos(state->ast, decl);
+        if (ast_node_type(state->ast, decl) != NODE_ASSIGN ||
+            !ast_assign(state->ast, decl).from_decl) {
+            return error(state, pos, "expected declaration");
         }
 
-        AssignNode* assign = (AssignNode*)iter->node;
+        AssignNode assign = ast_assign(state->ast, decl);
 
-        assert(assign->left->type == NODE_VAR);
-        VarNode* var_node = (VarNode*)assign->left;
-        type_check_var(state, var_node);
+        assert(ast_node_type(state->ast, assign.left) == NODE_VAR);
+        VarNode var_node = ast_var(state->ast, assign.left);
+        type_check_var(state, assign.left);
 
-        const TypedASTNode* l_node = as_typed_ast(assign->left);
-        Error* err = type_check_node(state, assign->right);
+        Error* err = type_check_node(state, assign.right);
         if (err != NULL) {
             return err;
         }
 
         // TODO: more compile-time evaluation
-        if (assign->right->type != NODE_INTLIT &&
-            assign->right->type != NODE_STRLIT) {
-            return error(
-                state, assign->pos,
-                "initialized element is not a compile-time constant integer "
-                "or string literal");
+        ASTNodeType r_node_type = ast_node_type(state->ast, assign.right);
+        if (r_node_type != NODE_INTLIT && r_node_type != NODE_FLOATLIT &&
+            r_node_type != NODE_STRLIT) {
+            return error(state, pos,
+                         "initialized element is not a compile-time constant "
+                         "number or string literal");
         }
 
-        const TypedASTNode* r_node = as_typed_ast(assign->right);
-        const Type* l_type = &l_node->type_info.type;
-        const Type* r_type = &r_node->type_info.type;
+        const Type* l_type = type_of(state, assign.left);
+        const Type* r_type = type_of(state, assign.right);
 
         if (!is_allowed_type_convert(l_type, r_type)) {
-            return error(state, assign->pos, "type is not assignable");
+            return error(state, pos, "type is not assignable");
         }
+        convert_float_lit(state, assign.right, l_type);
 
-        assert(var_node->ste->type == SYM_VAR);
-        VarSymbolTableEntry* ste = (VarSymbolTableEntry*)var_node->ste;
-        ste->init_val = assign->right;
-
-        iter = iter->next;
+        assert(var_node.ste->type == SYM_VAR);
+        VarSymbolTableEntry* ste = (VarSymbolTableEntry*)var_node.ste;
+        ste->init_val = assign.right;
     }
 
     return NULL;
 }
 
-Error* sema(SemaState* state, ASTNode* node, SymbolTable* sym, Str entry_sym) {
+// Pass the leading scalar arguments in registers for functions that are only
+// called directly from ika code. The arguments are spilled to the end of the
+// local variables by the callee.
+static void use_regparm(FuncSymbolTableEntry* func) {
+    FuncMetadata* func_data = &func->func_data;
+
+    int arg_count = 0;
+    ArgList* arg = func_data->args;
+    while (arg) {
+        arg_count++;
+        arg = arg->next;
+    }
+
+    // args are stored in reverse order
+    int reg_arg_count = 0;
+    while (reg_arg_count < MAX_REG_ARG_COUNT && reg_arg_count < arg_count) {
+        arg = func_data->args;
+        for (int i = 0; i < arg_count - reg_arg_count - 1; i++) {
+            arg = arg->next;
+        }
+
+        if (arg->type->size > REGISTER_SIZE) {
+            break;
+        }
+        reg_arg_count++;
+    }
+
+    func_data->callconv = CALLCONV_REGPARM;
+    func_data->reg_arg_count = reg_arg_count;
+
+    if (reg_arg_count == 0) {
+        return;
+    }
+
+    SymbolTable* func_sym = func->func_sym;
+    int reg_args_size = reg_arg_count * REGISTER_SIZE;
+    func_sym->reg_arg_offset = *func_sym->stack_size;
+
+    SymbolTableEntry* curr = func_sym->ste;
+    while (curr) {
+        VarSymbolTableEntry* var = (VarSymbolTableEntry*)curr;
+        if (curr->type == SYM_VAR && var->is_arg) {
+            if (var->offset < reg_args_size) {
+                var->is_arg = 0;
+                var->offset += func_sym->reg_arg_offset + REGISTER_SIZE;
+            } else {
+                var->offset -= reg_args_size;
+            }
+        }
+        curr = curr->next;
+    }
+
+    *func_sym->stack_size += reg_args_size;
+}
+
+// Returns the argument at index in declaration order. Arguments have
+// increasing offsets.
+static VarSymbolTableEntry* get_arg_var(SymbolTable* func_sym, int index) {
+    SymbolTableEntry* curr = func_sym->ste;
+    while (curr) {
+        VarSymbolTableEntry* var = (VarSymbolTableEntry*)curr;
+        if (curr->type == SYM_VAR && var->is_arg) {
+            int count = 0;
+            SymbolTableEntry* other = func_sym->ste;
+            while (other) {
+                VarSymbolTableEntry* other_var = (VarSymbolTableEntry*)other;
+                if (other->type == SYM_VAR && other_var->is_arg &&
+                    other_var->offset < var->offset) {
+                    count++;
+                }
+                other = other->next;
+            }
+
+            if (count == index) {
+                return var;
+            }
+        }
+        curr = curr->next;
+    }
+    UNREACHABLE();
+}
+
+// Lay out the arguments by the x86-64 System V ABI. Arguments passed in
+// registers are spilled to the end of the local variables by the callee, in
+// 8-byte slots after the hidden return pointer.
+static void use_sysv_abi(SemaState* state, FuncSymbolTableEntry* func) {
+    FuncMetadata* func_data = &func->func_data;
+    SymbolTable* func_sym = func->func_sym;
+
+    int arg_count = 0;
+    ArgList* arg = func_data->args;
+    while (arg) {
+        arg_count++;
+        arg = arg->next;
+    }
+
+    SysVArgState arg_state;
+    sysv_init_args(&arg_state, func_data->return_type);
+
+    func_sym->reg_arg_offset = *func_sym->stack_size;
+    int spill_size = arg_state.gpr_count * REGISTER_SIZE;
+
+    VarSymbolTableEntry** vars =
+        utlarena_alloc(state->arena, sizeof(VarSymbolTableEntry*) * arg_count);
+    for (int i = 0; i < arg_count; i++) {
+        vars[i] = get_arg_var(func_sym, i);
+    }
+
+    for (int i = 0; i < arg_count; i++) {
+        VarSymbolTableEntry* var = vars[i];
+
+        SysVArgLoc loc;
+        sysv_assign_arg(&arg_state, var->data_type, &loc);
+        if (loc.eightbyte_count > 0) {
+            spill_size += loc.eightbyte_count * REGISTER_SIZE;
+            var->is_arg = 0;
+            var->offset = func_sym->reg_arg_offset + spill_size;
+        } else {
+            var->offset = loc.stack_offset;
+        }
+    }
+
+    func_sym->arg_offset = 2 * PTR_SIZE;
+    func_sym->arg_size = arg_state.stack_size;
+    *func_sym->stack_size += spill_size;
+}
+
+Error* sema(SemaState* state, NodeIndex node, SymbolTable* sym, Str entry_sym) {
     Error* err;
 
     SymbolTableEntry* entry_func = symbol_table_find(sym, entry_sym, 1);
@@ -784,8 +988,27 @@ Error* sema(SemaState* state, ASTNode* node, SymbolTable* sym, Str entry_sym) {
         }
     }
 
-    // Functions
     SymbolTableEntry* curr = sym->ste;
+    while (curr) {
+        if (curr->type == SYM_FUNC && target_info.arch == TARGET_X86_64) {
+            FuncSymbolTableEntry* func = (FuncSymbolTableEntry*)curr;
+            if (func->node) {
+                use_sysv_abi(state, func);
+            }
+        } else if (curr->type == SYM_FUNC) {
+            FuncSymbolTableEntry* func = (FuncSymbolTableEntry*)curr;
+            if (func->node && func->attr == SYM_ATTR_NONE &&
+                !func->address_taken &&
+                func->func_data.callconv == CALLCONV_CDECL &&
+                !func->func_data.has_va_args) {
+                use_regparm(func);
+            }
+        }
+        curr = curr->next;
+    }
+
+    // Functions
+    curr = sym->ste;
     while (curr) {
         if (curr->type == SYM_FUNC) {
             FuncSymbolTableEntry* func = (FuncSymbolTableEntry*)curr;
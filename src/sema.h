@@ -8,6 +8,7 @@
 
 typedef struct SemaState {
     UtlArenaAllocator* arena;
+    AST* ast;
 
     int return_label;
     const Type* return_type;
@@ -16,6 +17,6 @@ typedef struct SemaState {
     int in_loop;
 } SemaState;
 
-Error* sema(SemaState* state, ASTNode* node, SymbolTable* sym, Str entry_sym);
+Error* sema(SemaState* state, NodeIndex node, SymbolTable* sym, Str entry_sym);
 
 #endif
@@ -0,0 +1,34 @@
+#include "source.h"
+
+const SourceLine* source_find_line(const SourceState* src, SourcePos pos) {
+    if (src->line_map.size == 0) {
+        return NULL;
+    }
+
+    // Last file starting at or before pos
+    const SourceRange* files = src->line_map.data;
+    size_t lo = 0;
+    size_t hi = src->line_map.size;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (files[mid].lines[0].offset <= pos.offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Last line of the file starting at or before pos
+    const SourceLine* lines = files[lo].lines;
+    hi = files[lo].count;
+    lo = 0;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (lines[mid].offset <= pos.offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return &lines[lo];
+}
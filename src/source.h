@@ -1,34 +1,58 @@
 #ifndef SOURCE_H
 #define SOURCE_H
 
-#include "utl/utlvector.h"
+#include <stdint.h>
 
-typedef struct SourceLine SourceLine;
+#include "utl/utlvector.h"
 
-struct SourceLine {
+typedef struct SourceLine {
     int file_index;
     int lineno;
-    char* content;
-
-    struct SourceLine* next;
-};
-
+    uint32_t offset;      // source offset of the first character
+    uint32_t len;         // length of the content without the line break
+    const char* content;  // points into the file, ends at is_line_end
+} SourceLine;
+
+// Consecutive lines of a file
+typedef struct SourceRange {
+    const SourceLine* lines;
+    size_t count;
+} SourceRange;
+
+// Lines are not null-terminated, they end at a line break or at the '\0'
+// following the contents of the file
+static inline int is_line_end(const char* p) {
+    return *p == '\0' || *p == '\n' ||
+           (*p == '\r' && (p[1] == '\n' || p[1] == '\0'));
+}
+
+// Offset into the source map, lines of every file get their own range
 typedef struct SourcePos {
-    SourceLine line;
-    size_t index;
+    uint32_t offset;
 } SourcePos;
 
 typedef struct SourceFile {
-    char* filename;
+    const char* filename;
     int is_open;
     SourcePos pos;
 } SourceFile;
 
 typedef UtlVector(SourceFile) SourceFiles;
 
+typedef UtlVector(SourceRange) SourceRanges;
+
 typedef struct SourceState {
     SourceFiles files;
-    SourceLine* lines;
+    SourceRanges lines;     // lines left after preprocessing, in order
+    SourceRanges line_map;  // lines of every file read, sorted by offset
+    uint32_t size;          // offset of the next line read
 } SourceState;
 
+static inline SourcePos source_pos(const SourceLine* line, size_t index) {
+    return (SourcePos){line->offset + (uint32_t)index};
+}
+
+// Line containing pos, or NULL if no line has been read
+const SourceLine* source_find_line(const SourceState* src, SourcePos pos);
+
 #endif
@@ -1,13 +1,8 @@
 #include "symbol_table.h"
 
-static inline int djb2_hash(Str s) {
-    int hash = 5381;
-    for (int i = 0; i < s.len; i++) {
-        hash = ((hash << 5) + hash) + s.ptr[i];
-    }
+#include <string.h>
 
-    return hash;
-}
+#include "intern.h"
 
 void symbol_table_init(SymbolTable* sym, int offset, int* stack_size,
                        int is_global, UtlArenaAllocator* arena) {
@@ -16,6 +11,9 @@ void symbol_table_init(SymbolTable* sym, int offset, int* stack_size,
     sym->parent = NULL;
     sym->arena = arena;
     sym->ste = NULL;
+    sym->slots = NULL;
+    sym->slot_count = 0;
+    sym->used_count = 0;
 
     if (!stack_size) {
         stack_size = utlarena_alloc(arena, sizeof(int));
@@ -24,15 +22,81 @@ void symbol_table_init(SymbolTable* sym, int offset, int* stack_size,
     sym->stack_size = stack_size;
 
     sym->arg_size = 0;                // fill in during parsing
-    sym->arg_offset = 8;              // saved ebp + return address
+    sym->arg_offset = 2 * PTR_SIZE;   // saved ebp + return address
+    sym->reg_arg_offset = 0;          // fill in during type check
     sym->max_struct_return_size = 0;  // fill in during type check
 }
 
+#define SYMBOL_TABLE_MIN_SLOTS 8
+
+// Marks a slot whose entry was removed, so probing continues past it.
+// Its ident is never equal to an interned string.
+static SymbolTableEntry removed_slot;
+
+static void symbol_table_insert_slot(SymbolTableEntry** slots, int slot_count,
+                                     SymbolTableEntry* ste) {
+    unsigned int mask = slot_count - 1;
+    unsigned int i = (unsigned int)ste->hash & mask;
+    while (slots[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = ste;
+}
+
+static void symbol_table_grow(SymbolTable* sym) {
+    int slot_count = SYMBOL_TABLE_MIN_SLOTS;
+    while (slot_count < 4 * (sym->used_count + 1)) {
+        slot_count *= 2;
+    }
+
+    SymbolTableEntry** slots =
+        utlarena_alloc(sym->arena, slot_count * sizeof(SymbolTableEntry*));
+    memset(slots, 0, slot_count * sizeof(SymbolTableEntry*));
+
+    // Removed slots are dropped
+    int used_count = 0;
+    for (SymbolTableEntry* ste = sym->ste; ste; ste = ste->next) {
+        symbol_table_insert_slot(slots, slot_count, ste);
+        used_count++;
+    }
+
+    sym->slots = slots;
+    sym->slot_count = slot_count;
+    sym->used_count = used_count;
+}
+
 static inline void symbol_table_append(SymbolTable* sym,
                                        SymbolTableEntry* ste) {
     ste->sym = sym;
     ste->next = sym->ste;
     sym->ste = ste;
+
+    // Keep the load factor at most 3/4
+    if (4 * (sym->used_count + 1) > 3 * sym->slot_count) {
+        symbol_table_grow(sym);
+    } else {
+        symbol_table_insert_slot(sym->slots, sym->slot_count, ste);
+        sym->used_count++;
+    }
+}
+
+// Returns the slot holding ident, or NULL if not in this scope
+static SymbolTableEntry** symbol_table_find_slot(SymbolTable* sym, Str ident,
+                                                 int hash) {
+    if (sym->slot_count == 0) {
+        return NULL;
+    }
+
+    unsigned int mask = sym->slot_count - 1;
+    unsigned int i = (unsigned int)hash & mask;
+    while (sym->slots[i] != NULL) {
+        SymbolTableEntry* ste = sym->slots[i];
+        if (ste->ident.ptr == ident.ptr) {
+            return &sym->slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
 }
 
 VarSymbolTableEntry* symbol_table_append_var(SymbolTable* sym, Str ident,
@@ -46,7 +110,7 @@ VarSymbolTableEntry* symbol_table_append_var(SymbolTable* sym, Str ident,
     ste->type = SYM_VAR;
 
     ste->ident = ident;
-    ste->hash = djb2_hash(ident);
+    ste->hash = intern_hash(ident);
     ste->pos = pos;
 
     ste->is_arg = is_arg;
@@ -54,7 +118,7 @@ VarSymbolTableEntry* symbol_table_append_var(SymbolTable* sym, Str ident,
     ste->is_global = sym->is_global;
 
     ste->data_type = data_type;
-    ste->init_val = NULL;
+    ste->init_val = 0;
 
     int size = data_type->size;
     int alignment = data_type->alignment;
@@ -62,8 +126,8 @@ VarSymbolTableEntry* symbol_table_append_var(SymbolTable* sym, Str ident,
     if (attr != SYM_ATTR_EXTERN) {
         if (is_arg) {
             // Arguments
-            if (size < 4) {
-                size = 4;
+            if (size < REGISTER_SIZE) {
+                size = REGISTER_SIZE;
             }
             alignment = MAX_ALIGNMENT;
             int alignment_off = sym->arg_size % alignment;
@@ -112,7 +176,7 @@ FieldSymbolTableEntry* symbol_table_append_field(SymbolTable* sym, Str ident,
     ste->type = SYM_FIELD;
 
     ste->ident = ident;
-    ste->hash = djb2_hash(ident);
+    ste->hash = intern_hash(ident);
     ste->pos = pos;
 
     ste->data_type = data_type;
@@ -151,7 +215,7 @@ DefSymbolTableEntry* symbol_table_append_def(SymbolTable* sym, Str ident,
     ste->type = SYM_DEF;
 
     ste->ident = ident;
-    ste->hash = djb2_hash(ident);
+    ste->hash = intern_hash(ident);
     ste->pos = pos;
 
     ste->val = val;
@@ -170,14 +234,15 @@ FuncSymbolTableEntry* symbol_table_append_func(SymbolTable* sym, Str ident,
     ste->type = SYM_FUNC;
 
     ste->ident = ident;
-    ste->hash = djb2_hash(ident);
+    ste->hash = intern_hash(ident);
     ste->pos = pos;
 
     ste->attr = attr;
     // ste->func_data = func_data; // fill in during parsing
 
-    ste->node = NULL;      // fill in during parsing
+    ste->node = 0;         // fill in during parsing
     ste->func_sym = NULL;  // fill in during parsing
+    ste->address_taken = 0;
 
     symbol_table_append(sym, (SymbolTableEntry*)ste);
 
@@ -193,7 +258,7 @@ TypeSymbolTableEntry* symbol_table_append_type(SymbolTable* sym, Str ident,
     ste->type = SYM_TYPE;
 
     ste->ident = ident;
-    ste->hash = djb2_hash(ident);
+    ste->hash = intern_hash(ident);
     ste->pos = pos;
 
     ste->incomplete = 1;
@@ -201,6 +266,12 @@ TypeSymbolTableEntry* symbol_table_append_type(SymbolTable* sym, Str ident,
     ste->alignment = 0;
     ste->name_space = NULL;
 
+    ste->struct_type = (Type){
+        .incomplete = 1,
+        .type = METADATA_TYPE,
+        .type_ste = ste,
+    };
+
     symbol_table_append(sym, (SymbolTableEntry*)ste);
 
     return ste;
@@ -212,19 +283,16 @@ SymbolTableEntry* symbol_table_find(SymbolTable* sym, Str ident,
         return NULL;
     }
 
-    SymbolTableEntry* ste = sym->ste;
-
-    int hash = djb2_hash(ident);
+    int hash = intern_hash(ident);
 
-    while (ste) {
-        if (ste->hash == hash && str_eql(ste->ident, ident)) {
-            return ste;
+    do {
+        SymbolTableEntry** slot = symbol_table_find_slot(sym, ident, hash);
+        if (slot) {
+            return *slot;
         }
-        ste = ste->next;
-    }
+        sym = sym->parent;
+    } while (sym && !in_current_scope);
 
-    if (!in_current_scope)
-        return symbol_table_find(sym->parent, ident, 0);
     return NULL;
 }
 
@@ -239,7 +307,7 @@ SymbolTableEntry* symbol_table_append_sym(SymbolTable* sym, Str ident) {
     ste->type = SYM_NONE;
 
     ste->ident = ident;
-    ste->hash = djb2_hash(ident);
+    ste->hash = intern_hash(ident);
 
     symbol_table_append(sym, ste);
     return ste;
@@ -249,23 +317,19 @@ int symbol_table_remove(SymbolTable* sym, Str ident) {
     if (!sym)
         return 0;
 
-    SymbolTableEntry* prev = NULL;
-    SymbolTableEntry* curr = sym->ste;
+    SymbolTableEntry** slot =
+        symbol_table_find_slot(sym, ident, intern_hash(ident));
+    if (!slot)
+        return 0;
 
-    int hash = djb2_hash(ident);
+    SymbolTableEntry* ste = *slot;
+    *slot = &removed_slot;
 
-    while (curr) {
-        if (curr->hash == hash && str_eql(curr->ident, ident)) {
-            if (prev) {
-                prev->next = curr->next;
-            } else {
-                sym->ste = curr->next;
-            }
-            return 1;
-        }
-        prev = curr;
-        curr = curr->next;
+    SymbolTableEntry** link = &sym->ste;
+    while (*link != ste) {
+        link = &(*link)->next;
     }
+    *link = ste->next;
 
-    return 0;
+    return 1;
 }
@@ -6,7 +6,8 @@
 #include "type.h"
 #include "utl/allocator/utlarena.h"
 
-struct ASTNode;
+// Index of a node in the AST, 0 if there is no node. See ast.h
+typedef uint32_t NodeIndex;
 
 typedef enum SymbolType {
     SYM_NONE,
@@ -54,7 +55,7 @@ struct VarSymbolTableEntry {
     int is_global;
     int offset;
     const Type* data_type;
-    struct ASTNode* init_val;  // only used for global variable
+    NodeIndex init_val;  // only used for global variable
 };
 
 struct FieldSymbolTableEntry {
@@ -73,7 +74,7 @@ typedef struct DefSymbolValue {
     int is_str;
     union {
         Str str;
-        unsigned int val;
+        long long val;
     };
     PrimitiveType data_type;  // for val
 } DefSymbolValue;
@@ -100,8 +101,9 @@ struct FuncSymbolTableEntry {
     SymbolAttr attr;
     FuncMetadata func_data;
 
-    struct ASTNode* node;
+    NodeIndex node;
     SymbolTable* func_sym;
+    int address_taken;  // used other than being called directly
 };
 
 struct TypeSymbolTableEntry {
@@ -116,21 +118,29 @@ struct TypeSymbolTableEntry {
     int size;
     int alignment;
     SymbolTable* name_space;
+    Type struct_type;  // completed along with the entry
 };
 
 struct SymbolTable {
     SymbolTable* parent;
     UtlArenaAllocator* arena;
-    SymbolTableEntry* ste;
+    SymbolTableEntry* ste;  // entries in reverse order of insertion
+    // Open addressing hash table of the entries for lookup
+    SymbolTableEntry** slots;
+    int slot_count;  // 0 or a power of two
+    int used_count;  // entries and removed slots
     int* stack_size;  // total stack size
     int is_global;    // is global symbol table
     int offset;       // offset for local variables
     int arg_size;     // total size of arguments
     int arg_offset;   // offset for the arguments (usually saved ebp + return
                       // address = 8)
+    int reg_arg_offset;  // offset for the spilled register arguments
     int max_struct_return_size;  // size of the max return type in this function
 };
 
+// Identifiers passed to the symbol table must be interned
+
 void symbol_table_init(SymbolTable* sym, int offset, int* stack_size,
                        int is_global, UtlArenaAllocator* arena);
 
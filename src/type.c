@@ -1,6 +1,16 @@
 #include "type.h"
 
-static const Type primitive_tpyes[] = {
+#include <stdint.h>
+#include <string.h>
+
+TargetInfo target_info = {
+    .arch = TARGET_I386,
+    .register_size = 4,
+    .max_alignment = 4,
+    .ptr_size = 4,
+};
+
+static Type primitive_tpyes[] = {
     [TYPE_VOID] =
         {
             .incomplete = 1,
@@ -56,6 +66,34 @@ static const Type primitive_tpyes[] = {
             .type = METADATA_PRIMITIVE,
             .primitive_type = TYPE_I32,
         },
+    [TYPE_U64] =
+        {
+            .size = 8,
+            .alignment = 4,
+            .type = METADATA_PRIMITIVE,
+            .primitive_type = TYPE_U64,
+        },
+    [TYPE_I64] =
+        {
+            .size = 8,
+            .alignment = 4,
+            .type = METADATA_PRIMITIVE,
+            .primitive_type = TYPE_I64,
+        },
+    [TYPE_F32] =
+        {
+            .size = 4,
+            .alignment = 4,
+            .type = METADATA_PRIMITIVE,
+            .primitive_type = TYPE_F32,
+        },
+    [TYPE_F64] =
+        {
+            .size = 8,
+            .alignment = 4,
+            .type = METADATA_PRIMITIVE,
+            .primitive_type = TYPE_F64,
+        },
 };
 
 const Type* get_primitive_type(PrimitiveType type) {
@@ -63,8 +101,8 @@ const Type* get_primitive_type(PrimitiveType type) {
 }
 
 static Type string_type = {
-    .size = PTR_SIZE,
-    .alignment = PTR_SIZE,
+    .size = 4,
+    .alignment = 4,
     .type = METADATA_ARRAY,
     .array_size = 0,
     .inner_type = &primitive_tpyes[TYPE_U8],
@@ -73,8 +111,8 @@ static Type string_type = {
 const Type* get_string_type(void) { return &string_type; }
 
 static Type void_ptr_type = {
-    .size = PTR_SIZE,
-    .alignment = PTR_SIZE,
+    .size = 4,
+    .alignment = 4,
     .type = METADATA_POINTER,
     .pointer_level = 1,
     .inner_type = &primitive_tpyes[TYPE_VOID],
@@ -82,55 +120,229 @@ static Type void_ptr_type = {
 
 const Type* get_void_ptr_type(void) { return &void_ptr_type; }
 
-int is_equal_type(const Type* a, const Type* b) {
-    if (a->type != b->type) {
-        return 0;
+void set_target(TargetArch arch) {
+    target_info.arch = arch;
+    switch (arch) {
+        case TARGET_I386:
+            target_info.register_size = 4;
+            target_info.max_alignment = 4;
+            target_info.ptr_size = 4;
+            break;
+        case TARGET_X86_64:
+            target_info.register_size = 8;
+            target_info.max_alignment = 8;
+            target_info.ptr_size = 8;
+            break;
+        default:
+            UNREACHABLE();
     }
 
-    switch (a->type) {
-        case METADATA_PRIMITIVE:
-            return a->primitive_type == b->primitive_type;
+    primitive_tpyes[TYPE_U64].alignment = MAX_ALIGNMENT;
+    primitive_tpyes[TYPE_I64].alignment = MAX_ALIGNMENT;
+    primitive_tpyes[TYPE_F64].alignment = MAX_ALIGNMENT;
+
+    string_type.size = PTR_SIZE;
+    string_type.alignment = PTR_SIZE;
+    void_ptr_type.size = PTR_SIZE;
+    void_ptr_type.alignment = PTR_SIZE;
+}
+
+#define TYPE_TABLE_MIN_SLOTS 256
 
-        case METADATA_TYPE:
-            return a->type_ste == b->type_ste;
+typedef struct TypeTable {
+    UtlArenaAllocator* arena;
+    const Type** slots;
+    int slot_count;  // power of two
+    int count;
+} TypeTable;
 
+static TypeTable type_table;
+
+static unsigned int hash_type(const Type* type) {
+    unsigned int hash = type->type;
+    hash = hash * 31 + (unsigned int)((uintptr_t)type->inner_type >> 3);
+
+    switch (type->type) {
         case METADATA_ARRAY:
-            if (a->array_size != b->array_size) {
-                return 0;
-            }
-            return is_equal_type(a->inner_type, b->inner_type);
+            hash = hash * 31 + type->array_size;
+            break;
 
         case METADATA_POINTER:
-            if (a->pointer_level != b->pointer_level) {
-                return 0;
-            }
-            return is_equal_type(a->inner_type, b->inner_type);
+            hash = hash * 31 + type->pointer_level;
+            break;
 
         case METADATA_FUNC: {
-            if (a->func_data.has_va_args != b->func_data.has_va_args) {
-                return 0;
+            const FuncMetadata* func_data = &type->func_data;
+            hash = hash * 31 +
+                   (unsigned int)((uintptr_t)func_data->return_type >> 3);
+            for (ArgList* arg = func_data->args; arg; arg = arg->next) {
+                hash = hash * 31 + (unsigned int)((uintptr_t)arg->type >> 3);
             }
+            hash = hash * 31 + func_data->callconv;
+            hash = hash * 31 + func_data->has_va_args;
+            hash = hash * 31 + func_data->reg_arg_count;
+            hash = hash * 31 + func_data->attrs;
+            hash = hash * 31 + func_data->alignment;
+        } break;
 
-            if (!is_equal_type(a->func_data.return_type,
-                               b->func_data.return_type)) {
-                return 0;
-            }
+        default:
+            UNREACHABLE();
+    }
 
-            ArgList* a_arg = a->func_data.args;
-            ArgList* b_arg = b->func_data.args;
+    return hash * 2654435761u;
+}
 
-            while (a_arg != NULL && b_arg != NULL) {
-                if (!is_equal_type(a_arg->type, b_arg->type)) {
-                    return 0;
-                }
-                a_arg = a_arg->next;
-                b_arg = b_arg->next;
-            }
+static int is_same_args(const ArgList* a, const ArgList* b) {
+    while (a != NULL && b != NULL) {
+        if (a->type != b->type) {
+            return 0;
+        }
+        a = a->next;
+        b = b->next;
+    }
+    return a == NULL && b == NULL;
+}
 
-            return a_arg == NULL && b_arg == NULL;
+// Components are interned, so they are compared by address
+static int is_same_type(const Type* a, const Type* b) {
+    if (a->type != b->type || a->inner_type != b->inner_type) {
+        return 0;
+    }
+
+    switch (a->type) {
+        case METADATA_ARRAY:
+            return a->array_size == b->array_size;
+
+        case METADATA_POINTER:
+            return a->pointer_level == b->pointer_level;
+
+        case METADATA_FUNC: {
+            const FuncMetadata* a_func = &a->func_data;
+            const FuncMetadata* b_func = &b->func_data;
+            return a_func->return_type == b_func->return_type &&
+                   a_func->callconv == b_func->callconv &&
+                   a_func->has_va_args == b_func->has_va_args &&
+                   a_func->reg_arg_count == b_func->reg_arg_count &&
+                   a_func->attrs == b_func->attrs &&
+                   a_func->alignment == b_func->alignment &&
+                   is_same_args(a_func->args, b_func->args);
         }
 
         default:
             UNREACHABLE();
     }
 }
+
+static void type_table_insert(const Type** slots, int slot_count,
+                              const Type* type) {
+    unsigned int mask = slot_count - 1;
+    unsigned int i = hash_type(type) & mask;
+    while (slots[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = type;
+}
+
+static void type_table_grow(void) {
+    int slot_count = type_table.slot_count * 2;
+    const Type** slots =
+        utlarena_alloc(type_table.arena, slot_count * sizeof(Type*));
+    memset(slots, 0, slot_count * sizeof(Type*));
+
+    for (int i = 0; i < type_table.slot_count; i++) {
+        if (type_table.slots[i] != NULL) {
+            type_table_insert(slots, slot_count, type_table.slots[i]);
+        }
+    }
+
+    type_table.slots = slots;
+    type_table.slot_count = slot_count;
+}
+
+// Return the interned copy of type
+static const Type* intern_type(const Type* type) {
+    unsigned int mask = type_table.slot_count - 1;
+    unsigned int i = hash_type(type) & mask;
+    while (type_table.slots[i] != NULL) {
+        if (is_same_type(type_table.slots[i], type)) {
+            return type_table.slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    Type* new_type = utlarena_alloc(type_table.arena, sizeof(Type));
+    *new_type = *type;
+    type_table.slots[i] = new_type;
+    type_table.count++;
+
+    // Keep the load factor at most 1/2
+    if (2 * type_table.count > type_table.slot_count) {
+        type_table_grow();
+    }
+
+    return new_type;
+}
+
+void type_table_init(UtlArenaAllocator* arena) {
+    type_table.arena = arena;
+    type_table.slot_count = TYPE_TABLE_MIN_SLOTS;
+    type_table.slots =
+        utlarena_alloc(arena, type_table.slot_count * sizeof(Type*));
+    memset(type_table.slots, 0, type_table.slot_count * sizeof(Type*));
+    type_table.count = 0;
+
+    type_table_insert(type_table.slots, type_table.slot_count, &string_type);
+    type_table_insert(type_table.slots, type_table.slot_count,
+                      &void_ptr_type);
+    type_table.count += 2;
+}
+
+const Type* get_pointer_type(const Type* inner_type, int pointer_level) {
+    Type type = {
+        .size = PTR_SIZE,
+        .alignment = PTR_SIZE,
+        .type = METADATA_POINTER,
+        .pointer_level = pointer_level,
+        .inner_type = inner_type,
+    };
+    return intern_type(&type);
+}
+
+const Type* get_array_type(const Type* inner_type, int array_size) {
+    Type type = {
+        .size = PTR_SIZE,
+        .alignment = PTR_SIZE,
+        .type = METADATA_ARRAY,
+        .array_size = array_size,
+        .inner_type = inner_type,
+    };
+    if (array_size != 0) {
+        type.size = inner_type->size * array_size;
+        type.alignment = inner_type->alignment;
+    }
+    return intern_type(&type);
+}
+
+const Type* get_func_type(const FuncMetadata* func_data) {
+    Type type = {
+        .size = PTR_SIZE,
+        .alignment = PTR_SIZE,
+        .type = METADATA_FUNC,
+        .func_data = *func_data,
+    };
+    return intern_type(&type);
+}
+
+int is_equal_type(const Type* a, const Type* b) {
+    if (a == b) {
+        return 1;
+    }
+
+    if (a->type != METADATA_FUNC || b->type != METADATA_FUNC) {
+        return 0;
+    }
+
+    return a->func_data.return_type == b->func_data.return_type &&
+           a->func_data.has_va_args == b->func_data.has_va_args &&
+           is_same_args(a->func_data.args, b->func_data.args);
+}
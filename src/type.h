@@ -1,9 +1,25 @@
 #ifndef TYPE_H
 #define TYPE_H
 
-#define REGISTER_SIZE 4
-#define MAX_ALIGNMENT 4
-#define PTR_SIZE 4
+#include "utl/allocator/utlarena.h"
+
+typedef enum TargetArch {
+    TARGET_I386,
+    TARGET_X86_64,
+} TargetArch;
+
+typedef struct TargetInfo {
+    TargetArch arch;
+    int register_size;
+    int max_alignment;
+    int ptr_size;
+} TargetInfo;
+
+extern TargetInfo target_info;
+
+#define REGISTER_SIZE (target_info.register_size)
+#define MAX_ALIGNMENT (target_info.max_alignment)
+#define PTR_SIZE (target_info.ptr_size)
 
 typedef enum PrimitiveType {
     TYPE_VOID,
@@ -11,9 +27,13 @@ typedef enum PrimitiveType {
     TYPE_U8,
     TYPE_U16,
     TYPE_U32,
+    TYPE_U64,
     TYPE_I8,
     TYPE_I16,
     TYPE_I32,
+    TYPE_I64,
+    TYPE_F32,
+    TYPE_F64,
 } PrimitiveType;
 
 typedef enum TypeMetadataType {
@@ -30,18 +50,33 @@ typedef enum CallConvType {
     CALLCONV_CDECL,
     CALLCONV_STDCALL,
     CALLCONV_THISCALL,
+    CALLCONV_REGPARM,  // internal functions only, see sema
 } CallConvType;
 
+// Registers used by CALLCONV_REGPARM, in argument order
+#define MAX_REG_ARG_COUNT 3
+
 typedef struct ArgList {
     struct ArgList* next;
     const Type* type;
 } ArgList;
 
+typedef enum FuncAttr {
+    FUNC_ATTR_NONE = 0,
+    FUNC_ATTR_INLINE = 1 << 0,    // always inline at direct call sites
+    FUNC_ATTR_NOINLINE = 1 << 1,  // never inline
+    FUNC_ATTR_HOT = 1 << 2,       // placed in .text.hot
+    FUNC_ATTR_COLD = 1 << 3,      // placed in .text.unlikely
+} FuncAttr;
+
 typedef struct FuncMetadata {
     const Type* return_type;
     ArgList* args;
     CallConvType callconv;
     int has_va_args;
+    int reg_arg_count;  // number of leading arguments passed in registers
+    int attrs;      // FuncAttr flags
+    int alignment;  // entry alignment in bytes, 0 for default
 } FuncMetadata;
 
 struct Type {
@@ -66,7 +101,7 @@ struct Type {
 typedef struct TypeInfo {
     int is_lvalue;
     int is_address;
-    Type type;
+    const Type* type;
 } TypeInfo;
 
 static inline int is_ptr(const Type* type) {
@@ -103,7 +138,37 @@ static inline int is_bool(const Type* type) {
 static inline int is_int(const Type* type) {
     return type->type == METADATA_PRIMITIVE &&
            type->primitive_type != TYPE_VOID &&
-           type->primitive_type != TYPE_BOOL;
+           type->primitive_type != TYPE_BOOL &&
+           type->primitive_type != TYPE_F32 &&
+           type->primitive_type != TYPE_F64;
+}
+
+// Floating-point values are kept in XMM0
+static inline int is_float(const Type* type) {
+    return type->type == METADATA_PRIMITIVE &&
+           (type->primitive_type == TYPE_F32 ||
+            type->primitive_type == TYPE_F64);
+}
+
+static inline int is_arithmetic(const Type* type) {
+    return is_int(type) || is_float(type);
+}
+
+// 64-bit integers are kept in EDX:EAX on i386
+static inline int is_int64(const Type* type) {
+    return type->type == METADATA_PRIMITIVE &&
+           (type->primitive_type == TYPE_U64 ||
+            type->primitive_type == TYPE_I64);
+}
+
+// Types that don't fit in registers, they are passed around by address
+static inline int is_large_type(const Type* type) {
+    if (target_info.arch == TARGET_X86_64) {
+        // Structs and fixed-size arrays are always copied through memory
+        return type->type == METADATA_TYPE ||
+               (type->type == METADATA_ARRAY && type->array_size != 0);
+    }
+    return type->size > REGISTER_SIZE && !is_int64(type) && !is_float(type);
 }
 
 static inline int is_signed(PrimitiveType type) {
@@ -111,10 +176,12 @@ static inline int is_signed(PrimitiveType type) {
         case TYPE_U8:
         case TYPE_U16:
         case TYPE_U32:
+        case TYPE_U64:
             return 0;
         case TYPE_I8:
         case TYPE_I16:
         case TYPE_I32:
+        case TYPE_I64:
             return 1;
         default:
             UNREACHABLE();
@@ -124,6 +191,22 @@ static inline int is_signed(PrimitiveType type) {
 // TODO: Int primitive tpye should probably be a struct with is_signed and size.
 static inline PrimitiveType implicit_type_convert(PrimitiveType a,
                                                   PrimitiveType b) {
+    if (a == TYPE_F64 || b == TYPE_F64) {
+        return TYPE_F64;
+    }
+
+    if (a == TYPE_F32 || b == TYPE_F32) {
+        return TYPE_F32;
+    }
+
+    if (a == TYPE_U64 || b == TYPE_U64) {
+        return TYPE_U64;
+    }
+
+    if (a == TYPE_I64 || b == TYPE_I64) {
+        return TYPE_I64;
+    }
+
     switch (a) {
         case TYPE_U8:
             switch (b) {
@@ -202,10 +285,24 @@ static inline PrimitiveType implicit_type_convert(PrimitiveType a,
     }
 }
 
+// Select the target, must be called before parsing
+void set_target(TargetArch arch);
+
+// Types are interned, each distinct type exists once. Struct types live in
+// their symbol table entry.
+void type_table_init(UtlArenaAllocator* arena);
+
 const Type* get_primitive_type(PrimitiveType type);
 const Type* get_string_type(void);
 const Type* get_void_ptr_type(void);
 
+const Type* get_pointer_type(const Type* inner_type, int pointer_level);
+// array_size 0 for the unknown size array
+const Type* get_array_type(const Type* inner_type, int array_size);
+const Type* get_func_type(const FuncMetadata* func_data);
+
+// Function types also carry the calling convention and attributes, only the
+// signatures are compared
 int is_equal_type(const Type* a, const Type* b);
 
 #endif
@@ -6,6 +6,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 void ika_log(LogType level, const char* fmt, ...) {
     switch (level) {
         case LOG_DEBUG:
@@ -67,7 +74,8 @@ UtlAllocator never_fail_allocator = {
     .free = never_fail_free,
 };
 
-char* read_entire_file(UtlAllocator* allocator, const char* path) {
+char* read_entire_file(UtlAllocator* allocator, const char* path,
+                       size_t* size_out) {
     FILE* fp = fopen(path, "rb");
     if (!fp) {
         return NULL;
@@ -98,9 +106,46 @@ char* read_entire_file(UtlAllocator* allocator, const char* path) {
 
     buf[size] = '\0';
 
+    if (size_out) {
+        *size_out = size;
+    }
     return buf;
 }
 
+const char* map_entire_file(UtlAllocator* allocator, const char* path,
+                            size_t* size) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // The zero-filled tail of the last page terminates the contents, so a
+    // file ending on a page boundary has to be read instead
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (S_ISREG(st.st_mode) && st.st_size >= MAP_FILE_MIN_SIZE &&
+        page_size > 0 && st.st_size % page_size != 0) {
+        void* buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (buf != MAP_FAILED) {
+            close(fd);
+            if (size) {
+                *size = st.st_size;
+            }
+            return buf;
+        }
+    }
+    close(fd);
+#endif
+
+    return read_entire_file(allocator, path, size);
+}
+
 Str get_dir_name(Str path) {
     if (path.len == 0) {
         return str(".");
@@ -146,10 +191,22 @@ Str get_dir_name(Str path) {
 }
 
 int file_is_readable(const char* path) {
+#ifndef _WIN32
+    return access(path, R_OK) == 0;
+#else
     FILE* f = fopen(path, "r");
     if (f) {
         fclose(f);
         return 1;
     }
     return 0;
+#endif
+}
+
+char* get_real_path(const char* path) {
+#ifndef _WIN32
+    return realpath(path, NULL);
+#else
+    return _fullpath(NULL, path, 0);
+#endif
 }
@@ -6,10 +6,26 @@
 
 extern UtlAllocator never_fail_allocator;
 
-char* read_entire_file(UtlAllocator* allocator, const char* path);
+// The contents are followed by a '\0'. The size is stored if size isn't NULL.
+char* read_entire_file(UtlAllocator* allocator, const char* path,
+                       size_t* size);
+
+// Files at least this large are mapped instead of read
+#define MAP_FILE_MIN_SIZE (1 << 16)
+
+// Like read_entire_file, but large files are mapped into memory without a
+// copy. The contents are followed by a '\0' and must not be modified. Mapped
+// files stay mapped until the process exits. The size is stored if size isn't
+// NULL.
+const char* map_entire_file(UtlAllocator* allocator, const char* path,
+                            size_t* size);
 
 Str get_dir_name(Str path);
 
 int file_is_readable(const char* path);
 
+// Absolute path of the file with . and .. and symbolic links resolved,
+// allocated with malloc, or NULL if the file can't be resolved
+char* get_real_path(const char* path);
+
 #endif